@@ -9,6 +9,12 @@
 // BigBuf and functions to allocate/free parts of it.
 //-----------------------------------------------------------------------------
 #include "BigBuf.h"
+#include "profile.h"
+#include "trace_compact.h"
+#include "cmd.h"
+#ifdef WITH_FLASH
+#include "flashmem.h"
+#endif
 
 // BigBuf is the large multi-purpose buffer, typically used to hold A/D samples or traces.
 // Also used to hold various smaller buffers and the Mifare Emulator Memory.
@@ -24,15 +30,49 @@ Pointer to highest available memory: BigBuf_hi
 */
 
 // High memory mark
-static uint16_t BigBuf_hi = BIGBUF_SIZE;
+static uint32_t BigBuf_hi = BIGBUF_SIZE;
 
 // pointer to the emulator memory.
 static uint8_t *emulator_memory = NULL;
 
 // trace related variables
-static uint16_t traceLen = 0;
+static uint32_t traceLen = 0;
 int tracing = 1; //Last global one.. todo static?
 
+// compact record encoding (common/trace_compact.h). traceCompact is what the client asked for,
+// it only applies from the next trace on,  a trace is never a mix of both encodings.
+static bool traceCompact = false;
+static bool traceCompactCur = false;
+static uint32_t traceLastTimestamp = 0;
+
+// streaming sniff,  the trace area is a ring of whole classic records drained over USB.
+// traceLen is the write position,  streamTail the first byte not sent yet.  When a record
+// doesn't fit at the end,  the writer wraps to 0 and streamWrap marks the end of the valid data.
+#define TRACE_STREAM_HIGH_WATER		(USB_CMD_DATA_SIZE / 2)	// send as soon as this much is pending
+#define TRACE_STREAM_QUIET			2000					// idle calls before sending less than that
+static bool traceStream = false;
+static bool traceStreamCur = false;
+static uint32_t streamTail = 0;
+static uint32_t streamWrap = 0;
+static uint32_t streamQuiet = 0;
+static trace_stream_stats_t streamStats;
+
+#ifdef WITH_FLASH
+// trace spill to external flash (RDV40).
+// When enabled, a sniffer moves the trace to the flash trace area when BigBuf is about full and
+// reuses BigBuf.  The trace area (FLASH_MEM_TRACE_OFFSET, common.h) is reserved for this.
+// traceSpilled is the number of trace bytes already stored in flash,  traceSegments the number of moves.
+static bool traceSpill = false;
+static uint32_t traceSpilled = 0;
+static uint16_t traceSegments = 0;
+// flash trace area is erased lazily, one 4kb sector at the time.  This is the first non-erased address.
+static uint32_t traceErased = 0;
+// the flash failed,  no more spills for this trace
+static bool traceSpillFailed = false;
+// spill when less than this is left,  room for the records until the next idle gap
+#define TRACE_SPILL_HEADROOM	1024
+#endif
+
 // get the address of BigBuf
 uint8_t *BigBuf_get_addr(void)
 {
@@ -113,18 +153,34 @@ void BigBuf_print_status(void)
 	Dbprintf("Tracing");
 	Dbprintf("  tracing ................%d", tracing);
 	Dbprintf("  traceLen ...............%d", traceLen);
+	Dbprintf("  compact encoding .......%d", traceCompactCur);
+	Dbprintf("  trace stream ...........%d", traceStream);
+#ifdef WITH_FLASH
+	Dbprintf("  trace spill ............%d", traceSpill);
+	Dbprintf("  spilled to flash .......%d", traceSpilled);
+	Dbprintf("  trace segments .........%d", traceSegments);
+#endif
 }
 
 // return the maximum trace length (i.e. the unallocated size of BigBuf)
-uint16_t BigBuf_max_traceLen(void)
+uint32_t BigBuf_max_traceLen(void)
 {
 	return BigBuf_hi;
 }
 
 void clear_trace() {
 	traceLen = 0;
+	traceCompactCur = traceCompact;
+	traceLastTimestamp = 0;
+	traceStreamCur = false;
+#ifdef WITH_FLASH
+	traceSpilled = 0;
+	traceSegments = 0;
+	traceErased = 0;
+	traceSpillFailed = false;
+#endif
 }
-void set_tracelen(uint16_t value) {
+void set_tracelen(uint32_t value) {
     traceLen = value;
 }
 void set_tracing(bool enable) {
@@ -136,14 +192,237 @@ bool get_tracing(void) {
 }
 
 /**
- * Get the number of bytes traced
+ * Get the number of bytes traced, which are still in BigBuf
  * @return
  */
-uint16_t BigBuf_get_traceLen(void)
+uint32_t BigBuf_get_traceLen(void)
 {
 	return traceLen;
 }
 
+/**
+ * Describe the current trace for the client.
+ * The trace consists of the spilled part in flash memory (if any), followed by the part in BigBuf.
+ */
+void BigBuf_get_trace_header(trace_header_t *hdr)
+{
+	hdr->magic = TRACE_HEADER_MAGIC;
+	hdr->version = traceCompactCur ? TRACE_FORMAT_COMPACT : TRACE_FORMAT_VERSION;
+#ifdef WITH_FLASH
+	hdr->segments = traceSegments + 1;
+	hdr->spilled = traceSpilled;
+#else
+	hdr->segments = 1;
+	hdr->spilled = 0;
+#endif
+	hdr->length = hdr->spilled + traceLen;
+}
+
+void set_trace_compact(bool enable) {
+	traceCompact = enable;
+	// nothing recorded yet,  start this trace in the new encoding
+	bool empty = (traceLen == 0);
+#ifdef WITH_FLASH
+	empty = empty && (traceSpilled == 0);
+#endif
+	if (empty) {
+		traceCompactCur = enable;
+		traceLastTimestamp = 0;
+	}
+}
+
+void set_trace_stream(bool enable) {
+	traceStream = enable;
+}
+
+static uint32_t stream_fill(void) {
+	return streamWrap ? streamWrap - streamTail + traceLen : traceLen - streamTail;
+}
+
+// size of the classic record at pos
+static uint32_t stream_record_len(uint8_t *trace, uint32_t pos) {
+	uint16_t len = (trace[pos + 6] | (trace[pos + 7] << 8)) & 0x7FFF;
+	return TRACE_CLASSIC_HEADER + len + trace_parity_len(len);
+}
+
+// append one record to the ring,  false if it doesn't fit.
+// stream_send() ships whole records only,  one that exceeds a packet is never accepted.
+static bool stream_reserve(uint32_t size) {
+	if (size > USB_CMD_DATA_SIZE)
+		return false;
+
+	uint32_t max = BigBuf_max_traceLen();
+	if (streamWrap) {
+		// keep the writer strictly behind the tail,  equal means empty
+		if (traceLen + size >= streamTail)
+			return false;
+	} else if (traceLen + size > max) {
+		if (size >= streamTail)
+			return false;
+		streamWrap = traceLen;
+		traceLen = 0;
+	}
+	return true;
+}
+
+// send the records at the tail,  as many as fit in one packet
+static void stream_send(void) {
+	uint8_t *trace = BigBuf_get_addr();
+
+	if (streamWrap && streamTail == streamWrap) {
+		streamTail = 0;
+		streamWrap = 0;
+	}
+
+	uint32_t end = streamWrap ? streamWrap : traceLen;
+	uint32_t n = 0, records = 0;
+	while (streamTail + n < end) {
+		uint32_t rec = stream_record_len(trace, streamTail + n);
+		if (n + rec > USB_CMD_DATA_SIZE)
+			break;
+		n += rec;
+		records++;
+	}
+	if (n == 0)
+		return;
+
+	cmd_send(CMD_TRACE_STREAM_DATA, n, streamStats.dropped, streamStats.packets, trace + streamTail, n);
+	streamStats.packets++;
+	streamStats.records += records;
+	streamTail += n;
+
+	if (streamWrap && streamTail == streamWrap) {
+		streamTail = 0;
+		streamWrap = 0;
+	}
+	// empty,  start over at the beginning for the longest contiguous space
+	if (!streamWrap && streamTail == traceLen) {
+		streamTail = 0;
+		traceLen = 0;
+	}
+}
+
+// start of a sniff,  after clear_trace().  Only the sniffers drain the ring,  so only they stream.
+void BigBuf_stream_start(void)
+{
+	traceStreamCur = traceStream;
+	if (!traceStreamCur)
+		return;
+
+	// streamed records are always classic,  a dropped record would break the compact delta chain
+	traceCompactCur = false;
+	streamTail = 0;
+	streamWrap = 0;
+	streamQuiet = 0;
+	memset(&streamStats, 0, sizeof(streamStats));
+}
+
+/**
+ * Streaming sniff,  called by the sniffers in the idle gaps between frames.
+ * Sends one packet when at least TRACE_STREAM_HIGH_WATER bytes are pending,  or whatever is
+ * pending after TRACE_STREAM_QUIET calls without a new record.  A packet blocks for well under
+ * a millisecond,  short enough to catch up with the DMA buffer afterwards.
+ */
+void RAMFUNC BigBuf_stream_trace(void)
+{
+	if (!traceStreamCur)
+		return;
+
+	uint32_t fill = stream_fill();
+	if (fill == 0)
+		return;
+	if (fill < TRACE_STREAM_HIGH_WATER && ++streamQuiet < TRACE_STREAM_QUIET)
+		return;
+
+	streamQuiet = 0;
+	stream_send();
+}
+
+// end of a streaming sniff,  send what is left and the statistics
+void BigBuf_stream_end(void)
+{
+	if (!traceStreamCur)
+		return;
+
+	// stop when a packet makes no progress,  rather than spin on a record that can't be sent
+	uint32_t fill;
+	while ((fill = stream_fill()) > 0) {
+		stream_send();
+		if (stream_fill() >= fill)
+			break;
+	}
+
+	streamStats.size = BigBuf_max_traceLen();
+	cmd_send(CMD_TRACE_STREAM_END, 0, 0, 0, &streamStats, sizeof(streamStats));
+
+	// the ring content is gone,  don't offer it for download
+	traceLen = 0;
+	streamTail = 0;
+	streamWrap = 0;
+	traceStreamCur = false;
+}
+
+#ifdef WITH_FLASH
+void set_trace_spill(bool enable) {
+	traceSpill = enable;
+}
+#endif
+
+// time to spill the trace,  and room for it in the flash trace area
+bool BigBuf_spill_due(void)
+{
+#ifdef WITH_FLASH
+	return traceSpill && !traceSpillFailed && tracing && !traceStreamCur
+		&& traceLen + TRACE_SPILL_HEADROOM >= BigBuf_max_traceLen()
+		&& traceSpilled + traceLen <= FLASH_MEM_TRACE_SIZE;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Move all records in BigBuf to the flash trace area, and start over with an empty BigBuf trace.
+ * Called by the sniffers in an idle gap (a record boundary) with their DMA stopped, erasing and
+ * writing the flash takes far longer than the DMA buffer lasts.  Frames meanwhile are lost.
+ * @return false if the flash trace area is full or not available
+ */
+bool BigBuf_spill_trace(void)
+{
+#ifdef WITH_FLASH
+	if (traceLen == 0 || traceSpilled + traceLen > FLASH_MEM_TRACE_SIZE)
+		return false;
+
+	uint8_t *trace = BigBuf_get_addr();
+	uint32_t addr = FLASH_MEM_TRACE_OFFSET + traceSpilled;
+	uint32_t end = addr + traceLen;
+
+	if (traceErased < FLASH_MEM_TRACE_OFFSET)
+		traceErased = FLASH_MEM_TRACE_OFFSET;
+
+	// erase the sectors we are about to write
+	while (traceErased < end) {
+		if (!Flash_WipeMemorySector(traceErased)) {
+			traceSpillFailed = true;
+			return false;
+		}
+		traceErased += FLASH_MEM_SECTOR_SIZE;
+	}
+
+	// Flash_WriteData splits it into pages
+	if (Flash_WriteData(addr, trace, traceLen) != traceLen) {
+		traceSpillFailed = true;
+		return false;
+	}
+
+	traceSpilled += traceLen;
+	traceSegments++;
+	traceLen = 0;
+	return true;
+#else
+	return false;
+#endif
+}
+
 /**
   This is a function to store traces. All protocols can use this generic tracer-function.
   The traces produced by calling this function can be fetched on the client-side
@@ -154,16 +433,33 @@ bool RAMFUNC LogTrace(const uint8_t *btBytes, uint16_t iLen, uint32_t timestamp_
 {
 	if (!tracing) return false;
 
+	PROF_ENTER();
 	uint8_t *trace = BigBuf_get_addr();
 
 	uint16_t num_paritybytes = (iLen-1)/8 + 1;	// number of valid paritybytes in *parity
 	uint16_t duration = timestamp_end - timestamp_start;
-
-	// Return when trace is full
-	if (traceLen + sizeof(iLen) + sizeof(timestamp_start) + sizeof(duration) + num_paritybytes + iLen >= BigBuf_max_traceLen()) {
+	uint32_t header = traceCompactCur ? TRACE_COMPACT_MAX_HEADER : sizeof(iLen) + sizeof(timestamp_start) + sizeof(duration);
+
+	if (traceStreamCur) {
+		// a full ring drops the record,  the sniff goes on
+		streamQuiet = 0;
+		if (!stream_reserve(header + iLen + num_paritybytes)) {
+			streamStats.dropped++;
+			PROF_LEAVE(PROF_FN_LOGTRACE);
+			return true;
+		}
+	} else if (traceLen + header + num_paritybytes + iLen >= BigBuf_max_traceLen()) {
+		// full,  a sniffer with trace spill moves it to flash before it gets here
 		tracing = false;	// don't trace any more
+		PROF_LEAVE(PROF_FN_LOGTRACE);
 		return false;
 	}
+	if (traceCompactCur) {
+		traceLen += trace_compact_encode(trace + traceLen, &traceLastTimestamp, btBytes, iLen, timestamp_start, duration, parity, !readerToTag);
+		PROF_LEAVE(PROF_FN_LOGTRACE);
+		return true;
+	}
+
 	// Traceformat:
 	// 32 bits timestamp (little endian)
 	// 16 bits duration (little endian)
@@ -206,6 +502,10 @@ bool RAMFUNC LogTrace(const uint8_t *btBytes, uint16_t iLen, uint32_t timestamp_
 	}
 	traceLen += num_paritybytes;
 
+	if (traceStreamCur && stream_fill() > streamStats.peak)
+		streamStats.peak = stream_fill();
+
+	PROF_LEAVE(PROF_FN_LOGTRACE);
 	return true;
 }
 
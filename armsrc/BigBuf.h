@@ -27,7 +27,7 @@
 
 extern uint8_t *BigBuf_get_addr(void);
 extern uint8_t *BigBuf_get_EM_addr(void);
-extern uint16_t BigBuf_max_traceLen(void);
+extern uint32_t BigBuf_max_traceLen(void);
 extern void BigBuf_Clear(void);
 extern void BigBuf_Clear_ext(bool verbose);
 extern void BigBuf_Clear_keep_EM(void);
@@ -36,10 +36,21 @@ extern uint8_t *BigBuf_malloc(uint16_t);
 extern void BigBuf_free(void);
 extern void BigBuf_free_keep_EM(void);
 extern void BigBuf_print_status(void);
-extern uint16_t BigBuf_get_traceLen(void);
+extern uint32_t BigBuf_get_traceLen(void);
+extern void BigBuf_get_trace_header(trace_header_t *hdr);
 extern void clear_trace(void);
 extern void set_tracing(bool enable);
-extern void set_tracelen(uint16_t value);
+extern void set_tracelen(uint32_t value);
+#ifdef WITH_FLASH
+extern void set_trace_spill(bool enable);
+#endif
+extern bool BigBuf_spill_due(void);
+extern bool BigBuf_spill_trace(void);
+extern void set_trace_compact(bool enable);
+extern void set_trace_stream(bool enable);
+extern void BigBuf_stream_start(void);
+extern void RAMFUNC BigBuf_stream_trace(void);
+extern void BigBuf_stream_end(void);
 extern bool get_tracing(void);
 extern bool RAMFUNC LogTrace(const uint8_t *btBytes, uint16_t iLen, uint32_t timestamp_start, uint32_t timestamp_end, uint8_t *parity, bool readerToTag);
 extern int LogTraceHitag(const uint8_t * btBytes, int iBits, int iSamples, uint32_t dwParity, int bReader);
@@ -23,6 +23,7 @@
 #include "lfsampling.h"
 #include "BigBuf.h"
 #include "mifareutil.h"
+#include "profile.h"
 
 #define DEBUG 1
 
@@ -389,6 +390,7 @@ void SendStatus(void) {
 	printConfig(); //LF Sampling config
 #endif	
 	printUSBSpeed();
+	Profile_print_status();
 	Dbprintf("Various");
 	Dbprintf("  MF_DBGLEVEL.............%d", MF_DBGLEVEL);
 	Dbprintf("  ToSendMax...............%d", ToSendMax);
@@ -621,6 +623,12 @@ void UsbPacketReceived(uint8_t *packet, int len) {
 		case CMD_SET_LF_SAMPLING_CONFIG:
 			setSamplingConfig((sample_config *) c->d.asBytes);
 			break;
+		case CMD_LF_STREAM:
+			// arg0 = 1 start streaming, arg1 = field on, arg2 = samples to keep (0 = until stopped).
+			// arg0 = 0 stops a stream,  any command does,  nothing to do here
+			if (c->arg[0])
+				StreamLF(c->arg[1], c->arg[2]);
+			break;
 		case CMD_ACQUIRE_RAW_ADC_SAMPLES_125K: {
 			uint32_t bits = SampleLF(c->arg[0], c->arg[1]);
 			cmd_send(CMD_ACK, bits, 0, 0, 0, 0);
@@ -668,6 +676,11 @@ void UsbPacketReceived(uint8_t *packet, int len) {
 			CmdEM410xdemod(c->arg[0], &high, &low, 1);
 			break;
 		}
+		case CMD_LF_WATCH:
+			// arg0 = 0 only stops a running watch
+			if (c->arg[0])
+				LFWatch(c->arg[0], c->arg[1], c->arg[2], 1);
+			break;
 		case CMD_EM410X_WRITE_TAG:
 			WriteEM410x(c->arg[0], c->arg[1], c->arg[2]);
 			break;
@@ -1160,6 +1173,39 @@ void UsbPacketReceived(uint8_t *packet, int len) {
 			LED_B_OFF();
 			break;
 		}
+		case CMD_TRACE_INFO: {
+			// tell the client where to find the trace,  and how big it is
+			trace_header_t hdr;
+			BigBuf_get_trace_header(&hdr);
+			cmd_send(CMD_ACK, 1, hdr.length, hdr.spilled, &hdr, sizeof(trace_header_t));
+			break;
+		}
+#ifdef WITH_FLASH
+		case CMD_TRACE_SPILL:
+			// arg0 = 1 enable, 0 disable moving full trace buffers to flash memory
+			set_trace_spill(c->arg[0]);
+			cmd_send(CMD_ACK, 1, 0, 0, 0, 0);
+			break;
+#endif
+		case CMD_TRACE_COMPACT:
+			// arg0 = 1 enable, 0 disable the compact trace encoding,  from the next trace on
+			set_trace_compact(c->arg[0]);
+			cmd_send(CMD_ACK, 1, 0, 0, 0, 0);
+			break;
+		case CMD_TRACE_STREAM:
+			// arg0 = 1 enable, 0 disable streaming the trace to the client while sniffing,  from the next trace on
+			set_trace_stream(c->arg[0]);
+			cmd_send(CMD_ACK, 1, 0, 0, 0, 0);
+			break;
+		case CMD_PROFILE:
+			// arg0 = 0 send the table, from entry arg1 on,  1 clear it
+			if (c->arg[0] == 1) {
+				Profile_reset();
+				cmd_send(CMD_ACK, 1, 0, 0, 0, 0);
+			} else {
+				Profile_send(c->arg[1]);
+			}
+			break;
 		case CMD_READ_MEM:
 			ReadMem(c->arg[0]);
 			break;
@@ -1201,36 +1247,9 @@ void UsbPacketReceived(uint8_t *packet, int len) {
 			uint16_t len = c->arg[1];
 			uint8_t* data = c->d.asBytes;
 			
-			uint32_t tmp = startidx + len;
-			
-			// inside 256b page?
-			if ( (tmp & 0xFF) != 0) {				
-				
-					// is offset+len larger than a page
-					tmp =  (startidx & 0xFF ) + len;
-					if (tmp > 0xFF ) {
-					
-						// data spread over two pages.
-						
-						// offset xxxx10,   
-						uint8_t first_len =  (~startidx & 0xFF)+1;
-												
-						// first mem page						
-						res = Flash_WriteData(startidx, data, first_len);
-						
-						// second mem page
-						res = Flash_WriteData(startidx + first_len, data + first_len, len - first_len);
-						
-						isok = (res == (len - first_len)) ? 1 : 0;
-						
-					} else {
-						res = Flash_WriteData(startidx, data, len);
-						isok = (res == len) ? 1 : 0;
-					}					
-			} else {				
-				res = Flash_WriteData(startidx, data, len);
-				isok = (res == len) ? 1 : 0;
-			}
+			// split into pages and verified by Flash_WriteData
+			res = Flash_WriteData(startidx, data, len);
+			isok = (res == len) ? 1 : 0;
 
 			cmd_send(CMD_ACK, isok, 0, 0, 0, 0);
 			LED_B_OFF();
@@ -1292,7 +1311,10 @@ void UsbPacketReceived(uint8_t *packet, int len) {
 				Flash_UniqueID( info->flashid);
 				FlashStop();
 			}
-			cmd_send(CMD_ACK, isok, 0, 0, info, sizeof(rdv40_validation_t));
+
+			// throughput,  a timed read now and the page writes so far
+			uint32_t rd_speed = Flash_ReadSpeed();
+			cmd_send(CMD_ACK, isok, rd_speed, Flash_WriteSpeed(), info, sizeof(rdv40_validation_t));
 			BigBuf_free();
 			
 			LED_B_OFF();			
@@ -1335,6 +1357,7 @@ void UsbPacketReceived(uint8_t *packet, int len) {
 		case CMD_SETUP_WRITE:
 		case CMD_FINISH_WRITE:
 		case CMD_HARDWARE_RESET:
+			usb_flush();
 			usb_disable();
 
 			// (iceman) why this wait?
@@ -1348,6 +1371,7 @@ void UsbPacketReceived(uint8_t *packet, int len) {
 			if(common_area.flags.bootrom_present) {
 				common_area.command = COMMON_AREA_COMMAND_ENTER_FLASH_MODE;
 			}
+			usb_flush();
 			usb_disable();
 			AT91C_BASE_RSTC->RSTC_RCR = RST_CONTROL_KEY | AT91C_RSTC_PROCRST;
 			// We're going to flash, and the bootrom will take control.
@@ -1355,7 +1379,7 @@ void UsbPacketReceived(uint8_t *packet, int len) {
 			break;
 
 		case CMD_DEVICE_INFO: {
-			uint32_t dev_info = DEVICE_INFO_FLAG_OSIMAGE_PRESENT | DEVICE_INFO_FLAG_CURRENT_MODE_OS;
+			uint32_t dev_info = DEVICE_INFO_FLAG_OSIMAGE_PRESENT | DEVICE_INFO_FLAG_CURRENT_MODE_OS | DEVICE_INFO_FLAG_TRACE_INFO;
 			if (common_area.flags.bootrom_present) {
 				dev_info |= DEVICE_INFO_FLAG_BOOTROM_PRESENT;
 			}
@@ -1408,6 +1432,7 @@ void  __attribute__((noreturn)) AppMain(void) {
 	FpgaDownloadAndGo(FPGA_BITSTREAM_HF);
 	
 	StartTickCount();
+	Profile_init();
   	
 #ifdef WITH_LCD
 	LCDInit();
@@ -1436,7 +1461,13 @@ void  __attribute__((noreturn)) AppMain(void) {
 		
 		// Check if there is a usb packet available
 		if ( cmd_receive( (UsbCommand*)rx ) ) {
+#ifdef WITH_PROFILE
+			uint32_t start = prof_ticks();
 			UsbPacketReceived(rx, sizeof(UsbCommand) );
+			Profile_command(((UsbCommand*)rx)->cmd, start);
+#else
+			UsbPacketReceived(rx, sizeof(UsbCommand) );
+#endif
 		}
 		
 		// Press button for one second to enter a possible standalone mode
@@ -1,4 +1,5 @@
 #include "flashmem.h"
+#include "string.h"
 
 /* here: use NCPS2 @ PA10: */
 #define SPI_CSR_NUM      2          		// Chip Select register[] 0,1,2,3  (at91samv512 has 4)
@@ -25,6 +26,11 @@
 #endif
 
 
+// one page read back for verification
+static uint8_t flash_page[PAGESIZE];
+
+flash_stats_t flash_stats = {0, 0, 0, 0};
+
 /*
 	ȡָԴһλÿʼĶܽоƬȡ
 	ҳдָÿдΪ1-256ֽڣǲܿԽ256ֽڱ߽
@@ -129,6 +135,45 @@ uint16_t FlashSendLastByte(uint32_t data) {
 	return FlashSendByte(data | AT91C_SPI_LASTXFER);
 }
 
+//	clock len bytes through SPI with the PDC instead of one by one.  Chip select stays
+//	active,  the caller ends the command with FlashSendLastByte().  With rx NULL only
+//	the transmit side runs and the received bytes are dropped.
+static void FlashSendBulk(const uint8_t *tx, uint8_t *rx, uint16_t len) {
+	if (!len) return;
+
+	while ((AT91C_BASE_SPI->SPI_SR & AT91C_SPI_TXEMPTY) == 0) {};
+	if (AT91C_BASE_SPI->SPI_RDR == 0) {};
+
+	AT91C_BASE_PDC_SPI->PDC_PTCR = AT91C_PDC_RXTDIS | AT91C_PDC_TXTDIS;
+	AT91C_BASE_PDC_SPI->PDC_RNCR = 0;
+	AT91C_BASE_PDC_SPI->PDC_TNCR = 0;
+	if (rx) {
+		AT91C_BASE_PDC_SPI->PDC_RPR = (uint32_t)rx;
+		AT91C_BASE_PDC_SPI->PDC_RCR = len;
+	}
+	AT91C_BASE_PDC_SPI->PDC_TPR = (uint32_t)tx;
+	AT91C_BASE_PDC_SPI->PDC_TCR = len;
+	AT91C_BASE_PDC_SPI->PDC_PTCR = (rx ? AT91C_PDC_RXTEN : 0) | AT91C_PDC_TXTEN;
+
+	if (rx) {
+		while ((AT91C_BASE_SPI->SPI_SR & AT91C_SPI_ENDRX) == 0)
+			WDT_HIT();
+	} else {
+		while ((AT91C_BASE_SPI->SPI_SR & AT91C_SPI_ENDTX) == 0)
+			WDT_HIT();
+		while ((AT91C_BASE_SPI->SPI_SR & AT91C_SPI_TXEMPTY) == 0) {};
+		// drop the last byte received and the overrun flag,  FlashSendByte() waits for RDRF
+		if (AT91C_BASE_SPI->SPI_RDR == 0) {};
+		if (AT91C_BASE_SPI->SPI_SR == 0) {};
+	}
+	AT91C_BASE_PDC_SPI->PDC_PTCR = AT91C_PDC_RXTDIS | AT91C_PDC_TXTDIS;
+}
+
+// bytes/s from a byte count and GetTicks() ticks
+static uint32_t flash_rate(uint32_t bytes, uint32_t ticks) {
+	return ticks ? (uint32_t)((uint64_t)bytes * FLASH_TICKS_PER_SEC / ticks) : 0;
+}
+
 //	read state register 1
 uint8_t Flash_ReadStat1(void) {
 	FlashSendByte(READSTAT1);
@@ -163,6 +208,18 @@ bool Flash_CheckBusy(uint16_t times) {
 	return ret;
 }
 
+// wait for the running erase or program to finish.  Polls the status register without
+// the SpinDelay(1) of Flash_CheckBusy(),  a page program takes less than a millisecond.
+bool Flash_WaitIdle(void) {
+	uint32_t start = GetTicks();
+	while (Flash_ReadStat1() & BUSY) {
+		WDT_HIT();
+		if (GetTicks() - start > FLASH_BUSY_TIMEOUT)
+			return false;
+	}
+	return true;
+}
+
 // read ID out
 uint8_t Flash_ReadID(void) {
 
@@ -216,37 +273,47 @@ uint16_t Flash_ReadData(uint32_t address, uint8_t *out, uint16_t len) {
 	// length should never be zero
 	if (!len || Flash_CheckBusy(100)) return 0;
 
+	uint32_t start = GetTicks();
+
 	FlashSendByte(READDATA);
 	FlashSendByte((address >> 16) & 0xFF);
 	FlashSendByte((address >> 8) & 0xFF);
 	FlashSendByte((address >> 0) & 0xFF);
 
-	uint16_t i = 0;
-	for (; i < (len - 1); i++)
-		out[i] = FlashSendByte(0xFF);
+	// the chip ignores its input while it shifts data out,  so out is clocked out as is
+	FlashSendBulk(out, out, len - 1);
+	out[len - 1] = FlashSendLastByte(0xFF);
+
+	flash_stats.read_bytes += len;
+	flash_stats.read_ticks += GetTicks() - start;
 
-	out[i] = FlashSendLastByte(0xFF);
-	
 	FlashStop();	
 	return len;	
 }
 
-// Write data can only program one page. A page has 256 bytes. 
-// if len > 256, it might wrap around and overwrite pos 0.
+// read back len bytes of a page into flash_page,  chip select already set up
+static void Flash_ReadPage(uint32_t address, uint16_t len) {
+	FlashSendByte(READDATA);
+	FlashSendByte((address >> 16) & 0xFF);
+	FlashSendByte((address >> 8) & 0xFF);
+	FlashSendByte((address >> 0) & 0xFF);
+	FlashSendBulk(flash_page, flash_page, len - 1);
+	flash_page[len - 1] = FlashSendLastByte(0xFF);
+}
+
+// Writes len bytes at address,  the pages must be erased.  A page program can't cross a
+// 256 byte page,  so the data is split up here.  The chip only runs one operation at a time,
+// the pipelining is around it:  each page is read back as soon as it is programmed and
+// compared while the chip programs the next one.
+// Returns the number of bytes written and verified,  less than len if a page didn't read back.
 uint16_t Flash_WriteData(uint32_t address, uint8_t *in, uint16_t len) {
 
 	// length should never be zero
 	if (!len)
 		return 0;
 	
-	//	Max 256 bytes write
-	if (((address & 0xFF) + len) > 256) {
-		Dbprintf("Flash_WriteData 256 fail [ 0x%02x ] [ %u ]", (address & 0xFF)+len, len );
-		return 0;
-	}
-	
 	// out-of-range
-	if ( (( address >> 16 ) & 0xFF ) > MAX_BLOCKS) {
+	if ( ((address + len - 1) >> 16) >= MAX_BLOCKS) {
 		Dbprintf("Flash_WriteData,  block out-of-range");
 		return 0;
 	}
@@ -256,23 +323,53 @@ uint16_t Flash_WriteData(uint32_t address, uint8_t *in, uint16_t len) {
 		return 0;
 	}
 	
-	Flash_ReadStat1();
+	uint32_t start = GetTicks();
+	uint16_t done = 0, verified = 0, prev_len = 0;
+	uint8_t *prev = NULL;
+	bool ok = true;
+
+	while (done < len && ok) {
+		uint32_t addr = address + done;
+		uint16_t n = MIN(PAGESIZE - (addr & (PAGESIZE - 1)), len - done);
+
+		// previous page done programming?  read it back
+		if (!Flash_WaitIdle()) break;
+		if (prev_len)
+			Flash_ReadPage(addr - prev_len, prev_len);
+
+		Flash_WriteEnable();
+		FlashSendByte(PAGEPROG);
+		FlashSendByte((addr >> 16) & 0xFF);
+		FlashSendByte((addr >> 8) & 0xFF);
+		FlashSendByte((addr >> 0) & 0xFF);
+		FlashSendBulk(in + done, NULL, n - 1);
+		FlashSendLastByte(in[done + n - 1]);
+
+		// while this page programs
+		if (prev_len) {
+			ok = (memcmp(flash_page, prev, prev_len) == 0);
+			if (ok) verified += prev_len;
+		}
+		prev = in + done;
+		prev_len = n;
+		done += n;
+	}
 
-	Flash_WriteEnable();
-	
-	FlashSendByte(PAGEPROG);
-	FlashSendByte((address >> 16) & 0xFF);
-	FlashSendByte((address >> 8) & 0xFF);
-	FlashSendByte((address >> 0) & 0xFF);
+	// the last page
+	if (ok && prev_len && Flash_WaitIdle()) {
+		Flash_ReadPage(address + done - prev_len, prev_len);
+		if (memcmp(flash_page, prev, prev_len) == 0)
+			verified += prev_len;
+	}
 
-	uint16_t i = 0;
-	for (; i < (len - 1); i++)
-		FlashSendByte(in[i]);
+	if (verified != len)
+		Dbprintf("Flash_WriteData verify failed at 0x%06x", address + verified);
 
-	FlashSendLastByte(in[i]);
+	flash_stats.write_bytes += verified;
+	flash_stats.write_ticks += GetTicks() - start;
 
 	FlashStop();
-	return len;	
+	return verified;	
 }
 
 bool Flash_WipeMemoryPage(uint8_t page) {
@@ -288,6 +385,20 @@ bool Flash_WipeMemoryPage(uint8_t page) {
 	FlashStop();
 	return true;	
 }
+// Wipes the 4kb sector which contains address, fills with 0xFF
+bool Flash_WipeMemorySector(uint32_t address) {
+	if (!FlashInit()) {
+		if ( MF_DBGLEVEL > 3 ) Dbprintf("Flash_WipeMemorySector init fail");
+		return false;
+	}
+	Flash_ReadStat1();
+
+	// one sector erase takes up to 400ms
+	Flash_WriteEnable(); Flash_Erase4k((address >> 16) & 0xFF, (address >> 12) & 0x0F); Flash_CheckBusy(400);
+
+	FlashStop();
+	return true;
+}
 // Wipes flash memory completely, fills with 0xFF
 bool Flash_WipeMemory() {
 	if (!FlashInit()) {
@@ -381,6 +492,23 @@ bool FlashInit(void) {
 	return true;
 }
 
+// bytes/s of a timed read of FLASH_SPEED_TEST_LEN bytes,  run now.
+// Reads in packet sized chunks through a stack buffer,  BigBuf may hold a trace.
+uint32_t Flash_ReadSpeed(void) {
+	uint8_t buf[USB_CMD_DATA_SIZE];
+	uint32_t before = flash_stats.read_ticks;
+	for (uint32_t i = 0; i < FLASH_SPEED_TEST_LEN; i += sizeof(buf)) {
+		if (Flash_ReadData(i, buf, sizeof(buf)) != sizeof(buf))
+			return 0;
+	}
+	return flash_rate(FLASH_SPEED_TEST_LEN, flash_stats.read_ticks - before);
+}
+
+// bytes/s of all page writes since power on,  0 if nothing was written
+uint32_t Flash_WriteSpeed(void) {
+	return flash_rate(flash_stats.write_bytes, flash_stats.write_ticks);
+}
+
 void Flashmem_print_status(void) {
 	DbpString("Flash memory");
 
@@ -412,6 +540,10 @@ void Flashmem_print_status(void) {
 			uid[7], uid[6], uid[5], uid[4], 
 			uid[3], uid[2], uid[1], uid[0]
 	);
+	if (flash_stats.read_bytes)
+		Dbprintf("  Read....................%d kb, %d kb/s", flash_stats.read_bytes >> 10, flash_rate(flash_stats.read_bytes, flash_stats.read_ticks) >> 10);
+	if (flash_stats.write_bytes)
+		Dbprintf("  Written.................%d kb, %d kb/s", flash_stats.write_bytes >> 10, Flash_WriteSpeed() >> 10);
 	
 	FlashStop();
 }
\ No newline at end of file
@@ -110,6 +110,24 @@
 #define MAX_BLOCKS		4
 #define MAX_SECTORS		16
 
+// GetTicks() runs at MCK/32 while the flash is in use (FlashInit)
+#define FLASH_TICKS_PER_SEC		1500000
+// longest erase,  a 64kb block takes up to 2s
+#define FLASH_BUSY_TIMEOUT		(3 * FLASH_TICKS_PER_SEC)
+
+// bytes moved by Flash_ReadData / Flash_WriteData since power on and the time it took,
+// for the throughput in 'hw status' and 'flashmem info'
+typedef struct {
+	uint32_t read_bytes;
+	uint32_t read_ticks;
+	uint32_t write_bytes;
+	uint32_t write_ticks;
+} flash_stats_t;
+extern flash_stats_t flash_stats;
+
+// size of the timed read for 'flashmem info'
+#define FLASH_SPEED_TEST_LEN	8192
+
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~//
 extern void Dbprintf(const char *fmt, ...);
@@ -124,6 +142,7 @@ uint16_t FlashSendByte(uint32_t data);
 void Flash_WriteEnable();
 bool Flash_WipeMemoryPage(uint8_t page);
 bool Flash_WipeMemory();
+bool Flash_WipeMemorySector(uint32_t address);
 bool Flash_Erase4k(uint8_t block, uint8_t sector);
 //bool Flash_Erase32k(uint32_t address);
 bool Flash_Erase64k(uint8_t block);
@@ -134,6 +153,8 @@ void Flash_UniqueID(uint8_t *uid);
 uint8_t Flash_ReadID(void);
 uint16_t Flash_ReadData(uint32_t address, uint8_t *out, uint16_t len);
 uint16_t Flash_WriteData(uint32_t address, uint8_t *in, uint16_t len);
+uint32_t Flash_ReadSpeed(void);
+uint32_t Flash_WriteSpeed(void);
 void Flashmem_print_status(void);
 
 #endif
\ No newline at end of file
@@ -19,7 +19,6 @@ static int downloaded_bitstream = 0;
 extern uint8_t _binary_obj_fpga_all_bit_z_start, _binary_obj_fpga_all_bit_z_end;
 
 static uint8_t *fpga_image_ptr = NULL;
-static uint32_t uncompressed_bytes_cnt;
 
 #define OUTPUT_BUFFER_LEN 		80
 
@@ -177,37 +176,22 @@ bool FpgaSetupSscDma(uint8_t *buf, int len) {
 // Uncompress (inflate) the FPGA data. Returns one decompressed byte with
 // each call.
 //----------------------------------------------------------------------------
-static int get_from_fpga_combined_stream(z_streamp compressed_fpga_stream, uint8_t *output_buffer) {
+static int get_from_fpga_stream(z_streamp compressed_fpga_stream, uint8_t *output_buffer) {
 	if (fpga_image_ptr == compressed_fpga_stream->next_out) {	// need more data
 		compressed_fpga_stream->next_out = output_buffer;
 		compressed_fpga_stream->avail_out = OUTPUT_BUFFER_LEN;
 		fpga_image_ptr = output_buffer;
 		int res = inflate(compressed_fpga_stream, Z_SYNC_FLUSH);
 
-		if (res != Z_OK)
+		if (res != Z_OK && res != Z_STREAM_END)
 			Dbprintf("inflate returned: %d, %s", res, compressed_fpga_stream->msg);
 
 		if (res < 0)
 			return res;
 	}
-	uncompressed_bytes_cnt++;
 	return *fpga_image_ptr++;
 }
 
-//----------------------------------------------------------------------------
-// Undo the interleaving of several FPGA config files. FPGA config files
-// are combined into one big file:
-// 288 bytes from FPGA file 1, followed by 288 bytes from FGPA file 2, etc.
-//----------------------------------------------------------------------------
-static int get_from_fpga_stream(int bitstream_version, z_streamp compressed_fpga_stream, uint8_t *output_buffer) {
-	while((uncompressed_bytes_cnt / FPGA_INTERLEAVE_SIZE) % fpga_bitstream_num != (bitstream_version - 1)) {
-		// skip undesired data belonging to other bitstream_versions
-		get_from_fpga_combined_stream(compressed_fpga_stream, output_buffer);
-	}
-
-	return get_from_fpga_combined_stream(compressed_fpga_stream, output_buffer);
-}
-
 static voidpf fpga_inflate_malloc(voidpf opaque, uInt items, uInt size) {
 	return BigBuf_malloc(items*size);
 }
@@ -217,34 +201,49 @@ static void fpga_inflate_free(voidpf opaque, voidpf address) {
 	BigBuf_free(); BigBuf_Clear_ext(false);
 }
 
+// the container is byte aligned only, see fpga.h
+static uint32_t fpga_container_le32(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
 //----------------------------------------------------------------------------
-// Initialize decompression of the respective (HF or LF) FPGA stream
+// Initialize decompression of the respective (HF or LF) FPGA stream.
+// The container directory gives us the position of its own deflate stream
+// and the length of the configuration data, nothing else is inflated.
 //----------------------------------------------------------------------------
-static bool reset_fpga_stream(int bitstream_version, z_streamp compressed_fpga_stream, uint8_t *output_buffer) {
-	uint8_t header[FPGA_BITSTREAM_FIXED_HEADER_SIZE];
+static bool reset_fpga_stream(int bitstream_version, z_streamp compressed_fpga_stream, uint8_t *output_buffer, uint32_t *bitstream_length) {
+	const uint8_t *container = &_binary_obj_fpga_all_bit_z_start;
+	uint32_t container_len = &_binary_obj_fpga_all_bit_z_end - &_binary_obj_fpga_all_bit_z_start;
+
+	if (container_len < FPGA_CONTAINER_HEADER_SIZE
+		|| fpga_container_le32(container) != FPGA_CONTAINER_MAGIC
+		|| bitstream_version < 1
+		|| (uint32_t)bitstream_version > fpga_container_le32(container + 4)) {
+		Dbprintf("Invalid FPGA image container");
+		return false;
+	}
+
+	const uint8_t *entry = container + FPGA_CONTAINER_HEADER_SIZE + (bitstream_version - 1) * FPGA_CONTAINER_ENTRY_SIZE;
+	uint32_t offset = fpga_container_le32(entry);
+	uint32_t len = fpga_container_le32(entry + 4);
+	if (offset + len > container_len)
+		return false;
 
-	uncompressed_bytes_cnt = 0;
+	*bitstream_length = fpga_container_le32(entry + 8);
 
 	// initialize z_stream structure for inflate:
-	compressed_fpga_stream->next_in = &_binary_obj_fpga_all_bit_z_start;
-	compressed_fpga_stream->avail_in = &_binary_obj_fpga_all_bit_z_end - &_binary_obj_fpga_all_bit_z_start;
+	compressed_fpga_stream->next_in = (uint8_t *)container + offset;
+	compressed_fpga_stream->avail_in = len;
 	compressed_fpga_stream->next_out = output_buffer;
 	compressed_fpga_stream->avail_out = OUTPUT_BUFFER_LEN;
 	compressed_fpga_stream->zalloc = &fpga_inflate_malloc;
 	compressed_fpga_stream->zfree = &fpga_inflate_free;
 
-	inflateInit2(compressed_fpga_stream, 0);
+	if (inflateInit2(compressed_fpga_stream, 0) != Z_OK)
+		return false;
 
 	fpga_image_ptr = output_buffer;
-
-	for (uint16_t i = 0; i < FPGA_BITSTREAM_FIXED_HEADER_SIZE; i++)
-		header[i] = get_from_fpga_stream(bitstream_version, compressed_fpga_stream, output_buffer);
-
-	// Check for a valid .bit file (starts with bitparse_fixed_header)
-	if (memcmp(bitparse_fixed_header, header, FPGA_BITSTREAM_FIXED_HEADER_SIZE) == 0)
-		return true;
-
-	return false;
+	return true;
 }
 
 static void DownloadFPGA_byte(unsigned char w) {
@@ -260,7 +259,7 @@ static void DownloadFPGA_byte(unsigned char w) {
 }
 
 // Download the fpga image starting at current stream position with length FpgaImageLen bytes
-static void DownloadFPGA(int bitstream_version, int FpgaImageLen, z_streamp compressed_fpga_stream, uint8_t *output_buffer) {
+static void DownloadFPGA(int FpgaImageLen, z_streamp compressed_fpga_stream, uint8_t *output_buffer) {
 	int i = 0;
 
 	AT91C_BASE_PIOA->PIO_OER = GPIO_FPGA_ON;
@@ -313,7 +312,7 @@ static void DownloadFPGA(int bitstream_version, int FpgaImageLen, z_streamp comp
 	}
 
 	for (i = 0; i < FpgaImageLen; i++) {
-		int b = get_from_fpga_stream(bitstream_version, compressed_fpga_stream, output_buffer);
+		int b = get_from_fpga_stream(compressed_fpga_stream, output_buffer);
 		if (b < 0) {
 			Dbprintf("Error %d during FpgaDownload", b);
 			break;
@@ -336,57 +335,6 @@ static void DownloadFPGA(int bitstream_version, int FpgaImageLen, z_streamp comp
 	LED_D_OFF();
 }
 
-/* Simple Xilinx .bit parser. The file starts with the fixed opaque byte sequence
- * 00 09 0f f0 0f f0 0f f0 0f f0 00 00 01
- * After that the format is 1 byte section type (ASCII character), 2 byte length
- * (big endian), <length> bytes content. Except for section 'e' which has 4 bytes
- * length.
- */
-static int bitparse_find_section(int bitstream_version, char section_name, uint32_t *section_length, z_streamp compressed_fpga_stream, uint8_t *output_buffer) {
-	int result = 0;
-	#define MAX_FPGA_BIT_STREAM_HEADER_SEARCH 100  // maximum number of bytes to search for the requested section
-	uint16_t numbytes = 0;
-	while(numbytes < MAX_FPGA_BIT_STREAM_HEADER_SEARCH) {
-		char current_name = get_from_fpga_stream(bitstream_version, compressed_fpga_stream, output_buffer);
-		numbytes++;
-		uint32_t current_length = 0;
-		if (current_name < 'a' || current_name > 'e') {
-			/* Strange section name, abort */
-			break;
-		}
-		current_length = 0;
-		switch (current_name) {
-		case 'e':
-			/* Four byte length field */
-			current_length += get_from_fpga_stream(bitstream_version, compressed_fpga_stream, output_buffer) << 24;
-			current_length += get_from_fpga_stream(bitstream_version, compressed_fpga_stream, output_buffer) << 16;
-			numbytes += 2;
-		default: /* Fall through, two byte length field */
-			current_length += get_from_fpga_stream(bitstream_version, compressed_fpga_stream, output_buffer) << 8;
-			current_length += get_from_fpga_stream(bitstream_version, compressed_fpga_stream, output_buffer) << 0;
-			numbytes += 2;
-		}
-
-		if (current_name != 'e' && current_length > 255) {
-			/* Maybe a parse error */
-			break;
-		}
-
-		if (current_name == section_name) {
-			/* Found it */
-			*section_length = current_length;
-			result = 1;
-			break;
-		}
-
-		for (uint16_t i = 0; i < current_length && numbytes < MAX_FPGA_BIT_STREAM_HEADER_SEARCH; i++) {
-			get_from_fpga_stream(bitstream_version, compressed_fpga_stream, output_buffer);
-			numbytes++;
-		}
-	}
-	return result;
-}
-
 //----------------------------------------------------------------------------
 // Check which FPGA image is currently loaded (if any). If necessary
 // decompress and load the correct (HF or LF) image to the FPGA
@@ -405,14 +353,12 @@ void FpgaDownloadAndGo(int bitstream_version) {
 	// make sure that we have enough memory to decompress
 	BigBuf_free(); BigBuf_Clear_ext(verbose);
 
-	if (!reset_fpga_stream(bitstream_version, &compressed_fpga_stream, output_buffer))
+	uint32_t bitstream_length;
+	if (!reset_fpga_stream(bitstream_version, &compressed_fpga_stream, output_buffer, &bitstream_length))
 		return;
 
-	uint32_t bitstream_length;
-	if (bitparse_find_section(bitstream_version, 'e', &bitstream_length, &compressed_fpga_stream, output_buffer)) {
-		DownloadFPGA(bitstream_version, bitstream_length, &compressed_fpga_stream, output_buffer);
-		downloaded_bitstream = bitstream_version;
-	}
+	DownloadFPGA(bitstream_length, &compressed_fpga_stream, output_buffer);
+	downloaded_bitstream = bitstream_version;
 
 	inflateEnd(&compressed_fpga_stream);
 
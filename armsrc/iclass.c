@@ -807,6 +807,7 @@ static void iclass_setup_sniff(void){
 
 	BigBuf_free(); BigBuf_Clear_ext(false); 
 	clear_trace();
+	BigBuf_stream_start();
 	set_tracing(true);
 
 	// Initialize Demod and Uart structs
@@ -889,6 +890,17 @@ void RAMFUNC SniffIClass(void) {
 			data = dmaBuf;
 			AT91C_BASE_PDC_SSC->PDC_RNPR = (uint32_t) dmaBuf;
 			AT91C_BASE_PDC_SSC->PDC_RNCR = ICLASS_DMA_BUFFER_SIZE;
+
+			// once per DMA buffer,  stream the trace when no frame is in progress
+			if (!TagIsActive && !ReaderIsActive) {
+				BigBuf_stream_trace();
+				// or move it to flash,  with the DMA stopped.  Frames meanwhile are lost
+				if (BigBuf_spill_due()) {
+					FpgaDisableSscDma();
+					BigBuf_spill_trace();
+					if (!FpgaSetupSscDma(dmaBuf, ICLASS_DMA_BUFFER_SIZE)) break;
+				}
+			}
 		}
 		
 		if ( *data & 0xF) { 
@@ -956,6 +968,8 @@ void RAMFUNC SniffIClass(void) {
 		}
 	} // end main loop
 
+	BigBuf_stream_end();
+
 	if (MF_DBGLEVEL >= 1) {	
 		DbpString("[+] Sniff statistics:");	
 		Dbhexdump(ICLASS_DMA_BUFFER_SIZE, data, false);
@@ -209,6 +209,7 @@ void UartInit(uint8_t *data, uint8_t *parity) {
 
 // use parameter non_real_time to provide a timestamp. Set to 0 if the decoder should measure real time
 RAMFUNC bool MillerDecoding(uint8_t bit, uint32_t non_real_time) {
+	PROF_ENTER();
 	Uart.fourBits = (Uart.fourBits << 8) | bit;
 	
 	if (Uart.state == STATE_UNSYNCD) {											// not yet synced
@@ -293,12 +294,14 @@ RAMFUNC bool MillerDecoding(uint8_t bit, uint32_t non_real_time) {
 						Uart.parityBits <<= 1;									// add a (void) parity bit
 						Uart.parityBits <<= (8 - (Uart.len&0x0007));			// left align parity bits
 						Uart.parity[Uart.parityLen++] = Uart.parityBits;		// and store it
+						PROF_LEAVE(PROF_FN_MILLER);
 						return true;
 					} else if (Uart.len & 0x0007) {								// there are some parity bits to store
 						Uart.parityBits <<= (8 - (Uart.len&0x0007));			// left align remaining parity bits
 						Uart.parity[Uart.parityLen++] = Uart.parityBits;		// and store them
 					}
 					if (Uart.len) {
+						PROF_LEAVE(PROF_FN_MILLER);
 						return true;											// we are finished with decoding the raw data sequence
 					} else {
 						UartReset();											// Nothing received - start over
@@ -325,6 +328,7 @@ RAMFUNC bool MillerDecoding(uint8_t bit, uint32_t non_real_time) {
 			}
 		}			
 	} 
+    PROF_LEAVE(PROF_FN_MILLER);
     return false;	// not finished yet, need more data
 }
 
@@ -382,6 +386,7 @@ void DemodInit(uint8_t *data, uint8_t *parity) {
 
 // use parameter non_real_time to provide a timestamp. Set to 0 if the decoder should measure real time
 RAMFUNC int ManchesterDecoding(uint8_t bit, uint16_t offset, uint32_t non_real_time) {
+	PROF_ENTER();
 	Demod.twoBits = (Demod.twoBits << 8) | bit;
 	
 	if (Demod.state == DEMOD_UNSYNCD) {
@@ -454,12 +459,14 @@ RAMFUNC int ManchesterDecoding(uint8_t bit, uint16_t offset, uint32_t non_real_t
 					Demod.parityBits <<= 1;								// add a (void) parity bit
 					Demod.parityBits <<= (8 - (Demod.len&0x0007));		// left align remaining parity bits
 					Demod.parity[Demod.parityLen++] = Demod.parityBits;	// and store them
+					PROF_LEAVE(PROF_FN_MANCHESTER);
 					return true;
 				} else if (Demod.len & 0x0007) {						// there are some parity bits to store
 					Demod.parityBits <<= (8 - (Demod.len&0x0007));		// left align remaining parity bits
 					Demod.parity[Demod.parityLen++] = Demod.parityBits;	// and store them
 				}
 				if (Demod.len) {
+					PROF_LEAVE(PROF_FN_MANCHESTER);
 					return true;										// we are finished with decoding the raw data sequence
 				} else { 												// nothing received. Start over
 					DemodReset();
@@ -467,6 +474,7 @@ RAMFUNC int ManchesterDecoding(uint8_t bit, uint16_t offset, uint32_t non_real_t
 			}
 		}
 	}
+    PROF_LEAVE(PROF_FN_MANCHESTER);
     return false;	// not finished yet, need more data
 }
 
@@ -492,6 +500,7 @@ void RAMFUNC SniffIso14443a(uint8_t param) {
 	// free all previous allocations first
 	BigBuf_free(); BigBuf_Clear_ext(false);
 	clear_trace();
+	BigBuf_stream_start();
 	set_tracing(true);
 	
 	// The command (reader -> tag) that we're receiving.
@@ -554,7 +563,22 @@ void RAMFUNC SniffIso14443a(uint8_t param) {
 				break;
 			}
 		}
-		if (dataLen < 1) continue;
+		if (dataLen < 1) {
+			// caught up with the DMA,  and no frame in progress: time to stream the trace
+			if (!TagIsActive && !ReaderIsActive) {
+				BigBuf_stream_trace();
+				// or to move it to flash,  with the DMA stopped.  Frames meanwhile are lost
+				if (BigBuf_spill_due()) {
+					FpgaDisableSscDma();
+					BigBuf_spill_trace();
+					if (!FpgaSetupSscDma(dmaBuf, DMA_BUFFER_SIZE)) break;
+					data = dmaBuf;
+					UartReset();
+					DemodReset();
+				}
+			}
+			continue;
+		}
 
 		// primary buffer was stopped( <-- we lost data!
 		if (!AT91C_BASE_PDC_SSC->PDC_RCR) {
@@ -633,6 +657,8 @@ void RAMFUNC SniffIso14443a(uint8_t param) {
 		}
 	} // end main loop
 
+	BigBuf_stream_end();
+
 	if (MF_DBGLEVEL >= 1) {
 		Dbprintf("maxDataLen=%d, Uart.state=%x, Uart.len=%d", maxDataLen, Uart.state, Uart.len);
 		Dbprintf("traceLen=%d, Uart.output[0]=%08x", BigBuf_get_traceLen(), (uint32_t)Uart.output[0]);
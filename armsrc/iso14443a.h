@@ -29,6 +29,7 @@ extern "C" {
 #include "parity.h"
 #include "random.h"
 #include "mifare.h"  // structs
+#include "profile.h"
 
 typedef struct {
 	enum {
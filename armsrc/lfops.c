@@ -16,6 +16,7 @@
 #include "string.h"
 #include "lfdemod.h"
 #include "lfsampling.h"
+#include "lfwatch.h"
 #include "protocols.h"
 #include "usb_cdc.h" // for usb_poll_validate_length
 
@@ -1237,6 +1238,46 @@ void CmdIOdemodFSK(int findone, uint32_t *high, uint32_t *low, int ledcontrol) {
 	if (ledcontrol) LED_A_OFF();
 }
 
+// Watch loop behind 'lf watch',  samples and demodulates for the protocols in the
+// LF_WATCH_* mask until the button is pressed or a command arrives.  Only the ids
+// read are sent to the client,  instead of each acquisition.
+void LFWatch(uint8_t protocols, uint8_t flags, int divisor, int ledcontrol) {
+	lf_watch_id_t ids[LF_WATCH_PROTOCOLS], last[LF_WATCH_PROTOCOLS];
+	uint32_t rounds = 0, reads = 0, sent = 0;
+	bool done = false;
+
+	BigBuf_free_keep_EM();
+	uint8_t *dest = BigBuf_get_addr();
+	// the demods work in place,  each one gets a copy of the samples
+	uint8_t *work = BigBuf_malloc(LF_WATCH_SAMPLES);
+	memset(last, 0, sizeof(last));
+
+	LFSetupFPGAForADC(divisor ? divisor : 95, true);
+
+	while (!done && !BUTTON_PRESS() && !usb_poll_validate_length()) {
+		WDT_HIT();
+		if (ledcontrol) LED_A_ON();
+
+		uint32_t bits = DoPartialAcquisition(-1, true, LF_WATCH_SAMPLES, 0);
+		rounds++;
+
+		int n = lf_watch_decode(dest, bits >> 3, work, protocols, ids);
+		for (int i = 0; i < n && !done; i++) {
+			reads++;
+			if (!lf_watch_update(last, &ids[i]) && !(flags & LF_WATCH_EVERY_READ))
+				continue;
+			cmd_send(CMD_LF_WATCH_ID, rounds, 0, 0, &ids[i], sizeof(lf_watch_id_t));
+			sent++;
+			if (flags & LF_WATCH_FINDONE)
+				done = true;
+		}
+		if (ledcontrol) LED_A_OFF();
+	}
+	FpgaWriteConfWord(FPGA_MAJOR_MODE_OFF);
+	BigBuf_free_keep_EM();
+	cmd_send(CMD_LF_WATCH_END, rounds, reads, sent, 0, 0);
+}
+
 /*------------------------------
  * T5555/T5557/T5567/T5577 routines
  *------------------------------
@@ -261,6 +261,167 @@ uint32_t SnoopLF() {
 	return ret;	
 }
 
+/**
+ * Continuous acquisition,  streamed to the client instead of stopping when BigBuf is full.
+ * The ADC samples come in by DMA,  so sampling goes on while a packet is sent.  They are
+ * decimated,  averaged and packed like in DoAcquisition(),  MSB first as pushBit() does,
+ * into a ring over BigBuf which is drained in USB_CMD_DATA_SIZE packets.  When USB can't
+ * keep up and the ring is full,  whole samples are dropped so the packing stays aligned.
+ * When the DMA stops or overtakes the reader,  what wasn't read yet is stale and discarded.
+ * Runs until the button is pressed,  a command arrives or 'samples' samples are kept (0 = no limit).
+ * @return number of samples kept
+ */
+#define LF_STREAM_DMA_SIZE		1024	// ~8ms of samples at 125kHz,  covers a blocking packet send
+
+uint32_t StreamLF(bool activeField, uint32_t samples) {
+	lf_stream_stats_t st;
+	memset(&st, 0, sizeof(st));
+
+	uint8_t bits_per_sample = config.bits_per_sample;
+	uint8_t decimation = config.decimation;
+	int trigger_threshold = config.trigger_threshold;
+	if (bits_per_sample < 1) bits_per_sample = 1;
+	if (bits_per_sample > 8) bits_per_sample = 8;
+	if (decimation < 1) decimation = 1;
+
+	BigBuf_free(); BigBuf_Clear_ext(false);
+	uint8_t *dmaBuf = BigBuf_malloc(LF_STREAM_DMA_SIZE);
+	uint8_t *data = dmaBuf;
+	// samples written by the DMA and read from dmaBuf,  counted since the last restart
+	uint32_t dmaLaps = 0, dmaPos = 0, readPos = 0;
+
+	// whole packets in the ring,  so a packet never wraps
+	uint8_t *ring = BigBuf_get_addr();
+	uint32_t ringsize = (BigBuf_max_traceLen() / USB_CMD_DATA_SIZE) * USB_CMD_DATA_SIZE;
+	uint32_t head = 0, tail = 0, fill = 0, seq = 0;
+
+	uint32_t acc = 0, sample_sum = 0;
+	uint8_t accbits = 0, sample_counter = 0;
+
+	LFSetupFPGAForADC(config.divisor, activeField);
+	if (!FpgaSetupSscDma(dmaBuf, LF_STREAM_DMA_SIZE)) {
+		cmd_send(CMD_ACK, 0, 0, 0, 0, 0);
+		return 0;
+	}
+
+	// the client needs the packing to unpack the samples
+	cmd_send(CMD_ACK, 1, 0, 0, &config, sizeof(config));
+
+	while (!BUTTON_PRESS() && !usb_poll_validate_length()) {
+		WDT_HIT();
+		if (AT91C_BASE_SSC->SSC_SR & AT91C_SSC_TXRDY) {
+			AT91C_BASE_SSC->SSC_THR = 0x43;
+			LED_D_ON();
+		}
+
+		// a consistent pair,  the PDC may switch to the next buffer in between
+		uint32_t rcr, rncr;
+		do {
+			rncr = AT91C_BASE_PDC_SSC->PDC_RNCR;
+			rcr = AT91C_BASE_PDC_SSC->PDC_RCR;
+		} while (rncr != AT91C_BASE_PDC_SSC->PDC_RNCR);
+
+		if (!rcr) {
+			// both buffers used up,  the DMA stopped.  What is left in dmaBuf was overwritten
+			// while we were away,  drop it and restart at the beginning of the buffer.
+			AT91C_BASE_PDC_SSC->PDC_RPR = (uint32_t) dmaBuf;
+			AT91C_BASE_PDC_SSC->PDC_RCR = LF_STREAM_DMA_SIZE;
+			AT91C_BASE_PDC_SSC->PDC_RNPR = (uint32_t) dmaBuf;
+			AT91C_BASE_PDC_SSC->PDC_RNCR = LF_STREAM_DMA_SIZE;
+			st.overruns++;
+			// the current buffer and the reloaded next one were filled,  later samples weren't taken
+			st.lost += (dmaLaps + 2) * LF_STREAM_DMA_SIZE - readPos;
+			data = dmaBuf;
+			dmaLaps = readPos = 0;
+			continue;
+		}
+		if (!rncr) {
+			// the DMA moved on to the next buffer,  which is dmaBuf again
+			AT91C_BASE_PDC_SSC->PDC_RNPR = (uint32_t) dmaBuf;
+			AT91C_BASE_PDC_SSC->PDC_RNCR = LF_STREAM_DMA_SIZE;
+			dmaLaps++;
+		}
+
+		dmaPos = dmaLaps * LF_STREAM_DMA_SIZE + (LF_STREAM_DMA_SIZE - rcr);
+		if (dmaPos - readPos >= LF_STREAM_DMA_SIZE) {
+			// lapped,  the unread samples were overwritten.  Carry on at the DMA position
+			st.overruns++;
+			st.lost += dmaPos - readPos;
+			readPos = dmaPos;
+			data = dmaBuf + (LF_STREAM_DMA_SIZE - rcr) % LF_STREAM_DMA_SIZE;
+		}
+
+		while (readPos != dmaPos) {
+			uint8_t sample = *data++;
+			if (data == dmaBuf + LF_STREAM_DMA_SIZE)
+				data = dmaBuf;
+			readPos++;
+			st.seen++;
+
+			// threshold either high or low values 128 = center 0.
+			if ((trigger_threshold > 0) && (sample < (trigger_threshold + 128)) && (sample > (128 - trigger_threshold)))
+				continue;
+			trigger_threshold = 0;
+
+			if (config.averaging)
+				sample_sum += sample;
+
+			if (decimation > 1) {
+				if (++sample_counter < decimation) continue;
+				sample_counter = 0;
+				if (config.averaging) {
+					sample = sample_sum / decimation;
+					sample_sum = 0;
+				}
+			}
+
+			if (fill == ringsize) {
+				st.dropped++;
+				continue;
+			}
+			st.saved++;
+
+			acc = (acc << bits_per_sample) | (sample >> (8 - bits_per_sample));
+			accbits += bits_per_sample;
+			if (accbits >= 8) {
+				accbits -= 8;
+				ring[head] = acc >> accbits;
+				head = (head + 1 == ringsize) ? 0 : head + 1;
+				fill++;
+			}
+		}
+		LED_D_OFF();
+
+		if (fill >= USB_CMD_DATA_SIZE) {
+			cmd_send(CMD_LF_STREAM_DATA, USB_CMD_DATA_SIZE, seq++, st.dropped, ring + tail, USB_CMD_DATA_SIZE);
+			tail = (tail + USB_CMD_DATA_SIZE == ringsize) ? 0 : tail + USB_CMD_DATA_SIZE;
+			fill -= USB_CMD_DATA_SIZE;
+			st.sent += USB_CMD_DATA_SIZE;
+		}
+
+		if (samples && st.saved >= samples)
+			break;
+	}
+
+	FpgaDisableSscDma();
+	FpgaWriteConfWord(FPGA_MAJOR_MODE_OFF);
+
+	// last bits,  padded with zeros
+	if (accbits && fill < ringsize) {
+		ring[head] = acc << (8 - accbits);
+		fill++;
+	}
+	while (fill) {
+		uint32_t n = MIN(fill, USB_CMD_DATA_SIZE);
+		cmd_send(CMD_LF_STREAM_DATA, n, seq++, st.dropped, ring + tail, n);
+		tail = (tail + n == ringsize) ? 0 : tail + n;
+		fill -= n;
+		st.sent += n;
+	}
+	cmd_send(CMD_LF_STREAM_END, 0, 0, 0, &st, sizeof(st));
+	return st.saved;
+}
+
 /**
 * acquisition of T55x7 LF signal. Similar to other LF, but adjusted with @marshmellows thresholds
 * the data is collected in BigBuf.
@@ -35,6 +35,12 @@ uint32_t SampleLF(bool silent, int sample_size);
 **/
 uint32_t SnoopLF();
 
+/**
+* Initializes the FPGA and streams the samples to the client until stopped,  'lf stream'.
+* @return number of samples kept
+**/
+uint32_t StreamLF(bool activeField, uint32_t samples);
+
 // adds sample size to default options
 uint32_t DoPartialAcquisition(int trigger_threshold, bool silent, int sample_size, uint32_t cancel_after);
 
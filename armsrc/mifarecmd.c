@@ -1077,6 +1077,7 @@ typedef struct chk_t {
 //  0 = correct key
 uint8_t chkKey( struct chk_t *c ) {
 	uint8_t i = 0, res = 2;	
+	PROF_ENTER();
 	while( i < 5 ) {
 		// this part is from Piwi's faster nonce collecting part in Hardnested.
 		// assume: fast select
@@ -1093,6 +1094,7 @@ uint8_t chkKey( struct chk_t *c ) {
 			// mifare_classic_halt_ex(c->pcs);
 		break;
 	}
+	PROF_LEAVE(PROF_FN_CHKKEY);
 	return res;
 }
 
@@ -305,7 +305,7 @@ bool RAMFUNC MfSniffLogic(const uint8_t *data, uint16_t len, uint8_t *parity, ui
 */
 
 void RAMFUNC MfSniffSend() {
-	uint16_t tracelen = BigBuf_get_traceLen();
+	uint32_t tracelen = BigBuf_get_traceLen();
 	uint16_t chunksize = 0;
 	int packlen = tracelen;	// total number of bytes to send
 	uint8_t *data = BigBuf_get_addr();	
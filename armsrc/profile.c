@@ -0,0 +1,79 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Per command and per hot function timing,  read out by 'hw profile'.
+//-----------------------------------------------------------------------------
+#include "profile.h"
+#include "apps.h"
+#include "cmd.h"
+#include "string.h"
+
+// slots 0..PROF_FUNCTIONS-1 are the hot functions,  then commands in the order they
+// are first seen,  the last slot collects everything that didn't fit
+prof_entry_t prof_table[PROF_ENTRIES];
+
+static const char *prof_fn_names[PROF_FUNCTIONS] = {
+	"LogTrace", "MillerDecoding", "ManchesterDecoding", "chkKey"
+};
+
+void Profile_init(void) {
+	// free running,  no interrupt
+	AT91C_BASE_PITC->PITC_PIMR = AT91C_PITC_PITEN | AT91C_PITC_PIV;
+	Profile_reset();
+}
+
+void Profile_reset(void) {
+	memset(prof_table, 0, sizeof(prof_table));
+	for (int i = 0; i < PROF_FUNCTIONS; i++)
+		prof_table[i].id = PROF_ID_FN + i;
+	prof_table[PROF_ENTRIES - 1].id = PROF_ID_OTHER;
+}
+
+void Profile_command(uint16_t cmd, uint32_t start) {
+	int i;
+	for (i = PROF_FUNCTIONS; i < PROF_ENTRIES - 1; i++) {
+		if (prof_table[i].id == cmd && prof_table[i].calls)
+			break;
+		if (prof_table[i].calls == 0) {
+			prof_table[i].id = cmd;
+			break;
+		}
+	}
+	prof_add(&prof_table[i], start);
+}
+
+// as many entries as fit in one packet,  starting at first.  None if not compiled in
+void Profile_send(uint32_t first) {
+	uint32_t n = 0;
+#ifdef WITH_PROFILE
+	if (first < PROF_ENTRIES)
+		n = MIN(PROF_ENTRIES - first, USB_CMD_DATA_SIZE / sizeof(prof_entry_t));
+#endif
+	cmd_send(CMD_ACK, n, first, PROF_ENTRIES, prof_table + first, n * sizeof(prof_entry_t));
+}
+
+void Profile_print_status(void) {
+	Dbprintf("Profile");
+#ifdef WITH_PROFILE
+	uint32_t cmds = 0;
+	prof_entry_t *top = NULL;
+	for (int i = PROF_FUNCTIONS; i < PROF_ENTRIES; i++) {
+		if (prof_table[i].calls == 0)
+			continue;
+		cmds++;
+		if (top == NULL || prof_table[i].ticks > top->ticks)
+			top = &prof_table[i];
+	}
+	Dbprintf("  commands seen...........%d", cmds);
+	if (top)
+		Dbprintf("  busiest command.........0x%04x, %d ms", top->id, (uint32_t)(top->ticks / PROF_TICKS_PER_MS));
+	for (int i = 0; i < PROF_FUNCTIONS; i++) {
+		if (prof_table[i].calls)
+			Dbprintf("  %-24s%d calls, %d ms", prof_fn_names[i], prof_table[i].calls, (uint32_t)(prof_table[i].ticks / PROF_TICKS_PER_MS));
+	}
+#else
+	Dbprintf("  not compiled in, build with -DWITH_PROFILE");
+#endif
+}
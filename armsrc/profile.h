@@ -0,0 +1,56 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Per command and per hot function timing,  read out by 'hw profile'.
+//
+// The timer/counters TC0..TC2 behind GetTicks() and GetCountSspClk() are
+// reprogrammed by the protocol code,  so the profiler uses the otherwise unused
+// periodic interval timer instead. With the maximum period its image register
+// (PICNT:CPIV) is a free running 32 bit counter of MCK/16,  it wraps after ~23min.
+//
+//	PROF_ENTER();
+//	...
+//	PROF_LEAVE(PROF_FN_MILLER);		// before every return
+//
+// Opt-in: add -DWITH_PROFILE to APP_CFLAGS in armsrc/Makefile. Without it the
+// macros are empty,  so the timing critical sniff decoders pay nothing.
+//-----------------------------------------------------------------------------
+
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+#include <stdint.h>
+#include "proxmark3.h"
+#include "usb_cmd.h"
+
+extern prof_entry_t prof_table[PROF_ENTRIES];
+
+extern void Profile_init(void);
+extern void Profile_reset(void);
+extern void Profile_command(uint16_t cmd, uint32_t start);
+extern void Profile_send(uint32_t first);
+extern void Profile_print_status(void);
+
+static inline uint32_t prof_ticks(void) {
+	return AT91C_BASE_PITC->PITC_PIIR;
+}
+
+static inline void prof_add(prof_entry_t *e, uint32_t start) {
+	uint32_t t = prof_ticks() - start;
+	e->calls++;
+	e->ticks += t;
+	if (t > e->max)
+		e->max = t;
+}
+
+#ifdef WITH_PROFILE
+# define PROF_ENTER()		uint32_t prof_start = prof_ticks()
+# define PROF_LEAVE(fn)		prof_add(&prof_table[(fn)], prof_start)
+#else
+# define PROF_ENTER()
+# define PROF_LEAVE(fn)
+#endif
+
+#endif
@@ -77,6 +77,26 @@ int usage_analyse_a(void) {
 	PrintAndLogEx(NORMAL, "      analyse a d 137AF00A0A0D");
 	return 0;
 }
+int usage_analyse_bench(void) {
+	PrintAndLogEx(NORMAL, "Runs key recovery attacks end to end against seeded simulated cards and readers,");
+	PrintAndLogEx(NORMAL, "reports wall / cpu time per phase (acquisition, reduction, brute force) and the client's");
+	PrintAndLogEx(NORMAL, "peak RSS during each attack.  The peak is reset before every attack on Linux,  elsewhere");
+	PrintAndLogEx(NORMAL, "the column shows the client's maximum so far.");
+	PrintAndLogEx(NORMAL, "The same seed gives the same cards,  keys and nonces on every run.");
+	PrintAndLogEx(NORMAL, "");
+	PrintAndLogEx(NORMAL, "Usage:  analyse bench [h] [a <attack>] [s <seed>] [r <rounds>]");
+	PrintAndLogEx(NORMAL, "Options:");
+	PrintAndLogEx(NORMAL, "           h             This help");
+	PrintAndLogEx(NORMAL, "           a <attack>    nested, darkside, mfkey32, mfkey32m, mfkey64, loclass, hardnested");
+	PrintAndLogEx(NORMAL, "                         (default: all but hardnested,  which takes minutes)");
+	PrintAndLogEx(NORMAL, "           s <seed>      seed for the simulated cards (default 1)");
+	PrintAndLogEx(NORMAL, "           r <rounds>    runs of each attack,  one card per run (default 1)");
+	PrintAndLogEx(NORMAL, "");
+	PrintAndLogEx(NORMAL, "Examples:");
+	PrintAndLogEx(NORMAL, "      analyse bench");
+	PrintAndLogEx(NORMAL, "      analyse bench a darkside r 10");
+	return 0;
+}
 
 static uint8_t calculateLRC( uint8_t* bytes, uint8_t len) {
     uint8_t LRC = 0;
@@ -881,6 +901,482 @@ int CmdAnalyseNuid(const char *Cmd){
 	PrintAndLogEx(NORMAL, "NUID | %s \n", sprint_hex(nuid, 4));
 	return 0;
 }
+//-----------------------------------------------------------------------------
+// analyse bench,  key recovery attacks against simulated cards.
+// The card and reader side are modelled with crapto1 / loclass,  the attack side
+// is the same client code the real commands use.
+//-----------------------------------------------------------------------------
+enum { BENCH_ACQUIRE, BENCH_REDUCE, BENCH_BRUTE, BENCH_PHASES };
+
+typedef struct {
+	uint64_t wall_us[BENCH_PHASES];
+	uint64_t cpu_us[BENCH_PHASES];
+	bool phases;				// false: attack isn't split into phases,  only totals
+} bench_time_t;
+
+typedef struct {
+	uint32_t uid;
+	uint64_t key;
+	uint32_t nt;				// last nonce of the weak PRNG
+} bench_card_t;
+
+static uint32_t bench_seed = 1;
+static bench_time_t *bench_cur = NULL;
+static int bench_phase = -1;
+static uint64_t bench_t_wall = 0, bench_t_cpu = 0;
+
+// xorshift,  rand() would be shared with hardnested's srand(time)
+static uint32_t bench_rand(void) {
+	bench_seed ^= bench_seed << 13;
+	bench_seed ^= bench_seed >> 17;
+	bench_seed ^= bench_seed << 5;
+	return bench_seed;
+}
+
+// user + system time of all threads
+static uint64_t bench_cpu_us(void) {
+#if defined(_WIN32)
+	return (uint64_t)clock() * 1000000 / CLOCKS_PER_SEC;
+#else
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+#endif
+}
+
+// peak resident set size of the client so far,  in kB
+static uint64_t bench_max_rss(void) {
+#if defined(_WIN32)
+	return 0;
+#else
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+# if defined(__APPLE__)
+	return ru.ru_maxrss / 1024;
+# else
+	return ru.ru_maxrss;
+# endif
+#endif
+}
+
+// Reset the peak resident set size to the current one,  so each attack is measured on its own.
+// Linux only (/proc/self/clear_refs),  false where the peak can't be reset.
+static bool bench_reset_peak_rss(void) {
+#if defined(__linux__)
+	FILE *f = fopen("/proc/self/clear_refs", "w");
+	if (!f)
+		return false;
+	bool ok = (fputs("5", f) >= 0);
+	return (fclose(f) == 0) && ok;
+#else
+	return false;
+#endif
+}
+
+// peak resident set size since the last bench_reset_peak_rss(),  in kB
+static uint64_t bench_peak_rss(void) {
+#if defined(__linux__)
+	FILE *f = fopen("/proc/self/status", "r");
+	if (f) {
+		char line[128];
+		unsigned long long kb = 0;
+		bool found = false;
+		while (!found && fgets(line, sizeof(line), f))
+			found = (sscanf(line, "VmHWM: %llu kB", &kb) == 1);
+		fclose(f);
+		if (found)
+			return kb;
+	}
+#endif
+	return bench_max_rss();
+}
+
+// close the running phase and start the next one,  -1 only closes
+static void bench_enter(int phase) {
+	uint64_t wall = usclock(), cpu = bench_cpu_us();
+	if (bench_cur && bench_phase >= 0) {
+		bench_cur->wall_us[bench_phase] += wall - bench_t_wall;
+		bench_cur->cpu_us[bench_phase] += cpu - bench_t_cpu;
+	}
+	bench_phase = phase;
+	bench_t_wall = wall;
+	bench_t_cpu = cpu;
+}
+
+static void bench_new_card(bench_card_t *card) {
+	card->uid = bench_rand();
+	card->key = ((uint64_t)bench_rand() << 32 | bench_rand()) & 0xFFFFFFFFFFFF;
+	card->nt = prng_successor(0x01200145, bench_rand() & 0xFFFF);
+}
+
+static uint32_t bench_card_nonce(bench_card_t *card) {
+	card->nt = prng_successor(card->nt, 160 + (bench_rand() & 0xFF));
+	return card->nt;
+}
+
+// a reader authenticating with the card's key,  as sniffed or seen by a simulated card:
+// {nr}, {ar} and the card's answer {at}
+static void bench_reader_auth(bench_card_t *card, uint32_t nt, uint32_t *nr_enc, uint32_t *ar_enc, uint32_t *at_enc) {
+	uint32_t nr = bench_rand();
+	struct Crypto1State *s = crypto1_create(card->key);
+	crypto1_word(s, card->uid ^ nt, 0);
+	*nr_enc = nr ^ crypto1_word(s, nr, 0);
+	*ar_enc = prng_successor(nt, 64) ^ crypto1_word(s, 0, 0);
+	*at_enc = prng_successor(nt, 96) ^ crypto1_word(s, 0, 0);
+	crypto1_destroy(s);
+}
+
+// authenticate with a candidate key,  the card checks {ar} with its real key.  What mfCheckKeys does
+static bool bench_card_auth(bench_card_t *card, uint64_t key) {
+	uint32_t nt = bench_card_nonce(card), nr = bench_rand();
+	struct Crypto1State *reader = crypto1_create(key);
+	struct Crypto1State *tag = crypto1_create(card->key);
+	crypto1_word(reader, card->uid ^ nt, 0);
+	uint32_t nr_enc = nr ^ crypto1_word(reader, nr, 0);
+	uint32_t ar_enc = prng_successor(nt, 64) ^ crypto1_word(reader, 0, 0);
+	crypto1_word(tag, card->uid ^ nt, 0);
+	crypto1_word(tag, nr_enc, 1);
+	bool ok = (ar_enc ^ crypto1_word(tag, 0, 0)) == prng_successor(nt, 64);
+	crypto1_destroy(reader);
+	crypto1_destroy(tag);
+	return ok;
+}
+
+// the card answers {nr}{ar} with an encrypted 4 bit NACK when all 8 parity bits are right
+static bool bench_card_nack(bench_card_t *card, uint32_t nt, uint8_t *nr_ar, uint8_t par, uint8_t *ks) {
+	struct Crypto1State *s = crypto1_create(card->key);
+	crypto1_word(s, card->uid ^ nt, 0);
+	bool ok = true;
+	for (int i = 0; i < 8 && ok; i++) {
+		uint8_t plain = nr_ar[i] ^ crypto1_byte(s, i < 4 ? nr_ar[i] : 0, i < 4);
+		ok = ((par >> (7 - i)) & 1) == (oddparity8(plain) ^ filter(s->odd));
+	}
+	if (ok) {
+		*ks = 0;
+		for (int i = 0; i < 4; i++)
+			*ks |= crypto1_bit(s, 0, 0) << i;
+	}
+	crypto1_destroy(s);
+	return ok;
+}
+
+static bool bench_nested(bench_card_t *card, uint64_t *key) {
+	StateList_t statelists[2];
+
+	bench_enter(BENCH_ACQUIRE);
+	for (int i = 0; i < 2; i++) {
+		struct Crypto1State *s = crypto1_create(card->key);
+		statelists[i].blockNo = 0;
+		statelists[i].keyType = 0;
+		statelists[i].uid = card->uid;
+		statelists[i].nt = bench_card_nonce(card);
+		statelists[i].ks1 = crypto1_word(s, card->uid ^ statelists[i].nt, 0);
+		crypto1_destroy(s);
+	}
+
+	bench_enter(BENCH_REDUCE);
+	uint32_t keycnt = mfnested_candidates(statelists);
+
+	bench_enter(BENCH_BRUTE);
+	bool found = false;
+	for (uint32_t i = 0; i < keycnt && !found; i++) {
+		crypto1_get_lfsr(statelists[0].head.slhead + i, key);
+		found = bench_card_auth(card, *key);
+	}
+	free(statelists[0].head.slhead);
+	free(statelists[1].head.slhead);
+	return found;
+}
+
+// same parity search as ReaderMifare() in the firmware
+static bool bench_darkside(bench_card_t *card, uint64_t *key) {
+	bool found = false;
+
+	for (int attempt = 0; attempt < 16 && !found; attempt++) {
+		bench_enter(BENCH_ACQUIRE);
+		uint32_t nt = bench_card_nonce(card);
+		uint8_t nr_ar[8], par_list[8] = {0}, ks_list[8] = {0};
+		uint8_t par = 0, par_low = 0, nt_diff = 0, ks = 0;
+		num_to_bytes(bench_rand(), 4, nr_ar);
+		num_to_bytes(bench_rand(), 4, nr_ar + 4);
+		nr_ar[3] &= 0x1F;
+
+		while (true) {
+			if (bench_card_nack(card, nt, nr_ar, par, &ks)) {
+				if (nt_diff == 0)
+					par_low = par & 0xE0;
+				par_list[nt_diff] = reflect8(par);
+				ks_list[nt_diff] = ks;
+				if (nt_diff == 7)
+					break;
+				nt_diff++;
+				nr_ar[3] = (nr_ar[3] & 0x1F) | (nt_diff << 5);
+				par = par_low;
+			} else if (nt_diff == 0) {
+				if (++par == 0)
+					return false;
+			} else {
+				par = ((par & 0x1F) + 1) | par_low;
+			}
+		}
+		nr_ar[3] &= 0x1F;
+
+		bench_enter(BENCH_REDUCE);
+		uint64_t *keylist = NULL;
+		uint32_t keycount = nonce2key(card->uid, nt, bytes_to_num(nr_ar, 4), bytes_to_num(nr_ar + 4, 4),
+			bytes_to_num(par_list, 8), bytes_to_num(ks_list, 8), &keylist);
+
+		// no candidates is expected in 25% of all cases,  like on a real card try another reader nonce
+		bench_enter(BENCH_BRUTE);
+		for (uint32_t i = 0; i < keycount && !found; i++) {
+			*key = keylist[i];
+			found = bench_card_auth(card, *key);
+		}
+		free(keylist);
+	}
+	return found;
+}
+
+static bool bench_mfkey32(bench_card_t *card, uint64_t *key, bool moebius) {
+	nonces_t data;
+	uint32_t at;
+	memset(&data, 0, sizeof(data));
+
+	bench_enter(BENCH_ACQUIRE);
+	data.cuid = card->uid;
+	data.nonce = bench_card_nonce(card);
+	data.nonce2 = moebius ? bench_card_nonce(card) : data.nonce;
+	bench_reader_auth(card, data.nonce, &data.nr, &data.ar, &at);
+	bench_reader_auth(card, data.nonce2, &data.nr2, &data.ar2, &at);
+
+	bench_enter(BENCH_REDUCE);
+	bool found = moebius ? mfkey32_moebius(data, key) : mfkey32(data, key);
+
+	bench_enter(BENCH_BRUTE);
+	return found && bench_card_auth(card, *key);
+}
+
+static bool bench_mfkey64(bench_card_t *card, uint64_t *key) {
+	nonces_t data;
+	memset(&data, 0, sizeof(data));
+
+	bench_enter(BENCH_ACQUIRE);
+	data.cuid = card->uid;
+	data.nonce = bench_card_nonce(card);
+	bench_reader_auth(card, data.nonce, &data.nr, &data.ar, &data.at);
+
+	bench_enter(BENCH_REDUCE);
+	mfkey64(data, key);
+
+	bench_enter(BENCH_BRUTE);
+	return bench_card_auth(card, *key);
+}
+
+// the elite reader attack: a simulated iClass card collects the reader's MACs for a set of
+// CSNs chosen so that every key table byte is brute forced at most two at a time (Carl55)
+#define BENCH_NUM_CSNS	15
+static const uint8_t bench_csns[8 * BENCH_NUM_CSNS] = {
+	0x00, 0x0B, 0x0F, 0xFF, 0xF7, 0xFF, 0x12, 0xE0,
+	0x00, 0x04, 0x0E, 0x08, 0xF7, 0xFF, 0x12, 0xE0,
+	0x00, 0x09, 0x0D, 0x05, 0xF7, 0xFF, 0x12, 0xE0,
+	0x00, 0x0A, 0x0C, 0x06, 0xF7, 0xFF, 0x12, 0xE0,
+	0x00, 0x0F, 0x0B, 0x03, 0xF7, 0xFF, 0x12, 0xE0,
+	0x00, 0x08, 0x0A, 0x0C, 0xF7, 0xFF, 0x12, 0xE0,
+	0x00, 0x0D, 0x09, 0x09, 0xF7, 0xFF, 0x12, 0xE0,
+	0x00, 0x0E, 0x08, 0x0A, 0xF7, 0xFF, 0x12, 0xE0,
+	0x00, 0x03, 0x07, 0x17, 0xF7, 0xFF, 0x12, 0xE0,
+	0x00, 0x3C, 0x06, 0xE0, 0xF7, 0xFF, 0x12, 0xE0,
+	0x00, 0x01, 0x05, 0x1D, 0xF7, 0xFF, 0x12, 0xE0,
+	0x00, 0x02, 0x04, 0x1E, 0xF7, 0xFF, 0x12, 0xE0,
+	0x00, 0x07, 0x03, 0x1B, 0xF7, 0xFF, 0x12, 0xE0,
+	0x00, 0x00, 0x02, 0x24, 0xF7, 0xFF, 0x12, 0xE0,
+	0x00, 0x05, 0x01, 0x21, 0xF7, 0xFF, 0x12, 0xE0
+};
+
+static bool bench_loclass(uint64_t *key) {
+	uint8_t master[8], keytable[128], key_index[8], key_sel[8], key_sel_p[8], div_key[8];
+	uint16_t cracked[128] = {0};
+	dumpdata items[BENCH_NUM_CSNS];
+
+	bench_enter(BENCH_ACQUIRE);
+	num_to_bytes(bench_rand(), 4, master);
+	num_to_bytes(bench_rand(), 4, master + 4);
+	hash2(master, keytable);
+	for (int i = 0; i < BENCH_NUM_CSNS; i++) {
+		memcpy(items[i].csn, bench_csns + i * 8, 8);
+		for (int j = 0; j < sizeof(items[i].cc_nr); j++)
+			items[i].cc_nr[j] = bench_rand();
+		hash1(items[i].csn, key_index);
+		for (int j = 0; j < 8; j++)
+			key_sel[j] = keytable[key_index[j]];
+		permutekey_rev(key_sel, key_sel_p);
+		diversifyKey(items[i].csn, key_sel_p, div_key);
+		doMAC(items[i].cc_nr, div_key, items[i].mac);
+	}
+
+	bench_enter(BENCH_BRUTE);
+	int errors = 0;
+	for (int i = 0; i < BENCH_NUM_CSNS; i++)
+		errors += bruteforceItem(items[i], cracked);
+
+	bench_enter(BENCH_REDUCE);
+	uint8_t first16bytes[16];
+	for (int i = 0; i < 16; i++)
+		first16bytes[i] = cracked[i] & 0xFF;
+	uint64_t master_found = 0;
+	errors += calculateMasterKey(first16bytes, &master_found);
+	*key = bytes_to_num(master, 8);
+	return errors == 0 && memcmp(&master_found, master, 8) == 0;
+}
+
+static bool bench_hardnested(bench_card_t *card, uint64_t *key) {
+	uint8_t trgkey[6];
+	num_to_bytes(card->key, 6, trgkey);
+	bench_cur->phases = false;
+	bench_enter(BENCH_ACQUIRE);
+	// test mode simulates its own nonces (seeded from time(),  so not repeatable) and appends to hardnested_stats.txt
+	*key = 0;
+	return mfnestedhard(0, 0, NULL, 0, 0, trgkey, false, false, false, 1, key, NULL) == 0 && *key == card->key;
+}
+
+static const char *bench_attacks[] = {"nested", "darkside", "mfkey32", "mfkey32m", "mfkey64", "loclass", "hardnested"};
+#define BENCH_ATTACKS	(sizeof(bench_attacks) / sizeof(bench_attacks[0]))
+
+static bool bench_run(int attack, bench_card_t *card, uint64_t *key) {
+	switch (attack) {
+		case 0: return bench_nested(card, key);
+		case 1: return bench_darkside(card, key);
+		case 2: return bench_mfkey32(card, key, false);
+		case 3: return bench_mfkey32(card, key, true);
+		case 4: return bench_mfkey64(card, key);
+		case 5: return bench_loclass(key);
+		case 6: return bench_hardnested(card, key);
+	}
+	return false;
+}
+
+static void bench_print_ms(char *line, size_t len, bench_time_t *t, int phase, uint32_t rounds) {
+	if (!t->phases)
+		snprintf(line + strlen(line), len - strlen(line), " %9s |", "-");
+	else
+		snprintf(line + strlen(line), len - strlen(line), " %9.1f |", t->wall_us[phase] / 1000.0 / rounds);
+}
+
+int CmdAnalyseBench(const char *Cmd) {
+	char attack_name[20] = {0};
+	uint32_t seed = 1, rounds = 1;
+	uint8_t cmdp = 0;
+	int only = -1;
+	bool errors = false;
+
+	while (param_getchar(Cmd, cmdp) != 0x00 && !errors) {
+		switch (tolower(param_getchar(Cmd, cmdp))) {
+		case 'h':
+			return usage_analyse_bench();
+		case 'a':
+			param_getstr(Cmd, cmdp+1, attack_name, sizeof(attack_name));
+			for (int i = 0; i < BENCH_ATTACKS; i++)
+				if (!strcmp(attack_name, bench_attacks[i]))
+					only = i;
+			if (only < 0) {
+				PrintAndLogEx(WARNING, "Unknown attack '%s'", attack_name);
+				errors = true;
+			}
+			cmdp += 2;
+			break;
+		case 's':
+			seed = param_get32ex(Cmd, cmdp+1, 1, 10);
+			cmdp += 2;
+			break;
+		case 'r':
+			rounds = param_get32ex(Cmd, cmdp+1, 1, 10);
+			cmdp += 2;
+			break;
+		default:
+			PrintAndLogEx(WARNING, "Unknown parameter '%c'", param_getchar(Cmd, cmdp));
+			errors = true;
+			break;
+		}
+	}
+	if (errors) return usage_analyse_bench();
+	if (rounds == 0) rounds = 1;
+	if (seed == 0) seed = 1;
+
+	bench_time_t results[BENCH_ATTACKS];
+	uint32_t ok[BENCH_ATTACKS];
+	uint64_t rss[BENCH_ATTACKS];
+	uint64_t max_rss = bench_max_rss();
+	bool rss_per_attack = true;
+	memset(results, 0, sizeof(results));
+	memset(ok, 0, sizeof(ok));
+
+	for (int a = 0; a < BENCH_ATTACKS; a++) {
+		// hardnested takes minutes,  only on request
+		if ((only >= 0 && a != only) || (only < 0 && a == 6))
+			continue;
+
+		results[a].phases = true;
+		if (!bench_reset_peak_rss())
+			rss_per_attack = false;
+		for (uint32_t r = 0; r < rounds; r++) {
+			// every attack sees the same cards for a given seed
+			bench_seed = seed + r;
+			bench_card_t card;
+			bench_new_card(&card);
+
+			bench_time_t run;
+			memset(&run, 0, sizeof(run));
+			run.phases = true;
+			bench_cur = &run;
+			uint64_t key = 0;
+			bool found = bench_run(a, &card, &key);
+			bench_enter(-1);
+			bench_cur = NULL;
+
+			if (found) ok[a]++;
+			if (!run.phases) results[a].phases = false;
+			for (int p = 0; p < BENCH_PHASES; p++) {
+				results[a].wall_us[p] += run.wall_us[p];
+				results[a].cpu_us[p] += run.cpu_us[p];
+			}
+			PrintAndLogEx(INFO, "%s run %u: %s [%012" PRIx64 "]", bench_attacks[a], r + 1, found ? "key found" : _RED_("FAILED"), key);
+		}
+		rss[a] = bench_peak_rss();
+		max_rss = MAX(max_rss, rss[a]);
+	}
+
+	PrintAndLogEx(NORMAL, "");
+	PrintAndLogEx(NORMAL, "seed %u,  %u round%s,  times are ms per run", seed, rounds, rounds > 1 ? "s" : "");
+	PrintAndLogEx(NORMAL, " attack     |  ok   |   acquire |    reduce |     brute |      wall |       cpu | %17s", rss_per_attack ? "peak RSS kB" : "client max RSS kB");
+	PrintAndLogEx(NORMAL, "------------+-------+-----------+-----------+-----------+-----------+-----------+------------------");
+	for (int a = 0; a < BENCH_ATTACKS; a++) {
+		if (!results[a].phases && !results[a].wall_us[0])
+			continue;
+		if (results[a].phases && !results[a].wall_us[0] && !results[a].wall_us[1] && !results[a].wall_us[2])
+			continue;
+
+		uint64_t wall = 0, cpu = 0;
+		for (int p = 0; p < BENCH_PHASES; p++) {
+			wall += results[a].wall_us[p];
+			cpu += results[a].cpu_us[p];
+		}
+		char line[200];
+		snprintf(line, sizeof(line), " %-10s | %2u/%-2u |", bench_attacks[a], ok[a], rounds);
+		bench_print_ms(line, sizeof(line), &results[a], BENCH_ACQUIRE, rounds);
+		bench_print_ms(line, sizeof(line), &results[a], BENCH_REDUCE, rounds);
+		bench_print_ms(line, sizeof(line), &results[a], BENCH_BRUTE, rounds);
+		snprintf(line + strlen(line), sizeof(line) - strlen(line), " %9.1f | %9.1f | %17" PRIu64,
+			wall / 1000.0 / rounds, cpu / 1000.0 / rounds, rss[a]);
+		PrintAndLogEx(NORMAL, "%s", line);
+	}
+	PrintAndLogEx(NORMAL, "");
+	if (!rss_per_attack)
+		PrintAndLogEx(WARNING, "can't reset the peak RSS on this platform,  the RSS column is the client's maximum so far");
+	PrintAndLogEx(NORMAL, "client peak RSS %" PRIu64 " kB", max_rss);
+	PrintAndLogEx(NORMAL, "");
+	return 0;
+}
+
 static command_t CommandTable[] = {
 	{"help",	CmdHelp,            1, "This help"},
 	{"lcr",		CmdAnalyseLCR,		1, "Generate final byte for XOR LRC"},
@@ -891,6 +1387,7 @@ static command_t CommandTable[] = {
 	{"lfsr",	CmdAnalyseLfsr,		1,	"LFSR tests"},
 	{"a",		CmdAnalyseA,		1,	"num bits test"},
 	{"nuid",	CmdAnalyseNuid,		1,	"create NUID from 7byte UID"},
+	{"bench",	CmdAnalyseBench,	1,	"Benchmark key recovery attacks against simulated cards"},
 	{NULL, NULL, 0, NULL}
 };
 
@@ -25,6 +25,14 @@
 #include "loclass/elite_crack.h"
 #include "mfkey.h"  //nonce2key 
 #include "util_posix.h" // msclock
+#include "mifarehost.h"	// nested
+#include "cmdhfmfhard.h"
+#include "parity.h"
+#include "loclass/cipher.h"
+#include "loclass/ikeys.h"
+#if !defined(_WIN32)
+#include <sys/resource.h>	// getrusage
+#endif
 
 
 int usage_analyse_lcr(void);
@@ -32,6 +40,7 @@ int usage_analyse_checksum(void);
 int usage_analyse_crc(void);
 int usage_analyse_hid(void);
 int usage_analyse_nuid(void);
+int usage_analyse_bench(void);
 
 int CmdAnalyse(const char *Cmd);
 int CmdAnalyseLCR(const char *Cmd);
@@ -42,4 +51,5 @@ int CmdAnalyseTEASelfTest(const char *Cmd);
 int CmdAnalyseLfsr(const char *Cmd);
 int CmdAnalyseHid(const char *Cmd);
 int CmdAnalyseNuid(const char *Cmd);
+int CmdAnalyseBench(const char *Cmd);
 #endif
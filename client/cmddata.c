@@ -12,8 +12,6 @@
 uint8_t DemodBuffer[MAX_DEMOD_BUF_LEN];
 //uint8_t g_debugMode = 0;
 size_t DemodBufferLen = 0;
-size_t g_DemodStartIdx = 0;
-int g_DemodClock = 0;
 
 static int CmdHelp(const char *Cmd);
 
@@ -289,51 +287,6 @@ double median_uint8( uint8_t *src, size_t size ) {
     qsort( src, size, sizeof(uint8_t), cmp_uint8);
     return 0.5 * ( src[size/2] + src[(size-1)/2]);
 }
-// function to compute mean for a series
-static double compute_mean(const int *data, size_t n) {
-	double mean = 0.0;
-	for (size_t i=0; i < n; i++)
-		mean += data[i];
-	mean /= n;
-	return mean;
-}
-
-//  function to compute variance for a series
-static double compute_variance(const int *data, size_t n) {
-	double variance = 0.0;
-	double mean = compute_mean(data, n);
-
-	for (size_t i=0; i < n; i++)
-		variance += pow(( data[i] - mean), 2.0);
-
-	variance /= n;	
-	return variance;
-}
-
-// Function to compute autocorrelation for a series
-//  Author: Kenneth J. Christensen
-//  - Corrected divide by n to divide (n - lag) from Tobias Mueller
-/*
-static double compute_autoc(const int *data, size_t n, int lag) {
-	double autocv = 0.0;	// Autocovariance value
-	double ac_value;		// Computed autocorrelation value to be returned
-	double variance; 		// Computed variance
-	double mean;
-	
-	mean = compute_mean(data, n);
-	variance = compute_variance(data, n);
-	
-	for (size_t i=0; i < (n - lag); i++)
-		autocv += (data[i] - mean) * (data[i+lag] - mean);
-
-	autocv = (1.0 / (n - lag)) * autocv;
-
-	// Autocorrelation is autocovariance divided by variance
-	ac_value = autocv / variance;
-	return ac_value;
-}
-*/
-
 // option '1' to save DemodBuffer any other to restore
 void save_restoreDB(uint8_t saveOpt) {
 	static uint8_t SavedDB[MAX_DEMOD_BUF_LEN];
@@ -359,8 +312,11 @@ void save_restoreDB(uint8_t saveOpt) {
 
 int CmdSetDebugMode(const char *Cmd) {
 	int demod = 0;
-	sscanf(Cmd, "%i", &demod);
+	unsigned int rate = 0;
+	sscanf(Cmd, "%i %u", &demod, &rate);
 	g_debugMode = (uint8_t)demod;
+	// limit debug output to <rate> lines per second,  0 = no limit
+	SetLogRateLimit(DEBUG, rate);
 	return 1;
 }
 
@@ -709,59 +665,6 @@ int Cmdaskrawdemod(const char *Cmd)
 	return ASKDemod(Cmd, true, false, 0);
 }
 
-int AutoCorrelate(const int *in, int *out, size_t len, int window, bool SaveGrph, bool verbose) {
-	// sanity check
-	if ( window > len ) window = len;
-	
-	if (verbose) PrintAndLogEx(INFO, "performing %d correlations", GraphTraceLen - window);
-	
-	//test
-	double autocv = 0.0;	// Autocovariance value
-	double ac_value;		// Computed autocorrelation value to be returned
-	double variance; 		// Computed variance
-	double mean;
-	size_t correlation = 0;
-	int lastmax = 0;
-	
-	// in, len, 4000
-	mean = compute_mean(in, len);
-	variance = compute_variance(in, len);
-		
-	static int CorrelBuffer[MAX_GRAPH_TRACE_LEN];
-	
-	for (int i = 0; i < len - window; ++i) {
-
-		for (size_t j=0; j < (len - i); j++) {
-			autocv += (in[j] - mean) * (in[j+i] - mean);
-		}
-		autocv = (1.0 / (len - i)) * autocv;
-
-		CorrelBuffer[i] = autocv;
-		
-		// Autocorrelation is autocovariance divided by variance
-		ac_value = autocv / variance;
-
-		// keep track of which distance is repeating.
-		if ( ac_value > 1) {
-			correlation = i-lastmax;
-			lastmax = i;
-		}
-	}
-
-	if (verbose && ( correlation > 1 ) ) {
-		PrintAndLogEx(SUCCESS, "possible correlation %4d samples", correlation);
-	} else {
-		PrintAndLogEx(FAILED, "no repeating pattern found");
-	}
-	
-	if (SaveGrph){
-		//GraphTraceLen = GraphTraceLen - window;
-		memcpy(out, CorrelBuffer, len * sizeof(int));
-		RepaintGraphWindow();  
-	}
-	return correlation;
-}
-
 int CmdAutoCorr(const char *Cmd) {
 
 	uint32_t window = 4000;
@@ -1271,29 +1174,6 @@ int CmdRawDemod(const char *Cmd)
 	return ans;
 }
 
-void setClockGrid(int clk, int offset) {
-	g_DemodStartIdx = offset;
-	g_DemodClock = clk;
-	PrintAndLogEx(DEBUG, "DEBUG: (setClockGrid) demodoffset %d, clk %d", offset, clk);
-
-	if (offset > clk) offset %= clk;
-	if (offset < 0) offset += clk;
-
-	if (offset > GraphTraceLen || offset < 0) return;
-	if (clk < 8 || clk > GraphTraceLen) {
-		GridLocked = false;
-		GridOffset = 0;
-		PlotGridX = 0;
-		PlotGridXdefault = 0;
-		RepaintGraphWindow();
-	} else {
-		GridLocked = true;
-		GridOffset = offset;
-		PlotGridX = clk;
-		PlotGridXdefault = clk;
-		RepaintGraphWindow();
-	}
-}
 
 int CmdGrid(const char *Cmd)
 {
@@ -2048,7 +1928,7 @@ static command_t CommandTable[] =
 	{"save",            CmdSave,            1, "<filename> -- Save trace (from graph window)"},
 	{"setgraphmarkers", CmdSetGraphMarkers, 1, "[orange_marker] [blue_marker] (in graph window)"},
 	{"scale",           CmdScale,           1, "<int> -- Set cursor display scale"},
-	{"setdebugmode",    CmdSetDebugMode,    1, "<0|1|2> -- Turn on or off Debugging Level for lf demods"},
+	{"setdebugmode",    CmdSetDebugMode,    1, "<0|1|2> [rate] -- Turn on or off Debugging Level for lf demods, limit debug output to [rate] lines/s"},
 	{"shiftgraphzero",  CmdGraphShiftZero,  1, "<shift> -- Shift 0 for Graphed wave + or - shift value"},
 	{"dirthreshold",    CmdDirectionalThreshold,   1, "<thres up> <thres down> -- Max rising higher up-thres/ Min falling lower down-thres, keep rest as prev."},
 	{"tune",            CmdTuneSamples,     0, "Get hw tune samples for graph window"},
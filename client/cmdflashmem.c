@@ -30,6 +30,8 @@ int usage_flashmem_load(void){
 	PrintAndLogEx(NORMAL, "  o <offset>    :      offset in memory");
 	PrintAndLogEx(NORMAL, "  f <filename>  :      file name");
 	PrintAndLogEx(NORMAL, "");
+	PrintAndLogEx(NORMAL, "Block 1 and 2 (0x%05X - 0x%05X) are reserved for 'trace spill'.", FLASH_MEM_TRACE_OFFSET, FLASH_MEM_TRACE_OFFSET + FLASH_MEM_TRACE_SIZE - 1);
+	PrintAndLogEx(NORMAL, "");
 	PrintAndLogEx(NORMAL, "Examples:");
 	PrintAndLogEx(NORMAL, "        mem load f myfile");			// upload file myfile at default offset 0
 	PrintAndLogEx(NORMAL, "        mem load f myfile o 1024");	// upload file myfile at offset 1024
@@ -63,7 +65,7 @@ int usage_flashmem_wipe(void){
 	return 0;
 }
 int usage_flashmem_info(void){
-	PrintAndLogEx(NORMAL, "Collect signature and verify it from flash memory\n");
+	PrintAndLogEx(NORMAL, "Collect signature and verify it from flash memory,  and show the flash throughput\n");
 	PrintAndLogEx(NORMAL, " Usage:  mem info [h|s|w]");
 	PrintAndLogEx(NORMAL, "  s    :      create a signature");
 	PrintAndLogEx(NORMAL, "  w    :      write signature to flash memory");
@@ -181,6 +183,19 @@ int CmdFlashMemLoad(const char *Cmd){
 	size_t bytes_read = fread(dump, 1, fsize, f);
 	if (f)
 		fclose(f);
+
+	if (start_index + bytes_read > FLASH_MEM_MAX_SIZE) {
+		PrintAndLogDevice(WARNING, "error, offset + filesize is larger than available memory");
+		free(dump);
+		return 1;
+	}
+
+	// the trace spill area is overwritten by sniffs
+	if (start_index < FLASH_MEM_TRACE_OFFSET + FLASH_MEM_TRACE_SIZE && start_index + bytes_read > FLASH_MEM_TRACE_OFFSET) {
+		PrintAndLogEx(FAILED, "error, 0x%05X - 0x%05X is reserved for 'trace spill'", FLASH_MEM_TRACE_OFFSET, FLASH_MEM_TRACE_OFFSET + FLASH_MEM_TRACE_SIZE - 1);
+		free(dump);
+		return 1;
+	}
 	
 	//Send to device
 	uint32_t bytes_sent = 0;
@@ -377,6 +392,15 @@ int CmdFlashMemInfo(const char *Cmd){
 	PrintAndLogEx(INFO, "RSA SIGNATURE |");
 	print_hex_break( mem.signature, sizeof(mem.signature), 32);
 
+	// throughput,  a timed read on the device and its page writes since power on
+	uint32_t rd_speed = resp.arg[1], wr_speed = resp.arg[2];
+	if (rd_speed)
+		PrintAndLogEx(INFO, "Read speed    | %u kB/s", rd_speed / 1024);
+	if (wr_speed)
+		PrintAndLogEx(INFO, "Write speed   | %u kB/s  (program + verify)", wr_speed / 1024);
+	else
+		PrintAndLogEx(INFO, "Write speed   | no writes since power on");
+
 //-------------------------------------------------------------------------------	
 // Example RSA-1024 keypair, for test purposes  (from common/polarssl/rsa.c)
 //  
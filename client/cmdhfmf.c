@@ -2070,9 +2070,9 @@ int CmdHF14AMfSniff(const char *Cmd){
 	uint8_t atqa[2] = {0x00, 0x00};
 	bool isTag = false;
 	uint8_t *buf = NULL;
-	uint16_t bufsize = 0;
+	uint32_t bufsize = 0;
 	uint8_t *bufPtr = NULL;
-	uint16_t traceLen = 0;
+	uint32_t traceLen = 0;
 	
 	memset(uid, 0x00, sizeof(uid));
 	
@@ -68,5 +68,7 @@ extern int CmdHf14AMfNack(const char *Cmd);
 void showSectorTable(void);
 void readerAttack(nonces_t data, bool setEmulatorMem, bool verbose);
 void printKeyTable( uint8_t sectorscnt, sector_t *e_sector );
+char * GenerateFilename(const char *prefix, const char *suffix);
+uint8_t NumOfSectors(char card);
 void printKeyTable_fast( uint8_t sectorscnt, icesector_t *e_sector, uint64_t bar, uint64_t foo );
 #endif
@@ -18,6 +18,7 @@
 #include "cmdhw.h"
 #include "cmdmain.h"
 #include "cmddata.h"
+#include "util.h"
 
 /* low-level hardware control */
 
@@ -291,6 +292,120 @@ int CmdStatus(const char *Cmd) {
 	return 0;
 }
 
+// command names,  generated from usb_cmd.h
+static const struct {
+	uint16_t id;
+	const char *name;
+} usb_cmd_names[] = {
+#include "usb_cmd_names.h"
+};
+
+static const char *prof_fn_names[PROF_FUNCTIONS] = {
+	"LogTrace", "MillerDecoding", "ManchesterDecoding", "chkKey"
+};
+
+static const char *prof_name(uint16_t id) {
+	static char buf[20];
+	if (id >= PROF_ID_FN && id < PROF_ID_FN + PROF_FUNCTIONS)
+		return prof_fn_names[id - PROF_ID_FN];
+	if (id == PROF_ID_OTHER)
+		return "(other commands)";
+	for (size_t i = 0; i < sizeof(usb_cmd_names) / sizeof(usb_cmd_names[0]); i++)
+		if (usb_cmd_names[i].id == id)
+			return usb_cmd_names[i].name;
+	snprintf(buf, sizeof(buf), "0x%04x", id);
+	return buf;
+}
+
+static int prof_cmp(const void *a, const void *b) {
+	const prof_entry_t *pa = a, *pb = b;
+	return (pa->ticks < pb->ticks) - (pa->ticks > pb->ticks);
+}
+
+static void prof_print(prof_entry_t *e, int n) {
+	qsort(e, n, sizeof(prof_entry_t), prof_cmp);
+	for (int i = 0; i < n; i++) {
+		if (e[i].calls == 0)
+			continue;
+		PrintAndLogEx(NORMAL, " %-36s | %9u | %11.1f | %12" PRIu64 " | %12" PRIu64,
+			prof_name(e[i].id),
+			e[i].calls,
+			(double)e[i].ticks / PROF_TICKS_PER_MS,
+			e[i].ticks * PROF_CYCLES_PER_TICK / e[i].calls,
+			(uint64_t)e[i].max * PROF_CYCLES_PER_TICK
+			);
+	}
+}
+
+int usage_hw_profile(void) {
+	PrintAndLogEx(NORMAL, "Download and print the device's per command and per hot function timing.");
+	PrintAndLogEx(NORMAL, "Command times include the functions they call,  cycles are 48MHz MCK cycles.");
+	PrintAndLogEx(NORMAL, "Needs a firmware built with -DWITH_PROFILE (armsrc/Makefile),  it is off by default.");
+	PrintAndLogEx(NORMAL, "");
+	PrintAndLogEx(NORMAL, "Usage:  hw profile [h] [r]");
+	PrintAndLogEx(NORMAL, "Options:");
+	PrintAndLogEx(NORMAL, "       h     this help");
+	PrintAndLogEx(NORMAL, "       r     reset the counters after printing them");
+	PrintAndLogEx(NORMAL, "");
+	PrintAndLogEx(NORMAL, "Examples:");
+	PrintAndLogEx(NORMAL, "       hw profile r");
+	PrintAndLogEx(NORMAL, "       hf mf fchk 1 default_keys.dic");
+	PrintAndLogEx(NORMAL, "       hw profile");
+	return 0;
+}
+
+int CmdProfile(const char *Cmd) {
+	prof_entry_t table[PROF_ENTRIES];
+	uint32_t got = 0;
+	bool reset = false;
+	char ctmp = tolower(param_getchar(Cmd, 0));
+
+	if (ctmp == 'h') return usage_hw_profile();
+	if (ctmp == 'r') reset = true;
+
+	memset(table, 0, sizeof(table));
+	while (got < PROF_ENTRIES) {
+		UsbCommand resp, c = {CMD_PROFILE, {0, got, 0}};
+		clearCommandBuffer();
+		SendCommand(&c);
+		if (!WaitForResponseTimeout(CMD_ACK, &resp, 2000)) {
+			PrintAndLogEx(WARNING, "command execution time out,  firmware without profiling support?");
+			return 1;
+		}
+		uint32_t n = MIN(resp.arg[0], PROF_ENTRIES - got);
+		if (n == 0 && got == 0) {
+			PrintAndLogEx(WARNING, "firmware built without profiling,  add -DWITH_PROFILE to armsrc/Makefile");
+			return 1;
+		}
+		if (n == 0 || resp.arg[1] != got)
+			break;
+		memcpy(table + got, resp.d.asBytes, n * sizeof(prof_entry_t));
+		got += n;
+	}
+
+	PrintAndLogEx(NORMAL, "");
+	PrintAndLogEx(NORMAL, " command                              |     calls |    total ms |   avg cycles |   max cycles");
+	PrintAndLogEx(NORMAL, "--------------------------------------+-----------+-------------+--------------+-------------");
+	prof_print(table + PROF_FUNCTIONS, got > PROF_FUNCTIONS ? got - PROF_FUNCTIONS : 0);
+	PrintAndLogEx(NORMAL, "");
+	PrintAndLogEx(NORMAL, " function                             |     calls |    total ms |   avg cycles |   max cycles");
+	PrintAndLogEx(NORMAL, "--------------------------------------+-----------+-------------+--------------+-------------");
+	prof_print(table, MIN(got, PROF_FUNCTIONS));
+	PrintAndLogEx(NORMAL, "");
+
+	if (reset) {
+		UsbCommand c = {CMD_PROFILE, {1, 0, 0}};
+		clearCommandBuffer();
+		SendCommand(&c);
+		if (!WaitForResponseTimeout(CMD_ACK, NULL, 2000)) {
+			PrintAndLogEx(WARNING, "command execution time out");
+			return 1;
+		}
+		PrintAndLogEx(SUCCESS, "profile counters cleared");
+	}
+	return 0;
+}
+
 int CmdPing(const char *Cmd) {
 	clearCommandBuffer();
 	UsbCommand resp;
@@ -319,6 +434,7 @@ static command_t CommandTable[] = {
 	{"version",       CmdVersion,     0, "Show version information about the connected Proxmark"},
 	{"status",        CmdStatus,      0, "Show runtime status information about the connected Proxmark"},
 	{"ping",          CmdPing,        0, "Test if the pm3 is responsive"},
+	{"profile",       CmdProfile,     0, "[r] -- Show (and reset) the device's per command / per function timing"},
 	{NULL, NULL, 0, NULL}
 };
 
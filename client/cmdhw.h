@@ -24,4 +24,5 @@ int CmdSetMux(const char *Cmd);
 int CmdTune(const char *Cmd);
 int CmdVersion(const char *Cmd);
 int CmdPing(const char *Cmd);
+int CmdProfile(const char *Cmd);
 #endif
@@ -50,6 +50,41 @@ int usage_lf_snoop(void) {
 	PrintAndLogEx(NORMAL, "Use 'lf config' to set parameters.");
 	return 0;
 }
+int usage_lf_stream(void) {
+	PrintAndLogEx(NORMAL, "Sample continuously,  streaming the samples to the client instead of filling device memory.");
+	PrintAndLogEx(NORMAL, "Samples are packed as set with 'lf config'.  Stop with the button or any key.");
+	PrintAndLogEx(NORMAL, "With a trigger threshold set ('lf config t') it waits for the first sample above it without a timeout.");
+	PrintAndLogEx(NORMAL, "Usage: lf stream [h] [s] [n <samples>] [f <filename>] [d <demod>] [w <window>]");
+	PrintAndLogEx(NORMAL, "Options:");
+	PrintAndLogEx(NORMAL, "       h             This help");
+	PrintAndLogEx(NORMAL, "       s             snoop,  field off");
+	PrintAndLogEx(NORMAL, "       n <samples>   stop after this many samples (default: until stopped)");
+	PrintAndLogEx(NORMAL, "       f <filename>  write the samples to a trace file,  as 'data save' does");
+	PrintAndLogEx(NORMAL, "       d <demod>     demodulate while streaming: search, em, hid, io, awid, indala, fdx");
+	PrintAndLogEx(NORMAL, "       w <window>    samples per demod window,  windows overlap by half (default 30000)");
+	PrintAndLogEx(NORMAL, "The last window is left in the graph buffer.");
+	PrintAndLogEx(NORMAL, "");
+	PrintAndLogEx(NORMAL, "Examples:");
+	PrintAndLogEx(NORMAL, "         lf stream d em");
+	PrintAndLogEx(NORMAL, "         lf stream s f long_snoop.pm3");
+	return 0;
+}
+int usage_lf_watch(void) {
+	PrintAndLogEx(NORMAL, "Watch for tags,  the device samples and demodulates in a loop and only sends the ids read.");
+	PrintAndLogEx(NORMAL, "By default an id is shown when it differs from the last one of its protocol.  Stop with the button or any key.");
+	PrintAndLogEx(NORMAL, "Usage: lf watch [h] [H] [p <protocol>] ... [1] [a]");
+	PrintAndLogEx(NORMAL, "Options:");
+	PrintAndLogEx(NORMAL, "       h             This help");
+	PrintAndLogEx(NORMAL, "       H             134 kHz (default 125 kHz)");
+	PrintAndLogEx(NORMAL, "       p <protocol>  em, hid, io, awid,  can be repeated (default: all)");
+	PrintAndLogEx(NORMAL, "       1             stop at the first id");
+	PrintAndLogEx(NORMAL, "       a             show every read");
+	PrintAndLogEx(NORMAL, "");
+	PrintAndLogEx(NORMAL, "Examples:");
+	PrintAndLogEx(NORMAL, "         lf watch");
+	PrintAndLogEx(NORMAL, "         lf watch p hid p io");
+	return 0;
+}
 int usage_lf_config(void) {
 	PrintAndLogEx(NORMAL, "Usage: lf config [h] [H|<divisor>] [b <bps>] [d <decim>] [a 0|1]");
 	PrintAndLogEx(NORMAL, "Options:");
@@ -388,6 +423,414 @@ int CmdLFSnoop(const char *Cmd) {
 	return 0;
 }
 
+// 'lf stream'.  Packets are queued by the usb receiver thread,  the command drains the queue.
+// One stream at a time,  frames from other devices than the streaming one are ignored
+typedef struct {
+	pthread_mutex_t lock;
+	pm3_device *dev;		// device streaming,  NULL if none
+	uint8_t *buf;
+	uint32_t len;
+	uint32_t size;
+	uint32_t packets;		// next expected sequence number
+	uint32_t lost;			// packets missing in the sequence
+	uint32_t dropped;		// samples dropped on device,  as last reported
+	bool done;
+	lf_stream_stats_t stats;
+} lf_stream_queue_t;
+static lf_stream_queue_t lfStream = { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0, 0, 0, 0, 0, false, {0, 0, 0, 0, 0, 0} };
+
+// called from the receiver thread of the device that sent it
+void LFStreamReceived(UsbCommand *c) {
+	pthread_mutex_lock(&lfStream.lock);
+	if (CurrentDevice() != lfStream.dev) {
+		pthread_mutex_unlock(&lfStream.lock);
+		return;
+	}
+	if (c->cmd == CMD_LF_STREAM_END) {
+		memcpy(&lfStream.stats, c->d.asBytes, sizeof(lf_stream_stats_t));
+		lfStream.done = true;
+	} else {
+		uint32_t n = MIN(c->arg[0], USB_CMD_DATA_SIZE);
+		if (c->arg[1] != lfStream.packets)
+			lfStream.lost += c->arg[1] - lfStream.packets;
+		lfStream.packets = c->arg[1] + 1;
+		lfStream.dropped = c->arg[2];
+
+		if (lfStream.len + n > lfStream.size) {
+			uint32_t size = MAX(lfStream.size * 2, 64 * USB_CMD_DATA_SIZE);
+			uint8_t *buf = realloc(lfStream.buf, size);
+			if (buf) {
+				lfStream.buf = buf;
+				lfStream.size = size;
+			}
+		}
+		if (lfStream.len + n <= lfStream.size) {
+			memcpy(lfStream.buf + lfStream.len, c->d.asBytes, n);
+			lfStream.len += n;
+		} else {
+			lfStream.lost++;
+		}
+	}
+	pthread_mutex_unlock(&lfStream.lock);
+}
+
+static void lfStreamRelease(void) {
+	pthread_mutex_lock(&lfStream.lock);
+	lfStream.dev = NULL;
+	pthread_mutex_unlock(&lfStream.lock);
+}
+
+typedef struct {
+	const char *name;
+	int (*demod)(const char *Cmd);
+	const char *args;
+} lf_stream_demod_t;
+
+static lf_stream_demod_t lfStreamDemods[] = {
+	{"search",	CmdLFfind,			"1"},
+	{"em",		CmdEM410xDemod,		""},
+	{"hid",		CmdHIDDemod,		""},
+	{"io",		CmdIOProxDemod,		""},
+	{"awid",	CmdAWIDDemod,		""},
+	{"indala",	CmdIndalaDemod,		""},
+	{"fdx",		CmdFdxDemod,		""},
+	{NULL, NULL, NULL}
+};
+
+// window ring,  oldest sample first,  into the graph buffer
+static void streamWindowToGraph(int *window, uint32_t size, uint32_t total) {
+	uint32_t n = MIN(total, size);
+	uint32_t start = (total > size) ? total % size : 0;
+	for (uint32_t i = 0; i < n; i++)
+		GraphBuffer[i] = window[(start + i) % size];
+	GraphTraceLen = n;
+}
+
+int CmdLFStream(const char *Cmd) {
+	bool errors = false, snoop = false;
+	uint32_t samples = 0, winsize = 30000;
+	char filename[FILE_PATH_SIZE] = {0};
+	char demodname[10] = {0};
+	lf_stream_demod_t *demod = NULL;
+	uint8_t cmdp = 0;
+	while (param_getchar(Cmd, cmdp) != 0x00 && !errors) {
+		switch (tolower(param_getchar(Cmd, cmdp))) {
+		case 'h':
+			return usage_lf_stream();
+		case 's':
+			snoop = true;
+			cmdp++;
+			break;
+		case 'n':
+			samples = param_get32ex(Cmd, cmdp+1, 0, 10);
+			cmdp += 2;
+			break;
+		case 'f':
+			if (param_getstr(Cmd, cmdp+1, filename, sizeof(filename)) == 0)
+				errors = true;
+			cmdp += 2;
+			break;
+		case 'd':
+			param_getstr(Cmd, cmdp+1, demodname, sizeof(demodname));
+			for (demod = lfStreamDemods; demod->name; demod++)
+				if (strcmp(demodname, demod->name) == 0)
+					break;
+			if (demod->name == NULL)
+				errors = true;
+			cmdp += 2;
+			break;
+		case 'w':
+			winsize = param_get32ex(Cmd, cmdp+1, 0, 10);
+			if (winsize < 1000 || winsize > MAX_GRAPH_TRACE_LEN)
+				errors = true;
+			cmdp += 2;
+			break;
+		default:
+			PrintAndLogEx(WARNING, "Unknown parameter '%c'", param_getchar(Cmd, cmdp));
+			errors = true;
+			break;
+		}
+	}
+	if (errors) return usage_lf_stream();
+
+	FILE *f = NULL;
+	if (filename[0]) {
+		f = fopen(filename, "w");
+		if (!f) {
+			PrintAndLogEx(FAILED, "Could not create file %s", filename);
+			return 1;
+		}
+	}
+	int *window = calloc(winsize, sizeof(int));
+	if (!window) {
+		PrintAndLogEx(FAILED, "Cannot allocate memory for samples");
+		if (f) fclose(f);
+		return 2;
+	}
+
+	pthread_mutex_lock(&lfStream.lock);
+	if (lfStream.dev) {
+		pthread_mutex_unlock(&lfStream.lock);
+		PrintAndLogEx(WARNING, "device %d is streaming already", lfStream.dev->id);
+		free(window);
+		if (f) fclose(f);
+		return 1;
+	}
+	lfStream.dev = CurrentDevice();
+	lfStream.len = lfStream.packets = lfStream.lost = lfStream.dropped = 0;
+	lfStream.done = false;
+	pthread_mutex_unlock(&lfStream.lock);
+
+	UsbCommand resp;
+	UsbCommand c = {CMD_LF_STREAM, {1, !snoop, samples}};
+	clearCommandBuffer();
+	SendCommand(&c);
+	if (!WaitForResponseTimeout(CMD_ACK, &resp, 2500) || resp.arg[0] == 0) {
+		PrintAndLogEx(WARNING, "command execution time out");
+		lfStreamRelease();
+		free(window);
+		if (f) fclose(f);
+		return 1;
+	}
+	sample_config sc;
+	memcpy(&sc, resp.d.asBytes, sizeof(sample_config));
+	uint8_t bps = sc.bits_per_sample;
+	if (bps < 1 || bps > 8) bps = 8;
+	PrintAndLogEx(INFO, "streaming @ %d bits/smpl, decimation 1:%d, press a key to stop", bps, sc.decimation);
+
+	uint8_t *buf = NULL;
+	uint32_t bufsize = 0, total = 0, sinceDemod = 0, hits = 0, windows = 0, dropped = 0;
+	uint32_t acc = 0, accbits = 0;
+	uint64_t start = msclock(), last = start;
+	bool done = false, stopping = false;
+
+	while (!done) {
+		if (!stopping && ukbhit()) {
+			int gc = getchar(); (void)gc;
+			UsbCommand stop = {CMD_LF_STREAM, {0, 0, 0}};
+			SendCommand(&stop);
+			stopping = true;
+			last = msclock();
+		}
+
+		// take what the receiver thread queued
+		pthread_mutex_lock(&lfStream.lock);
+		uint32_t len = lfStream.len;
+		if (len > bufsize) {
+			uint8_t *tmp = realloc(buf, lfStream.size);
+			if (tmp) {
+				buf = tmp;
+				bufsize = lfStream.size;
+			}
+		}
+		len = MIN(len, bufsize);
+		if (len)
+			memcpy(buf, lfStream.buf, len);
+		lfStream.len = 0;
+		done = lfStream.done;
+		uint32_t devdropped = lfStream.dropped;
+		pthread_mutex_unlock(&lfStream.lock);
+
+		if (devdropped > dropped) {
+			PrintAndLogEx(WARNING, "%u samples dropped on device, USB fell behind", devdropped - dropped);
+			dropped = devdropped;
+		}
+
+		if (len == 0 && !done) {
+			// an armed trigger sends nothing until a tag shows up,  that may take a while
+			bool armed = (sc.trigger_threshold > 0 && total == 0);
+			if (stopping && msclock() - last > 3000) {
+				PrintAndLogEx(WARNING, "no end of stream from device");
+				break;
+			}
+			if (!stopping && !armed && msclock() - last > 3000) {
+				PrintAndLogEx(WARNING, "no samples from device, stopping");
+				UsbCommand stop = {CMD_LF_STREAM, {0, 0, 0}};
+				SendCommand(&stop);
+				stopping = true;
+				last = msclock();
+			}
+			msleep(10);
+			continue;
+		}
+		last = msclock();
+
+		// unpack,  MSB first.  The padding of the last byte isn't a sample
+		for (uint32_t i = 0; i < len; i++) {
+			acc = (acc << 8) | buf[i];
+			accbits += 8;
+			while (accbits >= bps) {
+				if (done && total >= lfStream.stats.saved)
+					break;
+				accbits -= bps;
+				int sample = (int)(((acc >> accbits) & ((1 << bps) - 1)) << (8 - bps)) - 128;
+				if (f) fprintf(f, "%d\n", sample);
+				window[total % winsize] = sample;
+				total++;
+
+				if (demod && total >= winsize && ++sinceDemod >= winsize / 2) {
+					sinceDemod = 0;
+					windows++;
+					streamWindowToGraph(window, winsize, total);
+					if (demod->demod(demod->args) > 0)
+						hits++;
+				}
+			}
+		}
+	}
+
+	uint64_t ms = MAX(msclock() - start, 1);
+	lfStreamRelease();
+	free(buf);
+	if (f) fclose(f);
+
+	streamWindowToGraph(window, winsize, total);
+	free(window);
+	setClockGrid(0, 0);
+	DemodBufferLen = 0;
+	RepaintGraphWindow();
+
+	PrintAndLogEx(SUCCESS, "%u samples in %u ms, %u samples/s", total, (uint32_t)ms, (uint32_t)(total * 1000 / ms));
+	if (done) {
+		lf_stream_stats_t *st = &lfStream.stats;
+		PrintAndLogEx(INFO, "device: %u samples taken, %u kept, %u bytes sent", st->seen, st->saved, st->sent);
+		if (st->dropped || st->overruns)
+			PrintAndLogEx(WARNING, "device: %u samples dropped, %u DMA overruns, %u samples lost to them", st->dropped, st->overruns, st->lost);
+	}
+	if (lfStream.lost)
+		PrintAndLogEx(WARNING, "%u packets lost", lfStream.lost);
+	if (demod)
+		PrintAndLogEx(INFO, "%u windows demodulated, %u with a valid ID", windows, hits);
+	if (f)
+		PrintAndLogEx(SUCCESS, "saved to %s", filename);
+	return 0;
+}
+
+static const char *lfWatchNames[LF_WATCH_PROTOCOLS] = { "em", "hid", "io", "awid" };
+
+static void lfWatchPrint(const lf_watch_id_t *id, uint64_t ms) {
+	char when[20], reads[16] = {0};
+	snprintf(when, sizeof(when), "%4u.%01us", (uint32_t)(ms / 1000), (uint32_t)(ms % 1000) / 100);
+	if (id->reads > 1)
+		snprintf(reads, sizeof(reads), "  x%u", id->reads);
+
+	switch (id->protocol) {
+	case LF_WATCH_EM410X:
+		if (id->bits == 88)
+			PrintAndLogEx(SUCCESS, "%s  EM410x XL  %06x%08x%08x%s", when, id->raw[0], id->raw[1], id->raw[2], reads);
+		else
+			PrintAndLogEx(SUCCESS, "%s  EM410x     %02x%08x%s", when, id->raw[1], id->raw[2], reads);
+		break;
+	case LF_WATCH_HID:
+		if (id->raw[0] || id->bits == 0)
+			PrintAndLogEx(SUCCESS, "%s  HID Prox   %x%08x%08x%s", when, id->raw[0], id->raw[1], id->raw[2], reads);
+		else
+			PrintAndLogEx(SUCCESS, "%s  HID Prox   %x%08x  %u bit, FC %u, card %u%s", when, id->raw[1], id->raw[2], id->bits, id->fc, id->card, reads);
+		break;
+	case LF_WATCH_IOPROX: {
+		// version is bits 27..34 of the raw 64 bits
+		uint64_t raw = ((uint64_t)id->raw[1] << 32) | id->raw[2];
+		PrintAndLogEx(SUCCESS, "%s  IO Prox    XSF(%02u)%02x:%05u  (%08x%08x)%s", when, (uint8_t)(raw >> 29), id->fc, id->card, id->raw[1], id->raw[2], reads);
+		break;
+	}
+	case LF_WATCH_AWID:
+		PrintAndLogEx(SUCCESS, "%s  AWID       %u bit, FC %u, card %u  (%08x%08x%08x)%s", when, id->bits, id->fc, id->card, id->raw[0], id->raw[1], id->raw[2], reads);
+		break;
+	}
+}
+
+// Runs the watch loop on the device until a key or the button is pressed or,  with
+// LF_WATCH_FINDONE,  the first id is read.  The last id read is returned in found.
+bool lf_watch(uint8_t protocols, uint8_t flags, int divisor, lf_watch_id_t *found) {
+	UsbCommand c = {CMD_LF_WATCH, {protocols, flags, divisor}};
+	UsbCommand resp;
+	bool got = false;
+	uint64_t start = msclock(), stopped = 0;
+
+	clearCommandBuffer();
+	SendCommand(&c);
+
+	while (true) {
+		if (!stopped && ukbhit()) {
+			int gc = getchar(); (void)gc;
+			PrintAndLogEx(NORMAL, "\naborted via keyboard!\n");
+			UsbCommand stop = {CMD_LF_WATCH, {0, 0, 0}};
+			SendCommand(&stop);
+			stopped = msclock();
+		}
+		if (!WaitForResponseTimeoutW(CMD_UNKNOWN, &resp, 100, false)) {
+			if (stopped && msclock() - stopped > 2000) {
+				PrintAndLogEx(WARNING, "no answer from device");
+				break;
+			}
+			continue;
+		}
+		if (resp.cmd == CMD_LF_WATCH_ID) {
+			lf_watch_id_t *id = (lf_watch_id_t *)resp.d.asBytes;
+			lfWatchPrint(id, msclock() - start);
+			if (found) *found = *id;
+			got = true;
+		} else if (resp.cmd == CMD_LF_WATCH_END) {
+			PrintAndLogEx(INFO, "%u acquisitions in %u ms, %u reads, %u shown",
+				(uint32_t)resp.arg[0], (uint32_t)(msclock() - start), (uint32_t)resp.arg[1], (uint32_t)resp.arg[2]);
+			break;
+		}
+	}
+	return got;
+}
+
+int CmdLFWatch(const char *Cmd) {
+	bool errors = false;
+	uint8_t protocols = 0, flags = 0;
+	int divisor = 95;
+	char name[10];
+	uint8_t cmdp = 0;
+	while (param_getchar(Cmd, cmdp) != 0x00 && !errors) {
+		switch (param_getchar(Cmd, cmdp)) {
+		case 'h':
+			return usage_lf_watch();
+		case 'H':
+			divisor = 88;
+			cmdp++;
+			break;
+		case 'p':
+		case 'P': {
+			int i = 0;
+			memset(name, 0, sizeof(name));
+			param_getstr(Cmd, cmdp+1, name, sizeof(name));
+			while (i < LF_WATCH_PROTOCOLS && strcmp(name, lfWatchNames[i]) != 0)
+				i++;
+			if (i == LF_WATCH_PROTOCOLS)
+				errors = true;
+			else
+				protocols |= 1 << i;
+			cmdp += 2;
+			break;
+		}
+		case '1':
+			flags |= LF_WATCH_FINDONE;
+			cmdp++;
+			break;
+		case 'a':
+		case 'A':
+			flags |= LF_WATCH_EVERY_READ;
+			cmdp++;
+			break;
+		default:
+			PrintAndLogEx(WARNING, "Unknown parameter '%c'", param_getchar(Cmd, cmdp));
+			errors = true;
+			break;
+		}
+	}
+	if (errors) return usage_lf_watch();
+	if (protocols == 0)
+		protocols = LF_WATCH_ALL;
+
+	PrintAndLogEx(INFO, "watching,  press a key or the button to stop");
+	lf_watch(protocols, flags, divisor, NULL);
+	return 0;
+}
+
 static void ChkBitstream(const char *str) {
 	// convert to bitstream if necessary
 	for (int i = 0; i < (int)(GraphTraceLen / 2); i++){
@@ -979,6 +1422,8 @@ static command_t CommandTable[] = {
 	{"simpsk",      CmdLFpskSim,        0, "[1|2|3] [c <clock>] [i] [r <carrier>] [d <raw hex to sim>] \n\t\t-- Simulate LF PSK tag from demodbuffer or input"},
 	{"simbidir",    CmdLFSimBidir,      0, "Simulate LF tag (with bidirectional data transmission between reader and tag)"},
 	{"snoop",       CmdLFSnoop,         0, "Snoop LF"},
+	{"stream",      CmdLFStream,        0, "Sample continuously, streaming to the client"},
+	{"watch",       CmdLFWatch,         0, "Watch for tags, demodulating on the device"},
 	{"vchdemod",    CmdVchDemod,        1, "['clone'] -- Demodulate samples for VeriChip"},
 	{NULL, NULL, 0, NULL}
 };
@@ -65,15 +65,21 @@ extern int CmdLFfskSim(const char *Cmd);
 extern int CmdLFpskSim(const char *Cmd);
 extern int CmdLFSimBidir(const char *Cmd);
 extern int CmdLFSnoop(const char *Cmd);
+extern int CmdLFStream(const char *Cmd);
+extern void LFStreamReceived(UsbCommand *c);
+extern int CmdLFWatch(const char *Cmd);
 extern int CmdVchDemod(const char *Cmd);
 extern int CmdLFfind(const char *Cmd);
 
 extern bool lf_read(bool silent, uint32_t samples);
+extern bool lf_watch(uint8_t protocols, uint8_t flags, int divisor, lf_watch_id_t *found);
 
 // usages helptext
 extern int usage_lf_cmdread(void);
 extern int usage_lf_read(void);
 extern int usage_lf_snoop(void);
+extern int usage_lf_stream(void);
+extern int usage_lf_watch(void);
 extern int usage_lf_config(void);
 extern int usage_lf_simfsk(void);
 extern int usage_lf_simask(void);
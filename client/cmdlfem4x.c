@@ -567,27 +567,28 @@ int CmdEM410xBrute(const char *Cmd) {
 	return 0;
 }
 
-/* Function is equivalent of lf read + data samples + em410xread
- * looped until an EM410x tag is detected 
- * 
- * Why is CmdSamples("16000")?
- *  TBD: Auto-grow sample size based on detected sample rate.  IE: If the
- *       rate gets lower, then grow the number of samples
- *  Changed by martin, 4000 x 4 = 16000, 
- *  see http://www.proxmark.org/forum/viewtopic.php?pid=7235#p7235
- *
- *  EDIT -- capture enough to get 2 complete preambles at the slowest data rate known to be used (rf/64) (64*64*2+9 = 8201)	marshmellow
+/* Watches for an EM410x tag until one is read,  the device samples and demodulates
+ * in a loop (see 'lf watch') instead of sending each acquisition to the client.
+ * Keeps watching if the captured ID was in XL-format.
+ * Option 'h' for 134 kHz.
 */
-int CmdEM410xWatch(const char *Cmd) {
+// watch until a 40 bit EM410x id is read into g_em410xid,  false if aborted
+static bool em410x_watch(const char *Cmd) {
+	char cmdp = param_getchar(Cmd, 0);
+	int divisor = (cmdp == 'h' || cmdp == 'H') ? 88 : 95;
+	lf_watch_id_t id;
 	do {
-		if (ukbhit()) {
-			int gc = getchar(); (void)gc;
-			PrintAndLogEx(NORMAL, "\naborted via keyboard!\n");
-			break;
-		}		
-		lf_read(true, 8201);
-		
-	} while (!CmdEM410xRead(""));
+		if (!lf_watch(LF_WATCH_EM410X, LF_WATCH_FINDONE, divisor, &id))
+			return false;
+
+		g_em410xid = ((uint64_t)id.raw[1] << 32) | id.raw[2];
+		printEM410x(id.raw[0], g_em410xid);
+	} while (id.bits != 40);
+	return true;
+}
+
+int CmdEM410xWatch(const char *Cmd) {
+	em410x_watch(Cmd);
 	return 0;
 }
 
@@ -597,10 +598,13 @@ int CmdEM410xWatchnSpoof(const char *Cmd) {
 	char cmdp = param_getchar(Cmd, 0);
 	if (cmdp == 'h' || cmdp == 'H') return usage_lf_em410x_ws();
 	
-	// loops if the captured ID was in XL-format.
-	CmdEM410xWatch(Cmd);
-	PrintAndLogEx(NORMAL, "# Replaying captured ID: %010" PRIx64 , g_em410xid);
-	CmdLFaskSim("");
+	if (!em410x_watch(Cmd))
+		return 0;
+
+	char uid[11];
+	snprintf(uid, sizeof(uid), "%010" PRIx64, g_em410xid);
+	PrintAndLogEx(NORMAL, "# Replaying captured ID: %s", uid);
+	CmdEM410xSim(uid);
 	return 0;
 }
 
@@ -44,7 +44,7 @@ int CmdLFHitagList(const char *Cmd) {
 		return 2;
 	}
 	
-	uint16_t traceLen = response.arg[2];
+	uint32_t traceLen = response.arg[2];
 	if (traceLen > USB_CMD_DATA_SIZE) {
 		uint8_t *p = realloc(got, traceLen);
 		if (p == NULL) {
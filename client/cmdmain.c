@@ -15,17 +15,7 @@ static int CmdQuit(const char *Cmd);
 static int CmdRev(const char *Cmd);
 static int CmdRem(const char *Cmd);
 
-//For storing command that are received from the device
-static UsbCommand cmdBuffer[CMD_BUFFER_SIZE];
-
-//Points to the next empty position to write to
-static int cmd_head = 0;
-
-//Points to the position of the last unread command
-static int cmd_tail = 0;
-
-// to lock cmdBuffer operations from different threads
-static pthread_mutex_t cmdBufferMutex = PTHREAD_MUTEX_INITIALIZER;
+// received commands are kept per device,  see pm3_device in proxmark3.h
 
 static command_t CommandTable[] = {
 	{"help",	CmdHelp,	1, "This help. Use '<command> help' for details of a particular command."},
@@ -34,6 +24,7 @@ static command_t CommandTable[] = {
 	{"hf",		CmdHF,		1, "{ High Frequency commands... }"},
 	{"hw",		CmdHW,		1, "{ Hardware commands... }"},
 	{"lf",		CmdLF,		1, "{ Low Frequency commands... }"},
+	{"multi",	CmdMulti,	1, "{ Several Proxmarks from one client... }"},
 	{"rem",		CmdRem, 	1, "{ Add text to row in log file }"},
 	{"reveng",	CmdRev, 	1, "{ Crc calculations from the software reveng 1.53... }"},
 	{"script",	CmdScript,	1, "{ Scripting commands }"},
@@ -88,9 +79,10 @@ bool dl_it(uint8_t *dest, uint32_t bytes, uint32_t start_index, UsbCommand *resp
  */
 void clearCommandBuffer() {
     //This is a very simple operation
-	pthread_mutex_lock(&cmdBufferMutex);
-    cmd_tail = cmd_head;
-	pthread_mutex_unlock(&cmdBufferMutex);
+	pm3_device *dev = CurrentDevice();
+	pthread_mutex_lock(&dev->cmdBufferMutex);
+    dev->cmd_tail = dev->cmd_head;
+	pthread_mutex_unlock(&dev->cmdBufferMutex);
 }
 
 /**
@@ -99,20 +91,21 @@ void clearCommandBuffer() {
  */
 void storeCommand(UsbCommand *command) {
 	
-	pthread_mutex_lock(&cmdBufferMutex);
-    if ( ( cmd_head+1) % CMD_BUFFER_SIZE == cmd_tail) {
+	pm3_device *dev = CurrentDevice();
+	pthread_mutex_lock(&dev->cmdBufferMutex);
+    if ( ( dev->cmd_head+1) % CMD_BUFFER_SIZE == dev->cmd_tail) {
         //If these two are equal, we're about to overwrite in the
         // circular buffer.
         PrintAndLogEx(FAILED, "WARNING: Command buffer about to overwrite command! This needs to be fixed!");
 		fflush(NULL);
     }
     //Store the command at the 'head' location
-    UsbCommand* destination = &cmdBuffer[cmd_head];
+    UsbCommand* destination = &dev->cmdBuffer[dev->cmd_head];
     memcpy(destination, command, sizeof(UsbCommand));
 
 	 //increment head and wrap
-    cmd_head = (cmd_head +1) % CMD_BUFFER_SIZE;	
-	pthread_mutex_unlock(&cmdBufferMutex);
+    dev->cmd_head = (dev->cmd_head +1) % CMD_BUFFER_SIZE;	
+	pthread_mutex_unlock(&dev->cmdBufferMutex);
 }
 /**
  * @brief getCommand gets a command from an internal circular buffer.
@@ -120,24 +113,36 @@ void storeCommand(UsbCommand *command) {
  * @return 1 if response was returned, 0 if nothing has been received
  */
 int getCommand(UsbCommand* response) {
-	pthread_mutex_lock(&cmdBufferMutex);
+	pm3_device *dev = CurrentDevice();
+	pthread_mutex_lock(&dev->cmdBufferMutex);
     //If head == tail, there's nothing to read, or if we just got initialized
-    if (cmd_head == cmd_tail)  {
-		pthread_mutex_unlock(&cmdBufferMutex);
+    if (dev->cmd_head == dev->cmd_tail)  {
+		pthread_mutex_unlock(&dev->cmdBufferMutex);
 		return 0;
 	}
 	
     //Pick out the next unread command
-    UsbCommand* last_unread = &cmdBuffer[cmd_tail];
+    UsbCommand* last_unread = &dev->cmdBuffer[dev->cmd_tail];
     memcpy(response, last_unread, sizeof(UsbCommand));
 
     //Increment tail - this is a circular buffer, so modulo buffer size
-    cmd_tail = (cmd_tail +1 ) % CMD_BUFFER_SIZE;
+    dev->cmd_tail = (dev->cmd_tail +1 ) % CMD_BUFFER_SIZE;
 
-	pthread_mutex_unlock(&cmdBufferMutex);
+	pthread_mutex_unlock(&dev->cmdBufferMutex);
     return 1;
 }
 
+/**
+ * @brief getCommandBufferUsage returns the number of received commands not yet read
+ */
+int getCommandBufferUsage(void) {
+	pm3_device *dev = CurrentDevice();
+	pthread_mutex_lock(&dev->cmdBufferMutex);
+	int used = (dev->cmd_head - dev->cmd_tail + CMD_BUFFER_SIZE) % CMD_BUFFER_SIZE;
+	pthread_mutex_unlock(&dev->cmdBufferMutex);
+	return used;
+}
+
 /**
  * @brief Waits for a certain response type. This method waits for a maximum of
  * ms_timeout milliseconds for a specified response command.
@@ -201,9 +206,7 @@ void UsbCommandReceived(UsbCommand* _ch) {
 	//UsbCommand *c = malloc(sizeof(UsbCommand));
 	//memset(cp, 0x00, sizeof(*cp));
 
-	pthread_mutex_lock(&cmdBufferMutex);
 	UsbCommand* c = _ch;
-	pthread_mutex_unlock(&cmdBufferMutex);	
 			
 	switch(c->cmd) {
 		// First check if we are handling a debug message
@@ -227,6 +230,18 @@ void UsbCommandReceived(UsbCommand* _ch) {
 			PrintAndLogEx(NORMAL, "#db# %08x, %08x, %08x", c->arg[0], c->arg[1], c->arg[2]);
 			break;
 		}
+		// streaming sniff,  'trace stream'
+		case CMD_TRACE_STREAM_DATA:
+		case CMD_TRACE_STREAM_END: {
+			TraceStreamReceived(c);
+			break;
+		}
+		// 'lf stream'
+		case CMD_LF_STREAM_DATA:
+		case CMD_LF_STREAM_END: {
+			LFStreamReceived(c);
+			break;
+		}
 		// iceman:  hw status - down the path on device, runs printusbspeed which starts sending a lot of
 		// CMD_DOWNLOAD_RAW_ADC_SAMPLES_125K packages which is not dealt with. I wonder if simply ignoring them will
 		// work. lets try it. 
@@ -33,11 +33,10 @@
 #include "cmdscript.h"
 #include "cmdcrc.h"
 #include "cmdanalyse.h"
+#include "cmdmulti.h"
 #include "cmdflashmem.h"	// rdv40 flashmem commands
 #include "cmdsmartcard.h"	// rdv40 smart card ISO7816 commands
 
-//For storing command that are received from the device
-#define CMD_BUFFER_SIZE 100
 typedef enum {
 	BIG_BUF,
 	BIG_BUF_EML,
@@ -51,6 +50,8 @@ extern bool WaitForResponseTimeoutW(uint32_t cmd, UsbCommand* response, size_t m
 extern bool WaitForResponseTimeout(uint32_t cmd, UsbCommand* response, size_t ms_timeout);
 extern bool WaitForResponse(uint32_t cmd, UsbCommand* response);
 extern void clearCommandBuffer();
+extern int getCommand(UsbCommand* response);
+extern int getCommandBufferUsage(void);
 extern command_t* getTopLevelCommandTable();
 
 extern bool GetFromDevice(DeviceMemType_t memtype, uint8_t *dest, uint32_t bytes, uint32_t start_index, UsbCommand *response, size_t ms_timeout, bool show_warning);
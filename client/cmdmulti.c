@@ -0,0 +1,547 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Several Proxmarks from one client,  work sharded across them.
+//
+// Every device has its own receiver thread and response buffer.  A worker
+// thread is started per device and bound to it with SetCurrentDevice(),  so
+// the usual SendCommand / WaitForResponse code runs unchanged against it.
+//-----------------------------------------------------------------------------
+#include "cmdmulti.h"
+
+static int CmdHelp(const char *Cmd);
+
+typedef struct {
+	pm3_device *dev;
+	char *cmd;
+	uint8_t sectorsCnt;
+	uint8_t *keys;
+	uint32_t keycnt;
+	sector_t *e_sector;
+	int res;
+} multi_job_t;
+
+// commands that only talk to the device bound to the calling thread
+static const char *multi_run_allowed[] = {
+	"hw ping",
+	"hw version",
+	"hw status",
+	"hf 14a reader",
+	"hf 14a info",
+	"hf mf rdbl",
+	"hf mf rdsc",
+	"hf mf wrbl",
+	"hf mf dump",
+	"lf t55xx write",
+	NULL
+};
+
+int usage_multi_connect(void) {
+	PrintAndLogEx(NORMAL, "Connect an additional Proxmark");
+	PrintAndLogEx(NORMAL, "Usage:  multi connect [h] <port>");
+	PrintAndLogEx(NORMAL, "Options:");
+	PrintAndLogEx(NORMAL, "       h       this help");
+	PrintAndLogEx(NORMAL, "       <port>  serial port,  or tcp:host:port");
+	PrintAndLogEx(NORMAL, "");
+	PrintAndLogEx(NORMAL, "Examples:");
+	PrintAndLogEx(NORMAL, "       multi connect /dev/ttyACM1");
+	return 0;
+}
+int usage_multi_select(void) {
+	PrintAndLogEx(NORMAL, "Send the following console commands to another device");
+	PrintAndLogEx(NORMAL, "Usage:  multi select [h] <id>");
+	PrintAndLogEx(NORMAL, "Options:");
+	PrintAndLogEx(NORMAL, "       h       this help");
+	PrintAndLogEx(NORMAL, "       <id>    device id,  see 'multi list'");
+	return 0;
+}
+int usage_multi_close(void) {
+	PrintAndLogEx(NORMAL, "Disconnect an additional Proxmark");
+	PrintAndLogEx(NORMAL, "Usage:  multi close [h] <id>");
+	PrintAndLogEx(NORMAL, "Options:");
+	PrintAndLogEx(NORMAL, "       h       this help");
+	PrintAndLogEx(NORMAL, "       <id>    device id,  see 'multi list'");
+	return 0;
+}
+int usage_multi_run(void) {
+	PrintAndLogEx(NORMAL, "Run a command on all connected devices in parallel");
+	PrintAndLogEx(NORMAL, "Only commands that keep no client side state can run here,  the graph,  trace");
+	PrintAndLogEx(NORMAL, "and emulator buffers would be shared between the devices.");
+	PrintAndLogEx(NORMAL, "Usage:  multi run [h] <command>");
+	PrintAndLogEx(NORMAL, "Options:");
+	PrintAndLogEx(NORMAL, "       h          this help");
+	PrintAndLogEx(NORMAL, "       <command>  one of:");
+	for (int i = 0; multi_run_allowed[i]; i++)
+		PrintAndLogEx(NORMAL, "                    %s", multi_run_allowed[i]);
+	PrintAndLogEx(NORMAL, "");
+	PrintAndLogEx(NORMAL, "Examples:");
+	PrintAndLogEx(NORMAL, "       multi run hf 14a reader");
+	return 0;
+}
+int usage_multi_fchk(void) {
+	PrintAndLogEx(NORMAL, "Check keys on all connected devices,  the dictionary is split between them.");
+	PrintAndLogEx(NORMAL, "Every device needs a card of the same system on it.  Keys found on one card");
+	PrintAndLogEx(NORMAL, "are checked on the others,  each card gets the keys that work on it.");
+	PrintAndLogEx(NORMAL, "Usage:  multi fchk [h] <card memory> [d] [<key (12 hex symbols)>] [<dic (*.dic)>]");
+	PrintAndLogEx(NORMAL, "Options:");
+	PrintAndLogEx(NORMAL, "       h             this help");
+	PrintAndLogEx(NORMAL, "       <cardmem>     all sectors based on card memory, 0 = 320 bytes (Mifare Mini), 1 = 1K, 2 = 2K, 4 = 4K");
+	PrintAndLogEx(NORMAL, "       d             write keys to binary file,  one per card");
+	PrintAndLogEx(NORMAL, "");
+	PrintAndLogEx(NORMAL, "Examples:");
+	PrintAndLogEx(NORMAL, "       multi fchk 1 default_keys.dic");
+	PrintAndLogEx(NORMAL, "       multi fchk 1 d default_keys.dic  -- check keys and save them for 'multi dump'");
+	return 0;
+}
+int usage_multi_dump(void) {
+	PrintAndLogEx(NORMAL, "Dump the Mifare Classic cards on all connected devices in parallel, see 'hf mf dump'");
+	PrintAndLogEx(NORMAL, "Usage:  multi dump [h] [card memory] [k <name>]");
+	PrintAndLogEx(NORMAL, "Options:");
+	PrintAndLogEx(NORMAL, "       h             this help");
+	PrintAndLogEx(NORMAL, "       [card memory] 0 = 320 bytes (Mifare Mini), 1 = 1K (default), 2 = 2K, 4 = 4K");
+	PrintAndLogEx(NORMAL, "       k <name>      key filename,  default hf-mf-<UID>-key.bin per card");
+	PrintAndLogEx(NORMAL, "");
+	PrintAndLogEx(NORMAL, "Examples:");
+	PrintAndLogEx(NORMAL, "       multi dump 1");
+	return 0;
+}
+int usage_multi_t55write(void) {
+	PrintAndLogEx(NORMAL, "Write a T55xx block on all connected devices in parallel, see 'lf t55xx write'");
+	PrintAndLogEx(NORMAL, "Usage:  multi t55write [h] b <block> d <data> [p <password>] [1] [t]");
+	PrintAndLogEx(NORMAL, "");
+	PrintAndLogEx(NORMAL, "Examples:");
+	PrintAndLogEx(NORMAL, "       multi t55write b 3 d 11223344");
+	return 0;
+}
+
+// online devices,  in id order
+static int collect_devices(pm3_device **devs) {
+	int n = 0;
+	for (int i = 0; i < MAX_PM3_DEVICES; i++) {
+		pm3_device *dev = GetDevice(i);
+		if (dev && DeviceOnline(dev))
+			devs[n++] = dev;
+	}
+	return n;
+}
+
+static void run_jobs(multi_job_t *jobs, int n, void *(*worker)(void *)) {
+	pthread_t threads[MAX_PM3_DEVICES];
+	for (int i = 0; i < n; i++)
+		pthread_create(&threads[i], NULL, worker, &jobs[i]);
+	for (int i = 0; i < n; i++)
+		pthread_join(threads[i], NULL);
+}
+
+static void *run_worker(void *arg) {
+	multi_job_t *job = (multi_job_t *)arg;
+	SetCurrentDevice(job->dev);
+	PrintAndLogEx(INFO, "device %d: %s", job->dev->id, job->cmd);
+	job->res = CommandReceived(job->cmd);
+	return NULL;
+}
+
+static bool run_allowed(const char *cmd) {
+	for (int i = 0; multi_run_allowed[i]; i++) {
+		size_t len = strlen(multi_run_allowed[i]);
+		if (strncmp(cmd, multi_run_allowed[i], len) == 0 && (cmd[len] == 0 || cmd[len] == ' '))
+			return true;
+	}
+	return false;
+}
+
+// runs one client command on every online device,  each in its own thread
+static int run_on_all(const char *Cmd) {
+	pm3_device *devs[MAX_PM3_DEVICES];
+	multi_job_t jobs[MAX_PM3_DEVICES];
+	char cmd[256] = {0};
+
+	// single spaces,  for the allowlist
+	for (size_t i = 0, j = 0; Cmd[i] && j < sizeof(cmd) - 1; i++) {
+		if (Cmd[i] == ' ' && (j == 0 || cmd[j - 1] == ' '))
+			continue;
+		cmd[j++] = Cmd[i];
+	}
+	if (!run_allowed(cmd)) {
+		PrintAndLogEx(WARNING, "'%s' can't run on several devices,  see 'multi run h'", cmd);
+		return 1;
+	}
+
+	int n = collect_devices(devs);
+	if (n == 0) {
+		PrintAndLogEx(WARNING, "no device connected");
+		return 1;
+	}
+
+	memset(jobs, 0, sizeof(jobs));
+	for (int i = 0; i < n; i++) {
+		jobs[i].dev = devs[i];
+		// the parser may modify it
+		jobs[i].cmd = calloc(strlen(cmd) + 1, sizeof(char));
+		strcpy(jobs[i].cmd, cmd);
+	}
+
+	uint64_t t1 = msclock();
+	run_jobs(jobs, n, run_worker);
+	t1 = msclock() - t1;
+
+	for (int i = 0; i < n; i++) {
+		PrintAndLogEx(NORMAL, "device %d: returned %d", jobs[i].dev->id, jobs[i].res);
+		free(jobs[i].cmd);
+	}
+	PrintAndLogEx(SUCCESS, "%d devices,  %.1fs", n, (float)(t1/1000.0));
+	return 0;
+}
+
+int CmdMultiConnect(const char *Cmd) {
+	char port[255] = {0};
+	char cmdp = param_getchar(Cmd, 0);
+	if (strlen(Cmd) < 1 || cmdp == 'h' || cmdp == 'H') return usage_multi_connect();
+
+	param_getstr(Cmd, 0, port, sizeof(port));
+
+	pm3_device *dev = OpenDevice(port);
+	if (!dev)
+		return 1;
+
+	// make sure a Proxmark answers on it
+	pm3_device *prev = CurrentDevice();
+	SetCurrentDevice(dev);
+	UsbCommand c = {CMD_PING};
+	clearCommandBuffer();
+	SendCommand(&c);
+	bool ok = WaitForResponseTimeout(CMD_ACK, NULL, 1500);
+	SetCurrentDevice(prev);
+
+	if (!ok) {
+		PrintAndLogEx(WARNING, "no answer from %s", port);
+		CloseDevice(dev);
+		return 1;
+	}
+	PrintAndLogEx(SUCCESS, "connected %s as device %d", port, dev->id);
+	return 0;
+}
+
+int CmdMultiClose(const char *Cmd) {
+	char cmdp = param_getchar(Cmd, 0);
+	if (strlen(Cmd) < 1 || cmdp == 'h' || cmdp == 'H') return usage_multi_close();
+
+	int id = param_get8(Cmd, 0);
+	pm3_device *dev = GetDevice(id);
+	if (!dev || id == 0) {
+		PrintAndLogEx(WARNING, "no additional device %d", id);
+		return 1;
+	}
+	CloseDevice(dev);
+	PrintAndLogEx(SUCCESS, "device %d closed", id);
+	return 0;
+}
+
+int CmdMultiList(const char *Cmd) {
+	pm3_device *curr = CurrentDevice();
+	PrintAndLogEx(NORMAL, " id | state   | port");
+	PrintAndLogEx(NORMAL, "----+---------+----------------------");
+	for (int i = 0; i < MAX_PM3_DEVICES; i++) {
+		pm3_device *dev = GetDevice(i);
+		if (!dev) continue;
+		PrintAndLogEx(NORMAL, "%c%2d | %-7s | %s"
+			, (dev == curr) ? '*' : ' '
+			, dev->id
+			, DeviceOnline(dev) ? "online" : "offline"
+			, dev->port
+			);
+	}
+	return 0;
+}
+
+int CmdMultiSelect(const char *Cmd) {
+	char cmdp = param_getchar(Cmd, 0);
+	if (strlen(Cmd) < 1 || cmdp == 'h' || cmdp == 'H') return usage_multi_select();
+
+	int id = param_get8(Cmd, 0);
+	pm3_device *dev = GetDevice(id);
+	if (!dev) {
+		PrintAndLogEx(WARNING, "no device %d", id);
+		return 1;
+	}
+	SetCurrentDevice(dev);
+	PrintAndLogEx(SUCCESS, "commands go to device %d,  %s", id, dev->port);
+	return 0;
+}
+
+int CmdMultiRun(const char *Cmd) {
+	char cmdp = param_getchar(Cmd, 0);
+	if (strlen(Cmd) < 1 || (strlen(Cmd) == 1 && (cmdp == 'h' || cmdp == 'H'))) return usage_multi_run();
+	return run_on_all(Cmd);
+}
+
+int CmdMultiDump(const char *Cmd) {
+	char cmdp = param_getchar(Cmd, 0);
+	if (cmdp == 'h' || cmdp == 'H') return usage_multi_dump();
+
+	char cmd[256];
+	snprintf(cmd, sizeof(cmd), "hf mf dump %s", Cmd);
+	return run_on_all(cmd);
+}
+
+int CmdMultiT55Write(const char *Cmd) {
+	char cmdp = param_getchar(Cmd, 0);
+	if (strlen(Cmd) < 1 || cmdp == 'h' || cmdp == 'H') return usage_multi_t55write();
+
+	char cmd[256];
+	snprintf(cmd, sizeof(cmd), "lf t55xx write %s", Cmd);
+	return run_on_all(cmd);
+}
+
+static void *fchk_worker(void *arg) {
+	multi_job_t *job = (multi_job_t *)arg;
+	SetCurrentDevice(job->dev);
+	if (job->keycnt == 0)
+		return NULL;
+	job->res = 1;
+
+	uint32_t chunksize = MIN(job->keycnt, USB_CMD_DATA_SIZE/6);
+
+	// strategys. 1= deep first on sector 0 AB,  2= width first on all sectors
+	for (uint8_t strategy = 1; strategy < 3; strategy++) {
+		bool firstChunk = true, lastChunk = false;
+		for (uint32_t i = 0; i < job->keycnt; i += chunksize) {
+
+			uint32_t size = MIN(job->keycnt - i, chunksize);
+			if (size == job->keycnt - i)
+				lastChunk = true;
+
+			int res = mfCheckKeys_fast(job->sectorsCnt, firstChunk, lastChunk, strategy, size, job->keys + (i * 6), job->e_sector);
+			firstChunk = false;
+
+			// all keys,  aborted
+			if (res == 0 || res == 2) {
+				job->res = res;
+				return NULL;
+			}
+		}
+	}
+	return NULL;
+}
+
+// writes the found keys for the card on this device,  like 'hf mf fchk d'
+static void *fchk_save_worker(void *arg) {
+	multi_job_t *job = (multi_job_t *)arg;
+	SetCurrentDevice(job->dev);
+	job->res = 1;
+
+	char *fptr = GenerateFilename("hf-mf-", "-key.bin");
+	if (fptr == NULL)
+		return NULL;
+
+	FILE *f = fopen(fptr, "wb");
+	if (f == NULL) {
+		PrintAndLogEx(WARNING, "Could not create file %s", fptr);
+		free(fptr);
+		return NULL;
+	}
+
+	uint8_t tempkey[6];
+	for (int k = 0; k < 2; k++) {
+		for (int i = 0; i < job->sectorsCnt; i++) {
+			num_to_bytes(job->e_sector[i].Key[k], 6, tempkey);
+			fwrite(tempkey, 1, 6, f);
+		}
+	}
+	fclose(f);
+	PrintAndLogEx(SUCCESS, "device %d: keys saved to %s", job->dev->id, fptr);
+	free(fptr);
+	job->res = 0;
+	return NULL;
+}
+
+// keys given on the command line,  and from dictionary files
+static uint32_t load_keys(const char *Cmd, int start, uint8_t **keys, bool *createDumpFile) {
+	char filename[FILE_PATH_SIZE] = {0};
+	char buf[13];
+	uint32_t keycnt = 0, keyitems = 64;
+	uint8_t *p;
+
+	*keys = calloc(keyitems, 6);
+	if (*keys == NULL) return 0;
+
+	for (int i = start; param_getchar(Cmd, i); i++) {
+
+		char ctmp = param_getchar(Cmd, i);
+		int clen = param_getlength(Cmd, i);
+
+		if (clen == 1) {
+			if (ctmp == 'd' || ctmp == 'D') *createDumpFile = true;
+			continue;
+		}
+
+		if (keyitems - keycnt < 2) {
+			p = realloc(*keys, 6 * (keyitems += 64));
+			if (!p) break;
+			*keys = p;
+		}
+
+		if (clen == 12 && !param_gethex(Cmd, i, *keys + 6 * keycnt, 12)) {
+			keycnt++;
+			continue;
+		}
+
+		// May be a dic file
+		if (param_getstr(Cmd, i, filename, FILE_PATH_SIZE) >= FILE_PATH_SIZE) {
+			PrintAndLogEx(FAILED, "Filename too long");
+			continue;
+		}
+
+		FILE *f = fopen(filename, "r");
+		if (!f) {
+			PrintAndLogEx(FAILED, "File: %s: not found or locked.", filename);
+			continue;
+		}
+
+		uint32_t loaded = 0;
+		while (fgets(buf, sizeof(buf), f)) {
+			if (strlen(buf) < 12 || buf[11] == '\n')
+				continue;
+
+			while (fgetc(f) != '\n' && !feof(f)) ;  //goto next line
+
+			if (buf[0] == '#' || !isxdigit(buf[0])) continue;
+
+			buf[12] = 0;
+			if (keyitems - keycnt < 2) {
+				p = realloc(*keys, 6 * (keyitems += 64));
+				if (!p) break;
+				*keys = p;
+			}
+			num_to_bytes(strtoll(buf, NULL, 16), 6, *keys + 6 * keycnt);
+			keycnt++;
+			loaded++;
+		}
+		fclose(f);
+		PrintAndLogEx(SUCCESS, "Loaded %2d keys from %s", loaded, filename);
+	}
+
+	if (keycnt == 0) {
+		PrintAndLogEx(SUCCESS, "No key specified, trying default keys");
+		p = realloc(*keys, 6 * MIFARE_DEFAULTKEYS_SIZE);
+		if (!p) return 0;
+		*keys = p;
+		for (; keycnt < MIFARE_DEFAULTKEYS_SIZE; keycnt++)
+			num_to_bytes(g_mifare_default_keys[keycnt], 6, *keys + keycnt * 6);
+	}
+	return keycnt;
+}
+
+int CmdMultiFchk(const char *Cmd) {
+	char cmdp = param_getchar(Cmd, 0);
+	if (strlen(Cmd) < 1 || cmdp == 'h' || cmdp == 'H') return usage_multi_fchk();
+
+	pm3_device *devs[MAX_PM3_DEVICES];
+	multi_job_t jobs[MAX_PM3_DEVICES];
+	int n = collect_devices(devs);
+	if (n == 0) {
+		PrintAndLogEx(WARNING, "no device connected");
+		return 1;
+	}
+
+	uint8_t sectorsCnt = NumOfSectors(cmdp);
+	bool createDumpFile = false;
+	uint8_t *keys = NULL;
+	uint32_t keycnt = load_keys(Cmd, 1, &keys, &createDumpFile);
+	if (keycnt == 0) {
+		free(keys);
+		return 1;
+	}
+
+	// one contiguous slice of the dictionary per device,  results kept per device
+	memset(jobs, 0, sizeof(jobs));
+	for (int i = 0; i < n; i++) {
+		uint32_t from = (uint64_t)keycnt * i / n;
+		uint32_t to = (uint64_t)keycnt * (i + 1) / n;
+		jobs[i].dev = devs[i];
+		jobs[i].sectorsCnt = sectorsCnt;
+		jobs[i].keys = keys + from * 6;
+		jobs[i].keycnt = to - from;
+		jobs[i].e_sector = calloc(sectorsCnt, sizeof(sector_t));
+		jobs[i].res = 1;
+		if (to > from)
+			PrintAndLogEx(INFO, "device %d: keys %u - %u", devs[i]->id, from, to - 1);
+	}
+
+	uint64_t t1 = msclock();
+	run_jobs(jobs, n, fchk_worker);
+
+	// a key found in one slice is only a candidate for the other cards,  check it on them
+	uint8_t *found = calloc(n * sectorsCnt * 2, 6);
+	uint32_t foundcnt = 0;
+	for (int j = 0; found && j < n; j++) {
+		if (jobs[j].res == 2)
+			PrintAndLogEx(WARNING, "device %d timed out,  its keys are not all checked", jobs[j].dev->id);
+		for (int s = 0; s < sectorsCnt; s++) {
+			for (int k = 0; k < 2; k++) {
+				if (!jobs[j].e_sector[s].foundKey[k])
+					continue;
+				uint8_t key[6];
+				num_to_bytes(jobs[j].e_sector[s].Key[k], 6, key);
+				uint32_t f;
+				for (f = 0; f < foundcnt; f++)
+					if (memcmp(found + f * 6, key, 6) == 0)
+						break;
+				if (f == foundcnt)
+					memcpy(found + 6 * foundcnt++, key, 6);
+			}
+		}
+	}
+	if (n > 1 && foundcnt) {
+		for (int j = 0; j < n; j++) {
+			jobs[j].keys = found;
+			jobs[j].keycnt = (jobs[j].res == 1) ? foundcnt : 0;
+		}
+		PrintAndLogEx(INFO, "checking the %u keys found on all devices", foundcnt);
+		run_jobs(jobs, n, fchk_worker);
+	}
+	free(found);
+
+	t1 = msclock() - t1;
+	PrintAndLogEx(SUCCESS, "Time in checkkeys (fast,  %d devices):  %.1fs\n", n, (float)(t1/1000.0));
+
+	for (int j = 0; j < n; j++) {
+		PrintAndLogEx(NORMAL, "device %d:", jobs[j].dev->id);
+		printKeyTable(sectorsCnt, jobs[j].e_sector);
+	}
+
+	// every card gets the keys found on it
+	if (createDumpFile)
+		run_jobs(jobs, n, fchk_save_worker);
+
+	for (int j = 0; j < n; j++)
+		free(jobs[j].e_sector);
+	free(keys);
+	return 0;
+}
+
+static command_t CommandTable[] = {
+	{"help",     CmdHelp,          1, "This help"},
+	{"connect",  CmdMultiConnect,  1, "<port> -- Connect an additional Proxmark"},
+	{"close",    CmdMultiClose,    1, "<id> -- Disconnect an additional Proxmark"},
+	{"list",     CmdMultiList,     1, "List connected Proxmarks"},
+	{"select",   CmdMultiSelect,   1, "<id> -- Send the following console commands to this Proxmark"},
+	{"run",      CmdMultiRun,      1, "<command> -- Run a command on all Proxmarks in parallel"},
+	{"fchk",     CmdMultiFchk,     1, "Check keys fast,  dictionary split across all Proxmarks"},
+	{"dump",     CmdMultiDump,     1, "Dump the Mifare Classic cards on all Proxmarks in parallel"},
+	{"t55write", CmdMultiT55Write, 1, "Write a T55xx block on all Proxmarks in parallel"},
+	{NULL, NULL, 0, NULL}
+};
+
+int CmdMulti(const char *Cmd) {
+	clearCommandBuffer();
+	CmdsParse(CommandTable, Cmd);
+	return 0;
+}
+
+int CmdHelp(const char *Cmd) {
+	CmdsHelp(CommandTable);
+	return 0;
+}
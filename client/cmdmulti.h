@@ -0,0 +1,35 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Several Proxmarks from one client,  work sharded across them
+//-----------------------------------------------------------------------------
+
+#ifndef CMDMULTI_H__
+#define CMDMULTI_H__
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "cmdmain.h"
+#include "proxmark3.h"
+#include "ui.h"
+#include "util.h"
+#include "util_posix.h"
+#include "mifarehost.h"
+#include "mifaredefault.h"
+#include "cmdhfmf.h"
+
+extern int CmdMulti(const char *Cmd);
+
+extern int CmdMultiConnect(const char *Cmd);
+extern int CmdMultiClose(const char *Cmd);
+extern int CmdMultiList(const char *Cmd);
+extern int CmdMultiSelect(const char *Cmd);
+extern int CmdMultiRun(const char *Cmd);
+extern int CmdMultiFchk(const char *Cmd);
+extern int CmdMultiDump(const char *Cmd);
+extern int CmdMultiT55Write(const char *Cmd);
+
+#endif
@@ -16,11 +16,14 @@
 #include <string.h>
 #include <limits.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
 
 #include "proxmark3.h"
 #include "scripting.h"
 #include "ui.h"
+#include "util.h"
+#include "util_posix.h"
 #include "graph.h"
 #include "cmdparser.h"
 #include "cmdmain.h"
@@ -28,6 +31,7 @@
 #include "cmdhfmf.h"
 #include "pm3_binlib.h"
 #include "pm3_bitlib.h"
+#include "pm3_buflib.h"
 #include <lua.h>
 #include <lualib.h>
 #include <lauxlib.h>
@@ -94,6 +98,329 @@ int CmdScriptList(const char *Cmd) {
 	return 0;
 }
 
+/*
+ The Lua state is kept warm between `script run` invocations,  modules required from
+ lualibs/ stay in package.loaded. Each script gets its own global table (falling back
+ to the shared one) so globals don't leak from one run to the next. Globals a run adds
+ to _G and the other modules it loads are dropped when it returns. What stays shared:
+ the lualibs module tables,  and globals of _G a run changes rather than adds.
+ A script error drops the state.
+ Compiled chunks are cached as bytecode,  keyed by path and file mtime / size.
+*/
+typedef struct script_cache_s {
+	char *path;
+	time_t mtime;
+	off_t size;
+	char *code;
+	size_t len;
+	struct script_cache_s *next;
+} script_cache_t;
+
+static lua_State *lua_vm = NULL;
+static int lua_vm_depth = 0;			// nested runs via core.console
+static bool lua_vm_broken = false;
+static script_cache_t *script_cache = NULL;
+static uint32_t script_cache_hits = 0;
+static uint32_t script_cache_misses = 0;
+static uint64_t script_cache_fill_us = 0;	// time spent dumping bytecode into the cache
+
+static int script_dump_writer(lua_State *L, const void *p, size_t sz, void *ud) {
+	script_cache_t *e = (script_cache_t *)ud;
+	char *code = realloc(e->code, e->len + sz);
+	if (!code)
+		return 1;
+	memcpy(code + e->len, p, sz);
+	e->code = code;
+	e->len += sz;
+	return 0;
+}
+
+static void script_cache_clear(void) {
+	while (script_cache) {
+		script_cache_t *e = script_cache;
+		script_cache = e->next;
+		free(e->path);
+		free(e->code);
+		free(e);
+	}
+	script_cache_hits = script_cache_misses = 0;
+}
+
+// like luaL_loadfile,  but from the bytecode cache when the file is unchanged
+static int script_loadfile(lua_State *L, const char *path) {
+	struct stat st;
+	if (stat(path, &st) != 0)
+		return luaL_loadfile(L, path);
+
+	char chunkname[strlen(path) + 2];
+	sprintf(chunkname, "@%s", path);
+
+	script_cache_t *e;
+	for (e = script_cache; e; e = e->next) {
+		if (!strcmp(e->path, path))
+			break;
+	}
+	if (e && e->code && e->mtime == st.st_mtime && e->size == st.st_size) {
+		script_cache_hits++;
+		return luaL_loadbuffer(L, e->code, e->len, chunkname);
+	}
+
+	script_cache_misses++;
+	int res = luaL_loadfile(L, path);
+	if (res)
+		return res;
+
+	if (!e) {
+		e = calloc(1, sizeof(script_cache_t));
+		if (!e)
+			return res;
+		e->path = strdup(path);
+		e->next = script_cache;
+		script_cache = e;
+	}
+	free(e->code);
+	e->code = NULL;
+	e->len = 0;
+	uint64_t t = usclock();
+	if (lua_dump(L, script_dump_writer, e) != 0) {
+		free(e->code);
+		e->code = NULL;
+		e->len = 0;
+	}
+	script_cache_fill_us += usclock() - t;
+	e->mtime = st.st_mtime;
+	e->size = st.st_size;
+	return res;
+}
+
+// keys of the table at idx,  pushed as a set
+static void script_keys(lua_State *L, int idx) {
+	idx = lua_absindex(L, idx);
+	lua_newtable(L);
+	lua_pushnil(L);
+	while (lua_next(L, idx)) {
+		lua_pop(L, 1);
+		lua_pushvalue(L, -1);
+		lua_pushboolean(L, 1);
+		lua_rawset(L, -4);
+	}
+}
+
+// calls f(L, t, key) for each key of the table t missing from the set before,  the key on top
+static void script_new_keys(lua_State *L, int t, int before, void (*f)(lua_State *L, int t, int arg), int arg) {
+	t = lua_absindex(L, t);
+	before = lua_absindex(L, before);
+	lua_pushnil(L);
+	while (lua_next(L, t)) {
+		lua_pop(L, 1);
+		lua_pushvalue(L, -1);
+		lua_rawget(L, before);
+		bool old = !lua_isnil(L, -1);
+		lua_pop(L, 1);
+		if (!old)
+			f(L, t, arg);
+	}
+}
+
+// adds the key on top to the set at index keep
+static void script_mark_key(lua_State *L, int t, int keep) {
+	lua_pushvalue(L, -1);
+	lua_pushboolean(L, 1);
+	lua_rawset(L, keep);
+}
+
+// clears the key on top in t,  unless it is in the set at index keep.  Allowed while traversing
+static void script_clear_key(lua_State *L, int t, int keep) {
+	lua_pushvalue(L, -1);
+	lua_rawget(L, keep);
+	bool kept = !lua_isnil(L, -1);
+	lua_pop(L, 1);
+	if (kept)
+		return;
+	lua_pushvalue(L, -1);
+	lua_pushnil(L);
+	lua_rawset(L, t);
+}
+
+// runs a lualib module,  the globals it defines belong to it and stay with it
+static int script_lualib_loader(lua_State *L) {
+	int nargs = lua_gettop(L);
+	lua_pushglobaltable(L);
+	script_keys(L, -1);
+	lua_remove(L, -2);
+	int before = lua_gettop(L);
+
+	lua_pushvalue(L, lua_upvalueindex(1));
+	for (int i = 1; i <= nargs; i++)
+		lua_pushvalue(L, i);
+	lua_call(L, nargs, 1);
+
+	luaL_getsubtable(L, LUA_REGISTRYINDEX, "pm3_lualib_globals");
+	lua_pushglobaltable(L);
+	script_new_keys(L, -1, before, script_mark_key, lua_absindex(L, -2));
+	lua_pop(L, 2);
+	return 1;
+}
+
+// package.searchers[2] replacement,  lualibs loaded through the cache
+static int script_searcher(lua_State *L) {
+	const char *name = luaL_checkstring(L, 1);
+
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "searchpath");
+	lua_pushstring(L, name);
+	lua_getfield(L, -3, "path");
+	lua_call(L, 2, 2);
+	if (lua_isnil(L, -2))
+		return 1;	// error message
+
+	const char *filename = lua_tostring(L, -2);
+	if (script_loadfile(L, filename) != 0)
+		return luaL_error(L, "error loading module " LUA_QS " from file " LUA_QS ":\n\t%s",
+			name, filename, lua_tostring(L, -1));
+
+	// lualibs stay loaded between runs
+	const char *exedir = get_my_executable_directory();
+	if (!strncmp(filename, exedir, strlen(exedir)) && !strncmp(filename + strlen(exedir), LUA_LIBRARIES_DIRECTORY, strlen(LUA_LIBRARIES_DIRECTORY))) {
+		luaL_getsubtable(L, LUA_REGISTRYINDEX, "pm3_lualibs");
+		lua_pushboolean(L, 1);
+		lua_setfield(L, -2, name);
+		lua_pop(L, 1);
+		lua_pushcclosure(L, script_lualib_loader, 1);
+	}
+
+	lua_pushstring(L, filename);
+	return 2;
+}
+
+static lua_State *script_vm(void) {
+	if (lua_vm)
+		return lua_vm;
+
+	lua_State *L = luaL_newstate();
+
+	// load Lua libraries
+	luaL_openlibs(L);
+
+	//Sets the pm3 core libraries, that go a bit 'under the hood'
+	set_pm3_libraries(L);
+
+	//Add the 'bin' library
+	set_bin_library(L);
+
+	//Add the 'bit' library
+	set_bit_library(L);
+	set_buf_library(L);
+
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "searchers");
+	lua_pushcfunction(L, script_searcher);
+	lua_rawseti(L, -2, 2);
+	lua_pop(L, 2);
+
+	lua_vm = L;
+	lua_vm_broken = false;
+	return L;
+}
+
+static void script_vm_reset(void) {
+	if (lua_vm_depth) {
+		lua_vm_broken = true;
+		return;
+	}
+	if (lua_vm)
+		lua_close(lua_vm);
+	lua_vm = NULL;
+	lua_vm_broken = false;
+}
+
+// run the chunk on top of the stack with its own globals,  args in 'args'
+static int script_call(lua_State *L, const char *arguments) {
+	lua_newtable(L);
+	lua_newtable(L);
+	lua_pushglobaltable(L);
+	lua_setfield(L, -2, "__index");
+	lua_setmetatable(L, -2);
+	lua_pushstring(L, arguments);
+	lua_setfield(L, -2, "args");
+	if (!lua_setupvalue(L, -2, 1))
+		lua_pop(L, 1);
+
+	if (lua_vm_depth == 0) {
+		luaL_getsubtable(L, LUA_REGISTRYINDEX, "_LOADED");
+		script_keys(L, -1);
+		lua_setfield(L, LUA_REGISTRYINDEX, "pm3_loaded_before");
+		lua_pushglobaltable(L);
+		script_keys(L, -1);
+		lua_setfield(L, LUA_REGISTRYINDEX, "pm3_globals_before");
+		lua_pop(L, 2);
+	}
+
+	lua_vm_depth++;
+	int error = lua_pcall(L, 0, 0, 0);
+	lua_vm_depth--;
+
+	// what the run put into the shared tables goes,  nested runs leave it to the outer one
+	if (lua_vm_depth == 0) {
+		luaL_getsubtable(L, LUA_REGISTRYINDEX, "_LOADED");
+		lua_getfield(L, LUA_REGISTRYINDEX, "pm3_loaded_before");
+		luaL_getsubtable(L, LUA_REGISTRYINDEX, "pm3_lualibs");
+		script_new_keys(L, -3, -2, script_clear_key, lua_absindex(L, -1));
+		lua_pop(L, 3);
+		lua_pushglobaltable(L);
+		lua_getfield(L, LUA_REGISTRYINDEX, "pm3_globals_before");
+		luaL_getsubtable(L, LUA_REGISTRYINDEX, "pm3_lualib_globals");
+		script_new_keys(L, -3, -2, script_clear_key, lua_absindex(L, -1));
+		lua_pop(L, 3);
+	}
+	return error;
+}
+
+static int script_run(const char *script_path, const char *arguments) {
+	lua_State *L = script_vm();
+	int top = lua_gettop(L);
+
+	// run the Lua script
+	int error = script_loadfile(L, script_path);
+	if (!error)
+		error = script_call(L, arguments);
+
+	if (error) // if non-0, then an error
+	{
+		// the top of the stack should be the error string
+		if (!lua_isstring(L, lua_gettop(L)))
+			PrintAndLogEx(FAILED, "Error - but no error (?!)");
+
+		// get the top of the stack as the error and pop it off
+		const char * str = lua_tostring(L, lua_gettop(L));
+		if (str)
+			puts(str);
+		lua_settop(L, top);
+		// state may be half modified,  start over next time
+		script_vm_reset();
+		return error;
+	}
+
+	lua_settop(L, top);
+	if (lua_vm_depth == 0) {
+		if (lua_vm_broken) {
+			script_vm_reset();
+		} else {
+			reset_pm3_async(L);
+			lua_gc(L, LUA_GCCOLLECT, 0);
+		}
+	}
+	return 0;
+}
+
+static void script_get_path(char *script_path, size_t len, const char *script_name) {
+	char *suffix = "";
+	if (!str_ends_with(script_name, ".lua")) {
+		suffix = ".lua";
+	}
+	snprintf(script_path, len, "%s%s%s%s", get_my_executable_directory(), LUA_SCRIPTS_DIRECTORY, script_name, suffix);
+}
+
 /**
  * @brief CmdScriptRun - executes a script file.
  * @param argc
@@ -101,22 +428,6 @@ int CmdScriptList(const char *Cmd) {
  * @return
  */
 int CmdScriptRun(const char *Cmd) {
-    // create new Lua state
-    lua_State *lua_state;
-    lua_state = luaL_newstate();
-
-    // load Lua libraries
-    luaL_openlibs(lua_state);
-
-    //Sets the pm3 core libraries, that go a bit 'under the hood'
-    set_pm3_libraries(lua_state);
-
-    //Add the 'bin' library
-    set_bin_library(lua_state);
-
-	//Add the 'bit' library
-	set_bit_library(lua_state);
-
     char script_name[128] = {0};
     char arguments[256] = {0};
 
@@ -128,47 +439,133 @@ int CmdScriptRun(const char *Cmd) {
     if (!endsWith(script_name, ".lua")) {
         suffix = ".lua";
 	}
-	
+
 	char script_path[strlen(get_my_executable_directory()) + strlen(LUA_SCRIPTS_DIRECTORY) + strlen(script_name) + strlen(suffix) + 1];
-	strcpy(script_path, get_my_executable_directory());
-	strcat(script_path, LUA_SCRIPTS_DIRECTORY);
-	strcat(script_path, script_name);
-	strcat(script_path, suffix);
+	script_get_path(script_path, sizeof(script_path), script_name);
 
     PrintAndLogEx(SUCCESS, "Executing: %s%s, args '%s'\n", script_name, suffix, arguments);
 
-    // run the Lua script
-    int error = luaL_loadfile(lua_state, script_path);
-    if (!error) {
-        lua_pushstring(lua_state, arguments);
-        lua_setglobal(lua_state, "args");
-
-        //Call it with 0 arguments
-         error = lua_pcall(lua_state, 0, LUA_MULTRET, 0); // once again, returns non-0 on error,
-    }
-    if (error) // if non-0, then an error
-    {
-        // the top of the stack should be the error string
-        if (!lua_isstring(lua_state, lua_gettop(lua_state)))
-            PrintAndLogEx(FAILED, "Error - but no error (?!)");
-
-        // get the top of the stack as the error and pop it off
-        const char * str = lua_tostring(lua_state, lua_gettop(lua_state));
-        lua_pop(lua_state, 1);
-        puts(str);
-    }
-
-    //luaL_dofile(lua_state, buf);
-    // close the Lua state
-    lua_close(lua_state);
+    script_run(script_path, arguments);
+
     PrintAndLogEx(SUCCESS, "\nFinished\n");
     return 0;
 }
 
+int CmdScriptReset(const char *Cmd) {
+	if (lua_vm_depth) {
+		PrintAndLogEx(WARNING, "Can't reset while a script is running, done when it returns");
+		lua_vm_broken = true;
+		return 0;
+	}
+	script_vm_reset();
+	script_cache_clear();
+	PrintAndLogEx(SUCCESS, "Lua state and script cache cleared");
+	return 0;
+}
+
+int usage_script_bench(void) {
+	PrintAndLogEx(NORMAL, "Run a script many times, cold (new Lua state, no cache) and warm,");
+	PrintAndLogEx(NORMAL, "and report the time per invocation. Filling the bytecode cache is timed apart");
+	PrintAndLogEx(NORMAL, "from the cold runs. Without a script name the common lualibs (commands, utils,");
+	PrintAndLogEx(NORMAL, "getopt) are loaded.");
+	PrintAndLogEx(NORMAL, "");
+	PrintAndLogEx(NORMAL, "Usage:  script bench [n <count>] [<name> [args]]");
+	PrintAndLogEx(NORMAL, "Options:");
+	PrintAndLogEx(NORMAL, "      h           : this help");
+	PrintAndLogEx(NORMAL, "      n <count>   : number of runs, default 100");
+	PrintAndLogEx(NORMAL, "");
+	PrintAndLogEx(NORMAL, "Examples:");
+	PrintAndLogEx(NORMAL, "      script bench");
+	PrintAndLogEx(NORMAL, "      script bench n 1000 test_t55x7_psk");
+	return 0;
+}
+
+static int script_bench_run(const char *script_path, const char *arguments) {
+	if (script_path[0])
+		return script_run(script_path, arguments);
+
+	static const char *libs = "local cmds = require('commands') local utils = require('utils') local getopt = require('getopt')";
+	lua_State *L = script_vm();
+	int top = lua_gettop(L);
+	int error = luaL_loadstring(L, libs);
+	if (!error)
+		error = script_call(L, arguments);
+	if (error)
+		PrintAndLogEx(FAILED, "%s", lua_tostring(L, -1));
+	lua_settop(L, top);
+	if (lua_vm_depth == 0)
+		lua_gc(L, LUA_GCCOLLECT, 0);
+	return error;
+}
+
+int CmdScriptBench(const char *Cmd) {
+	char script_name[128] = {0};
+	char arguments[256] = {0};
+	uint32_t count = 100;
+
+	char cmdp = param_getchar(Cmd, 0);
+	if (cmdp == 'h' || cmdp == 'H') return usage_script_bench();
+
+	if ((cmdp == 'n' || cmdp == 'N') && param_getlength(Cmd, 0) == 1) {
+		count = param_get32ex(Cmd, 1, 100, 10);
+		if (count == 0) count = 1;
+		Cmd += strspn(Cmd, " ");
+		Cmd += strcspn(Cmd, " ");
+		Cmd += strspn(Cmd, " ");
+		Cmd += strcspn(Cmd, " ");
+	}
+	sscanf(Cmd, "%127s %255[^\n\r]", script_name, arguments);
+
+	if (lua_vm_depth) {
+		PrintAndLogEx(WARNING, "Can't bench from inside a script");
+		return 1;
+	}
+
+	char script_path[strlen(get_my_executable_directory()) + strlen(LUA_SCRIPTS_DIRECTORY) + strlen(script_name) + 5];
+	script_path[0] = 0;
+	if (script_name[0])
+		script_get_path(script_path, sizeof(script_path), script_name);
+
+	PrintAndLogEx(INFO, "Benchmarking %s, %u runs", script_name[0] ? script_name : "lualibs loading", count);
+
+	// filling the cache is timed on its own,  it is not part of a cold run
+	uint64_t t_fill = 0;
+	uint64_t t_cold = usclock();
+	for (uint32_t i = 0; i < count; i++) {
+		script_vm_reset();
+		script_cache_clear();
+		script_cache_fill_us = 0;
+		if (script_bench_run(script_path, arguments)) {
+			PrintAndLogEx(FAILED, "Script failed, bench stopped");
+			return 1;
+		}
+		t_fill += script_cache_fill_us;
+	}
+	t_cold = usclock() - t_cold - t_fill;
+
+	uint64_t t_warm = usclock();
+	for (uint32_t i = 0; i < count; i++) {
+		if (script_bench_run(script_path, arguments)) {
+			PrintAndLogEx(FAILED, "Script failed, bench stopped");
+			return 1;
+		}
+	}
+	t_warm = usclock() - t_warm;
+
+	PrintAndLogEx(NORMAL, "");
+	PrintAndLogEx(SUCCESS, "cold (new state, parse) : %8.3f ms per run", (double)t_cold / 1000 / count);
+	PrintAndLogEx(SUCCESS, "cache fill (lua_dump)   : %8.3f ms per run", (double)t_fill / 1000 / count);
+	PrintAndLogEx(SUCCESS, "warm (kept state, cache): %8.3f ms per run", (double)t_warm / 1000 / count);
+	PrintAndLogEx(SUCCESS, "bytecode cache          : %u hits, %u misses", script_cache_hits, script_cache_misses);
+	return 0;
+}
+
 static command_t CommandTable[] = {
 	{"help",  CmdHelp,			1, "This help"},
 	{"list",  CmdScriptList,	1, "List available scripts"},
 	{"run",   CmdScriptRun,		1, "<name> -- Execute a script"},
+	{"bench", CmdScriptBench,	1, "[n <count>] [<name>] -- Per invocation overhead of running a script"},
+	{"reset", CmdScriptReset,	1, "Drop the kept Lua state and the script cache"},
 	{NULL, NULL, 0, NULL}
 };
 
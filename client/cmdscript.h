@@ -15,4 +15,6 @@ extern int CmdScript(const char *Cmd);
 
 extern int CmdScriptList(const char *Cmd);
 extern int CmdScriptRun(const char *Cmd);
+extern int CmdScriptBench(const char *Cmd);
+extern int CmdScriptReset(const char *Cmd);
 #endif
@@ -11,19 +11,50 @@
 
 static int CmdHelp(const char *Cmd);
 
-// trace pointer
+// trace pointer, into traceFile
 static uint8_t *trace;
-long traceLen = 0;
+uint32_t traceLen = 0;
+static tracefile_t traceFile;
 bool preRDV40 = true;
+
+// traceFile,  trace and the MIFARE decoder state are shared between the main thread
+// (trace list/load/save) and the usb receiver thread (trace stream).
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// traces are downloaded from device in chunks of this size
+#define TRACE_CHUNK_SIZE	0x4000
+
+// streaming sniff,  'trace stream'.  Records arrive in the usb receiver thread.
+// One device streams at a time,  records from the others are ignored
+typedef struct {
+	pm3_device *dev;		// device streaming,  NULL if none
+	FILE *f;
+	char filename[FILE_PATH_SIZE];
+	uint8_t protocol;
+	uint8_t *buf;			// all records of this sniff
+	uint32_t len;
+	uint32_t size;
+	uint32_t listed;		// records up to here are listed
+	uint32_t packets;
+	uint32_t dropped;		// records dropped on device,  as last reported
+} trace_stream_t;
+static trace_stream_t traceStream = { NULL, NULL, "trace_stream.bin", TRACE_PROTO_UNKNOWN, NULL, 0, 0, 0, 0, 0 };
 	
 int usage_trace_list(){
 	PrintAndLogEx(NORMAL, "List protocol data in trace buffer.");
-	PrintAndLogEx(NORMAL, "Usage:  trace list <protocol> [f][c| <0|1>");
+	PrintAndLogEx(NORMAL, "Usage:  trace list <protocol> [f][c][t <start> <end>][x <cmd>][r <record>][n <count>][p] <0|1>");
 	PrintAndLogEx(NORMAL, "    f      - show frame delay times as well");
 	PrintAndLogEx(NORMAL, "    c      - mark CRC bytes");
+	PrintAndLogEx(NORMAL, "    t      - only records in time window <start> - <end>, relative to start of trace");
+	PrintAndLogEx(NORMAL, "    x      - only reader frames starting with command byte <cmd> (hex), and their responses");
+	PrintAndLogEx(NORMAL, "    r      - start at record number <record>");
+	PrintAndLogEx(NORMAL, "    n      - show <count> records (default 1 when r is given)");
+	PrintAndLogEx(NORMAL, "    p      - decode records on all cpu cores, output order is kept (not for topaz/felica)");
 	PrintAndLogEx(NORMAL, "    <0|1>  - use data from Tracebuffer, if not set, try reading data from tag.");
+	PrintAndLogEx(NORMAL, "Filters skip records without decoding them, 'mf' decryption needs the full trace.");
 	PrintAndLogEx(NORMAL, "Supported <protocol> values:");
 	PrintAndLogEx(NORMAL, "    raw    - just show raw data without annotations");
+	PrintAndLogEx(NORMAL, "    auto   - guess protocol from trace");
 	PrintAndLogEx(NORMAL, "    14a    - interpret data as iso14443a communications");
 	PrintAndLogEx(NORMAL, "    mf     - interpret data as iso14443a communications and decrypt crypto1 stream");
 	PrintAndLogEx(NORMAL, "    14b    - interpret data as iso14443b communications");
@@ -41,33 +72,73 @@ int usage_trace_list(){
 	PrintAndLogEx(NORMAL, "Examples:");
 	PrintAndLogEx(NORMAL, "        trace list 14a f");
 	PrintAndLogEx(NORMAL, "        trace list iclass");
+	PrintAndLogEx(NORMAL, "        trace list 14a x 30 1");
+	PrintAndLogEx(NORMAL, "        trace list auto r 1000 n 20 1");
+	PrintAndLogEx(NORMAL, "        trace list mf p 1");
 	return 0;
 }
 int usage_trace_load(){
 	PrintAndLogEx(NORMAL, "Load protocol data from file to trace buffer.");
+	PrintAndLogEx(NORMAL, "The file is memory mapped, records are decoded when listed.");
 	PrintAndLogEx(NORMAL, "Usage:  trace load <filename>");
 	PrintAndLogEx(NORMAL, "Examples:");
-	PrintAndLogEx(NORMAL, "        trace lload mytracefile.bin");
+	PrintAndLogEx(NORMAL, "        trace load mytracefile.bin");
 	return 0;
 }
 int usage_trace_save(){
-	PrintAndLogEx(NORMAL, "Save protocol data from trace buffer to file.");
+	PrintAndLogEx(NORMAL, "Save protocol data from trace buffer to file, with a record index.");
 	PrintAndLogEx(NORMAL, "Usage:  trace save <filename>");
 	PrintAndLogEx(NORMAL, "Examples:");
 	PrintAndLogEx(NORMAL, "        trace save mytracefile.bin");
 	return 0;
 }
+int usage_trace_compact(){
+	PrintAndLogEx(NORMAL, "Record traces in a compact encoding,  to fit longer sniffs in the device's memory.");
+	PrintAndLogEx(NORMAL, "Timestamps are stored as deltas,  parity bits only when they aren't plain odd parity.");
+	PrintAndLogEx(NORMAL, "The client expands compact traces on download,  the setting applies from the next trace on.");
+	PrintAndLogEx(NORMAL, "Usage:  trace compact <0|1>");
+	PrintAndLogEx(NORMAL, "    0      - classic records (default)");
+	PrintAndLogEx(NORMAL, "    1      - compact records");
+	PrintAndLogEx(NORMAL, "Examples:");
+	PrintAndLogEx(NORMAL, "        trace compact 1");
+	return 0;
+}
+int usage_trace_stream(){
+	PrintAndLogEx(NORMAL, "Stream the trace to the client while sniffing,  instead of keeping it on the device.");
+	PrintAndLogEx(NORMAL, "The device sends records in the idle gaps between frames,  they are appended to a trace file");
+	PrintAndLogEx(NORMAL, "and listed as they arrive.  When USB falls behind,  records are dropped on the device and counted.");
+	PrintAndLogEx(NORMAL, "Works with 'hf 14a sniff' and 'hf iclass sniff',  each sniff starts the file over.");
+	PrintAndLogEx(NORMAL, "Usage:  trace stream <0|1> [f <filename>] [p <protocol>]");
+	PrintAndLogEx(NORMAL, "    0      - keep the trace on the device (default)");
+	PrintAndLogEx(NORMAL, "    1      - stream the trace,  from the next sniff on");
+	PrintAndLogEx(NORMAL, "    f      - trace file,  default trace_stream.bin");
+	PrintAndLogEx(NORMAL, "    p      - protocol for the live listing,  as in 'trace list'.  Default raw");
+	PrintAndLogEx(NORMAL, "Examples:");
+	PrintAndLogEx(NORMAL, "        trace stream 1 f mysniff.bin p 14a");
+	PrintAndLogEx(NORMAL, "        hf 14a sniff");
+	return 0;
+}
+int usage_trace_spill(){
+	PrintAndLogEx(NORMAL, "RDV40, move full trace buffers to flash memory instead of stopping the trace.");
+	PrintAndLogEx(NORMAL, "The trace spill area in flash memory (block 1 and 2) is overwritten.");
+	PrintAndLogEx(NORMAL, "Usage:  trace spill <0|1>");
+	PrintAndLogEx(NORMAL, "    0      - disable trace spill (default)");
+	PrintAndLogEx(NORMAL, "    1      - enable trace spill");
+	PrintAndLogEx(NORMAL, "Examples:");
+	PrintAndLogEx(NORMAL, "        trace spill 1");
+	return 0;
+}
 
-bool is_last_record(uint16_t tracepos, uint8_t *trace, uint16_t traceLen) {
+bool is_last_record(uint32_t tracepos, uint8_t *trace, uint32_t traceLen) {
 	return(tracepos + sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint16_t) >= traceLen);
 }
 
-bool next_record_is_response(uint16_t tracepos, uint8_t *trace) {
+bool next_record_is_response(uint32_t tracepos, uint8_t *trace) {
 	uint16_t next_records_datalen = *((uint16_t *)(trace + tracepos + sizeof(uint32_t) + sizeof(uint16_t)));	
 	return(next_records_datalen & 0x8000);
 }
 
-bool merge_topaz_reader_frames(uint32_t timestamp, uint32_t *duration, uint16_t *tracepos, uint16_t traceLen,
+bool merge_topaz_reader_frames(uint32_t timestamp, uint32_t *duration, uint32_t *tracepos, uint32_t traceLen,
 								uint8_t *trace, uint8_t *frame, uint8_t *topaz_reader_command, uint16_t *data_len) {
 
 #define MAX_TOPAZ_READER_CMD_LEN	16
@@ -105,20 +176,42 @@ bool merge_topaz_reader_frames(uint32_t timestamp, uint32_t *duration, uint16_t
 	return true;
 }
 
-uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trace, uint8_t protocol, bool showWaitCycles, bool markCRCBytes) {
+// one trace record, decoded and formatted.  Everything except the MIFARE crypto state.
+typedef struct {
+	uint32_t nextpos;			// start of next record,  or traceLen if last
+	uint32_t first_timestamp;
+	uint32_t timestamp;
+	uint32_t duration;
+	uint32_t next_timestamp;	// for frame delay time
+	bool valid;
+	bool isResponse;
+	bool showFdt;
+	uint16_t data_len;
+	uint16_t parity_len;
+	uint8_t *frame;
+	uint8_t *parityBytes;
+	uint8_t topaz_reader_command[MAX_TOPAZ_READER_CMD_LEN];
+	uint8_t crcStatus;
+	int num_lines;
+	char line[18][110];
+	char explanation[30];
+} trace_line_t;
+
+// Decode a record.  Only reads the trace,  so records can be decoded in parallel
+static void decodeTraceLine(trace_line_t *tl, uint32_t tracepos, uint32_t traceLen, uint8_t *trace, uint8_t protocol, bool showWaitCycles, bool markCRCBytes) {
+
+	tl->valid = false;
+	tl->showFdt = false;
+	tl->nextpos = traceLen;
+	memset(tl->explanation, 0, sizeof(tl->explanation));
+
 	// sanity check
-	if (tracepos + sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint16_t) > traceLen) return traceLen;
+	if (tracepos + sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint16_t) > traceLen) return;
 
-	bool isResponse;
 	uint16_t data_len, parity_len;
-	uint32_t duration, timestamp, first_timestamp, EndOfTransmissionTimestamp;
-	uint8_t topaz_reader_command[9];
-	char explanation[30] = {0};
-	uint8_t mfData[32] = {0};
-	size_t mfDataLen = 0;
+	uint32_t duration, timestamp;
 
-		
-	first_timestamp = *((uint32_t *)(trace));
+	tl->first_timestamp = *((uint32_t *)(trace));
 	timestamp = *((uint32_t *)(trace + tracepos));
 	tracepos += 4;
 
@@ -130,28 +223,41 @@ uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trace, ui
 
 	if (data_len & 0x8000) {
 		data_len &= 0x7fff;
-		isResponse = true;
+		tl->isResponse = true;
 	} else {
-		isResponse = false;
+		tl->isResponse = false;
 	}
 	parity_len = (data_len-1)/8 + 1;
 
-	if (tracepos + data_len + parity_len > traceLen) {
-		return traceLen;
-	}
+	if (tracepos + data_len + parity_len > traceLen) return;
+
 	uint8_t *frame = trace + tracepos;
 	tracepos += data_len;
-	uint8_t *parityBytes = trace + tracepos;
+	tl->parityBytes = trace + tracepos;
 	tracepos += parity_len;
 
-	if (protocol == TOPAZ && !isResponse) {
+	if (protocol == TOPAZ && !tl->isResponse) {
 		// topaz reader commands come in 1 or 9 separate frames with 7 or 8 Bits each.
 		// merge them:
-		if (merge_topaz_reader_frames(timestamp, &duration, &tracepos, traceLen, trace, frame, topaz_reader_command, &data_len)) {
-			frame = topaz_reader_command;
+		if (merge_topaz_reader_frames(timestamp, &duration, &tracepos, traceLen, trace, frame, tl->topaz_reader_command, &data_len)) {
+			frame = tl->topaz_reader_command;
 		}
 	}
+
+	tl->nextpos = tracepos;
+	tl->timestamp = timestamp;
+	tl->duration = duration;
+	tl->data_len = data_len;
+	tl->parity_len = parity_len;
+	tl->frame = frame;
+
+	if (data_len == 0) {
+		// <empty trace - possible error>
+		return;
+	}
 	
+	bool isResponse = tl->isResponse;
+
 	//Check the CRC status
 	uint8_t crcStatus = 2;
 
@@ -166,7 +272,6 @@ uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trace, ui
 				crcStatus = iso14443B_CRC_check(frame, data_len);
 				break;
 			case PROTO_MIFARE:
-				crcStatus = mifare_CRC_check(isResponse, frame, data_len);		
 			case ISO_14443A:
 			case MFDES:
 				crcStatus = iso14443A_CRC_check(isResponse, frame, data_len);
@@ -181,22 +286,21 @@ uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trace, ui
 	//0 CRC-command, CRC not ok
 	//1 CRC-command, CRC ok
 	//2 Not crc-command
+	tl->crcStatus = crcStatus;
 
 	//--- Draw the data column
-	char line[18][110];
-
 	for (int j = 0; j < data_len && j/18 < 18; j++) {
 
-		uint8_t parityBits = parityBytes[j >> 3];
+		uint8_t parityBits = tl->parityBytes[j >> 3];
 		if (protocol != LEGIC &&
 			protocol != ISO_14443B && 
 			protocol != ISO_7816_4 &&
 			(isResponse || protocol == ISO_14443A) &&
 			(oddparity8(frame[j]) != ((parityBits >> (7-(j&0x0007))) & 0x01))) {
 				
-			snprintf(line[j/18]+(( j % 18) * 4),110, "%02x! ", frame[j]);
+			snprintf(tl->line[j/18]+(( j % 18) * 4),110, "%02x! ", frame[j]);
 		} else {
-			snprintf(line[j/18]+(( j % 18) * 4),110, "%02x  ", frame[j]);
+			snprintf(tl->line[j/18]+(( j % 18) * 4),110, "%02x  ", frame[j]);
 		}
 
 	}
@@ -204,66 +308,89 @@ uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trace, ui
 	if (markCRCBytes) {
 		//CRC-command
 		if(crcStatus == 0 || crcStatus == 1) {
-			char *pos1 = line[(data_len-2)/18]+(((data_len-2) % 18) * 4);
+			char *pos1 = tl->line[(data_len-2)/18]+(((data_len-2) % 18) * 4);
 			(*pos1) = '[';
-			char *pos2 = line[(data_len)/18]+(((data_len) % 18) * 4);
+			char *pos2 = tl->line[(data_len)/18]+(((data_len) % 18) * 4);
 			sprintf(pos2, "%c", ']');
 		}
 	}
 
-	if (data_len == 0 ) {
-		sprintf(line[0],"<empty trace - possible error>");
-		return tracepos;
-	}
-
-	// Draw the CRC column
-	char *crc = (crcStatus == 0 ? "!crc" : (crcStatus == 1 ? " ok " : "    "));
-
-	EndOfTransmissionTimestamp = timestamp + duration;
-
 	// Always annotate LEGIC read/tag
 	if ( protocol == LEGIC )
-		annotateLegic(explanation, sizeof(explanation), frame, data_len);
+		annotateLegic(tl->explanation, sizeof(tl->explanation), frame, data_len);
 
-	if ( protocol == PROTO_MIFARE )
-		annotateMifare(explanation, sizeof(explanation), frame, data_len, parityBytes, parity_len, isResponse);
-		
+	// MIFARE annotation depends on the authentication state,  see printDecodedTraceLine
 	if (!isResponse)	{
+		char *explanation = tl->explanation;
 		switch(protocol) {
-			case ICLASS:		annotateIclass(explanation,sizeof(explanation),frame,data_len); break;
-			case ISO_14443A:	annotateIso14443a(explanation,sizeof(explanation),frame,data_len); break;
-			case MFDES:			annotateMfDesfire(explanation,sizeof(explanation),frame,data_len); break;
-			case ISO_14443B:	annotateIso14443b(explanation,sizeof(explanation),frame,data_len); break;
-			case TOPAZ:			annotateTopaz(explanation,sizeof(explanation),frame,data_len); break;
-			case ISO_7816_4:	annotateIso7816(explanation,sizeof(explanation),frame,data_len); break;
-			case ISO_15693:		annotateIso15693(explanation,sizeof(explanation),frame,data_len); break;
-			case FELICA:		annotateFelica(explanation,sizeof(explanation),frame,data_len); break;
+			case ICLASS:		annotateIclass(explanation,sizeof(tl->explanation),frame,data_len); break;
+			case ISO_14443A:	annotateIso14443a(explanation,sizeof(tl->explanation),frame,data_len); break;
+			case MFDES:			annotateMfDesfire(explanation,sizeof(tl->explanation),frame,data_len); break;
+			case ISO_14443B:	annotateIso14443b(explanation,sizeof(tl->explanation),frame,data_len); break;
+			case TOPAZ:			annotateTopaz(explanation,sizeof(tl->explanation),frame,data_len); break;
+			case ISO_7816_4:	annotateIso7816(explanation,sizeof(tl->explanation),frame,data_len); break;
+			case ISO_15693:		annotateIso15693(explanation,sizeof(tl->explanation),frame,data_len); break;
+			case FELICA:		annotateFelica(explanation,sizeof(tl->explanation),frame,data_len); break;
 			default:			break;
 		}
 	}
 
-	int num_lines = MIN((data_len - 1)/18 + 1, 18);
+	tl->num_lines = MIN((data_len - 1)/18 + 1, 18);
+	tl->valid = true;
+
+	if (is_last_record(tracepos, trace, traceLen)) {
+		tl->nextpos = traceLen;
+		return;
+	}
+
+	if (showWaitCycles && !isResponse && next_record_is_response(tracepos, trace)) {
+		tl->showFdt = true;
+		tl->next_timestamp = *((uint32_t *)(trace + tracepos));
+	}
+}
+
+// Print a decoded record.  The MIFARE authentication state and crypto1 stream are tracked here,
+// so records must be passed in trace order.
+static void printDecodedTraceLine(trace_line_t *tl, uint8_t protocol) {
+
+	if (!tl->valid) return;
+
+	uint8_t mfData[32] = {0};
+	size_t mfDataLen = 0;
+	bool isResponse = tl->isResponse;
+	char *explanation = tl->explanation;
+
+	if ( protocol == PROTO_MIFARE )
+		annotateMifare(explanation, sizeof(tl->explanation), tl->frame, tl->data_len, tl->parityBytes, tl->parity_len, isResponse);
+
+	// Draw the CRC column
+	char *crc = (tl->crcStatus == 0 ? "!crc" : (tl->crcStatus == 1 ? " ok " : "    "));
+
+	uint32_t EndOfTransmissionTimestamp = tl->timestamp + tl->duration;
+	uint32_t first_timestamp = tl->first_timestamp;
+	int num_lines = tl->num_lines;
+
 	for (int j = 0; j < num_lines ; j++) {
 		if (j == 0) {
 			PrintAndLogEx(NORMAL, " %10u | %10u | %s |%-72s | %s| %s",
-				(timestamp - first_timestamp),
+				(tl->timestamp - first_timestamp),
 				(EndOfTransmissionTimestamp - first_timestamp),
 				(isResponse ? "Tag" : "Rdr"),
-				line[j],
+				tl->line[j],
 				(j == num_lines-1) ? crc : "    ",
 				(j == num_lines-1) ? explanation : "");
 		} else {
 			PrintAndLogEx(NORMAL, "            |            |     |%-72s | %s| %s",
-				line[j],
+				tl->line[j],
 				(j == num_lines-1) ? crc : "    ",
 				(j == num_lines-1) ? explanation : "");
 		}
 	}
 
-	if (DecodeMifareData(frame, data_len, parityBytes, isResponse, mfData, &mfDataLen)) {
-		memset(explanation, 0x00, sizeof(explanation));
+	if (DecodeMifareData(tl->frame, tl->data_len, tl->parityBytes, isResponse, mfData, &mfDataLen)) {
+		memset(explanation, 0x00, sizeof(tl->explanation));
 		if (!isResponse) {
-			annotateIso14443a(explanation, sizeof(explanation), mfData, mfDataLen);
+			annotateIso14443a(explanation, sizeof(tl->explanation), mfData, mfDataLen);
 		}
 		uint8_t crcc = iso14443A_CRC_check(isResponse, mfData, mfDataLen);
 		PrintAndLogEx(NORMAL, "            |            |  *  |%-72s | %-4s| %s",
@@ -272,25 +399,144 @@ uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trace, ui
 			explanation);
 	};
 
-	if (is_last_record(tracepos, trace, traceLen)) return traceLen;
-	
-	if (showWaitCycles && !isResponse && next_record_is_response(tracepos, trace)) {
-		uint32_t next_timestamp = *((uint32_t *)(trace + tracepos));
-			PrintAndLogEx(NORMAL, " %10u | %10u | %s |fdt (Frame Delay Time): %d",
-				(EndOfTransmissionTimestamp - first_timestamp),
-				(next_timestamp - first_timestamp),
-				"   ",
-				(next_timestamp - EndOfTransmissionTimestamp));
+	if (tl->showFdt) {
+		PrintAndLogEx(NORMAL, " %10u | %10u | %s |fdt (Frame Delay Time): %d",
+			(EndOfTransmissionTimestamp - first_timestamp),
+			(tl->next_timestamp - first_timestamp),
+			"   ",
+			(tl->next_timestamp - EndOfTransmissionTimestamp));
+	}
+}
+
+uint32_t printTraceLine(uint32_t tracepos, uint32_t traceLen, uint8_t *trace, uint8_t protocol, bool showWaitCycles, bool markCRCBytes) {
+	trace_line_t tl;
+	decodeTraceLine(&tl, tracepos, traceLen, trace, protocol, showWaitCycles, markCRCBytes);
+	printDecodedTraceLine(&tl, protocol);
+	return tl.nextpos;
+}
+
+// Pipelined listing.  Worker threads decode records into a ring of slots,  the caller
+// prints them in trace order.  Only the MIFARE crypto chain is left to the printing thread.
+#define TRACE_PIPE_SLOTS	1024
+
+typedef struct {
+	trace_line_t *slots;
+	bool *ready;
+	uint32_t *positions;
+	uint32_t count;
+	uint32_t next;			// next record to decode
+	uint32_t written;		// records printed
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint32_t traceLen;
+	uint8_t *trace;
+	uint8_t protocol;
+	bool showWaitCycles;
+	bool markCRCBytes;
+} trace_pipe_t;
+
+static void *decodeTraceWorker(void *arg) {
+	trace_pipe_t *p = (trace_pipe_t *)arg;
+
+	while (true) {
+		pthread_mutex_lock(&p->lock);
+		while (p->next < p->count && p->next - p->written >= TRACE_PIPE_SLOTS)
+			pthread_cond_wait(&p->cond, &p->lock);
+
+		if (p->next >= p->count) {
+			pthread_mutex_unlock(&p->lock);
+			break;
 		}
+		uint32_t i = p->next++;
+		pthread_mutex_unlock(&p->lock);
+
+		decodeTraceLine(&p->slots[i % TRACE_PIPE_SLOTS], p->positions[i], p->traceLen, p->trace, p->protocol, p->showWaitCycles, p->markCRCBytes);
+
+		pthread_mutex_lock(&p->lock);
+		p->ready[i % TRACE_PIPE_SLOTS] = true;
+		pthread_cond_broadcast(&p->cond);
+		pthread_mutex_unlock(&p->lock);
+	}
+	return NULL;
+}
+
+static int printTraceParallel(uint32_t *positions, uint32_t count, uint32_t traceLen, uint8_t *trace, uint8_t protocol, bool showWaitCycles, bool markCRCBytes) {
+
+	trace_pipe_t p;
+	memset(&p, 0, sizeof(p));
+	p.slots = calloc(TRACE_PIPE_SLOTS, sizeof(trace_line_t));
+	p.ready = calloc(TRACE_PIPE_SLOTS, sizeof(bool));
+	if (!p.slots || !p.ready) {
+		free(p.slots);
+		free(p.ready);
+		return 1;
+	}
+	p.positions = positions;
+	p.count = count;
+	p.traceLen = traceLen;
+	p.trace = trace;
+	p.protocol = protocol;
+	p.showWaitCycles = showWaitCycles;
+	p.markCRCBytes = markCRCBytes;
+	pthread_mutex_init(&p.lock, NULL);
+	pthread_cond_init(&p.cond, NULL);
+
+	// crc lookup table is shared.  14443a/b, 15693 and iclass all use the same table,
+	// once it is generated the workers' crc checks only read it.
+	init_table(CRC_14443_A);
+
+	int num_threads = MAX(num_CPUs() - 1, 1);
+	pthread_t *threads = calloc(num_threads, sizeof(pthread_t));
+	int started = 0;
+	if (threads) {
+		for (; started < num_threads; started++) {
+			if (pthread_create(&threads[started], NULL, decodeTraceWorker, &p))
+				break;
+		}
+	}
+	if (started == 0) {
+		free(threads);
+		pthread_cond_destroy(&p.cond);
+		pthread_mutex_destroy(&p.lock);
+		free(p.ready);
+		free(p.slots);
+		return 1;
+	}
 
-	return tracepos;
+	// ordered writer
+	for (uint32_t i = 0; i < count; i++) {
+		trace_line_t *tl = &p.slots[i % TRACE_PIPE_SLOTS];
+
+		pthread_mutex_lock(&p.lock);
+		while (!p.ready[i % TRACE_PIPE_SLOTS])
+			pthread_cond_wait(&p.cond, &p.lock);
+		pthread_mutex_unlock(&p.lock);
+
+		printDecodedTraceLine(tl, protocol);
+
+		pthread_mutex_lock(&p.lock);
+		p.ready[i % TRACE_PIPE_SLOTS] = false;
+		p.written++;
+		pthread_cond_broadcast(&p.cond);
+		pthread_mutex_unlock(&p.lock);
+	}
+
+	for (int i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	pthread_cond_destroy(&p.cond);
+	pthread_mutex_destroy(&p.lock);
+	free(p.ready);
+	free(p.slots);
+	return 0;
 }
 
-void printFelica(uint16_t traceLen, uint8_t *trace) {
+void printFelica(uint32_t traceLen, uint8_t *trace) {
 
 	PrintAndLogEx(NORMAL, "    Gap | Src | Data                            | CRC      | Annotation        |");
 	PrintAndLogEx(NORMAL, "--------|-----|---------------------------------|----------|-------------------|");
-    uint16_t tracepos = 0;
+    uint32_t tracepos = 0;
 
     while( tracepos < traceLen) {
 
@@ -404,6 +650,140 @@ static int SanityOfflineCheck( bool useTraceBuffer ){
 	return 1;
 }
 
+static const char *protocolName(uint8_t protocol) {
+	switch (protocol) {
+		case ISO_14443A:	return "14a";
+		case ICLASS:		return "iclass";
+		case ISO_14443B:	return "14b";
+		case TOPAZ:			return "topaz";
+		case ISO_7816_4:	return "7816";
+		case MFDES:			return "des";
+		case LEGIC:			return "legic";
+		case ISO_15693:		return "15";
+		case FELICA:		return "felica";
+		case PROTO_MIFARE:	return "mf";
+		default:			return "raw";
+	}
+}
+
+static bool protocolByName(const char *name, uint8_t *protocol) {
+	if (strcmp(name,     "iclass") == 0)	*protocol = ICLASS;
+	else if(strcmp(name, "14a") == 0)		*protocol = ISO_14443A;
+	else if(strcmp(name, "14b") == 0)		*protocol = ISO_14443B;
+	else if(strcmp(name, "topaz") == 0)		*protocol = TOPAZ;
+	else if(strcmp(name, "7816") == 0)		*protocol = ISO_7816_4;	
+	else if(strcmp(name, "des") == 0)		*protocol = MFDES;
+	else if(strcmp(name, "legic") == 0)		*protocol = LEGIC;
+	else if(strcmp(name, "15") == 0)		*protocol = ISO_15693;
+	else if(strcmp(name, "felica") == 0)	*protocol = FELICA;
+	else if(strcmp(name, "mf") == 0)		*protocol = PROTO_MIFARE;
+	else if(strcmp(name, "raw") == 0)		*protocol = -1;//No crc, no annotations
+	else return false;
+	return true;
+}
+
+// download the trace from device, in chunks.
+// The trace starts with the part spilled to flash memory (if any), followed by the part still in BigBuf.
+// the current trace is replaced,  caller holds trace_lock
+static void setTraceFile(tracefile_t *tf) {
+	tracefile_release(&traceFile);
+	traceFile = *tf;
+	trace = traceFile.data;
+	traceLen = traceFile.len;
+}
+
+// download into tf,  no locks held while waiting for the device
+static int downloadTrace(tracefile_t *tf) {
+
+	UsbCommand resp;
+	uint32_t len = 0, spilled = 0;
+	bool hasHeader = false, compact = false;
+
+	// older firmware doesn't answer CMD_TRACE_INFO,  ask what it knows first (once per connection)
+	pm3_device *dev = CurrentDevice();
+	if (dev->dev_info == 0) {
+		clearCommandBuffer();
+		UsbCommand info = {CMD_DEVICE_INFO, {0, 0, 0}};
+		SendCommand(&info);
+		if (WaitForResponseTimeout(CMD_DEVICE_INFO, &resp, 1000))
+			dev->dev_info = resp.arg[0];
+	}
+
+	if (dev->dev_info & DEVICE_INFO_FLAG_TRACE_INFO) {
+		clearCommandBuffer();
+		UsbCommand c = {CMD_TRACE_INFO, {0, 0, 0}};
+		SendCommand(&c);
+		if (WaitForResponseTimeout(CMD_ACK, &resp, 2000)) {
+			trace_header_t *hdr = (trace_header_t *)resp.d.asBytes;
+			if (hdr->magic == TRACE_HEADER_MAGIC && (hdr->version == TRACE_FORMAT_VERSION || hdr->version == TRACE_FORMAT_COMPACT)) {
+				compact = (hdr->version == TRACE_FORMAT_COMPACT);
+				len = hdr->length;
+				spilled = hdr->spilled;
+				hasHeader = true;
+				if (spilled > len) {
+					PrintAndLogEx(WARNING, "invalid trace info, %u bytes in flash memory for a %u bytes trace", spilled, len);
+					return 1;
+				}
+				if (hdr->segments > 1)
+					PrintAndLogEx(INFO, "trace recorded in %u segments, %u bytes in flash memory", hdr->segments, spilled);
+			}
+		}
+	}
+
+	uint8_t probe[USB_CMD_DATA_SIZE];
+	if (!hasHeader) {
+		// older firmware, query for the size of the trace,  downloading USB_CMD_DATA_SIZE
+		if ( !GetFromDevice(BIG_BUF, probe, USB_CMD_DATA_SIZE, 0, &resp, 4000, true)) {
+			PrintAndLogEx(WARNING, "timeout while waiting for reply.");
+			return 1;
+		}
+		len = resp.arg[2];
+	}
+
+	memset(tf, 0, sizeof(tracefile_t));
+
+	uint8_t *buf = calloc(MAX(len, USB_CMD_DATA_SIZE), sizeof(uint8_t));
+	if (buf == NULL) {
+		PrintAndLogEx(FAILED, "Cannot allocate memory for trace");
+		return 2;
+	}
+	tf->data = buf;
+
+	// BigBuf part first, downloading flash memory allocates BigBuf on device
+	for (uint32_t i = 0; i < len - spilled; i += TRACE_CHUNK_SIZE) {
+		uint32_t chunk = MIN(TRACE_CHUNK_SIZE, len - spilled - i);
+		if ( !GetFromDevice(BIG_BUF, buf + spilled + i, chunk, i, NULL, 2500, false)) {
+			PrintAndLogEx(WARNING, "command execution time out");
+			tracefile_release(tf);
+			return 3;
+		}
+	}
+
+	for (uint32_t i = 0; i < spilled; i += TRACE_CHUNK_SIZE) {
+		uint32_t chunk = MIN(TRACE_CHUNK_SIZE, spilled - i);
+		if ( !GetFromDevice(FLASH_MEM, buf + i, chunk, FLASH_MEM_TRACE_OFFSET + i, NULL, 2500, false)) {
+			PrintAndLogEx(WARNING, "command execution time out");
+			tracefile_release(tf);
+			return 3;
+		}
+	}
+
+	tf->len = len;
+	if (compact) {
+		if (tracefile_expand_compact(tf)) {
+			PrintAndLogEx(FAILED, "Cannot allocate memory for trace");
+			tracefile_release(tf);
+			return 2;
+		}
+		PrintAndLogEx(INFO, "compact trace, %u bytes on device, %u bytes expanded", len, tf->len);
+	} else if (tracefile_build_index(tf)) {
+		PrintAndLogEx(FAILED, "Cannot allocate memory for trace index");
+		tracefile_release(tf);
+		return 2;
+	}
+	return 0;
+}
+
 int CmdTraceList(const char *Cmd) {
 
 	clearCommandBuffer();
@@ -412,13 +792,16 @@ int CmdTraceList(const char *Cmd) {
 	bool markCRCBytes = false;
 	bool isOnline = true;
 	bool errors = false;
+	bool autoDetect = false;
+	bool filterTime = false;
+	bool filterCmd = false;
+	bool parallel = false;
 	uint8_t protocol = 0;
+	uint8_t filterCmdByte = 0;
+	uint32_t timeStart = 0, timeEnd = UINT32_MAX;
+	uint32_t firstRecord = 0, numRecords = UINT32_MAX;
 	char type[10] = {0};
 
-	//int tlen = param_getstr(Cmd,0,type);
-	//char param1 = param_getchar(Cmd, 1);
-	//char param2 = param_getchar(Cmd, 2);
-
 	char cmdp = 0;
 	while (param_getchar(Cmd, cmdp) != 0x00 && !errors) {
 		
@@ -444,6 +827,31 @@ int CmdTraceList(const char *Cmd) {
 				isOnline = false;
 				cmdp++;				
 				break;
+			case 't':
+				filterTime = true;
+				timeStart = param_get32ex(Cmd, cmdp+1, 0, 10);
+				timeEnd = param_get32ex(Cmd, cmdp+2, UINT32_MAX, 10);
+				cmdp += 3;
+				break;
+			case 'x':
+				filterCmd = true;
+				filterCmdByte = param_get8ex(Cmd, cmdp+1, 0, 16);
+				cmdp += 2;
+				break;
+			case 'r':
+				firstRecord = param_get32ex(Cmd, cmdp+1, 0, 10);
+				if (numRecords == UINT32_MAX)
+					numRecords = 1;
+				cmdp += 2;
+				break;
+			case 'n':
+				numRecords = param_get32ex(Cmd, cmdp+1, 1, 10);
+				cmdp += 2;
+				break;
+			case 'p':
+				parallel = true;
+				cmdp++;
+				break;
 			default:
 				PrintAndLogEx(WARNING, "Unknown parameter '%c'", param_getchar(Cmd, cmdp));
 				errors = true;
@@ -455,18 +863,8 @@ int CmdTraceList(const char *Cmd) {
 			str_lower(type);
 			
 			// validate type of output
-			if (strcmp(type,     "iclass") == 0)	protocol = ICLASS;
-			else if(strcmp(type, "14a") == 0)		protocol = ISO_14443A;
-			else if(strcmp(type, "14b") == 0)		protocol = ISO_14443B;
-			else if(strcmp(type, "topaz") == 0)		protocol = TOPAZ;
-			else if(strcmp(type, "7816") == 0)		protocol = ISO_7816_4;	
-			else if(strcmp(type, "des") == 0)		protocol = MFDES;
-			else if(strcmp(type, "legic") == 0)		protocol = LEGIC;
-			else if(strcmp(type, "15") == 0)		protocol = ISO_15693;
-			else if(strcmp(type, "felica") == 0)	protocol = FELICA;
-			else if(strcmp(type, "mf") == 0)		protocol = PROTO_MIFARE;
-			else if(strcmp(type, "raw") == 0)		protocol = -1;//No crc, no annotations
-			else errors = true;
+			if (strcmp(type, "auto") == 0)			autoDetect = true;
+			else if (!protocolByName(type, &protocol)) errors = true;
 			
 			cmdp++;
 		}		
@@ -477,40 +875,29 @@ int CmdTraceList(const char *Cmd) {
 	//Validations
 	if (errors) return usage_trace_list();
 	
-	uint16_t tracepos = 0;
-	// reserv some space.
-	if (!trace) {
-		printf("trace pointer not allocated\n");
-		trace = calloc(USB_CMD_DATA_SIZE, sizeof(uint8_t));
-	}
-	
+	tracefile_t dl;
 	if ( isOnline ) {
-		// Query for the size of the trace,  downloading USB_CMD_DATA_SIZE
-		UsbCommand response;
-		if ( !GetFromDevice(BIG_BUF, trace, USB_CMD_DATA_SIZE, 0, &response, 4000, true)) {
-			PrintAndLogEx(WARNING, "timeout while waiting for reply.");
-			return 1;
-		}
-		
-		traceLen = response.arg[2];
-		if (traceLen > USB_CMD_DATA_SIZE) {
-			uint8_t *p = realloc(trace, traceLen);
-			if (p == NULL) {
-				PrintAndLogEx(FAILED, "Cannot allocate memory for trace");
-				free(trace);
-				return 2;
-			}
-			trace = p;
-			if ( !GetFromDevice(BIG_BUF, trace, traceLen, 0, NULL, 2500, false)) {
-				PrintAndLogEx(WARNING, "command execution time out");
-				free(trace);
-				return 3;
-			}
-		}		
+		int res = downloadTrace(&dl);
+		if (res) return res;
+	}
+
+	pthread_mutex_lock(&trace_lock);
+	if ( isOnline )
+		setTraceFile(&dl);
+
+	if (autoDetect) {
+		protocol = tracefile_dominant_protocol(&traceFile);
+		PrintAndLogEx(INFO, "guessed protocol: %s", (protocol == TRACE_PROTO_UNKNOWN) ? "none, showing raw data" : protocolName(protocol));
 	}
 
-	PrintAndLogEx(NORMAL, "Recorded Activity (TraceLen = %d bytes)", traceLen);
+	PrintAndLogEx(NORMAL, "Recorded Activity (TraceLen = %u bytes, %u records)", traceLen, traceFile.count);
 	PrintAndLogEx(NORMAL, "");
+	// no room for a single timestamp,  let alone a record
+	if (traceLen < sizeof(uint32_t)) {
+		pthread_mutex_unlock(&trace_lock);
+		return 0;
+	}
+
 	if (protocol == FELICA) {
 		printFelica(traceLen, trace);
 	} else { 
@@ -532,73 +919,314 @@ int CmdTraceList(const char *Cmd) {
 		PrintAndLogEx(NORMAL, "------------+------------+-----+-------------------------------------------------------------------------+-----+--------------------");
 
 		ClearAuthData();
-		while (tracepos < traceLen) {
-			tracepos = printTraceLine(tracepos, traceLen, trace, protocol, showWaitCycles, markCRCBytes);
+
+		// walk the index,  only records passing the filters are decoded
+		uint32_t first_timestamp = *((uint32_t *)(trace));
+		uint32_t i = firstRecord;
+		if (filterTime)
+			i = MAX(i, tracefile_find_time(&traceFile, first_timestamp + timeStart));
+
+		// topaz frames are merged while walking the trace
+		if (protocol == TOPAZ) parallel = false;
+
+		uint32_t *positions = NULL;
+		if (parallel) {
+			positions = calloc(MIN(traceFile.count, numRecords), sizeof(uint32_t));
+			if (!positions) {
+				PrintAndLogEx(WARNING, "Cannot allocate memory, listing records one by one");
+				parallel = false;
+			}
+		}
+
+		uint32_t tracepos = 0, shown = 0;
+		bool lastShown = false;
+		for (; i < traceFile.count && shown < numRecords; i++) {
+			trace_index_entry_t *e = &traceFile.index[i];
+
+			// merged frames (topaz) are already printed
+			if (e->offset < tracepos) continue;
+
+			if (filterTime && e->timestamp - first_timestamp > timeEnd) break;
+
+			if (filterCmd) {
+				// reader frames with the command byte,  and the tag responses to them
+				bool isResponse = e->flags & TRACE_IDX_RESPONSE;
+				lastShown = isResponse ? lastShown : (e->data_len && e->cmd == filterCmdByte);
+				if (!lastShown) continue;
+			}
+
+			if (parallel)
+				positions[shown] = e->offset;
+			else
+				tracepos = printTraceLine(e->offset, traceLen, trace, protocol, showWaitCycles, markCRCBytes);
+			shown++;
+		}
+
+		if (parallel) {
+			if (printTraceParallel(positions, shown, traceLen, trace, protocol, showWaitCycles, markCRCBytes)) {
+				PrintAndLogEx(WARNING, "Cannot start decoder threads, listing records one by one");
+				for (uint32_t j = 0; j < shown; j++)
+					printTraceLine(positions[j], traceLen, trace, protocol, showWaitCycles, markCRCBytes);
+			}
+			free(positions);
 		}
 	}
+	pthread_mutex_unlock(&trace_lock);
 	return 0;
 }
 
 int CmdTraceLoad(const char *Cmd) {
 	
-	FILE *f = NULL;
 	char filename[FILE_PATH_SIZE];
 	char cmdp = param_getchar(Cmd, 0);
 	if (strlen(Cmd) < 1 || cmdp == 'h' || cmdp == 'H') return usage_trace_load();	
 	
 	param_getstr(Cmd, 0, filename, sizeof(filename));	
-	
-	if ((f = fopen(filename, "rb")) == NULL) { 
-		PrintAndLogEx(FAILED, "Could not open file %s", filename);
-		return 0;
-	}
-	
-	// get filesize in order to malloc memory
-	fseek(f, 0, SEEK_END);
-	long fsize = ftell(f);
-	fseek(f, 0, SEEK_SET);	
-	
-	if (fsize < 0) 	{
-		PrintAndLogEx(FAILED, "error, when getting filesize");
-		fclose(f);
-		return 3;
-	}
-	if (fsize < 4 ) 	{
-		PrintAndLogEx(FAILED, "error, file is too small");
-		fclose(f);
-		return 4;
-	}	
-
-	if ( trace )
-		free(trace);
-
-	trace = calloc(fsize, sizeof(uint8_t));
-	if (!trace) {
-		PrintAndLogEx(FAILED, "Cannot allocate memory for trace");
-		fclose(f);		
-		return 2;
-	}
-	
-	size_t bytes_read = fread(trace, 1, fsize, f);
-	traceLen = bytes_read;
-	fclose(f);
-	PrintAndLogEx(SUCCESS, "Recorded Activity (TraceLen = %d bytes) loaded from file %s", traceLen, filename);	
+
+	tracefile_t tf;
+	memset(&tf, 0, sizeof(tf));
+	int res = tracefile_map(&tf, filename);
+	if (res) return res;
+
+	pthread_mutex_lock(&trace_lock);
+	setTraceFile(&tf);
+	PrintAndLogEx(SUCCESS, "Recorded Activity (TraceLen = %u bytes, %u records) loaded from file %s", traceLen, traceFile.count, filename);	
+	pthread_mutex_unlock(&trace_lock);
 	return 0;
 }
 
 int CmdTraceSave(const char *Cmd) {
 	
+	char filename[FILE_PATH_SIZE];
+	char cmdp = param_getchar(Cmd, 0);
+	if (strlen(Cmd) < 1 || cmdp == 'h' || cmdp == 'H') return usage_trace_save();
+	
+	param_getstr(Cmd, 0, filename, sizeof(filename));
+
+	pthread_mutex_lock(&trace_lock);
 	if (traceLen == 0 ) {
+		pthread_mutex_unlock(&trace_lock);
 		PrintAndLogEx(WARNING, "trace is empty, exiting...");
 		return 0;
 	}
-	
-	char filename[FILE_PATH_SIZE];
+
+	// save with header and record index
+	int res = tracefile_save(filename, trace, traceLen, traceFile.index, traceFile.count);
+	pthread_mutex_unlock(&trace_lock);
+	return res;
+}
+
+int CmdTraceSpill(const char *Cmd) {
 	char cmdp = param_getchar(Cmd, 0);
-	if (strlen(Cmd) < 1 || cmdp == 'h' || cmdp == 'H') return usage_trace_save();
-	
-	param_getstr(Cmd, 0, filename, sizeof(filename));		
-	saveFile(filename, "bin", trace, traceLen);
+	if (strlen(Cmd) < 1 || (cmdp != '0' && cmdp != '1')) return usage_trace_spill();
+
+	UsbCommand c = {CMD_TRACE_SPILL, {cmdp - '0', 0, 0}};
+	clearCommandBuffer();
+	SendCommand(&c);
+	if ( !WaitForResponseTimeout(CMD_ACK, NULL, 2000)) {
+		PrintAndLogEx(WARNING, "timeout while waiting for reply.");
+		return 1;
+	}
+	PrintAndLogEx(SUCCESS, "trace spill to flash memory %s", (cmdp == '1') ? "enabled" : "disabled");
+	if (cmdp == '1')
+		PrintAndLogEx(WARNING, "sniffs overwrite flash memory 0x%05X - 0x%05X", FLASH_MEM_TRACE_OFFSET, FLASH_MEM_TRACE_OFFSET + FLASH_MEM_TRACE_SIZE - 1);
+	return 0;
+}
+
+int CmdTraceCompact(const char *Cmd) {
+	char cmdp = param_getchar(Cmd, 0);
+	if (strlen(Cmd) < 1 || (cmdp != '0' && cmdp != '1')) return usage_trace_compact();
+
+	UsbCommand c = {CMD_TRACE_COMPACT, {cmdp - '0', 0, 0}};
+	clearCommandBuffer();
+	SendCommand(&c);
+	if ( !WaitForResponseTimeout(CMD_ACK, NULL, 2000)) {
+		PrintAndLogEx(WARNING, "timeout while waiting for reply.");
+		return 1;
+	}
+	PrintAndLogEx(SUCCESS, "compact trace encoding %s", (cmdp == '1') ? "enabled" : "disabled");
+	return 0;
+}
+
+// rewrite the header,  so the file is a valid trace at any time
+static void streamUpdateHeader(void) {
+	trace_header_t hdr = {TRACE_HEADER_MAGIC, TRACE_FORMAT_VERSION, 1, traceStream.len, 0};
+	fseek(traceStream.f, 0, SEEK_SET);
+	fwrite(&hdr, sizeof(hdr), 1, traceStream.f);
+	fseek(traceStream.f, 0, SEEK_END);
+	fflush(traceStream.f);
+}
+
+static int streamOpen(void) {
+	free(traceStream.buf);
+	traceStream.buf = NULL;
+	traceStream.len = traceStream.size = traceStream.listed = 0;
+	traceStream.packets = traceStream.dropped = 0;
+
+	traceStream.f = fopen(traceStream.filename, "wb");
+	if (!traceStream.f) {
+		PrintAndLogEx(FAILED, "Could not create file %s", traceStream.filename);
+		return 1;
+	}
+	streamUpdateHeader();
+	return 0;
+}
+
+static void streamClose(void) {
+	if (traceStream.f) {
+		fclose(traceStream.f);
+		traceStream.f = NULL;
+	}
+}
+
+// CMD_TRACE_STREAM_DATA,  whole classic records
+static void streamData(UsbCommand *c) {
+	uint32_t n = MIN(c->arg[0], USB_CMD_DATA_SIZE);
+
+	// first packet of a sniff
+	if (c->arg[2] == 0) {
+		if (streamOpen()) return;
+		PrintAndLogEx(INFO, "streaming trace to %s", traceStream.filename);
+		PrintAndLogEx(NORMAL, "      Start |        End | Src | Data (! denotes parity error)                                           | CRC | Annotation");
+		PrintAndLogEx(NORMAL, "------------+------------+-----+-------------------------------------------------------------------------+-----+--------------------");
+		ClearAuthData();
+	}
+	if (!traceStream.f) return;
+
+	if (c->arg[2] != traceStream.packets)
+		PrintAndLogEx(WARNING, "stream packets lost, expected #%u, got #%u", traceStream.packets, (uint32_t)c->arg[2]);
+	traceStream.packets = c->arg[2] + 1;
+
+	if (c->arg[1] > traceStream.dropped) {
+		PrintAndLogEx(WARNING, "%u records dropped on device, USB fell behind", (uint32_t)(c->arg[1] - traceStream.dropped));
+		traceStream.dropped = c->arg[1];
+	}
+
+	if (traceStream.len + n > traceStream.size) {
+		uint32_t size = MAX(traceStream.size * 2, TRACE_CHUNK_SIZE);
+		uint8_t *buf = realloc(traceStream.buf, size);
+		if (!buf) {
+			PrintAndLogEx(FAILED, "Cannot allocate memory for trace, stream stopped");
+			streamClose();
+			return;
+		}
+		traceStream.buf = buf;
+		traceStream.size = size;
+	}
+	memcpy(traceStream.buf + traceStream.len, c->d.asBytes, n);
+	traceStream.len += n;
+
+	fwrite(c->d.asBytes, 1, n, traceStream.f);
+	streamUpdateHeader();
+
+	// list the new records
+	while (traceStream.listed < traceStream.len) {
+		uint32_t next = printTraceLine(traceStream.listed, traceStream.len, traceStream.buf, traceStream.protocol, false, false);
+		if (next <= traceStream.listed)
+			break;
+		traceStream.listed = next;
+	}
+}
+
+// CMD_TRACE_STREAM_END,  the sniff is over.  The streamed records become the trace buffer
+static void streamEnd(UsbCommand *c) {
+	trace_stream_stats_t *st = (trace_stream_stats_t *)c->d.asBytes;
+
+	PrintAndLogEx(SUCCESS, "stream done, %u records in %u packets, %u bytes", st->records, st->packets, traceStream.len);
+	if (st->dropped)
+		PrintAndLogEx(WARNING, "%u records dropped on device", st->dropped);
+	PrintAndLogEx(INFO, "device ring peak fill %u of %u bytes", st->peak, st->size);
+
+	if (!traceStream.f) return;
+	streamClose();
+
+	tracefile_t tf;
+	memset(&tf, 0, sizeof(tf));
+	tf.data = traceStream.buf;
+	tf.len = traceStream.len;
+	traceStream.buf = NULL;
+	if (tracefile_build_index(&tf)) {
+		PrintAndLogEx(FAILED, "Cannot allocate memory for trace index");
+		tracefile_release(&tf);
+		return;
+	}
+	setTraceFile(&tf);
+	PrintAndLogEx(SUCCESS, "saved to %s, use 'trace list <protocol> 1' to list it again", traceStream.filename);
+}
+
+// called from the usb receiver thread of the device that sent it
+void TraceStreamReceived(UsbCommand *c) {
+	pthread_mutex_lock(&trace_lock);
+	// streaming left enabled on a device,  its next sniff claims the stream
+	if (!traceStream.dev && c->cmd == CMD_TRACE_STREAM_DATA && c->arg[2] == 0)
+		traceStream.dev = CurrentDevice();
+	if (CurrentDevice() != traceStream.dev) {
+		pthread_mutex_unlock(&trace_lock);
+		return;
+	}
+	if (c->cmd == CMD_TRACE_STREAM_DATA)
+		streamData(c);
+	else if (c->cmd == CMD_TRACE_STREAM_END)
+		streamEnd(c);
+	pthread_mutex_unlock(&trace_lock);
+}
+
+int CmdTraceStream(const char *Cmd) {
+	char cmdp = param_getchar(Cmd, 0);
+	if (strlen(Cmd) < 1 || (cmdp != '0' && cmdp != '1')) return usage_trace_stream();
+
+	pm3_device *dev = CurrentDevice();
+	pthread_mutex_lock(&trace_lock);
+	pm3_device *streaming = traceStream.dev;
+	pthread_mutex_unlock(&trace_lock);
+	if (cmdp == '1' && streaming && streaming != dev) {
+		PrintAndLogEx(WARNING, "device %d is streaming already,  disable it there first", streaming->id);
+		return 1;
+	}
+
+	char type[10] = {0};
+	bool errors = false;
+	uint8_t i = 1;
+	while (param_getchar(Cmd, i) != 0x00 && !errors) {
+		switch (tolower(param_getchar(Cmd, i))) {
+			case 'f':
+				if (param_getstr(Cmd, i + 1, traceStream.filename, sizeof(traceStream.filename)) == 0)
+					errors = true;
+				i += 2;
+				break;
+			case 'p':
+				param_getstr(Cmd, i + 1, type, sizeof(type));
+				str_lower(type);
+				if (!protocolByName(type, &traceStream.protocol))
+					errors = true;
+				i += 2;
+				break;
+			default:
+				PrintAndLogEx(WARNING, "Unknown parameter '%c'", param_getchar(Cmd, i));
+				errors = true;
+				break;
+		}
+	}
+	if (errors) return usage_trace_stream();
+
+	UsbCommand c = {CMD_TRACE_STREAM, {cmdp - '0', 0, 0}};
+	clearCommandBuffer();
+	SendCommand(&c);
+	if ( !WaitForResponseTimeout(CMD_ACK, NULL, 2000)) {
+		PrintAndLogEx(WARNING, "timeout while waiting for reply.");
+		return 1;
+	}
+	pthread_mutex_lock(&trace_lock);
+	if (cmdp == '1')
+		traceStream.dev = dev;
+	else if (traceStream.dev == dev)
+		traceStream.dev = NULL;
+	pthread_mutex_unlock(&trace_lock);
+
+	if (cmdp == '1')
+		PrintAndLogEx(SUCCESS, "trace streaming enabled, to %s, protocol %s", traceStream.filename, protocolName(traceStream.protocol));
+	else
+		PrintAndLogEx(SUCCESS, "trace streaming disabled");
 	return 0;
 }
 
@@ -607,6 +1235,11 @@ static command_t CommandTable[] = {
 	{"list",    CmdTraceList,     1, "List protocol data in trace buffer"},	
 	{"load",	CmdTraceLoad,     1, "Load trace from file"},
 	{"save",	CmdTraceSave,     1, "Save trace buffer to file"},
+	{"compact",	CmdTraceCompact,  0, "Record traces in a compact encoding on device"},
+	{"stream",	CmdTraceStream,   0, "Stream the trace to the client while sniffing"},
+#ifdef WITH_FLASH
+	{"spill",	CmdTraceSpill,    0, "RDV40, move full trace buffers to flash memory"},
+#endif
 	{NULL, NULL, 0, NULL}
 };
 
@@ -25,16 +25,26 @@
 #include "ui.h"				// for show graph controls
 #include "cmdparser.h"		// for getting cli commands included in cmdmain.h
 #include "cmdmain.h"		// for sending cmds to device. GetFromBigBuf
+#include "common.h"			// for FLASH_MEM_TRACE_OFFSET
 #include "loclass/fileutils.h"		// for saveFile
+#include "tracefile.h"		// indexed trace files
 
 extern int CmdTrace(const char *Cmd);
 
 extern int CmdTraceList(const char *Cmd);
 extern int CmdTraceLoad(const char *Cmd);
 extern int CmdTraceSave(const char *Cmd);
+extern int CmdTraceSpill(const char *Cmd);
+extern int CmdTraceCompact(const char *Cmd);
+extern int CmdTraceStream(const char *Cmd);
+extern void TraceStreamReceived(UsbCommand *c);
 
 // usages helptext
 extern int usage_trace_list(void);					 
 extern int usage_trace_load(void);
 extern int usage_trace_save(void);
+extern int usage_trace_spill(void);
+extern int usage_trace_compact(void);
+extern int usage_trace_test(void);
+extern int usage_trace_stream(void);
 #endif
@@ -9,6 +9,7 @@
 //-----------------------------------------------------------------------------
 
 #include "cmdemv.h"
+#include "emv_batch.h"
 #include "test/cryptotest.h"
 
 static int CmdHelp(const char *Cmd);
@@ -708,7 +709,7 @@ int CmdHFEMVExec(const char *cmd) {
 			if (res) {	
 				PrintAndLogEx(NORMAL, "CDA error (%d)", res);
 			}
-			free(ac_tlv);
+			tlvdb_free(ac_tlv);
 			free(cdol_data_tlv);
 			
 			PrintAndLogEx(NORMAL, "\n* M/Chip transaction result:");
@@ -836,6 +837,63 @@ int CmdHfEMVList(const char *Cmd) {
 int CmdHFEMVTest(const char *cmd) {
 	return ExecuteCryptoTests(true);
 }
+
+int usage_emv_verify(void) {
+	PrintAndLogEx(NORMAL, "Offline SDA/DDA/CDA verification of recorded transactions:\n");
+	PrintAndLogEx(NORMAL, "Usage:  hf emv verify [-t <threads>][-v] <filename>\n");
+	PrintAndLogEx(NORMAL, "Options:");
+	PrintAndLogEx(NORMAL, "  -t       : number of threads, default all cpu cores");
+	PrintAndLogEx(NORMAL, "  -v       : show verified transactions too\n");
+	PrintAndLogEx(NORMAL, "One transaction per line, fields <name>=<hex>:");
+	PrintAndLogEx(NORMAL, "  tlv=     : card data, TLV objects as returned by the card");
+	PrintAndLogEx(NORMAL, "  oda=     : input list for Offline Data Authentication (records, AIP)");
+	PrintAndLogEx(NORMAL, "  ddol=    : Internal Authenticate data (DDA)");
+	PrintAndLogEx(NORMAL, "  ac=      : Generate AC response, pdol= and cdol1= : PDOL and CDOL1 data (CDA)\n");
+	PrintAndLogEx(NORMAL, "Examples:");
+	PrintAndLogEx(NORMAL, " hf emv verify -t 4 transactions.txt");
+	return 0;
+}
+
+int CmdHFEMVVerify(const char *cmd) {
+	char filename[FILE_PATH_SIZE] = {0};
+	int threads = 0;
+	bool verbose = false;
+
+	if (strlen(cmd) < 1)
+		return usage_emv_verify();
+
+	int cmdp = 0;
+	while(param_getchar(cmd, cmdp) != 0x00) {
+		char c = param_getchar(cmd, cmdp);
+		if ((c == '-') && (param_getlength(cmd, cmdp) == 2)) {
+			switch (param_getchar_indx(cmd, 1, cmdp)) {
+				case 'h':
+				case 'H':
+					return usage_emv_verify();
+				case 't':
+				case 'T':
+					threads = param_get32ex(cmd, cmdp + 1, 0, 10);
+					cmdp++;
+					break;
+				case 'v':
+				case 'V':
+					verbose = true;
+					break;
+				default:
+					PrintAndLogEx(WARNING, "Unknown parameter '%c'", param_getchar_indx(cmd, 1, cmdp));
+					return 1;
+			}
+		} else {
+			param_getstr(cmd, cmdp, filename, sizeof(filename));
+		}
+		cmdp++;
+	}
+
+	if (!filename[0])
+		return usage_emv_verify();
+
+	return emv_batch_verify_file(filename, threads, verbose);
+}
 static command_t CommandTable[] =  {
 	{"help",	CmdHelp,		1,	"This help"},
 	{"exec",	CmdHFEMVExec,	0,	"Executes EMV contactless transaction."},
@@ -843,6 +901,7 @@ static command_t CommandTable[] =  {
 	{"search",	CmdHFEMVSearch,	0,	"Try to select all applets from applets list and print installed applets."},
 	{"select",	CmdHFEMVSelect,	0,	"Select applet."},
 	{"test",	CmdHFEMVTest,	0,	"Crypto logic test."},
+	{"verify",	CmdHFEMVVerify,	1,	"Offline SDA/DDA/CDA verification of recorded transactions."},
 	/*
 	{"getrng",		CmdHfEMVGetrng,	  0, "get random number from terminal"}, 
 	{"eload",		CmdHfEmvELoad, 	  0, "load EMV tag into device"},
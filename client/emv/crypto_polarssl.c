@@ -86,6 +86,18 @@ struct crypto_pk_polarssl {
 	rsa_context ctx;
 };
 
+// rsa_public() fills ctx.RN (R^2 mod N) on first use.  Done when the key is opened instead,
+// so the key is only read afterwards and can be shared between threads (emv_pk keeps it).
+// On failure RN is left empty and rsa_public() computes it as before.
+static void crypto_pk_polarssl_precompute(struct crypto_pk_polarssl *cp)
+{
+	mpi *RN = &cp->ctx.RN;
+	if (mpi_lset(RN, 1) ||
+		mpi_shift_l(RN, cp->ctx.N.n * 2 * sizeof(t_uint) * 8) ||
+		mpi_mod_mpi(RN, RN, &cp->ctx.N))
+		mpi_free(RN);
+}
+
 static struct crypto_pk *crypto_pk_polarssl_open_rsa(va_list vl)
 {
 	struct crypto_pk_polarssl *cp = malloc(sizeof(*cp));
@@ -109,6 +121,8 @@ static struct crypto_pk *crypto_pk_polarssl_open_rsa(va_list vl)
 		return NULL;
 	}
 
+	crypto_pk_polarssl_precompute(cp);
+
 	return &cp->cp;
 }
 
@@ -154,6 +168,8 @@ static struct crypto_pk *crypto_pk_polarssl_open_priv_rsa(va_list vl)
 		return NULL;
 	}
 
+	crypto_pk_polarssl_precompute(cp);
+
 	return &cp->cp;
 }
 
@@ -188,6 +204,8 @@ static struct crypto_pk *crypto_pk_polarssl_genkey_rsa(va_list vl)
 		free(cp);		
 		return NULL;
 	}
+
+	crypto_pk_polarssl_precompute(cp);
 	
 	return &cp->cp;
 }
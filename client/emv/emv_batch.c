@@ -0,0 +1,593 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Offline verification of recorded EMV transactions
+//
+// CA public keys are loaded and verified once,  recovered issuer keys are
+// cached by (RID, CA index, hash of issuer certificate, remainder and exponent),
+// so most transactions only need the ICC level RSA operations.
+//-----------------------------------------------------------------------------
+
+#include "emv_batch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#include "crypto.h"
+#include "tlv.h"
+#include "emv_pki.h"
+#include "ui.h"
+#include "util.h"
+#include "util_posix.h"
+#include "proxmark3.h"		// get_my_executable_directory
+
+#define EMV_BATCH_LINE_LEN		(32 * 1024)
+#define ISSUER_CACHE_SIZE		256
+
+// CA public key table
+struct emv_pk_table_entry {
+	struct emv_pk *pk;
+	size_t order;			// position in file,  first one wins for duplicates
+};
+
+struct emv_pk_table {
+	struct emv_pk_table_entry *entries;
+	size_t count;
+};
+
+static int emv_pk_table_cmp(const void *a, const void *b) {
+	const struct emv_pk_table_entry *ea = a, *eb = b;
+	int res = memcmp(ea->pk->rid, eb->pk->rid, 5);
+	if (res) return res;
+	if (ea->pk->index != eb->pk->index) return ea->pk->index - eb->pk->index;
+	return (ea->order > eb->order) - (ea->order < eb->order);
+}
+
+struct emv_pk_table *emv_pk_table_load(const char *fname) {
+	FILE *f = fopen(fname, "r");
+	if (!f) {
+		PrintAndLogEx(WARNING, "Can't open CA public key file %s", fname);
+		return NULL;
+	}
+
+	struct emv_pk_table *table = calloc(1, sizeof(struct emv_pk_table));
+	size_t size = 32;
+	if (table)
+		table->entries = calloc(size, sizeof(struct emv_pk_table_entry));
+	if (!table || !table->entries) {
+		PrintAndLogEx(ERR, "Out of memory loading CA public keys");
+		free(table);
+		fclose(f);
+		return NULL;
+	}
+
+	char buf[2048];
+	size_t order = 0;
+	while (fgets(buf, sizeof(buf), f)) {
+		struct emv_pk *pk = emv_pk_parse_pk(buf);
+		if (!pk)
+			continue;
+
+		if (!emv_pk_verify(pk)) {
+			PrintAndLogEx(WARNING, "CA PK %02hhx:%02hhx:%02hhx:%02hhx:%02hhx IDX %02hhx failed verification, skipped",
+				pk->rid[0], pk->rid[1], pk->rid[2], pk->rid[3], pk->rid[4], pk->index);
+			emv_pk_free(pk);
+			continue;
+		}
+
+		if (table->count == size) {
+			struct emv_pk_table_entry *entries = realloc(table->entries, size * 2 * sizeof(struct emv_pk_table_entry));
+			if (!entries) {
+				PrintAndLogEx(ERR, "Out of memory loading CA public keys");
+				emv_pk_free(pk);
+				emv_pk_table_free(table);
+				fclose(f);
+				return NULL;
+			}
+			table->entries = entries;
+			size *= 2;
+		}
+		table->entries[table->count].pk = pk;
+		table->entries[table->count].order = order++;
+		table->count++;
+	}
+	fclose(f);
+
+	qsort(table->entries, table->count, sizeof(struct emv_pk_table_entry), emv_pk_table_cmp);
+	return table;
+}
+
+const struct emv_pk *emv_pk_table_get(const struct emv_pk_table *table, const unsigned char *rid, unsigned char idx) {
+	size_t lo = 0, hi = table->count;
+
+	// first entry not below (rid, idx)
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const struct emv_pk *pk = table->entries[mid].pk;
+		int res = memcmp(pk->rid, rid, 5);
+		if (res < 0 || (res == 0 && pk->index < idx))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < table->count) {
+		const struct emv_pk *pk = table->entries[lo].pk;
+		if (!memcmp(pk->rid, rid, 5) && pk->index == idx)
+			return pk;
+	}
+	return NULL;
+}
+
+size_t emv_pk_table_count(const struct emv_pk_table *table) {
+	return table->count;
+}
+
+void emv_pk_table_free(struct emv_pk_table *table) {
+	if (!table)
+		return;
+
+	for (size_t i = 0; i < table->count; i++)
+		emv_pk_free(table->entries[i].pk);
+	free(table->entries);
+	free(table);
+}
+
+// recovered issuer keys
+struct issuer_cache_entry {
+	unsigned char rid[5];
+	unsigned char index;
+	unsigned char hash[20];
+	struct emv_pk *pk;
+	struct issuer_cache_entry *next;
+};
+
+struct issuer_cache {
+	struct issuer_cache_entry *buckets[ISSUER_CACHE_SIZE];
+	pthread_mutex_t lock;
+	uint32_t hits;
+	uint32_t misses;
+};
+
+static bool issuer_cache_key(const struct tlvdb *db, unsigned char *hash) {
+	const struct tlv *cert_tlv = tlvdb_get(db, 0x90, NULL);
+	const struct tlv *rem_tlv = tlvdb_get(db, 0x92, NULL);
+	const struct tlv *exp_tlv = tlvdb_get(db, 0x9f32, NULL);
+
+	if (!cert_tlv || !exp_tlv)
+		return false;
+
+	struct crypto_hash *ch = crypto_hash_open(HASH_SHA_1);
+	if (!ch)
+		return false;
+
+	crypto_hash_write(ch, cert_tlv->value, cert_tlv->len);
+	if (rem_tlv)
+		crypto_hash_write(ch, rem_tlv->value, rem_tlv->len);
+	crypto_hash_write(ch, exp_tlv->value, exp_tlv->len);
+	memcpy(hash, crypto_hash_read(ch), 20);
+	crypto_hash_close(ch);
+	return true;
+}
+
+static struct issuer_cache_entry *issuer_cache_find(struct issuer_cache *cache, const struct emv_pk *ca_pk, const unsigned char *hash) {
+	struct issuer_cache_entry *e = cache->buckets[hash[0] % ISSUER_CACHE_SIZE];
+	for (; e; e = e->next)
+		if (!memcmp(e->hash, hash, 20) && e->index == ca_pk->index && !memcmp(e->rid, ca_pk->rid, 5))
+			return e;
+	return NULL;
+}
+
+// issuer key for a transaction,  owned by the cache
+static const struct emv_pk *issuer_cache_get(struct issuer_cache *cache, const struct emv_pk *ca_pk, struct tlvdb *db) {
+	unsigned char hash[20];
+	if (!issuer_cache_key(db, hash))
+		return NULL;
+
+	pthread_mutex_lock(&cache->lock);
+	struct issuer_cache_entry *e = issuer_cache_find(cache, ca_pk, hash);
+	if (e)
+		cache->hits++;
+	else
+		cache->misses++;
+	pthread_mutex_unlock(&cache->lock);
+
+	if (e) {
+		// certificate is known good,  only the PAN has to match
+		if (!emv_pki_issuer_pan_match(e->pk, tlvdb_get(db, 0x5a, NULL)))
+			return NULL;
+		return e->pk;
+	}
+
+	struct emv_pk *pk = emv_pki_recover_issuer_cert(ca_pk, db);
+	if (!pk)
+		return NULL;
+
+	pthread_mutex_lock(&cache->lock);
+	e = issuer_cache_find(cache, ca_pk, hash);
+	if (e) {
+		// recovered by another thread meanwhile
+		emv_pk_free(pk);
+	} else {
+		e = calloc(1, sizeof(struct issuer_cache_entry));
+		if (!e) {
+			pthread_mutex_unlock(&cache->lock);
+			emv_pk_free(pk);
+			return NULL;
+		}
+		memcpy(e->rid, ca_pk->rid, 5);
+		e->index = ca_pk->index;
+		memcpy(e->hash, hash, 20);
+		e->pk = pk;
+		e->next = cache->buckets[hash[0] % ISSUER_CACHE_SIZE];
+		cache->buckets[hash[0] % ISSUER_CACHE_SIZE] = e;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	return e->pk;
+}
+
+static void issuer_cache_free(struct issuer_cache *cache) {
+	for (int i = 0; i < ISSUER_CACHE_SIZE; i++) {
+		struct issuer_cache_entry *e = cache->buckets[i], *next;
+		for (; e; e = next) {
+			next = e->next;
+			emv_pk_free(e->pk);
+			free(e);
+		}
+	}
+}
+
+// transactions
+enum emv_batch_method {
+	EMV_BATCH_SDA,
+	EMV_BATCH_DDA,
+	EMV_BATCH_CDA,
+	EMV_BATCH_METHODS
+};
+
+static const char *emv_batch_method_names[EMV_BATCH_METHODS] = {"SDA", "DDA", "CDA"};
+
+enum emv_batch_result {
+	EMV_BATCH_OK,
+	EMV_BATCH_ERR_FORMAT,
+	EMV_BATCH_ERR_CAPK,
+	EMV_BATCH_ERR_ISSUER,
+	EMV_BATCH_ERR_ODA,
+	EMV_BATCH_ERR_SSAD,
+	EMV_BATCH_ERR_ICC,
+	EMV_BATCH_ERR_DYNAMIC,
+	EMV_BATCH_ERR_ATC,
+};
+
+static const char *emv_batch_result_names[] = {
+	"OK",
+	"can't parse card data",
+	"CA public key not found",
+	"issuer certificate error",
+	"no input list for Offline Data Authentication",
+	"SSAD verify error",
+	"ICC certificate error",
+	"dynamic signature verify error",
+	"ATC mismatch",
+};
+
+struct emv_batch_tx {
+	unsigned int line;
+	unsigned char *data;		// decoded fields,  trees and tlvs point into it
+	struct tlvdb *db;
+	struct tlvdb *ac_db;
+	struct tlv oda;
+	struct tlv ddol;
+	struct tlv pdol;
+	struct tlv cdol1;
+	enum emv_batch_method method;
+	enum emv_batch_result result;
+};
+
+struct emv_batch {
+	struct emv_pk_table *capk;
+	struct issuer_cache cache;
+	struct emv_batch_tx *tx;
+	size_t count;
+	size_t next;
+};
+
+static int hexval(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	c = tolower(c);
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+// parse "name=hex" fields of a line into tx
+static bool emv_batch_parse_line(char *line, struct emv_batch_tx *tx) {
+	size_t len = strlen(line);
+	unsigned char *data = calloc(len / 2 + 1, sizeof(unsigned char));
+	size_t pos = 0;
+	const unsigned char *tlv_data = NULL, *ac_data = NULL;
+	size_t tlv_len = 0, ac_len = 0;
+
+	if (!data)
+		return false;
+
+	char *p = line;
+	while (*p) {
+		while (isspace((unsigned char)*p)) p++;
+		if (!*p) break;
+
+		char *name = p;
+		while (*p && *p != '=' && !isspace((unsigned char)*p)) p++;
+		if (*p != '=') goto err;
+		*p++ = 0x00;
+
+		unsigned char *value = data + pos;
+		while (*p && !isspace((unsigned char)*p)) {
+			int hi = hexval(p[0]);
+			int lo = p[1] ? hexval(p[1]) : -1;
+			if (hi < 0 || lo < 0) goto err;
+			data[pos++] = (hi << 4) | lo;
+			p += 2;
+		}
+		size_t vlen = data + pos - value;
+
+		if (!strcmp(name, "tlv")) {
+			tlv_data = value;
+			tlv_len = vlen;
+		} else if (!strcmp(name, "ac")) {
+			ac_data = value;
+			ac_len = vlen;
+		} else if (!strcmp(name, "oda")) {
+			tx->oda = (struct tlv){.tag = 0x21, .len = vlen, .value = value};
+		} else if (!strcmp(name, "ddol")) {
+			tx->ddol = (struct tlv){.tag = 0x00, .len = vlen, .value = value};
+		} else if (!strcmp(name, "pdol")) {
+			tx->pdol = (struct tlv){.tag = 0x00, .len = vlen, .value = value};
+		} else if (!strcmp(name, "cdol1")) {
+			tx->cdol1 = (struct tlv){.tag = 0x00, .len = vlen, .value = value};
+		} else {
+			goto err;
+		}
+	}
+
+	tx->data = data;
+	if (tlv_data)
+		tx->db = tlvdb_parse_multi_ref(tlv_data, tlv_len);
+	if (ac_data)
+		tx->ac_db = tlvdb_parse_multi_ref(ac_data, ac_len);
+
+	if (!tx->db || (ac_data && !tx->ac_db)) {
+		tx->result = EMV_BATCH_ERR_FORMAT;
+	} else if (tx->ac_db) {
+		tx->method = EMV_BATCH_CDA;
+	} else if (tlvdb_get(tx->db, 0x9f4b, NULL)) {
+		tx->method = EMV_BATCH_DDA;
+	} else {
+		tx->method = EMV_BATCH_SDA;
+	}
+	return true;
+
+err:
+	free(data);
+	return false;
+}
+
+static enum emv_batch_result emv_batch_verify_tx(struct emv_batch *batch, struct emv_batch_tx *tx) {
+	struct tlvdb *db = tx->db;
+
+	const struct tlv *df_tlv = tlvdb_get(db, 0x84, NULL);
+	if (!df_tlv)
+		df_tlv = tlvdb_get(db, 0x4f, NULL);
+	const struct tlv *caidx_tlv = tlvdb_get(db, 0x8f, NULL);
+	if (!df_tlv || !caidx_tlv || df_tlv->len < 5 || caidx_tlv->len != 1)
+		return EMV_BATCH_ERR_CAPK;
+
+	const struct emv_pk *ca_pk = emv_pk_table_get(batch->capk, df_tlv->value, caidx_tlv->value[0]);
+	if (!ca_pk)
+		return EMV_BATCH_ERR_CAPK;
+
+	const struct emv_pk *issuer_pk = issuer_cache_get(&batch->cache, ca_pk, db);
+	if (!issuer_pk)
+		return EMV_BATCH_ERR_ISSUER;
+
+	if (tx->oda.len == 0)
+		return EMV_BATCH_ERR_ODA;
+
+	// static data,  if the card signed it
+	if (tx->method == EMV_BATCH_SDA || tlvdb_get(db, 0x93, NULL)) {
+		struct tlvdb *dac_db = emv_pki_recover_dac(issuer_pk, db, &tx->oda);
+		if (!dac_db)
+			return EMV_BATCH_ERR_SSAD;
+		tlvdb_free(dac_db);
+	}
+
+	if (tx->method == EMV_BATCH_SDA)
+		return EMV_BATCH_OK;
+
+	struct emv_pk *icc_pk = emv_pki_recover_icc_cert(issuer_pk, db, &tx->oda);
+	if (!icc_pk)
+		return EMV_BATCH_ERR_ICC;
+
+	enum emv_batch_result res = EMV_BATCH_OK;
+	struct tlvdb *idn_db = NULL;
+
+	if (tx->method == EMV_BATCH_CDA) {
+		idn_db = emv_pki_perform_cda(icc_pk, db, tx->ac_db, tx->pdol.len ? &tx->pdol : NULL, tx->cdol1.len ? &tx->cdol1 : NULL, NULL);
+		if (!idn_db)
+			res = EMV_BATCH_ERR_DYNAMIC;
+	} else if (tx->ddol.len) {
+		// DDA, Internal Authenticate
+		idn_db = emv_pki_recover_idn(icc_pk, db, &tx->ddol);
+		if (!idn_db)
+			res = EMV_BATCH_ERR_DYNAMIC;
+	} else {
+		// fDDA, signature from GPO
+		idn_db = emv_pki_recover_atc_ex(icc_pk, db, false);
+		if (!idn_db)
+			res = EMV_BATCH_ERR_DYNAMIC;
+		else if (!tlv_equal(tlvdb_get(idn_db, 0x9f36, NULL), tlvdb_get(db, 0x9f36, NULL)))
+			res = EMV_BATCH_ERR_ATC;
+	}
+
+	tlvdb_free(idn_db);
+	emv_pk_free(icc_pk);
+	return res;
+}
+
+static void *emv_batch_worker(void *arg) {
+	struct emv_batch *batch = arg;
+
+	while (true) {
+		size_t i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_SEQ_CST);
+		if (i >= batch->count)
+			break;
+
+		struct emv_batch_tx *tx = &batch->tx[i];
+		if (tx->result == EMV_BATCH_OK)
+			tx->result = emv_batch_verify_tx(batch, tx);
+	}
+	return NULL;
+}
+
+static void emv_batch_run(struct emv_batch *batch, int threads) {
+	pthread_t thread_id[threads];
+	int started = 0;
+	for (; started < threads; started++) {
+		if (pthread_create(&thread_id[started], NULL, emv_batch_worker, batch)) {
+			PrintAndLogEx(WARNING, "Can't start verify thread %d, continuing on %d threads", started + 1, started ? started : 1);
+			break;
+		}
+	}
+	// the workers share one job counter, so whoever runs drains the whole log
+	if (!started)
+		emv_batch_worker(batch);
+	for (int i = 0; i < started; i++)
+		pthread_join(thread_id[i], NULL);
+}
+
+static struct emv_pk_table *emv_batch_load_capk(void) {
+	const char *relfname = "emv/capk.txt";
+	char fname[strlen(get_my_executable_directory()) + strlen(relfname) + 1];
+	strcpy(fname, get_my_executable_directory());
+	strcat(fname, relfname);
+	return emv_pk_table_load(fname);
+}
+
+int emv_batch_verify_file(const char *fname, int threads, bool verbose) {
+	FILE *f = fopen(fname, "r");
+	if (!f) {
+		PrintAndLogEx(WARNING, "Can't open transaction log %s", fname);
+		return 1;
+	}
+
+	struct emv_batch batch;
+	memset(&batch, 0, sizeof(batch));
+	pthread_mutex_init(&batch.cache.lock, NULL);
+
+	uint64_t t1 = msclock();
+	batch.capk = emv_batch_load_capk();
+	if (!batch.capk) {
+		fclose(f);
+		return 2;
+	}
+	PrintAndLogEx(INFO, "Loaded %zu CA public keys in %" PRIu64 " ms", emv_pk_table_count(batch.capk), msclock() - t1);
+
+	// read the log
+	char *line = calloc(EMV_BATCH_LINE_LEN, sizeof(char));
+	size_t size = 256;
+	batch.tx = calloc(size, sizeof(struct emv_batch_tx));
+	unsigned int lineno = 0;
+	int res = 0;
+
+	if (!line || !batch.tx) {
+		PrintAndLogEx(ERR, "Out of memory reading transaction log");
+		free(line);
+		fclose(f);
+		res = 2;
+		goto out;
+	}
+
+	while (fgets(line, EMV_BATCH_LINE_LEN, f)) {
+		lineno++;
+		if (line[0] == '#' || strlen(line) < 2)
+			continue;
+
+		if (batch.count == size) {
+			struct emv_batch_tx *tx = realloc(batch.tx, size * 2 * sizeof(struct emv_batch_tx));
+			if (!tx) {
+				PrintAndLogEx(ERR, "Out of memory reading transaction log, line %u", lineno);
+				free(line);
+				fclose(f);
+				res = 2;
+				goto out;
+			}
+			batch.tx = tx;
+			size *= 2;
+		}
+		struct emv_batch_tx *tx = &batch.tx[batch.count];
+		memset(tx, 0, sizeof(struct emv_batch_tx));
+		tx->line = lineno;
+		if (!emv_batch_parse_line(line, tx)) {
+			PrintAndLogEx(WARNING, "line %u: invalid format, skipped", lineno);
+			continue;
+		}
+		batch.count++;
+	}
+	free(line);
+	fclose(f);
+
+	if (threads < 1)
+		threads = num_CPUs();
+	if (threads > batch.count)
+		threads = batch.count ? batch.count : 1;
+
+	PrintAndLogEx(INFO, "Verifying %zu transactions on %d threads...", batch.count, threads);
+
+	t1 = msclock();
+	emv_batch_run(&batch, threads);
+	uint64_t elapsed = msclock() - t1;
+
+	// report
+	uint32_t ok[EMV_BATCH_METHODS] = {0}, total[EMV_BATCH_METHODS] = {0};
+	uint32_t failed = 0;
+	for (size_t i = 0; i < batch.count; i++) {
+		struct emv_batch_tx *tx = &batch.tx[i];
+		total[tx->method]++;
+		if (tx->result == EMV_BATCH_OK) {
+			ok[tx->method]++;
+			if (verbose)
+				PrintAndLogEx(SUCCESS, "line %u: %s verified OK", tx->line, emv_batch_method_names[tx->method]);
+		} else {
+			failed++;
+			PrintAndLogEx(FAILED, "line %u: %s failed, %s", tx->line, emv_batch_method_names[tx->method], emv_batch_result_names[tx->result]);
+		}
+	}
+
+	PrintAndLogEx(NORMAL, "");
+	for (int m = 0; m < EMV_BATCH_METHODS; m++) {
+		if (total[m])
+			PrintAndLogEx(SUCCESS, "%s : %u of %u verified OK", emv_batch_method_names[m], ok[m], total[m]);
+	}
+	PrintAndLogEx(SUCCESS, "failed : %u", failed);
+	PrintAndLogEx(SUCCESS, "issuer certificate cache : %u misses, %u hits", batch.cache.misses, batch.cache.hits);
+	PrintAndLogEx(SUCCESS, "%zu transactions in %" PRIu64 " ms, %.1f tx/s",
+		batch.count, elapsed, elapsed ? (double)batch.count * 1000.0 / elapsed : 0.0);
+	res = failed ? 3 : 0;
+
+out:
+	for (size_t i = 0; i < batch.count; i++) {
+		tlvdb_free(batch.tx[i].db);
+		tlvdb_free(batch.tx[i].ac_db);
+		free(batch.tx[i].data);
+	}
+	free(batch.tx);
+	issuer_cache_free(&batch.cache);
+	pthread_mutex_destroy(&batch.cache.lock);
+	emv_pk_table_free(batch.capk);
+	return res;
+}
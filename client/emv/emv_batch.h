@@ -0,0 +1,37 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Offline verification of recorded EMV transactions
+//-----------------------------------------------------------------------------
+
+#ifndef EMV_BATCH_H
+#define EMV_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "emv_pk.h"
+
+/*
+ Transaction log, one transaction per line,  fields are <name>=<hex>:
+    tlv=    card data, TLV objects as returned by the card (and terminal data like 9f37)
+    oda=    input list for Offline Data Authentication (records and AIP)
+    ddol=   Internal Authenticate data (DDA)
+    ac=     Generate AC response (CDA)
+    pdol=   PDOL data (CDA)
+    cdol1=  CDOL1 data (CDA)
+ Lines starting with # are comments.
+ CDA is checked if ac= is given, DDA / fDDA if the card data has 9f4b, SDA otherwise.
+*/
+
+struct emv_pk_table;
+
+struct emv_pk_table *emv_pk_table_load(const char *fname);
+const struct emv_pk *emv_pk_table_get(const struct emv_pk_table *table, const unsigned char *rid, unsigned char idx);
+size_t emv_pk_table_count(const struct emv_pk_table *table);
+void emv_pk_table_free(struct emv_pk_table *table);
+
+int emv_batch_verify_file(const char *fname, int threads, bool verbose);
+
+#endif
@@ -384,6 +384,8 @@ void emv_pk_free(struct emv_pk *pk)
 	if (!pk)
 		return;
 
+	if (pk->crypto)
+		crypto_pk_close(pk->crypto);
 	free(pk->modulus);
 	free(pk);
 }
@@ -19,6 +19,8 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+struct crypto_pk;
+
 struct emv_pk {
 	unsigned char rid[5];
 	unsigned char index;
@@ -32,6 +34,7 @@ struct emv_pk {
 	size_t mlen;
 	unsigned char *modulus;
 	unsigned int expire;
+	struct crypto_pk *crypto;	// opened on first use (emv_pki.c), closed with the key
 };
 
 #define EXPIRE(yy, mm, dd)	0x ## yy ## mm ## dd
@@ -32,6 +32,31 @@ static const struct tlv empty_tlv = {.tag = 0x0, .len = 0, .value = empty_tlv_va
 
 static size_t emv_pki_hash_psn[256] = { 0, 0, 11, 2, 17, 2, };
 
+// Keys are used for many certificates (CA keys, cached issuer keys),  so the
+// crypto key with its precomputed R^2 mod N is kept with the emv_pk.
+// Opening is racy between threads,  the loser closes its copy.
+static struct crypto_pk *emv_pki_get_crypto(const struct emv_pk *enc_pk)
+{
+	struct emv_pk *pk = (struct emv_pk *)enc_pk;
+	struct crypto_pk *kcp = __atomic_load_n(&pk->crypto, __ATOMIC_ACQUIRE);
+	if (kcp)
+		return kcp;
+
+	kcp = crypto_pk_open(pk->pk_algo,
+			pk->modulus, pk->mlen,
+			pk->exp, pk->elen);
+	if (!kcp)
+		return NULL;
+
+	struct crypto_pk *cur = NULL;
+	if (!__atomic_compare_exchange_n(&pk->crypto, &cur, kcp, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		crypto_pk_close(kcp);
+		kcp = cur;
+	}
+
+	return kcp;
+}
+
 static unsigned char *emv_pki_decode_message(const struct emv_pk *enc_pk,
 		uint8_t msgtype,
 		size_t *len,
@@ -56,14 +81,11 @@ static unsigned char *emv_pki_decode_message(const struct emv_pk *enc_pk,
 		printf("ERROR: Certificate length (%zu) not equal key length (%zu)\n", cert_tlv->len, enc_pk->mlen);
 		return NULL;
 	}
-	kcp = crypto_pk_open(enc_pk->pk_algo,
-			enc_pk->modulus, enc_pk->mlen,
-			enc_pk->exp, enc_pk->elen);
+	kcp = emv_pki_get_crypto(enc_pk);
 	if (!kcp)
 		return NULL;
 
 	data = crypto_pk_encrypt(kcp, cert_tlv->value, cert_tlv->len, &data_len);
-	crypto_pk_close(kcp);
 
 /*	if (true){
 		printf("Recovered data:\n");
@@ -272,6 +294,32 @@ static struct emv_pk *emv_pki_decode_key(const struct emv_pk *enc_pk,
 	return emv_pki_decode_key_ex(enc_pk, msgtype, pan_tlv, cert_tlv, exp_tlv, rem_tlv, add_tlv, false);
 }
 
+/* PAN in a recovered issuer certificate matches the card's PAN */
+bool emv_pki_issuer_pan_match(const struct emv_pk *issuer_pk, const struct tlv *pan_tlv)
+{
+	struct tlv pan2_tlv = {
+		.tag = 0x5a,
+		.len = 4,
+		.value = issuer_pk->pan,
+	};
+
+	if (!pan_tlv)
+		return false;
+
+	unsigned pan_len = emv_cn_length(pan_tlv);
+	unsigned pan2_len = emv_cn_length(&pan2_tlv);
+
+	if (pan2_len < 4 || pan2_len > pan_len)
+		return false;
+
+	unsigned i;
+	for (i = 0; i < pan2_len; i++)
+		if (emv_cn_get(pan_tlv, i) != emv_cn_get(&pan2_tlv, i))
+			return false;
+
+	return true;
+}
+
 struct emv_pk *emv_pki_recover_issuer_cert(const struct emv_pk *pk, struct tlvdb *db)
 {
 	return emv_pki_decode_key(pk, 2,
@@ -22,6 +22,7 @@
 #include <stddef.h>
 
 struct emv_pk *emv_pki_recover_issuer_cert(const struct emv_pk *pk, struct tlvdb *db);
+bool emv_pki_issuer_pan_match(const struct emv_pk *issuer_pk, const struct tlv *pan_tlv);
 struct emv_pk *emv_pki_recover_icc_cert(const struct emv_pk *pk, struct tlvdb *db, const struct tlv *sda_tlv);
 struct emv_pk *emv_pki_recover_icc_pe_cert(const struct emv_pk *pk, struct tlvdb *db);
 
@@ -113,7 +113,7 @@ static bool print_cb(void *data, const struct tlv *tlv, int level, bool is_leaf)
 
 void TLVPrintFromBuffer(uint8_t *data, int datalen) {
 	struct tlvdb *t = NULL;
-	t = tlvdb_parse_multi(data, datalen);
+	t = tlvdb_parse_multi_ref(data, datalen);
 	if (t) {
 		PrintAndLogEx(NORMAL, "-------------------- TLV decoded --------------------");
 		
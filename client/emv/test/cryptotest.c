@@ -10,6 +10,7 @@
 
 #include "cryptotest.h"
 #include "util.h"
+#include "util_posix.h"
 #include "ui.h"
 
 #include "bignum.h"
@@ -22,6 +23,78 @@
 #include "sda_test.h"
 #include "dda_test.h"
 #include "cda_test.h"
+#include "tlv_test.h"
+#include "trace_compact_test.h"
+#include "../emv_pk.h"
+
+#define RSA_BENCH_ROUNDS	2000
+
+// rsa_public with R^2 mod N recomputed for every call,  as when each certificate opened its key,
+// against R^2 kept in the context of a key that stays open. CA keys from capk.txt.
+static int exec_rsa_bench(bool verbose) {
+	static const struct {
+		unsigned char rid[5];
+		unsigned char idx;
+	} keys[] = {
+		{{0xa0, 0x00, 0x00, 0x00, 0x03}, 0x01},
+		{{0xa0, 0x00, 0x00, 0x00, 0x03}, 0x08},
+		{{0xa0, 0x00, 0x00, 0x00, 0x03}, 0x09},
+	};
+	bool fail = false;
+
+	for (int k = 0; k < sizeof(keys) / sizeof(keys[0]); k++) {
+		struct emv_pk *pk = emv_pk_get_ca_pk(keys[k].rid, keys[k].idx);
+		if (!pk) {
+			PrintAndLogEx(WARNING, "RSA bench: CA key %s %02x not found, skipped", sprint_hex(keys[k].rid, 5), keys[k].idx);
+			continue;
+		}
+
+		rsa_context ctx;
+		rsa_init(&ctx, RSA_PKCS_V15, 0);
+
+		ctx.len = pk->mlen;
+		mpi_read_binary(&ctx.N, pk->modulus, pk->mlen);
+		mpi_read_binary(&ctx.E, pk->exp, pk->elen);
+
+		unsigned char in[256] = {0}, out1[256] = {0}, out2[256] = {0};
+		for (int i = 1; i < pk->mlen; i++)
+			in[i] = rand();
+
+		// the cached R^2 gives the same result
+		rsa_public(&ctx, in, out1);
+		rsa_public(&ctx, in, out2);
+		if (memcmp(out1, out2, pk->mlen)) {
+			PrintAndLogEx(ERR, "RSA-%zu: result with cached R^2 mismatch", pk->mlen * 8);
+			fail = true;
+		}
+
+		uint64_t t1 = msclock();
+		for (int i = 0; i < RSA_BENCH_ROUNDS; i++) {
+			mpi_free(&ctx.RN);
+			rsa_public(&ctx, in, out1);
+		}
+		t1 = msclock() - t1;
+
+		uint64_t t2 = msclock();
+		for (int i = 0; i < RSA_BENCH_ROUNDS; i++)
+			rsa_public(&ctx, in, out1);
+		t2 = msclock() - t2;
+
+		if (verbose)
+			PrintAndLogEx(INFO, "RSA-%zu x%d: R^2 per call %"PRIu64" ms, R^2 cached %"PRIu64" ms",
+				pk->mlen * 8, RSA_BENCH_ROUNDS, t1, t2);
+
+		rsa_free(&ctx);
+		emv_pk_free(pk);
+	}
+
+	if (fail)
+		PrintAndLogEx(WARNING, "RSA bench: [ERROR]");
+	else if (verbose)
+		PrintAndLogEx(INFO, "RSA bench: passed");
+
+	return fail;
+}
 
 int ExecuteCryptoTests(bool verbose) {
 	int res;
@@ -54,6 +127,15 @@ int ExecuteCryptoTests(bool verbose) {
 	res = exec_crypto_test(verbose);
 	if (res) TestFail = true;
 
+	res = exec_tlv_test(verbose);
+	if (res) TestFail = true;
+
+	res = exec_trace_compact_test(verbose);
+	if (res) TestFail = true;
+
+	res = exec_rsa_bench(verbose);
+	if (res) TestFail = true;
+
 	PrintAndLogEx(NORMAL, "\n--------------------------");
 	if (TestFail)
 		PrintAndLogEx(ERR, "Test(s) [ERROR].");
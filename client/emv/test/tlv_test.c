@@ -0,0 +1,142 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// TLV parser tests, arena backed trees
+//-----------------------------------------------------------------------------
+
+#include "tlv_test.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../tlv.h"
+
+// FCI template: 6F { 84 (AID), A5 { 50 "VISA", 87 01, BF0C { 50 "DEBIT" } } }
+static const unsigned char fci[] = {
+	0x6f, 0x1e,
+		0x84, 0x07, 0xa0, 0x00, 0x00, 0x00, 0x03, 0x10, 0x10,
+		0xa5, 0x13,
+			0x50, 0x04, 'V', 'I', 'S', 'A',
+			0x87, 0x01, 0x01,
+			0xbf, 0x0c, 0x07,
+				0x50, 0x05, 'D', 'E', 'B', 'I', 'T',
+};
+
+// two top level objects: 9F02 amount, 5F2A currency
+static const unsigned char multi[] = {
+	0x9f, 0x02, 0x06, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00,
+	0x5f, 0x2a, 0x02, 0x09, 0x78,
+};
+
+#define CHECK(cond, name) \
+	if (!(cond)) { \
+		fprintf(stderr, "TLV test %s: failed, %s\n", name, #cond); \
+		return 1; \
+	}
+
+static int tlv_test_parse(bool copy, bool verbose) {
+	const char *name = copy ? "parse" : "parse ref";
+	unsigned char buf[sizeof(fci)];
+	memcpy(buf, fci, sizeof(fci));
+
+	struct tlvdb *t = copy ? tlvdb_parse(buf, sizeof(buf)) : tlvdb_parse_ref(buf, sizeof(buf));
+	CHECK(t, name);
+
+	// top level
+	CHECK(tlvdb_find(t, 0x6f) == t, name);
+	CHECK(tlvdb_find(t, 0xa5) == NULL, name);
+
+	// anywhere in the tree, in tree order
+	const struct tlv *aid = tlvdb_get(t, 0x84, NULL);
+	CHECK(aid && aid->len == 7 && !memcmp(aid->value, fci + 4, 7), name);
+	const struct tlv *label = tlvdb_get(t, 0x50, NULL);
+	CHECK(label && label->len == 4 && !memcmp(label->value, "VISA", 4), name);
+	label = tlvdb_get(t, 0x50, label);
+	CHECK(label && label->len == 5 && !memcmp(label->value, "DEBIT", 5), name);
+	CHECK(tlvdb_get(t, 0x50, label) == NULL, name);
+	CHECK(tlvdb_get(t, 0x9f38, NULL) == NULL, name);
+
+	tlv_tag_t path[] = {0x6f, 0xa5, 0x87, 0x00};
+	struct tlvdb *pi = tlvdb_find_path(t, path);
+	CHECK(pi && tlvdb_get(pi, 0x87, NULL)->value[0] == 0x01, name);
+
+	// zero copy parses point into the caller's buffer, copies don't
+	bool in_buf = aid->value >= buf && aid->value < buf + sizeof(buf);
+	CHECK(in_buf != copy, name);
+
+	tlvdb_free(t);
+	if (verbose)
+		printf("TLV test %s: passed\n", name);
+	return 0;
+}
+
+static int tlv_test_multi(bool verbose) {
+	struct tlvdb *t = tlvdb_parse_multi(multi, sizeof(multi));
+	CHECK(t, "multi");
+
+	CHECK(tlvdb_find(t, 0x9f02) == t, "multi");
+	struct tlvdb *cur = tlvdb_find(t, 0x5f2a);
+	const struct tlv *cc = tlvdb_get(cur, 0x5f2a, NULL);
+	CHECK(cur && cc && cc->len == 2 && cc->value[0] == 0x09, "multi");
+	CHECK(tlvdb_find_next(cur, 0x5f2a) == NULL, "multi");
+
+	tlvdb_free(t);
+	if (verbose)
+		printf("TLV test multi: passed\n");
+	return 0;
+}
+
+// nodes added to parsed trees are found and freed with them
+static int tlv_test_add(bool verbose) {
+	static const unsigned char tvr[5] = {0x00, 0x00, 0x00, 0x80, 0x00};
+	static const unsigned char un[4] = {0x12, 0x34, 0x56, 0x78};
+
+	struct tlvdb *t = tlvdb_parse(fci, sizeof(fci));
+	struct tlvdb *m = tlvdb_parse_multi_ref(multi, sizeof(multi));
+	CHECK(t && m, "add");
+
+	// after the top level,  another parsed tree and a fixed node
+	tlvdb_add(t, m);
+	tlvdb_add(t, tlvdb_fixed(0x95, sizeof(tvr), tvr));
+	CHECK(tlvdb_find(t, 0x5f2a) != NULL, "add");
+	CHECK(tlvdb_get(t, 0x95, NULL) != NULL, "add");
+
+	// inside the parsed tree,  it isn't in the index then
+	tlv_tag_t path[] = {0x6f, 0xa5, 0x87, 0x00};
+	struct tlvdb *p87 = tlvdb_find_path(t, path);
+	CHECK(p87, "add");
+	tlvdb_add(p87, tlvdb_fixed(0x9f37, sizeof(un), un));
+	const struct tlv *p9f37 = tlvdb_get(t, 0x9f37, NULL);
+	CHECK(p9f37 && !memcmp(p9f37->value, un, sizeof(un)), "add");
+	CHECK(tlvdb_get(t, 0x50, NULL) != NULL, "add");
+
+	// releases both arenas and the fixed nodes
+	tlvdb_free(t);
+	if (verbose)
+		printf("TLV test add: passed\n");
+	return 0;
+}
+
+int exec_tlv_test(bool verbose)
+{
+	int ret;
+	fprintf(stdout, "\n");
+
+	ret = tlv_test_parse(true, verbose);
+	if (!ret)
+		ret = tlv_test_parse(false, verbose);
+	if (!ret)
+		ret = tlv_test_multi(verbose);
+	if (!ret)
+		ret = tlv_test_add(verbose);
+	if (ret) {
+		fprintf(stderr, "TLV arena test: failed\n");
+		return ret;
+	}
+	fprintf(stdout, "TLV arena test: passed\n");
+
+	return 0;
+}
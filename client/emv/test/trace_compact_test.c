@@ -0,0 +1,119 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Compact trace encoding tests, round trip of generated records
+//-----------------------------------------------------------------------------
+
+#include "trace_compact_test.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "trace_compact.h"
+#include "parity.h"
+
+#define TRACE_TEST_SIZE 0x20000
+
+#define CHECK(cond, name) \
+	if (!(cond)) { \
+		fprintf(stderr, "Trace compact test %s: failed, %s\n", name, #cond); \
+		ret = 1; \
+		goto out; \
+	}
+
+// xorshift32, reproducible records
+static uint32_t test_rand(uint32_t *state) {
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+// ISO14443A-like classic records: odd parity, no parity, broken parity, timer wrap
+static uint32_t trace_test_records(uint8_t *classic, uint32_t size) {
+	uint32_t len = 0, timestamp = 0xFFFF0000, prng = 1;
+	while (true) {
+		uint16_t data_len = test_rand(&prng) % 24;
+		uint16_t parity_len = trace_parity_len(data_len);
+		if (len + TRACE_CLASSIC_HEADER + data_len + parity_len > size)
+			break;
+		uint16_t duration = test_rand(&prng) % 3000;
+		timestamp += (test_rand(&prng) % 4) ? test_rand(&prng) % 2000 : test_rand(&prng) >> 1;
+		uint8_t *rec = classic + len;
+		memcpy(rec, &timestamp, 4);
+		memcpy(rec + 4, &duration, 2);
+		uint16_t flags = data_len | ((test_rand(&prng) & 1) ? 0x8000 : 0);
+		memcpy(rec + 6, &flags, 2);
+		for (int i = 0; i < data_len; i++)
+			rec[TRACE_CLASSIC_HEADER + i] = test_rand(&prng);
+		uint8_t *parity = rec + TRACE_CLASSIC_HEADER + data_len;
+		int mode = test_rand(&prng) % 4;
+		for (int i = 0; i < data_len && mode < 2; i++)
+			parity[i >> 3] |= oddparity8(rec[TRACE_CLASSIC_HEADER + i]) << (7 - (i & 7));
+		for (int i = 0; i < parity_len && mode == 3; i++)
+			parity[i] = test_rand(&prng);
+		len += TRACE_CLASSIC_HEADER + data_len + parity_len;
+	}
+	return len;
+}
+
+// classic records to compact at dst, returns the compact size
+static uint32_t trace_test_encode(const uint8_t *classic, uint32_t len, uint8_t *dst) {
+	uint32_t pos = 0, clen = 0, last_ts = 0;
+	while (pos + TRACE_CLASSIC_HEADER <= len) {
+		uint32_t timestamp;
+		uint16_t duration, data_len;
+		memcpy(&timestamp, classic + pos, 4);
+		memcpy(&duration, classic + pos + 4, 2);
+		memcpy(&data_len, classic + pos + 6, 2);
+		bool response = data_len & 0x8000;
+		data_len &= 0x7FFF;
+		const uint8_t *data = classic + pos + TRACE_CLASSIC_HEADER;
+		clen += trace_compact_encode(dst + clen, &last_ts, data, data_len, timestamp, duration, data + data_len, response);
+		pos += TRACE_CLASSIC_HEADER + data_len + trace_parity_len(data_len);
+	}
+	return clen;
+}
+
+int exec_trace_compact_test(bool verbose)
+{
+	int ret = 0;
+	uint8_t *classic = calloc(TRACE_TEST_SIZE, 1);
+	uint8_t *compact = calloc(TRACE_TEST_SIZE * 2 + TRACE_COMPACT_MAX_HEADER, 1);
+	uint8_t *expanded = calloc(TRACE_TEST_SIZE + 1, 1);
+	fprintf(stdout, "\n");
+	CHECK(classic && compact && expanded, "alloc");
+
+	uint32_t len = trace_test_records(classic, TRACE_TEST_SIZE);
+	uint32_t clen = trace_test_encode(classic, len, compact);
+	CHECK(clen > 0 && clen < len, "encode");
+	CHECK(trace_compact_expanded_len(compact, clen) == len, "round trip");
+	CHECK(trace_compact_expand(compact, clen, expanded) == len, "round trip");
+	CHECK(memcmp(classic, expanded, len) == 0, "round trip");
+	if (verbose)
+		printf("Trace compact test round trip: passed, %u bytes, %u compact (%u%%)\n", len, clen, clen * 100 / len);
+
+	// decoding stops before a cut off record
+	uint32_t cut = trace_compact_expanded_len(compact, clen - 1);
+	CHECK(cut < len, "truncated");
+	CHECK(trace_compact_expand(compact, clen - 1, expanded) == cut, "truncated");
+	CHECK(memcmp(classic, expanded, cut) == 0, "truncated");
+	if (verbose)
+		printf("Trace compact test truncated: passed\n");
+
+out:
+	free(classic);
+	free(compact);
+	free(expanded);
+	if (ret) {
+		fprintf(stderr, "Trace compact test: failed\n");
+		return ret;
+	}
+	fprintf(stdout, "Trace compact test: passed\n");
+	return 0;
+}
@@ -25,6 +25,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <assert.h>
 
 #define TLV_TAG_CLASS_MASK	0xc0
 #define TLV_TAG_COMPLEX		0x20
@@ -41,11 +42,17 @@
 //	const typeof( ((type *)0)->member ) *__mptr = (ptr);	
 //        (type *)( (char *)__mptr - offsetof(type,member) );})
 
+struct tlvdb_arena;
+
 struct tlvdb {
 	struct tlv tag;
 	struct tlvdb *next;
 	struct tlvdb *parent;
 	struct tlvdb *children;
+	/* parsed trees only */
+	struct tlvdb_arena *arena;
+	struct tlvdb *hash_next;	/* next node in the same hash bucket, in tree order */
+	unsigned int seq;		/* position in tree order */
 };
 
 struct tlvdb_root {
@@ -54,6 +61,111 @@ struct tlvdb_root {
 	unsigned char buf[0];
 };
 
+/*
+ * Parsed trees keep all nodes in an arena, freed together with the first
+ * top level node.  Nodes are indexed by tag on parse, so lookups don't
+ * walk the tree.
+ */
+#define TLVDB_HASH_SIZE		64
+#define TLVDB_BLOCK_NODES	32
+
+struct tlvdb_block {
+	struct tlvdb_block *next;
+	size_t used;
+	size_t size;
+	struct tlvdb nodes[0];
+};
+
+struct tlvdb_arena {
+	struct tlvdb *first;		/* first top level node */
+	struct tlvdb *tail;		/* last top level node */
+	struct tlvdb_block *blocks;
+	unsigned int count;
+	bool indexed;
+	struct tlvdb *hash[TLVDB_HASH_SIZE];
+	struct tlvdb *hash_last[TLVDB_HASH_SIZE];
+	struct tlvdb_arena *free_next;
+	size_t len;
+	unsigned char buf[0];		/* copy of the parsed data, empty for zero copy parses */
+};
+
+static unsigned int tlvdb_hash(tlv_tag_t tag)
+{
+	return (tag ^ (tag >> 6) ^ (tag >> 12)) & (TLVDB_HASH_SIZE - 1);
+}
+
+static struct tlvdb_arena *tlvdb_arena_new(const unsigned char *buf, size_t len, bool copy)
+{
+	struct tlvdb_arena *arena = calloc(1, sizeof(*arena) + (copy ? len : 0));
+	if (!arena)
+		return NULL;
+
+	if (copy) {
+		arena->len = len;
+		memcpy(arena->buf, buf, len);
+	}
+	arena->indexed = true;
+
+	return arena;
+}
+
+static void tlvdb_arena_free(struct tlvdb_arena *arena)
+{
+	struct tlvdb_block *block, *next;
+
+	for (block = arena->blocks; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+	free(arena);
+}
+
+static struct tlvdb *tlvdb_arena_alloc(struct tlvdb_arena *arena)
+{
+	struct tlvdb_block *block = arena->blocks;
+
+	if (!block || block->used == block->size) {
+		size_t size = block ? block->size * 2 : TLVDB_BLOCK_NODES;
+		block = malloc(sizeof(*block) + size * sizeof(struct tlvdb));
+		if (!block)
+			return NULL;
+		block->next = arena->blocks;
+		block->used = 0;
+		block->size = size;
+		arena->blocks = block;
+	}
+
+	struct tlvdb *tlvdb = &block->nodes[block->used++];
+	memset(tlvdb, 0, sizeof(*tlvdb));
+	tlvdb->arena = arena;
+	tlvdb->seq = arena->count++;
+
+	return tlvdb;
+}
+
+static void tlvdb_arena_index(struct tlvdb_arena *arena, struct tlvdb *tlvdb)
+{
+	unsigned int h = tlvdb_hash(tlvdb->tag.tag);
+
+	if (arena->hash_last[h])
+		arena->hash_last[h]->hash_next = tlvdb;
+	else
+		arena->hash[h] = tlvdb;
+	arena->hash_last[h] = tlvdb;
+}
+
+/* first indexed node with tag at or after tlvdb in tree order */
+static struct tlvdb *tlvdb_arena_lookup(const struct tlvdb *tlvdb, tlv_tag_t tag)
+{
+	struct tlvdb *node = tlvdb->arena->hash[tlvdb_hash(tag)];
+
+	for (; node; node = node->hash_next)
+		if (node->tag.tag == tag && node->seq >= tlvdb->seq)
+			return node;
+
+	return NULL;
+}
+
 static tlv_tag_t tlv_parse_tag(const unsigned char **buf, size_t *len)
 {
 	tlv_tag_t tag;
@@ -147,6 +259,9 @@ static bool tlvdb_parse_one(struct tlvdb *tlvdb,
 	*tmp += tlvdb->tag.len;
 	*left -= tlvdb->tag.len;
 
+	/* index before the children, keeps the buckets in tree order */
+	tlvdb_arena_index(tlvdb->arena, tlvdb);
+
 	if (tlv_is_constructed(&tlvdb->tag) && (tlvdb->tag.len != 0)) {
 		tlvdb->children = tlvdb_parse_children(tlvdb);
 		if (!tlvdb->children)
@@ -168,92 +283,81 @@ static struct tlvdb *tlvdb_parse_children(struct tlvdb *parent)
 	struct tlvdb *tlvdb, *first = NULL, *prev = NULL;
 
 	while (left != 0) {
-		tlvdb = malloc(sizeof(*tlvdb));
+		tlvdb = tlvdb_arena_alloc(parent->arena);
+		if (!tlvdb)
+			return NULL;
 		if (prev)
 			prev->next = tlvdb;
 		else
 			first = tlvdb;
 		prev = tlvdb;
 
+		/* nodes are released with the arena */
 		if (!tlvdb_parse_one(tlvdb, parent, &tmp, &left))
-			goto err;
-
-		tlvdb->parent = parent;
+			return NULL;
 	}
 
 	return first;
-
-err:
-	tlvdb_free(first);
-
-	return NULL;
 }
 
-struct tlvdb *tlvdb_parse(const unsigned char *buf, size_t len)
+static struct tlvdb *tlvdb_parse_arena(const unsigned char *buf, size_t len, bool multi, bool copy)
 {
-	struct tlvdb_root *root;
+	struct tlvdb_arena *arena;
+	struct tlvdb *db;
 	const unsigned char *tmp;
 	size_t left;
 
 	if (!len || !buf)
 		return NULL;
 
-	root = malloc(sizeof(*root) + len);
-	root->len = len;
-	memcpy(root->buf, buf, len);
+	arena = tlvdb_arena_new(buf, len, copy);
+	if (!arena)
+		return NULL;
 
-	tmp = root->buf;
+	tmp = copy ? arena->buf : buf;
 	left = len;
 
-	if (!tlvdb_parse_one(&root->db, NULL, &tmp, &left))
-		goto err;
+	do {
+		db = tlvdb_arena_alloc(arena);
+		if (!db || !tlvdb_parse_one(db, NULL, &tmp, &left))
+			goto err;
+
+		if (arena->tail)
+			arena->tail->next = db;
+		else
+			arena->first = db;
+		arena->tail = db;
+	} while (multi && left != 0);
 
 	if (left)
 		goto err;
 
-	return &root->db;
+	return arena->first;
 
 err:
-	tlvdb_free(&root->db);
+	tlvdb_arena_free(arena);
 
 	return NULL;
 }
 
-struct tlvdb *tlvdb_parse_multi(const unsigned char *buf, size_t len)
+struct tlvdb *tlvdb_parse(const unsigned char *buf, size_t len)
 {
-	struct tlvdb_root *root;
-	const unsigned char *tmp;
-	size_t left;
-
-	if (!len || !buf)
-		return NULL;
-
-	root = malloc(sizeof(*root) + len);
-	root->len = len;
-	memcpy(root->buf, buf, len);
-
-	tmp = root->buf;
-	left = len;
-
-	if (!tlvdb_parse_one(&root->db, NULL, &tmp, &left))
-		goto err;
-
-	while (left != 0) {
-		struct tlvdb *db = malloc(sizeof(*db));
-		if (!tlvdb_parse_one(db, NULL, &tmp, &left)) {
-			free (db);
-			goto err;
-		}
-
-		tlvdb_add(&root->db, db);
-	}
+	return tlvdb_parse_arena(buf, len, false, true);
+}
 
-	return &root->db;
+struct tlvdb *tlvdb_parse_multi(const unsigned char *buf, size_t len)
+{
+	return tlvdb_parse_arena(buf, len, true, true);
+}
 
-err:
-	tlvdb_free(&root->db);
+struct tlvdb *tlvdb_parse_ref(const unsigned char *buf, size_t len)
+{
+	return tlvdb_parse_arena(buf, len, false, false);
+}
 
-	return NULL;
+struct tlvdb *tlvdb_parse_multi_ref(const unsigned char *buf, size_t len)
+{
+	return tlvdb_parse_arena(buf, len, true, false);
 }
 
 struct tlvdb *tlvdb_fixed(tlv_tag_t tag, size_t len, const unsigned char *value)
@@ -264,6 +368,8 @@ struct tlvdb *tlvdb_fixed(tlv_tag_t tag, size_t len, const unsigned char *value)
 	memcpy(root->buf, value, len);
 
 	root->db.parent = root->db.next = root->db.children = NULL;
+	root->db.arena = NULL;
+	root->db.hash_next = NULL;
 	root->db.tag.tag = tag;
 	root->db.tag.len = len;
 	root->db.tag.value = root->buf;
@@ -278,6 +384,8 @@ struct tlvdb *tlvdb_external(tlv_tag_t tag, size_t len, const unsigned char *val
 	root->len = 0;
 
 	root->db.parent = root->db.next = root->db.children = NULL;
+	root->db.arena = NULL;
+	root->db.hash_next = NULL;
 	root->db.tag.tag = tag;
 	root->db.tag.len = len;
 	root->db.tag.value = value;
@@ -285,20 +393,50 @@ struct tlvdb *tlvdb_external(tlv_tag_t tag, size_t len, const unsigned char *val
 	return &root->db;
 }
 
-void tlvdb_free(struct tlvdb *tlvdb)
+static void tlvdb_free_list(struct tlvdb *tlvdb, struct tlvdb_arena **arenas)
 {
 	struct tlvdb *next = NULL;
 
-	if (!tlvdb)
-		return;
-
 	for (; tlvdb; tlvdb = next) {
 		next = tlvdb->next;
-		tlvdb_free(tlvdb->children);
+		if (tlvdb->arena) {
+			/* the list continues through the arena, release it afterwards */
+			if (tlvdb->arena->first == tlvdb) {
+				tlvdb->arena->free_next = *arenas;
+				*arenas = tlvdb->arena;
+			}
+			/* nodes added inside a parsed tree aren't in its arena */
+			if (!tlvdb->arena->indexed)
+				tlvdb_free_list(tlvdb->children, arenas);
+			continue;
+		}
+		tlvdb_free_list(tlvdb->children, arenas);
 		free(tlvdb);
 	}
 }
 
+/*
+ * Frees a tree and the trees chained after it.  A parsed tree is freed as a
+ * whole: pass the node tlvdb_parse*() returned, its other nodes live in the
+ * same arena and can't be freed on their own.
+ */
+void tlvdb_free(struct tlvdb *tlvdb)
+{
+	struct tlvdb_arena *arenas = NULL;
+
+	if (!tlvdb)
+		return;
+
+	assert(!tlvdb->arena || tlvdb->arena->first == tlvdb);
+	tlvdb_free_list(tlvdb, &arenas);
+
+	while (arenas) {
+		struct tlvdb_arena *arena = arenas;
+		arenas = arena->free_next;
+		tlvdb_arena_free(arena);
+	}
+}
+
 struct tlvdb *tlvdb_find_next(struct tlvdb *tlvdb, tlv_tag_t tag) {
 	if (!tlvdb)
 		return NULL;
@@ -313,6 +451,15 @@ struct tlvdb *tlvdb_find(struct tlvdb *tlvdb, tlv_tag_t tag) {
 	for (; tlvdb; tlvdb = tlvdb->next) {
 		if (tlvdb->tag.tag == tag)
 			return tlvdb;
+
+		/* top level of a parsed tree, look up the rest of it */
+		if (tlvdb->arena && tlvdb->arena->indexed && !tlvdb->parent) {
+			struct tlvdb *node = tlvdb_arena_lookup(tlvdb, tag);
+			for (; node; node = node->hash_next)
+				if (node->tag.tag == tag && !node->parent)
+					return node;
+			tlvdb = tlvdb->arena->tail;
+		}
 	}
 
 	return NULL;
@@ -335,10 +482,19 @@ struct tlvdb *tlvdb_find_path(struct tlvdb *tlvdb, tlv_tag_t tag[]) {
 
 void tlvdb_add(struct tlvdb *tlvdb, struct tlvdb *other)
 {
+	if (tlvdb->arena && tlvdb->arena->indexed && !tlvdb->parent)
+		tlvdb = tlvdb->arena->tail;
+
 	while (tlvdb->next) {
 		tlvdb = tlvdb->next;
+		if (tlvdb->arena && tlvdb->arena->indexed && !tlvdb->parent)
+			tlvdb = tlvdb->arena->tail;
 	}
 
+	/* nodes added inside a parsed tree aren't in its index */
+	if (tlvdb->arena && tlvdb->parent)
+		tlvdb->arena->indexed = false;
+
 	tlvdb->next = other;
 }
 
@@ -380,6 +536,15 @@ const struct tlv *tlvdb_get(const struct tlvdb *tlvdb, tlv_tag_t tag, const stru
 
 
 	while (tlvdb) {
+		if (tlvdb->arena && tlvdb->arena->indexed) {
+			/* rest of the parsed tree from the index, then go on after it */
+			const struct tlvdb *node = tlvdb_arena_lookup(tlvdb, tag);
+			if (node)
+				return &node->tag;
+			tlvdb = tlvdb->arena->tail->next;
+			continue;
+		}
+
 		if (tlvdb->tag.tag == tag)
 			return &tlvdb->tag;
 
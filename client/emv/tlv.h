@@ -37,6 +37,10 @@ struct tlvdb *tlvdb_fixed(tlv_tag_t tag, size_t len, const unsigned char *value)
 struct tlvdb *tlvdb_external(tlv_tag_t tag, size_t len, const unsigned char *value);
 struct tlvdb *tlvdb_parse(const unsigned char *buf, size_t len);
 struct tlvdb *tlvdb_parse_multi(const unsigned char *buf, size_t len);
+/* zero copy, the tree references buf which must outlive it */
+struct tlvdb *tlvdb_parse_ref(const unsigned char *buf, size_t len);
+struct tlvdb *tlvdb_parse_multi_ref(const unsigned char *buf, size_t len);
+/* frees the trees chained from tlvdb, of a parsed tree only its root */
 void tlvdb_free(struct tlvdb *tlvdb);
 
 struct tlvdb *tlvdb_find(struct tlvdb *tlvdb, tlv_tag_t tag);
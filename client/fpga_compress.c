@@ -6,7 +6,8 @@
 // the license.
 //-----------------------------------------------------------------------------
 // Compression tool for FPGA config files. Compress several *.bit files at
-// compile time. Decompression is done at run time (see fpgaloader.c).
+// compile time into one container with an independent stream per bitstream
+// (see fpga.h). Decompression is done at run time (see fpgaloader.c).
 // This uses the zlib library tuned to this specific case. The small file sizes
 // allow to use "insane" parameters for optimum compression ratio.
 //-----------------------------------------------------------------------------
@@ -47,11 +48,12 @@
 static void usage(void)
 {
 	fprintf(stdout, "Usage: fpga_compress <infile1> <infile2> ... <infile_n> <outfile>\n");
-	fprintf(stdout, "          Combine n FPGA bitstream files and compress them into one.\n\n");
+	fprintf(stdout, "          Compress n FPGA bitstream files into one indexed container.\n\n");
 	fprintf(stdout, "       fpga_compress -v <infile1> <infile2> ... <infile_n> <outfile>\n");
 	fprintf(stdout, "          Extract Version Information from FPGA bitstream files and write it to <outfile>\n\n");
 	fprintf(stdout, "       fpga_compress -d <infile> <outfile>\n");
-	fprintf(stdout, "          Decompress <infile>. Write result to <outfile>\n\n");
+	fprintf(stdout, "          Decompress <infile>. Write result to <outfile>\n");
+	fprintf(stdout, "          (for a FPGA container: the bitstreams one after the other)\n\n");
 	fprintf(stdout, "       fpga_compress -t <infile> <outfile>\n");
 	fprintf(stdout, "          Compress hardnested table <infile>. Write result to <outfile>\n\n");
 }
@@ -69,63 +71,14 @@ static void fpga_deflate_free(voidpf opaque, voidpf address)
 }
 
 
-static bool all_feof(FILE *infile[], uint8_t num_infiles)
+static int32_t zlib_deflate_buffer(uint8_t *inbuf, uint32_t inlen, uint8_t **outbuf, uint32_t *outlen)
 {
-	for (uint16_t i = 0; i < num_infiles; i++) {
-		if (!feof(infile[i])) {
-			return false;
-		}
-	}	
-	return true;
-}
-
-
-int zlib_compress(FILE *infile[], uint8_t num_infiles, FILE *outfile, bool hardnested_mode)
-{
-	uint8_t *fpga_config;
-	uint32_t i;
 	int32_t ret;
-	uint8_t c;
 	z_stream compressed_fpga_stream;
 
-	if (hardnested_mode) {
-		fpga_config = malloc(num_infiles * HARDNESTED_TABLE_SIZE);
-	} else {
-	fpga_config = malloc(num_infiles * FPGA_CONFIG_SIZE);
-	}		
-	// read the input files. Interleave them into fpga_config[]
-	i = 0;
-	do {
-
-		if (i >= num_infiles * (hardnested_mode?HARDNESTED_TABLE_SIZE:FPGA_CONFIG_SIZE)) {
-			if (hardnested_mode) {
-				fprintf(stderr, "Input file too big (> %lu bytes). This is probably not a hardnested bitflip state table.\n", HARDNESTED_TABLE_SIZE);
-			} else {
-				fprintf(stderr, "Input files too big (total > %lu bytes). These are probably not PM3 FPGA config files.\n", num_infiles*FPGA_CONFIG_SIZE);
-			}
-			for(uint16_t j = 0; j < num_infiles; j++) {
-				fclose(infile[j]);
-			}
-			free(fpga_config);
-			return(EXIT_FAILURE);
-		}
-
-		for(uint16_t j = 0; j < num_infiles; j++) {
-			for(uint16_t k = 0; k < FPGA_INTERLEAVE_SIZE; k++) {
-				c = (uint8_t)fgetc(infile[j]);
-				if (!feof(infile[j])) {
-					fpga_config[i++] = c;
-				} else if (num_infiles > 1) {
-					fpga_config[i++] = '\0';
-				}
-			}
-		}
-
-	} while (!all_feof(infile, num_infiles));
-
 	// initialize zlib structures
-	compressed_fpga_stream.next_in = fpga_config;
-	compressed_fpga_stream.avail_in = i;
+	compressed_fpga_stream.next_in = inbuf;
+	compressed_fpga_stream.avail_in = inlen;
 	compressed_fpga_stream.zalloc = fpga_deflate_malloc;
 	compressed_fpga_stream.zfree = fpga_deflate_free;
 	compressed_fpga_stream.opaque = Z_NULL;
@@ -139,8 +92,8 @@ int zlib_compress(FILE *infile[], uint8_t num_infiles, FILE *outfile, bool hardn
 
 	// estimate the size of the compressed output
 	uint32_t outsize_max = deflateBound(&compressed_fpga_stream, compressed_fpga_stream.avail_in);
-	uint8_t *outbuf = calloc(outsize_max, sizeof(uint8_t));
-	compressed_fpga_stream.next_out = outbuf;
+	*outbuf = calloc(outsize_max, sizeof(uint8_t));
+	compressed_fpga_stream.next_out = *outbuf;
 	compressed_fpga_stream.avail_out = outsize_max;
 					
 	if (ret == Z_OK) {
@@ -155,40 +108,199 @@ int zlib_compress(FILE *infile[], uint8_t num_infiles, FILE *outfile, bool hardn
 		ret = deflate(&compressed_fpga_stream, Z_FINISH);
 	}
 	
-	fprintf(stdout, "compressed %u input bytes to %lu output bytes\n", i, compressed_fpga_stream.total_out);
+	fprintf(stdout, "compressed %u input bytes to %lu output bytes\n", inlen, compressed_fpga_stream.total_out);
 
 	if (ret != Z_STREAM_END) {
 		fprintf(stderr, "Error in deflate(): %d %s\n", ret, compressed_fpga_stream.msg);
-		free(outbuf);
+		free(*outbuf);
+		*outbuf = NULL;
 		deflateEnd(&compressed_fpga_stream);
-		for(uint16_t j = 0; j < num_infiles; j++) {
-			fclose(infile[j]);
-		}
+		return ret;
+	}
+
+	*outlen = compressed_fpga_stream.total_out;
+	deflateEnd(&compressed_fpga_stream);
+	return Z_OK;
+}
+
+
+int zlib_compress(FILE *infile, FILE *outfile)
+{
+	uint8_t *table = malloc(HARDNESTED_TABLE_SIZE + 1);
+	uint8_t *outbuf = NULL;
+	uint32_t outlen = 0;
+
+	// read the input file
+	uint32_t len = fread(table, 1, HARDNESTED_TABLE_SIZE + 1, infile);
+	fclose(infile);
+	if (len > HARDNESTED_TABLE_SIZE) {
+		fprintf(stderr, "Input file too big (> %lu bytes). This is probably not a hardnested bitflip state table.\n", HARDNESTED_TABLE_SIZE);
 		fclose(outfile);
-		free(infile);
-		free(fpga_config);
+		free(table);
 		return(EXIT_FAILURE);
-		}
-		
-	for (i = 0; i < compressed_fpga_stream.total_out; i++) {
-		fputc(outbuf[i], outfile);
-	}	
+	}
+
+	if (zlib_deflate_buffer(table, len, &outbuf, &outlen) != Z_OK) {
+		fclose(outfile);
+		free(table);
+		return(EXIT_FAILURE);
+	}
+
+	fwrite(outbuf, 1, outlen, outfile);
 
 	free(outbuf);
-	deflateEnd(&compressed_fpga_stream);
-	for(uint16_t j = 0; j < num_infiles; j++) {
-		fclose(infile[j]);
+	fclose(outfile);
+	free(table);
+	return(EXIT_SUCCESS);
+}
+
+
+static void write_le32(FILE *outfile, uint32_t v)
+{
+	for (uint8_t i = 0; i < 4; i++) {
+		fputc((v >> (8*i)) & 0xFF, outfile);
+	}
+}
+
+
+/* Simple Xilinx .bit parser. The file starts with the fixed opaque byte sequence
+ * 00 09 0f f0 0f f0 0f f0 0f f0 00 00 01
+ * After that the format is 1 byte section type (ASCII character), 2 byte length
+ * (big endian), <length> bytes content. Except for section 'e' which has 4 bytes
+ * length.
+ */
+static int bitparse_find_section(FILE *infile, char section_name, unsigned int *section_length)
+{
+	int result = 0;
+	#define MAX_FPGA_BIT_STREAM_HEADER_SEARCH 100  // maximum number of bytes to search for the requested section
+	uint16_t numbytes = 0;
+	while (numbytes < MAX_FPGA_BIT_STREAM_HEADER_SEARCH) {
+		char current_name = (char)fgetc(infile);
+		numbytes++;
+		if (current_name < 'a' || current_name > 'e') {
+			/* Strange section name, abort */
+			break;
+		}
+		unsigned int current_length = 0;
+		switch (current_name) {
+		case 'e':
+			/* Four byte length field */
+			current_length += fgetc(infile) << 24;
+			current_length += fgetc(infile) << 16;
+			numbytes += 2;
+		default: /* Fall through, two byte length field */
+			current_length += fgetc(infile) << 8;
+			current_length += fgetc(infile) << 0;
+			numbytes += 2;
+		}
+
+		if (current_name != 'e' && current_length > 255) {
+			/* Maybe a parse error */
+			break;
+		}
+
+		if (current_name == section_name) {
+			/* Found it */
+			*section_length = current_length;
+			result = 1;
+			break;
+		}
+
+		for (uint16_t i = 0; i < current_length && numbytes < MAX_FPGA_BIT_STREAM_HEADER_SEARCH; i++) {
+			(void)fgetc(infile);
+			numbytes++;
+		}
+	}
+	return result;
+}
+
+//----------------------------------------------------------------------------
+// Build the FPGA image container (see fpga.h). Each bitstream gets its own
+// deflate stream of only its configuration data, so the loader can inflate
+// the one image it needs without touching the others or parsing .bit headers.
+//----------------------------------------------------------------------------
+int fpga_compress(FILE *infile[], uint8_t num_infiles, FILE *outfile)
+{
+	uint8_t *fpga_config = malloc(FPGA_CONFIG_SIZE);
+	uint8_t **outbuf = calloc(num_infiles, sizeof(uint8_t*));
+	uint32_t *outlen = calloc(num_infiles, sizeof(uint32_t));
+	uint32_t *config_len = calloc(num_infiles, sizeof(uint32_t));
+	int ret = EXIT_SUCCESS;
+
+	for (uint16_t i = 0; i < num_infiles && ret == EXIT_SUCCESS; i++) {
+		unsigned int len = 0;
+
+		for (uint16_t j = 0; j < FPGA_BITSTREAM_FIXED_HEADER_SIZE; j++) {
+			if (fgetc(infile[i]) != bitparse_fixed_header[j]) {
+				fprintf(stderr, "Invalid FPGA file. Aborting...\n\n");
+				ret = EXIT_FAILURE;
+				break;
+			}
+		}
+		if (ret != EXIT_SUCCESS) break;
+
+		if (!bitparse_find_section(infile[i], 'e', &len)) {
+			fprintf(stderr, "No bitstream (section 'e') found in FPGA file. Aborting...\n\n");
+			ret = EXIT_FAILURE;
+			break;
+		}
+
+		if (len > FPGA_CONFIG_SIZE) {
+			fprintf(stderr, "Input file too big (> %lu bytes). This is probably not a PM3 FPGA config file.\n", FPGA_CONFIG_SIZE);
+			ret = EXIT_FAILURE;
+			break;
+		}
+
+		if (fread(fpga_config, 1, len, infile[i]) != len) {
+			fprintf(stderr, "FPGA file truncated. Aborting...\n\n");
+			ret = EXIT_FAILURE;
+			break;
+		}
+
+		config_len[i] = len;
+		if (zlib_deflate_buffer(fpga_config, len, &outbuf[i], &outlen[i]) != Z_OK)
+			ret = EXIT_FAILURE;
+	}
+
+	if (ret == EXIT_SUCCESS) {
+		// header and section directory
+		uint32_t offset = FPGA_CONTAINER_HEADER_SIZE + num_infiles * FPGA_CONTAINER_ENTRY_SIZE;
+		write_le32(outfile, FPGA_CONTAINER_MAGIC);
+		write_le32(outfile, num_infiles);
+		for (uint16_t i = 0; i < num_infiles; i++) {
+			write_le32(outfile, offset);
+			write_le32(outfile, outlen[i]);
+			write_le32(outfile, config_len[i]);
+			offset += outlen[i];
+		}
+
+		// the streams
+		for (uint16_t i = 0; i < num_infiles; i++) {
+			fwrite(outbuf[i], 1, outlen[i], outfile);
+		}
+		fprintf(stdout, "wrote %u bitstreams, %u bytes total\n", num_infiles, offset);
+	}
+
+	for (uint16_t i = 0; i < num_infiles; i++) {
+		free(outbuf[i]);
+		fclose(infile[i]);
 	}
 	fclose(outfile);
+	free(outbuf);
+	free(outlen);
+	free(config_len);
 	free(infile);
 	free(fpga_config);
-	
-	return(EXIT_SUCCESS);
-	
+
+	return ret;
 }
 
 
-int zlib_decompress(FILE *infile, FILE *outfile)
+//----------------------------------------------------------------------------
+// Inflate one deflate stream of at most inlen bytes from infile's current
+// position to outfile.
+//----------------------------------------------------------------------------
+static int32_t zlib_inflate_stream(FILE *infile, uint32_t inlen, FILE *outfile)
 {
 	#define DECOMPRESS_BUF_SIZE 1024
 	uint8_t outbuf[DECOMPRESS_BUF_SIZE];
@@ -212,15 +324,14 @@ int zlib_decompress(FILE *infile, FILE *outfile)
 		if (compressed_fpga_stream.avail_in == 0) {
 			compressed_fpga_stream.next_in = inbuf;
 			uint16_t i = 0;
-			do {
+			while (i < DECOMPRESS_BUF_SIZE && inlen) {
 				int32_t c = fgetc(infile);
-				if (!feof(infile)) {
-					inbuf[i++] = c & 0xFF;
-					compressed_fpga_stream.avail_in++;
-				} else {
+				if (feof(infile))
 					break;
-				}
-			} while (i < DECOMPRESS_BUF_SIZE);
+				inbuf[i++] = c & 0xFF;
+				compressed_fpga_stream.avail_in++;
+				inlen--;
+			}
 		}
 
 		ret = inflate(&compressed_fpga_stream, Z_SYNC_FLUSH);
@@ -244,70 +355,54 @@ int zlib_decompress(FILE *infile, FILE *outfile)
 			fputc(outbuf[i++], outfile);
 			compressed_fpga_stream.avail_out++;
 		}
-		fclose(outfile);
-		fclose(infile);
-		return(EXIT_SUCCESS);
+		ret = Z_OK;
 	} else {
 		fprintf(stderr, "Error. Inflate() returned error %d, %s", ret, compressed_fpga_stream.msg);
-		fclose(outfile);
-		fclose(infile);
-		return(EXIT_FAILURE);
 	}
-	
+	inflateEnd(&compressed_fpga_stream);
+	return ret;
 }
 
 
-/* Simple Xilinx .bit parser. The file starts with the fixed opaque byte sequence
- * 00 09 0f f0 0f f0 0f f0 0f f0 00 00 01
- * After that the format is 1 byte section type (ASCII character), 2 byte length
- * (big endian), <length> bytes content. Except for section 'e' which has 4 bytes
- * length.
- */
-static int bitparse_find_section(FILE *infile, char section_name, unsigned int *section_length)
+static uint32_t read_le32(const uint8_t *p)
 {
-	int result = 0;
-	#define MAX_FPGA_BIT_STREAM_HEADER_SEARCH 100  // maximum number of bytes to search for the requested section
-	uint16_t numbytes = 0;
-	while (numbytes < MAX_FPGA_BIT_STREAM_HEADER_SEARCH) {
-		char current_name = (char)fgetc(infile);
-		numbytes++;
-		if (current_name < 'a' || current_name > 'e') {
-			/* Strange section name, abort */
-			break;
-		}
-		unsigned int current_length = 0;
-		switch (current_name) {
-		case 'e':
-			/* Four byte length field */
-			current_length += fgetc(infile) << 24;
-			current_length += fgetc(infile) << 16;
-			numbytes += 2;
-		default: /* Fall through, two byte length field */
-			current_length += fgetc(infile) << 8;
-			current_length += fgetc(infile) << 0;
-			numbytes += 2;
-		}
-
-		if (current_name != 'e' && current_length > 255) {
-			/* Maybe a parse error */
-			break;
-		}
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
 
-		if (current_name == section_name) {
-			/* Found it */
-			*section_length = current_length;
-			result = 1;
-			break;
+//----------------------------------------------------------------------------
+// Decompress either a plain deflate stream (hardnested tables) or an FPGA
+// image container. For the latter the configuration data of all bitstreams
+// is written one after the other.
+//----------------------------------------------------------------------------
+int zlib_decompress(FILE *infile, FILE *outfile)
+{
+	uint8_t header[FPGA_CONTAINER_HEADER_SIZE];
+	int32_t ret = Z_OK;
+
+	if (fread(header, 1, FPGA_CONTAINER_HEADER_SIZE, infile) == FPGA_CONTAINER_HEADER_SIZE
+		&& read_le32(header) == FPGA_CONTAINER_MAGIC) {
+		uint32_t num = read_le32(header + 4);
+		uint8_t *dir = calloc(num, FPGA_CONTAINER_ENTRY_SIZE);
+		if (fread(dir, FPGA_CONTAINER_ENTRY_SIZE, num, infile) != num) {
+			ret = Z_DATA_ERROR;
 		}
-
-		for (uint16_t i = 0; i < current_length && numbytes < MAX_FPGA_BIT_STREAM_HEADER_SEARCH; i++) {
-			(void)fgetc(infile);
-			numbytes++;
+		for (uint32_t i = 0; i < num && ret == Z_OK; i++) {
+			uint8_t *entry = dir + i * FPGA_CONTAINER_ENTRY_SIZE;
+			fseek(infile, read_le32(entry), SEEK_SET);
+			ret = zlib_inflate_stream(infile, read_le32(entry + 4), outfile);
 		}
+		free(dir);
+	} else {
+		rewind(infile);
+		ret = zlib_inflate_stream(infile, UINT32_MAX, outfile);
 	}
-	return result;
+
+	fclose(outfile);
+	fclose(infile);
+	return (ret == Z_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
+
 static int FpgaGatherVersion(FILE *infile, char* infile_name, char *dst, int len)
 {
 	unsigned int fpga_info_len;
@@ -467,8 +562,10 @@ int main(int argc, char **argv)
 			if (generate_fpga_version_info(infiles, infile_names, num_input_files, outfile)) {
 				return(EXIT_FAILURE);
 			}
+		} else if (hardnested_mode) {
+			return zlib_compress(infiles[0], outfile);
 		} else {
-		return zlib_compress(infiles, num_input_files, outfile, hardnested_mode);
+			return fpga_compress(infiles, num_input_files, outfile);
 		}
 	}
 }
@@ -8,10 +8,13 @@
 // Graph utilities
 //-----------------------------------------------------------------------------
 #include "graph.h"
+#include <math.h>
 
 int GraphBuffer[MAX_GRAPH_TRACE_LEN];
 int GraphTraceLen;
 int s_Buff[MAX_GRAPH_TRACE_LEN];
+size_t g_DemodStartIdx = 0;
+int g_DemodClock = 0;
 
 /* write a manchester bit to the graph */
 void AppendGraph(int redraw, int clock, int bit) {
@@ -231,3 +234,125 @@ int fskClocks(uint8_t *fc1, uint8_t *fc2, uint8_t *rf1, int *firstClockEdge) {
 	return 1;
 }
 
+void setClockGrid(int clk, int offset) {
+	g_DemodStartIdx = offset;
+	g_DemodClock = clk;
+	PrintAndLogEx(DEBUG, "DEBUG: (setClockGrid) demodoffset %d, clk %d", offset, clk);
+
+	if (offset > clk) offset %= clk;
+	if (offset < 0) offset += clk;
+
+	if (offset > GraphTraceLen || offset < 0) return;
+	if (clk < 8 || clk > GraphTraceLen) {
+		GridLocked = false;
+		GridOffset = 0;
+		PlotGridX = 0;
+		PlotGridXdefault = 0;
+		RepaintGraphWindow();
+	} else {
+		GridLocked = true;
+		GridOffset = offset;
+		PlotGridX = clk;
+		PlotGridXdefault = clk;
+		RepaintGraphWindow();
+	}
+}
+
+// function to compute mean for a series
+static double compute_mean(const int *data, size_t n) {
+	double mean = 0.0;
+	for (size_t i=0; i < n; i++)
+		mean += data[i];
+	mean /= n;
+	return mean;
+}
+
+//  function to compute variance for a series
+static double compute_variance(const int *data, size_t n) {
+	double variance = 0.0;
+	double mean = compute_mean(data, n);
+
+	for (size_t i=0; i < n; i++)
+		variance += pow(( data[i] - mean), 2.0);
+
+	variance /= n;	
+	return variance;
+}
+
+// Function to compute autocorrelation for a series
+//  Author: Kenneth J. Christensen
+//  - Corrected divide by n to divide (n - lag) from Tobias Mueller
+/*
+static double compute_autoc(const int *data, size_t n, int lag) {
+	double autocv = 0.0;	// Autocovariance value
+	double ac_value;		// Computed autocorrelation value to be returned
+	double variance; 		// Computed variance
+	double mean;
+	
+	mean = compute_mean(data, n);
+	variance = compute_variance(data, n);
+	
+	for (size_t i=0; i < (n - lag); i++)
+		autocv += (data[i] - mean) * (data[i+lag] - mean);
+
+	autocv = (1.0 / (n - lag)) * autocv;
+
+	// Autocorrelation is autocovariance divided by variance
+	ac_value = autocv / variance;
+	return ac_value;
+}
+*/
+
+int AutoCorrelate(const int *in, int *out, size_t len, int window, bool SaveGrph, bool verbose) {
+	// sanity check
+	if ( window > len ) window = len;
+	
+	if (verbose) PrintAndLogEx(INFO, "performing %d correlations", len - window);
+	
+	//test
+	double autocv = 0.0;	// Autocovariance value
+	double ac_value;		// Computed autocorrelation value to be returned
+	double variance; 		// Computed variance
+	double mean;
+	size_t correlation = 0;
+	int lastmax = 0;
+	
+	// in, len, 4000
+	mean = compute_mean(in, len);
+	variance = compute_variance(in, len);
+		
+	static int CorrelBuffer[MAX_GRAPH_TRACE_LEN];
+	
+	for (int i = 0; i < len - window; ++i) {
+
+		for (size_t j=0; j < (len - i); j++) {
+			autocv += (in[j] - mean) * (in[j+i] - mean);
+		}
+		autocv = (1.0 / (len - i)) * autocv;
+
+		CorrelBuffer[i] = autocv;
+		
+		// Autocorrelation is autocovariance divided by variance
+		ac_value = autocv / variance;
+
+		// keep track of which distance is repeating.
+		if ( ac_value > 1) {
+			correlation = i-lastmax;
+			lastmax = i;
+		}
+	}
+
+	if (verbose) {
+		if ( correlation > 1 )
+			PrintAndLogEx(SUCCESS, "possible correlation %4d samples", correlation);
+		else
+			PrintAndLogEx(FAILED, "no repeating pattern found");
+	}
+	
+	if (SaveGrph){
+		//GraphTraceLen = GraphTraceLen - window;
+		memcpy(out, CorrelBuffer, len * sizeof(int));
+		RepaintGraphWindow();  
+	}
+	return correlation;
+}
@@ -286,33 +286,13 @@ __attribute__((force_align_arg_pointer))
 	return statelist->head.slhead;
 }
 
-int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t * key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t * resultKey, bool calibrate) {
+// recover the candidate keys from two nested authentications (uid, nt, ks1 filled in).
+// The candidates are left sorted in statelists[0],  both lists must be freed by the caller
+uint32_t mfnested_candidates(StateList_t statelists[2]) {
 	uint16_t i;
-	uint32_t uid;
-	UsbCommand resp;
-	StateList_t statelists[2];
 	struct Crypto1State *p1, *p2, *p3, *p4;
-	
-	UsbCommand c = {CMD_MIFARE_NESTED, {blockNo + keyType * 0x100, trgBlockNo + trgKeyType * 0x100, calibrate}};
-	memcpy(c.d.asBytes, key, 6);
-	clearCommandBuffer();
-	SendCommand(&c);
-	if (!WaitForResponseTimeout(CMD_ACK, &resp, 1500)) return -1;
 
-	// error during nested
-	if (resp.arg[0]) return resp.arg[0];
-	
-	memcpy(&uid, resp.d.asBytes, 4);
-		
-	for (i = 0; i < 2; i++) {
-		statelists[i].blockNo = resp.arg[2] & 0xff;
-		statelists[i].keyType = (resp.arg[2] >> 8) & 0xff;
-		statelists[i].uid = uid;
-		memcpy(&statelists[i].nt,  (void *)(resp.d.asBytes + 4 + i * 8 + 0), 4);
-		memcpy(&statelists[i].ks1, (void *)(resp.d.asBytes + 4 + i * 8 + 4), 4);
-	}
-	
-	// calc keys	
+	// calc keys
 	pthread_t thread_id[2];
 		
 	// create and run worker threads
@@ -368,8 +348,35 @@ int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t * key, uint8_t trgBlockNo
 	// Create the intersection
 	statelists[0].len = intersection(statelists[0].head.keyhead, statelists[1].head.keyhead);
 
-	//statelists[0].tail.keytail = --p7;
-	uint32_t keycnt = statelists[0].len;
+	return statelists[0].len;
+}
+
+int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t * key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t * resultKey, bool calibrate) {
+	uint16_t i;
+	uint32_t uid;
+	UsbCommand resp;
+	StateList_t statelists[2];
+	
+	UsbCommand c = {CMD_MIFARE_NESTED, {blockNo + keyType * 0x100, trgBlockNo + trgKeyType * 0x100, calibrate}};
+	memcpy(c.d.asBytes, key, 6);
+	clearCommandBuffer();
+	SendCommand(&c);
+	if (!WaitForResponseTimeout(CMD_ACK, &resp, 1500)) return -1;
+
+	// error during nested
+	if (resp.arg[0]) return resp.arg[0];
+	
+	memcpy(&uid, resp.d.asBytes, 4);
+		
+	for (i = 0; i < 2; i++) {
+		statelists[i].blockNo = resp.arg[2] & 0xff;
+		statelists[i].keyType = (resp.arg[2] >> 8) & 0xff;
+		statelists[i].uid = uid;
+		memcpy(&statelists[i].nt,  (void *)(resp.d.asBytes + 4 + i * 8 + 0), 4);
+		memcpy(&statelists[i].ks1, (void *)(resp.d.asBytes + 4 + i * 8 + 4), 4);
+	}
+	
+	uint32_t keycnt = mfnested_candidates(statelists);
 	if ( keycnt == 0 ) goto out;
 
 	memset(resultKey, 0, 6);
@@ -384,8 +391,8 @@ int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t * key, uint8_t trgBlockNo
 		int size = keycnt - i > max_keys ? max_keys : keycnt - i;
 	
 		for (int j = 0; j < size; j++) {
-			crypto1_get_lfsr(statelists[0].head.slhead + i, &key64);
-			num_to_bytes(key64, 6, keyBlock + i * 6);
+			crypto1_get_lfsr(statelists[0].head.slhead + i + j, &key64);
+			num_to_bytes(key64, 6, keyBlock + j * 6);
 		}
 		
 		if (!mfCheckKeys(statelists[0].blockNo, statelists[0].keyType, false, size, keyBlock, &key64)) {		
@@ -0,0 +1,465 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Byte buffer userdata for Lua scripts.
+//
+// Data stays in C memory,  no hex strings in between. Slices are views on the
+// parent buffer (the parent is kept alive by them). Byte indexes are 1 based
+// like Lua strings,  negative ones count from the end. Bit offsets are 0 based,
+// MSB first.
+//
+//  local b = buf.bigbuf(4000, 0)          -- download BigBuf
+//  b:sub(1, 16):hex()                     -- view, no copy
+//  b:getbits(12, 4)                       -- 4 bits from bit offset 12
+//  b:to_graph()                           -- into GraphBuffer
+//  buf.command(CMD, a0, a1, a2, payload)  -- payload copied straight into the UsbCommand
+//  core.sha1_chunks(b, 64)                -- core.aes128_*_blocks / sha1_chunks take buffers too
+//-----------------------------------------------------------------------------
+#include "pm3_buflib.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <lauxlib.h>
+
+#include "proxmark3.h"
+#include "usb_cmd.h"
+#include "cmdmain.h"
+#include "graph.h"
+#include "cmddata.h"
+#include "ui.h"
+#include "util.h"
+#include "crc16.h"
+
+#define BUF_META	"pm3.buffer"
+
+typedef struct {
+	uint8_t *data;
+	size_t len;
+	bool owner;		// false for slices,  data belongs to the parent
+} pm3_buffer_t;
+
+static pm3_buffer_t *buf_check(lua_State *L, int idx) {
+	return (pm3_buffer_t *)luaL_checkudata(L, idx, BUF_META);
+}
+
+// new zeroed buffer on the stack
+static pm3_buffer_t *buf_push(lua_State *L, size_t len) {
+	pm3_buffer_t *b = (pm3_buffer_t *)lua_newuserdata(L, sizeof(pm3_buffer_t));
+	b->data = NULL;
+	b->len = 0;
+	b->owner = true;
+	luaL_setmetatable(L, BUF_META);
+
+	b->data = calloc(len ? len : 1, sizeof(uint8_t));
+	if (!b->data)
+		luaL_error(L, "Allocating memory failed");
+	b->len = len;
+	return b;
+}
+
+// bytes of a buffer or a string argument,  also used by the core.* bulk crypto helpers
+const uint8_t *buf_or_string(lua_State *L, int idx, size_t *len) {
+	pm3_buffer_t *b = (pm3_buffer_t *)luaL_testudata(L, idx, BUF_META);
+	if (b) {
+		*len = b->len;
+		return b->data;
+	}
+	return (const uint8_t *)luaL_checklstring(L, idx, len);
+}
+
+// string.sub style range,  1 based,  inclusive,  negative from the end
+static void buf_range(lua_State *L, pm3_buffer_t *b, int ia, int ib, size_t *start, size_t *end) {
+	lua_Integer i = luaL_optinteger(L, ia, 1);
+	lua_Integer j = luaL_optinteger(L, ib, -1);
+	lua_Integer len = (lua_Integer)b->len;
+
+	if (i < 0) i = len + i + 1;
+	if (j < 0) j = len + j + 1;
+	if (i < 1) i = 1;
+	if (j > len) j = len;
+
+	*start = (size_t)(i - 1);
+	*end = (j >= i) ? (size_t)j : *start;
+}
+
+static int buf_gc(lua_State *L) {
+	pm3_buffer_t *b = buf_check(L, 1);
+	if (b->owner)
+		free(b->data);
+	b->data = NULL;
+	b->len = 0;
+	return 0;
+}
+
+static int buf_len(lua_State *L) {
+	lua_pushunsigned(L, buf_check(L, 1)->len);
+	return 1;
+}
+
+static int buf_hex(lua_State *L) {
+	pm3_buffer_t *b = buf_check(L, 1);
+	static const char hex[] = "0123456789ABCDEF";
+	luaL_Buffer lb;
+	char *p = luaL_buffinitsize(L, &lb, b->len * 2 + 1);
+	for (size_t i = 0; i < b->len; i++) {
+		p[i * 2] = hex[b->data[i] >> 4];
+		p[i * 2 + 1] = hex[b->data[i] & 0x0F];
+	}
+	luaL_pushresultsize(&lb, b->len * 2);
+	return 1;
+}
+
+static int buf_bytes(lua_State *L) {
+	pm3_buffer_t *b = buf_check(L, 1);
+	lua_pushlstring(L, (const char *)b->data, b->len);
+	return 1;
+}
+
+static int buf_eq(lua_State *L) {
+	pm3_buffer_t *a = buf_check(L, 1);
+	pm3_buffer_t *b = buf_check(L, 2);
+	lua_pushboolean(L, a->len == b->len && !memcmp(a->data, b->data, a->len));
+	return 1;
+}
+
+// b[i] reads byte i,  other keys are methods
+static int buf_index(lua_State *L) {
+	pm3_buffer_t *b = buf_check(L, 1);
+	if (lua_type(L, 2) == LUA_TNUMBER) {
+		lua_Integer i = lua_tointeger(L, 2);
+		if (i < 1 || i > (lua_Integer)b->len)
+			return 0;
+		lua_pushunsigned(L, b->data[i - 1]);
+		return 1;
+	}
+	luaL_getmetatable(L, BUF_META);
+	lua_pushvalue(L, 2);
+	lua_rawget(L, -2);
+	return 1;
+}
+
+static int buf_newindex(lua_State *L) {
+	pm3_buffer_t *b = buf_check(L, 1);
+	lua_Integer i = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, i >= 1 && i <= (lua_Integer)b->len, 2, "index out of range");
+	b->data[i - 1] = luaL_checkunsigned(L, 3) & 0xFF;
+	return 0;
+}
+
+// b:sub(i, j)  view on bytes i..j,  shares the memory
+static int buf_sub(lua_State *L) {
+	pm3_buffer_t *b = buf_check(L, 1);
+	size_t start, end;
+	buf_range(L, b, 2, 3, &start, &end);
+
+	pm3_buffer_t *s = (pm3_buffer_t *)lua_newuserdata(L, sizeof(pm3_buffer_t));
+	s->data = b->data + start;
+	s->len = end - start;
+	s->owner = false;
+	luaL_setmetatable(L, BUF_META);
+
+	// keep the parent alive as long as the view
+	lua_createtable(L, 1, 0);
+	lua_pushvalue(L, 1);
+	lua_rawseti(L, -2, 1);
+	lua_setuservalue(L, -2);
+	return 1;
+}
+
+static int buf_copy(lua_State *L) {
+	pm3_buffer_t *b = buf_check(L, 1);
+	pm3_buffer_t *c = buf_push(L, b->len);
+	memcpy(c->data, b->data, b->len);
+	return 1;
+}
+
+// b:fill(v [, i, j])
+static int buf_fill(lua_State *L) {
+	pm3_buffer_t *b = buf_check(L, 1);
+	uint8_t v = luaL_checkunsigned(L, 2) & 0xFF;
+	size_t start, end;
+	buf_range(L, b, 3, 4, &start, &end);
+	memset(b->data + start, v, end - start);
+	lua_settop(L, 1);
+	return 1;
+}
+
+// b:set(i, data)  write a buffer or string at byte i,  clipped to the buffer
+static int buf_set(lua_State *L) {
+	pm3_buffer_t *b = buf_check(L, 1);
+	lua_Integer i = luaL_checkinteger(L, 2);
+	size_t len;
+	const uint8_t *src = buf_or_string(L, 3, &len);
+	luaL_argcheck(L, i >= 1 && i <= (lua_Integer)b->len + 1, 2, "index out of range");
+	if (len > b->len - (i - 1))
+		len = b->len - (i - 1);
+	memmove(b->data + i - 1, src, len);
+	lua_settop(L, 1);
+	return 1;
+}
+
+// b:getbits(offset, n)  up to 32 bits,  MSB first
+static int buf_getbits(lua_State *L) {
+	pm3_buffer_t *b = buf_check(L, 1);
+	lua_Unsigned off = luaL_checkunsigned(L, 2);
+	lua_Unsigned n = luaL_checkunsigned(L, 3);
+	luaL_argcheck(L, n <= 32, 3, "at most 32 bits");
+	luaL_argcheck(L, off + n <= b->len * 8, 2, "bits out of range");
+
+	uint32_t v = 0;
+	for (lua_Unsigned i = off; i < off + n; i++)
+		v = (v << 1) | ((b->data[i >> 3] >> (7 - (i & 7))) & 1);
+
+	lua_pushunsigned(L, v);
+	return 1;
+}
+
+// b:setbits(offset, n, value)
+static int buf_setbits(lua_State *L) {
+	pm3_buffer_t *b = buf_check(L, 1);
+	lua_Unsigned off = luaL_checkunsigned(L, 2);
+	lua_Unsigned n = luaL_checkunsigned(L, 3);
+	uint32_t v = luaL_checkunsigned(L, 4);
+	luaL_argcheck(L, n <= 32, 3, "at most 32 bits");
+	luaL_argcheck(L, off + n <= b->len * 8, 2, "bits out of range");
+
+	for (lua_Unsigned i = off + n; i > off; i--, v >>= 1) {
+		uint8_t mask = 1 << (7 - ((i - 1) & 7));
+		if (v & 1)
+			b->data[(i - 1) >> 3] |= mask;
+		else
+			b->data[(i - 1) >> 3] &= ~mask;
+	}
+	lua_settop(L, 1);
+	return 1;
+}
+
+// b:uint(i, n [, littleendian])  n byte unsigned integer at byte i
+static int buf_uint(lua_State *L) {
+	pm3_buffer_t *b = buf_check(L, 1);
+	lua_Integer i = luaL_checkinteger(L, 2);
+	lua_Integer n = luaL_checkinteger(L, 3);
+	bool le = lua_toboolean(L, 4);
+	luaL_argcheck(L, n >= 1 && n <= 4, 3, "1 to 4 bytes");
+	luaL_argcheck(L, i >= 1 && i + n - 1 <= (lua_Integer)b->len, 2, "index out of range");
+
+	uint8_t *p = b->data + i - 1;
+	uint32_t v = 0;
+	for (lua_Integer k = 0; k < n; k++)
+		v = (v << 8) | p[le ? n - 1 - k : k];
+	lua_pushunsigned(L, v);
+	return 1;
+}
+
+// b:xor(other)  in place,  other is repeated if shorter
+static int buf_xor(lua_State *L) {
+	pm3_buffer_t *b = buf_check(L, 1);
+	size_t len;
+	const uint8_t *k = buf_or_string(L, 2, &len);
+	if (len) {
+		for (size_t i = 0; i < b->len; i++)
+			b->data[i] ^= k[i % len];
+	}
+	lua_settop(L, 1);
+	return 1;
+}
+
+static const char *const crc_names[] = {"14a", "14b", "15", "iclass", "felica", "ccitt", "kermit", NULL};
+static const CrcType_t crc_types[] = {CRC_14443_A, CRC_14443_B, CRC_15693, CRC_ICLASS, CRC_FELICA, CRC_CCITT, CRC_KERMIT};
+
+// b:crc(type [, i, j])  CRC-16 over the range
+static int buf_crc(lua_State *L) {
+	pm3_buffer_t *b = buf_check(L, 1);
+	CrcType_t ct = crc_types[luaL_checkoption(L, 2, NULL, crc_names)];
+	size_t start, end;
+	buf_range(L, b, 3, 4, &start, &end);
+
+	const uint8_t *d = b->data + start;
+	size_t n = end - start;
+	uint16_t v = 0;
+	init_table(ct);
+	switch (ct) {
+		case CRC_14443_A: v = crc16_a(d, n); break;
+		case CRC_14443_B:
+		case CRC_15693: v = crc16_x25(d, n); break;
+		case CRC_ICLASS: v = crc16_iclass(d, n); break;
+		case CRC_FELICA: v = crc16_xmodem(d, n); break;
+		case CRC_CCITT: v = crc16_ccitt(d, n); break;
+		case CRC_KERMIT: v = crc16_kermit(d, n); break;
+		default: break;
+	}
+	lua_pushunsigned(L, v);
+	return 1;
+}
+
+// b:check_crc(type)  last two bytes are the CRC
+static int buf_check_crc(lua_State *L) {
+	pm3_buffer_t *b = buf_check(L, 1);
+	CrcType_t ct = crc_types[luaL_checkoption(L, 2, NULL, crc_names)];
+	lua_pushboolean(L, b->len >= 3 && check_crc(ct, b->data, b->len));
+	return 1;
+}
+
+// b:to_graph()  bytes as unsigned samples into GraphBuffer,  like `data samples`
+static int buf_to_graph(lua_State *L) {
+	pm3_buffer_t *b = buf_check(L, 1);
+	size_t n = b->len > MAX_GRAPH_TRACE_LEN ? MAX_GRAPH_TRACE_LEN : b->len;
+	for (size_t i = 0; i < n; i++)
+		GraphBuffer[i] = ((int)b->data[i]) - 128;
+	GraphTraceLen = n;
+	RepaintGraphWindow();
+	lua_pushunsigned(L, n);
+	return 1;
+}
+
+static int buf_new(lua_State *L) {
+	lua_Unsigned len = luaL_checkunsigned(L, 1);
+	uint8_t fill = luaL_optunsigned(L, 2, 0) & 0xFF;
+	pm3_buffer_t *b = buf_push(L, len);
+	memset(b->data, fill, len);
+	return 1;
+}
+
+static int buf_fromstring(lua_State *L) {
+	size_t len;
+	const char *s = luaL_checklstring(L, 1, &len);
+	pm3_buffer_t *b = buf_push(L, len);
+	memcpy(b->data, s, len);
+	return 1;
+}
+
+static int buf_fromhex(lua_State *L) {
+	size_t len;
+	const char *s = luaL_checklstring(L, 1, &len);
+	pm3_buffer_t *b = buf_push(L, len / 2);
+	size_t n = 0;
+	int hi = -1;
+	for (size_t i = 0; i < len; i++) {
+		char c = s[i];
+		int v;
+		if (c >= '0' && c <= '9') v = c - '0';
+		else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+		else if (c == ' ' || c == ':' || c == '-') continue;
+		else return luaL_argerror(L, 1, "not a hex string");
+		if (hi < 0) {
+			hi = v;
+		} else {
+			b->data[n++] = (hi << 4) | v;
+			hi = -1;
+		}
+	}
+	if (hi >= 0)
+		return luaL_argerror(L, 1, "odd number of hex digits");
+	b->len = n;
+	return 1;
+}
+
+// buf.graph()  GraphBuffer as unsigned samples
+static int buf_graph(lua_State *L) {
+	pm3_buffer_t *b = buf_push(L, GraphTraceLen);
+	for (size_t i = 0; i < b->len; i++) {
+		int v = GraphBuffer[i] + 128;
+		b->data[i] = v < 0 ? 0 : (v > 255 ? 255 : v);
+	}
+	return 1;
+}
+
+// buf.bigbuf(len [, start [, timeout]])  download straight into a new buffer
+static int buf_bigbuf(lua_State *L) {
+	lua_Unsigned len = luaL_checkunsigned(L, 1);
+	lua_Unsigned start = luaL_optunsigned(L, 2, 0);
+	lua_Unsigned timeout = luaL_optunsigned(L, 3, 2500);
+	luaL_argcheck(L, len <= BIGBUF_SIZE, 1, "longer than BigBuf");
+	luaL_argcheck(L, start <= BIGBUF_SIZE - len, 2, "past the end of BigBuf");
+	pm3_buffer_t *b = buf_push(L, len);
+	if (!GetFromDevice(BIG_BUF, b->data, len, start, NULL, timeout, false)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "command execution time out");
+		return 2;
+	}
+	return 1;
+}
+
+// buf.command(cmd, arg0, arg1, arg2 [, payload])  payload buffer or string,  up to USB_CMD_DATA_SIZE
+static int buf_command(lua_State *L) {
+	UsbCommand c = {luaL_checkunsigned(L, 1), {luaL_optunsigned(L, 2, 0), luaL_optunsigned(L, 3, 0), luaL_optunsigned(L, 4, 0)}};
+	if (!lua_isnoneornil(L, 5)) {
+		size_t len;
+		const uint8_t *d = buf_or_string(L, 5, &len);
+		luaL_argcheck(L, len <= USB_CMD_DATA_SIZE, 5, "payload too long");
+		memcpy(c.d.asBytes, d, len);
+	}
+	clearCommandBuffer();
+	SendCommand(&c);
+	return 0;
+}
+
+// buf.response(cmd [, timeout])  returns arg0, arg1, arg2, payload buffer  or nil, error
+static int buf_response(lua_State *L) {
+	uint32_t cmd = luaL_checkunsigned(L, 1);
+	size_t timeout = luaL_optunsigned(L, 2, 2500);
+	UsbCommand resp;
+	if (!WaitForResponseTimeout(cmd, &resp, timeout)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "No response from the device");
+		return 2;
+	}
+	lua_pushunsigned(L, resp.arg[0]);
+	lua_pushunsigned(L, resp.arg[1]);
+	lua_pushunsigned(L, resp.arg[2]);
+	pm3_buffer_t *b = buf_push(L, USB_CMD_DATA_SIZE);
+	memcpy(b->data, resp.d.asBytes, USB_CMD_DATA_SIZE);
+	return 4;
+}
+
+static const luaL_Reg buf_methods[] = {
+	{"__gc",		buf_gc},
+	{"__len",		buf_len},
+	{"__eq",		buf_eq},
+	{"__tostring",	buf_hex},
+	{"__index",		buf_index},
+	{"__newindex",	buf_newindex},
+	{"hex",			buf_hex},
+	{"bytes",		buf_bytes},
+	{"sub",			buf_sub},
+	{"copy",		buf_copy},
+	{"fill",		buf_fill},
+	{"set",			buf_set},
+	{"getbits",		buf_getbits},
+	{"setbits",		buf_setbits},
+	{"uint",		buf_uint},
+	{"xor",			buf_xor},
+	{"crc",			buf_crc},
+	{"check_crc",	buf_check_crc},
+	{"to_graph",	buf_to_graph},
+	{NULL, NULL}
+};
+
+static const luaL_Reg buflib[] = {
+	{"new",			buf_new},
+	{"fromstring",	buf_fromstring},
+	{"fromhex",		buf_fromhex},
+	{"graph",		buf_graph},
+	{"bigbuf",		buf_bigbuf},
+	{"command",		buf_command},
+	{"response",	buf_response},
+	{NULL, NULL}
+};
+
+LUALIB_API int luaopen_buf(lua_State *L) {
+	luaL_newmetatable(L, BUF_META);
+	luaL_setfuncs(L, buf_methods, 0);
+	lua_pop(L, 1);
+
+	luaL_newlib(L, buflib);
+	return 1;
+}
+
+int set_buf_library(lua_State *L) {
+	luaL_requiref(L, "buf", luaopen_buf, 1);
+	lua_pop(L, 1);
+	return 1;
+}
@@ -0,0 +1,10 @@
+#ifndef PM3_BUFLIB
+#define PM3_BUFLIB
+
+#include <stdint.h>
+#include <stddef.h>
+#include <lua.h>
+int set_buf_library (lua_State *L);
+const uint8_t *buf_or_string(lua_State *L, int idx, size_t *len);
+
+#endif /* PM3_BUFLIB */
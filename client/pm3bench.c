@@ -0,0 +1,461 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Micro-benchmarks of the client hot paths: crapto1, loclass, crc, lf demod
+// on the bundled traces,  autocorrelation and the hardnested bitarray kernels.
+//
+//   make bench
+//   ./pm3bench -d ../traces -t 1000 -f crapto1
+//
+// One line per benchmark,  whitespace separated:  name  iterations  ns/op  ops/s
+// Lines starting with '#' describe the machine,  so runs can be compared
+// between releases with plain diff / awk.
+//-----------------------------------------------------------------------------
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE	199309L			// need clock_gettime()
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "util.h"
+#include "util_posix.h"
+#include "crapto1/crapto1.h"
+#include "loclass/cipher.h"
+#include "loclass/ikeys.h"
+#include "loclass/elite_crack.h"
+#include "crc.h"
+#include "crc16.h"
+#include "lfdemod.h"
+#include "graph.h"
+#include "cmddata.h"
+#include "hardnested/hardnested_bitarray_core.h"
+
+#define BENCH_TIME_MS		500			// default time spent on each benchmark
+#define BENCH_TRACE_DIR		"../traces"
+#define BENCH_BUF_SIZE		1024		// crc input
+#define BENCH_BITARRAY		(sizeof(uint32_t) * (1<<19))	// 2^24 states,  as in hardnested
+
+typedef struct {
+	const char *name;
+	// run the operation n times,  return something depending on the result
+	uint32_t (*run)(uint32_t n);
+} bench_t;
+
+// keeps the compiler from dropping the benchmarked calls
+static volatile uint32_t sink;
+
+//-----------------------------------------------------------------------------
+// crapto1
+//-----------------------------------------------------------------------------
+static uint32_t ks2, ks3;
+
+static void crapto1_setup(void) {
+	struct Crypto1State *s = crypto1_create(0xa0a1a2a3a4a5);
+	crypto1_word(s, 0x01200145 ^ 0x9c599b32, 0);
+	crypto1_word(s, 0x5c4a5edc, 1);
+	ks2 = crypto1_word(s, 0, 0);
+	ks3 = crypto1_word(s, 0, 0);
+	crypto1_destroy(s);
+}
+
+static uint32_t bench_lfsr_recovery32(uint32_t n) {
+	uint32_t r = 0;
+	for (uint32_t i = 0; i < n; i++) {
+		struct Crypto1State *revstate = lfsr_recovery32(ks2, i);
+		r += revstate->odd;
+		free(revstate);
+	}
+	return r;
+}
+
+static uint32_t bench_lfsr_recovery64(uint32_t n) {
+	uint32_t r = 0;
+	for (uint32_t i = 0; i < n; i++) {
+		struct Crypto1State *revstate = lfsr_recovery64(ks2, ks3 ^ i);
+		r += revstate->odd;
+		crypto1_destroy(revstate);
+	}
+	return r;
+}
+
+static uint32_t bench_crypto1_word(uint32_t n) {
+	struct Crypto1State *s = crypto1_create(0xffffffffffff);
+	uint32_t r = 0;
+	for (uint32_t i = 0; i < n; i++)
+		r ^= crypto1_word(s, i, 0);
+	crypto1_destroy(s);
+	return r;
+}
+
+static uint32_t bench_nonce_distance(uint32_t n) {
+	uint32_t nt = 0x01200145, r = 0;
+	for (uint32_t i = 0; i < n; i++) {
+		uint32_t next = prng_successor(nt, 160 + (i & 0xFF));
+		r += nonce_distance(nt, next);
+		nt = next;
+	}
+	return r;
+}
+
+//-----------------------------------------------------------------------------
+// loclass
+//-----------------------------------------------------------------------------
+static uint32_t bench_doMAC(uint32_t n) {
+	uint8_t cc_nr[12] = {0xFE,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0x00,0x00,0x00,0x00};
+	uint8_t div_key[8] = {0xE0,0x33,0xCA,0x41,0x9A,0xEE,0x43,0xF9};
+	uint8_t mac[4] = {0};
+	uint32_t r = 0;
+	for (uint32_t i = 0; i < n; i++) {
+		memcpy(cc_nr + 8, &i, 4);
+		doMAC(cc_nr, div_key, mac);
+		r ^= bytes_to_num(mac, 4);
+	}
+	return r;
+}
+
+static uint32_t bench_hash0(uint32_t n) {
+	uint8_t k[8];
+	uint32_t r = 0;
+	for (uint32_t i = 0; i < n; i++) {
+		hash0(0x0123456789ABCDEFULL ^ i, k);
+		r ^= k[0];
+	}
+	return r;
+}
+
+static uint32_t bench_hash1(uint32_t n) {
+	uint8_t csn[8] = {0x01,0x02,0x03,0x04,0xF7,0xFF,0x12,0xE0};
+	uint8_t k[8];
+	uint32_t r = 0;
+	for (uint32_t i = 0; i < n; i++) {
+		csn[0] = i;
+		hash1(csn, k);
+		r ^= k[0];
+	}
+	return r;
+}
+
+//-----------------------------------------------------------------------------
+// crc,  over a 1 KiB buffer
+//-----------------------------------------------------------------------------
+static uint8_t crcbuf[BENCH_BUF_SIZE];
+
+static uint32_t bench_crc8_maxim(uint32_t n) {
+	uint32_t r = 0;
+	for (uint32_t i = 0; i < n; i++)
+		r += CRC8Maxim(crcbuf, sizeof(crcbuf));
+	return r;
+}
+
+static uint32_t bench_crc_update(uint32_t n) {
+	crc_t crc;
+	crc_init(&crc, 32, 0x04c11db7, 0xffffffff, 0xffffffff);
+	for (uint32_t i = 0; i < n; i++) {
+		crc_clear(&crc);
+		for (size_t j = 0; j < sizeof(crcbuf); j++)
+			crc_update(&crc, crcbuf[j], 8);
+	}
+	return crc_finish(&crc);
+}
+
+static uint32_t bench_crc16_a(uint32_t n) {
+	uint32_t r = 0;
+	for (uint32_t i = 0; i < n; i++)
+		r += crc16_a(crcbuf, sizeof(crcbuf));
+	return r;
+}
+
+static uint32_t bench_crc16_iclass(uint32_t n) {
+	uint32_t r = 0;
+	for (uint32_t i = 0; i < n; i++)
+		r += crc16_iclass(crcbuf, sizeof(crcbuf));
+	return r;
+}
+
+static uint32_t bench_crc16_fast(uint32_t n) {
+	uint32_t r = 0;
+	init_table(CRC_14443_A);
+	for (uint32_t i = 0; i < n; i++)
+		r += crc16_fast(crcbuf, sizeof(crcbuf), 0xC6C6, true, true);
+	return r;
+}
+
+//-----------------------------------------------------------------------------
+// lf demod,  every run works on a fresh copy of the trace like the client does
+//-----------------------------------------------------------------------------
+typedef struct {
+	const char *fname;
+	uint8_t *samples;
+	int *graph;
+	size_t len;
+} trace_t;
+
+static trace_t trace_ask = { "EM4102-1.pm3" };
+static trace_t trace_fsk = { "HID-weak-fob-11647.pm3" };
+static trace_t trace_psk = { "modulation-psk1-32-4.pm3" };
+static uint8_t demodbuf[MAX_GRAPH_TRACE_LEN];
+
+// same format and conversion as "data load" followed by getFromGraphBuf()
+static bool load_trace(const char *dir, trace_t *t) {
+	char fname[FILE_PATH_SIZE];
+	snprintf(fname, sizeof(fname), "%s/%s", dir, t->fname);
+	FILE *f = fopen(fname, "r");
+	if (!f) {
+		fprintf(stderr, "can't open %s\n", fname);
+		return false;
+	}
+	t->samples = calloc(MAX_GRAPH_TRACE_LEN, sizeof(uint8_t));
+	t->graph = calloc(MAX_GRAPH_TRACE_LEN, sizeof(int));
+	char line[80];
+	t->len = 0;
+	while (t->len < MAX_GRAPH_TRACE_LEN && fgets(line, sizeof(line), f)) {
+		int v = atoi(line);
+		if (v > 127) v = 127;
+		if (v < -127) v = -127;
+		t->graph[t->len] = v;
+		t->samples[t->len] = (uint8_t)(v + 128);
+		t->len++;
+	}
+	fclose(f);
+	return t->len != 0;
+}
+
+// the demods bail out early on a signal the last justNoise() call found to be noise
+static void use_trace(trace_t *t) {
+	justNoise(t->samples, t->len);
+}
+
+static uint32_t bench_DetectASKClock(uint32_t n) {
+	uint32_t r = 0;
+	use_trace(&trace_ask);
+	for (uint32_t i = 0; i < n; i++) {
+		int clk = 0;
+		memcpy(demodbuf, trace_ask.samples, trace_ask.len);
+		DetectASKClock(demodbuf, trace_ask.len, &clk, 100);
+		r += clk;
+	}
+	return r;
+}
+
+static uint32_t bench_askdemod(uint32_t n) {
+	uint32_t r = 0;
+	use_trace(&trace_ask);
+	for (uint32_t i = 0; i < n; i++) {
+		int clk = 64, invert = 0;
+		size_t size = trace_ask.len;
+		memcpy(demodbuf, trace_ask.samples, trace_ask.len);
+		askdemod(demodbuf, &size, &clk, &invert, 100, 0, 1);
+		r += size;
+	}
+	return r;
+}
+
+static uint32_t bench_fskdemod(uint32_t n) {
+	uint32_t r = 0;
+	use_trace(&trace_fsk);
+	for (uint32_t i = 0; i < n; i++) {
+		int start = 0;
+		memcpy(demodbuf, trace_fsk.samples, trace_fsk.len);
+		r += fskdemod(demodbuf, trace_fsk.len, 50, 1, 10, 8, &start);
+	}
+	return r;
+}
+
+static uint32_t bench_pskRawDemod(uint32_t n) {
+	uint32_t r = 0;
+	use_trace(&trace_psk);
+	for (uint32_t i = 0; i < n; i++) {
+		int clk = 0, invert = 0;
+		size_t size = trace_psk.len;
+		memcpy(demodbuf, trace_psk.samples, trace_psk.len);
+		pskRawDemod(demodbuf, &size, &clk, &invert);
+		r += size;
+	}
+	return r;
+}
+
+static uint32_t bench_AutoCorrelate(uint32_t n) {
+	static int out[MAX_GRAPH_TRACE_LEN];
+	uint32_t r = 0;
+	for (uint32_t i = 0; i < n; i++)
+		r += AutoCorrelate(trace_ask.graph, out, trace_ask.len, 4000, false, false);
+	return r;
+}
+
+//-----------------------------------------------------------------------------
+// hardnested bitarrays,  through the same SIMD dispatch as hf mf hardnested
+//-----------------------------------------------------------------------------
+static uint32_t *bitarray[4];
+
+static void bitarray_setup(void) {
+	for (int i = 0; i < 4; i++) {
+		bitarray[i] = malloc_bitarray(BENCH_BITARRAY);
+		for (uint32_t j = 0; j < (1<<19); j++)
+			bitarray[i][j] = prng_successor(j * 4 + i, 32);
+	}
+}
+
+static uint32_t bench_count_states(uint32_t n) {
+	uint32_t r = 0;
+	for (uint32_t i = 0; i < n; i++)
+		r += count_states(bitarray[i & 3]);
+	return r;
+}
+
+static uint32_t bench_bitarray_AND(uint32_t n) {
+	for (uint32_t i = 0; i < n; i++)
+		bitarray_AND(bitarray[0], bitarray[1]);
+	return bitarray[0][0];
+}
+
+static uint32_t bench_count_bitarray_AND(uint32_t n) {
+	uint32_t r = 0;
+	for (uint32_t i = 0; i < n; i++)
+		r += count_bitarray_AND(bitarray[1], bitarray[2]);
+	return r;
+}
+
+static uint32_t bench_bitarray_AND4(uint32_t n) {
+	for (uint32_t i = 0; i < n; i++)
+		bitarray_AND4(bitarray[0], bitarray[1], bitarray[2], bitarray[3]);
+	return bitarray[0][0];
+}
+
+static uint32_t bench_count_bitarray_AND4(uint32_t n) {
+	uint32_t r = 0;
+	for (uint32_t i = 0; i < n; i++)
+		r += count_bitarray_AND4(bitarray[0], bitarray[1], bitarray[2], bitarray[3]);
+	return r;
+}
+
+static bench_t benchmarks[] = {
+	{"crapto1.lfsr_recovery32",			bench_lfsr_recovery32},
+	{"crapto1.lfsr_recovery64",			bench_lfsr_recovery64},
+	{"crapto1.crypto1_word",			bench_crypto1_word},
+	{"crapto1.nonce_distance",			bench_nonce_distance},
+	{"loclass.doMAC",					bench_doMAC},
+	{"loclass.hash0",					bench_hash0},
+	{"loclass.hash1",					bench_hash1},
+	{"crc.CRC8Maxim/1k",				bench_crc8_maxim},
+	{"crc.crc_update/1k",				bench_crc_update},
+	{"crc16.crc16_a/1k",				bench_crc16_a},
+	{"crc16.crc16_iclass/1k",			bench_crc16_iclass},
+	{"crc16.crc16_fast/1k",				bench_crc16_fast},
+	{"lfdemod.DetectASKClock/em4102",	bench_DetectASKClock},
+	{"lfdemod.askdemod/em4102",			bench_askdemod},
+	{"lfdemod.fskdemod/hid",			bench_fskdemod},
+	{"lfdemod.pskRawDemod/psk1",		bench_pskRawDemod},
+	{"graph.AutoCorrelate/em4102",		bench_AutoCorrelate},
+	{"hardnested.count_states",			bench_count_states},
+	{"hardnested.bitarray_AND",			bench_bitarray_AND},
+	{"hardnested.count_bitarray_AND",	bench_count_bitarray_AND},
+	{"hardnested.bitarray_AND4",		bench_bitarray_AND4},
+	{"hardnested.count_bitarray_AND4",	bench_count_bitarray_AND4},
+	{NULL, NULL}
+};
+
+static void print_machine(void) {
+	printf("# pm3bench\n");
+	printf("# compiler %s\n", __VERSION__);
+	printf("# cpu features");
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("mmx")) printf(" mmx");
+	if (__builtin_cpu_supports("sse2")) printf(" sse2");
+	if (__builtin_cpu_supports("sse4.2")) printf(" sse4.2");
+	if (__builtin_cpu_supports("popcnt")) printf(" popcnt");
+	if (__builtin_cpu_supports("avx")) printf(" avx");
+	if (__builtin_cpu_supports("avx2")) printf(" avx2");
+#if (__GNUC__ >= 5) && (__GNUC__ > 5 || __GNUC_MINOR__ > 2)
+	if (__builtin_cpu_supports("avx512f")) printf(" avx512f");
+#endif
+#else
+	printf(" none");
+#endif
+	printf("\n");
+	printf("# %-34s %12s %14s %14s\n", "benchmark", "iterations", "ns/op", "ops/s");
+}
+
+// doubles the iteration count until a run takes a tenth of the time budget,
+// then runs once more sized to fill the budget
+static void run_bench(bench_t *b, uint64_t budget_us) {
+	uint32_t n = 1;
+	uint64_t t;
+	while (true) {
+		t = usclock();
+		sink = b->run(n);
+		t = usclock() - t;
+		if (t * 10 >= budget_us || n >= (1U << 30))
+			break;
+		n <<= 1;
+	}
+
+	uint64_t want = t ? (uint64_t)n * budget_us / t : n;
+	if (want > n) {
+		if (want > (1U << 30)) want = 1U << 30;
+		n = want;
+		t = usclock();
+		sink = b->run(n);
+		t = usclock() - t;
+	}
+
+	double ns = (double)t * 1000.0 / n;
+	printf("%-36s %12u %14.1f %14.1f\n", b->name, n, ns, ns > 0 ? 1e9 / ns : 0);
+	fflush(stdout);
+}
+
+static void usage(void) {
+	printf("Usage: pm3bench [-d <trace dir>] [-t <ms>] [-f <filter>] [-l]\n");
+	printf("          Micro-benchmarks of the client hot paths\n\n");
+	printf("       -d  directory with the bundled .pm3 traces (default %s)\n", BENCH_TRACE_DIR);
+	printf("       -t  time spent on each benchmark in ms (default %d)\n", BENCH_TIME_MS);
+	printf("       -f  only run benchmarks whose name contains <filter>\n");
+	printf("       -l  list the benchmarks\n");
+}
+
+int main(int argc, char *argv[]) {
+	const char *dir = BENCH_TRACE_DIR;
+	const char *filter = NULL;
+	uint32_t ms = BENCH_TIME_MS;
+
+	for (int i = 1; i < argc; i++) {
+		bool more = i + 1 < argc;
+		if (!strcmp(argv[i], "-d") && more) {
+			dir = argv[++i];
+		} else if (!strcmp(argv[i], "-t") && more) {
+			ms = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-f") && more) {
+			filter = argv[++i];
+		} else if (!strcmp(argv[i], "-l")) {
+			for (bench_t *b = benchmarks; b->name; b++)
+				printf("%s\n", b->name);
+			return EXIT_SUCCESS;
+		} else {
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (ms == 0) ms = BENCH_TIME_MS;
+
+	if (!load_trace(dir, &trace_ask) || !load_trace(dir, &trace_fsk) || !load_trace(dir, &trace_psk))
+		return EXIT_FAILURE;
+
+	for (size_t i = 0; i < sizeof(crcbuf); i++)
+		crcbuf[i] = i * 7 + 3;
+	crapto1_setup();
+	bitarray_setup();
+
+	print_machine();
+	for (bench_t *b = benchmarks; b->name; b++) {
+		if (filter && !strstr(b->name, filter))
+			continue;
+		run_bench(b, (uint64_t)ms * 1000);
+	}
+	return EXIT_SUCCESS;
+}
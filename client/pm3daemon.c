@@ -0,0 +1,609 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Headless daemon sharing one Proxmark between several client sessions.
+//
+//   proxmark3 /dev/ttyACM0 -daemon unix:/tmp/pm3.sock -daemon tcp:7902
+//   proxmark3 unix:/tmp/pm3.sock
+//   proxmark3 tcp:localhost:7902
+//
+// The daemon owns the port and runs the usual uart_receiver.  Sessions speak
+// the plain UsbCommand framing,  so any client connects unchanged.  Commands
+// are queued per session and sent to the device round robin,  one session at
+// a time:  all frames the device returns go to the session whose command is on
+// the device.  That command is done on its terminal frame:
+//  - CMD_ACK / CMD_NACK for most commands.  When its session sends the next
+//    command or after a quiet period without any frame it is done as well.
+//  - *_STREAM_END / CMD_LF_WATCH_END for streams,  also once a stream frame
+//    came for any other command (a sniff with trace streaming on).  There is
+//    no quiet period,  a trigger can keep a stream silent for long.  Further
+//    commands of the owning session (the stop) go straight to the device.
+//  - nothing for commands without a reply,  the next one is sent right away.
+// Commands of one session are never reordered.  Frames for a session are
+// buffered and written without blocking,  a session too slow to take them is
+// dropped.
+//
+// The device state is shared:  BigBuf (samples, traces, emulator memory),  the
+// sampling config,  the FPGA image.  A download returns whatever the last
+// command of any session left there,  sessions have to agree on who uses it.
+//-----------------------------------------------------------------------------
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE	200112L			// getaddrinfo, sigaction
+#endif
+
+#include "pm3daemon.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "proxmark3.h"
+#include "ui.h"
+
+#if defined(_WIN32)
+
+int RunDaemon(char *listen[], int listen_cnt, uint32_t quiet_ms, uint32_t stats_sec) {
+	PrintAndLogEx(WARNING, "daemon mode is not available on this platform");
+	return 1;
+}
+
+#else
+
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "util_posix.h"
+
+typedef struct {
+	bool used;
+	int fd;
+	int id;
+	char name[64];
+	UsbCommand rx;					// partial frame from the client
+	size_t rxlen;
+	uint8_t *out;					// frames for the client,  not written yet
+	size_t outlen;
+	UsbCommand queue[DAEMON_QUEUE_SIZE];
+	uint64_t queued_at[DAEMON_QUEUE_SIZE];
+	int head, tail;
+	// statistics
+	uint32_t sent, frames, max_depth, latency_cnt;
+	uint64_t wait_us, latency_us, max_latency_us;
+} session_t;
+
+static session_t sessions[DAEMON_MAX_SESSIONS];
+static int session_ids = 0;
+
+// frames from the device,  handed over by the receiver thread
+#define DEVICE_QUEUE_SIZE	256
+static UsbCommand dev_queue[DEVICE_QUEUE_SIZE];
+static int dev_head = 0, dev_tail = 0;
+static pthread_mutex_t dev_lock = PTHREAD_MUTEX_INITIALIZER;
+static int wake_pipe[2] = {-1, -1};
+
+static volatile sig_atomic_t daemon_running = 0;
+
+#define DAEMON_OUT_SIZE		(DAEMON_OUT_FRAMES * sizeof(UsbCommand))
+
+// the command currently on the device
+static int owner = -1;
+static bool inflight = false;
+static bool answered = false;
+static uint64_t wait_for = 0;			// its terminal frame
+static uint64_t wait_next = 0;			// terminal frame of a command sent through during a stream
+static bool streaming = false;			// stream frames seen,  hold until the end frame
+static uint64_t inflight_since = 0;
+static uint64_t last_activity = 0;
+static int last_served = -1;
+static bool stats_dirty = false;
+
+static void daemon_stop(int sig) {
+	daemon_running = 0;
+}
+
+// receiver thread
+static void daemon_frame(UsbCommand *c) {
+	pthread_mutex_lock(&dev_lock);
+	// the main loop drains the queue,  hold the device back until it has
+	while (((dev_head + 1) % DEVICE_QUEUE_SIZE) == dev_tail && daemon_running) {
+		pthread_mutex_unlock(&dev_lock);
+		msleep(1);
+		pthread_mutex_lock(&dev_lock);
+	}
+	memcpy(&dev_queue[dev_head], c, sizeof(UsbCommand));
+	dev_head = (dev_head + 1) % DEVICE_QUEUE_SIZE;
+	pthread_mutex_unlock(&dev_lock);
+
+	char b = 0;
+	if (write(wake_pipe[1], &b, 1) < 0) {
+		// pipe full,  the main loop is awake anyway
+	}
+}
+
+static bool device_pop(UsbCommand *c) {
+	bool ok = false;
+	pthread_mutex_lock(&dev_lock);
+	if (dev_head != dev_tail) {
+		memcpy(c, &dev_queue[dev_tail], sizeof(UsbCommand));
+		dev_tail = (dev_tail + 1) % DEVICE_QUEUE_SIZE;
+		ok = true;
+	}
+	pthread_mutex_unlock(&dev_lock);
+	return ok;
+}
+
+// frame that ends a command on the device,  CMD_ACK stands for CMD_NACK too.  0 if it has no reply
+static uint64_t terminal_frame(UsbCommand *c) {
+	switch (c->cmd) {
+		case CMD_LF_STREAM:
+			return c->arg[0] ? CMD_LF_STREAM_END : 0;
+		case CMD_LF_WATCH:
+			return c->arg[0] ? CMD_LF_WATCH_END : 0;
+		case CMD_DEVICE_INFO:
+			return CMD_DEVICE_INFO;
+		case CMD_BUFF_CLEAR:
+		case CMD_SET_LF_SAMPLING_CONFIG:
+		case CMD_HARDWARE_RESET:
+			return 0;
+		default:
+			return CMD_ACK;
+	}
+}
+
+static bool is_stream_frame(uint64_t cmd) {
+	return cmd == CMD_LF_STREAM_DATA || cmd == CMD_TRACE_STREAM_DATA || cmd == CMD_LF_WATCH_ID;
+}
+
+static bool is_stream_end(uint64_t cmd) {
+	return cmd == CMD_LF_STREAM_END || cmd == CMD_TRACE_STREAM_END || cmd == CMD_LF_WATCH_END;
+}
+
+// the command on the device only ends with its terminal frame,  no quiet period.
+// Once its session is gone the quiet period applies again,  in case the end never comes
+static bool holding(void) {
+	return inflight && owner >= 0 && (streaming || wait_for != CMD_ACK);
+}
+
+static int queue_depth(session_t *s) {
+	return (s->head - s->tail + DAEMON_QUEUE_SIZE) % DAEMON_QUEUE_SIZE;
+}
+
+static void print_session(session_t *s) {
+	PrintAndLogEx(NORMAL, "%3d | %-22s | %6d | %4u | %6u | %7u | %8.1f | %8.1f | %8.1f"
+		, s->id
+		, s->name
+		, queue_depth(s)
+		, s->max_depth
+		, s->sent
+		, s->frames
+		, s->sent ? s->wait_us / 1000.0 / s->sent : 0.0
+		, s->latency_cnt ? s->latency_us / 1000.0 / s->latency_cnt : 0.0
+		, s->max_latency_us / 1000.0
+		);
+}
+
+static void print_stats_header(void) {
+	PrintAndLogEx(NORMAL, " id | session                | queued |  max |   sent |  frames |  wait ms |   lat ms | max lat");
+	PrintAndLogEx(NORMAL, "----+------------------------+--------+------+--------+---------+----------+----------+---------");
+}
+
+static void print_stats(void) {
+	print_stats_header();
+	for (int i = 0; i < DAEMON_MAX_SESSIONS; i++)
+		if (sessions[i].used)
+			print_session(&sessions[i]);
+	stats_dirty = false;
+}
+
+static void session_open(int fd, const char *name) {
+	for (int i = 0; i < DAEMON_MAX_SESSIONS; i++) {
+		session_t *s = &sessions[i];
+		if (s->used) continue;
+		memset(s, 0, sizeof(session_t));
+		s->out = malloc(DAEMON_OUT_SIZE);
+		if (!s->out) {
+			PrintAndLogEx(WARNING, "no memory for session,  %s", name);
+			close(fd);
+			return;
+		}
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		s->used = true;
+		s->fd = fd;
+		s->id = ++session_ids;
+		snprintf(s->name, sizeof(s->name), "%s", name);
+		PrintAndLogEx(INFO, "session %d connected,  %s", s->id, s->name);
+		return;
+	}
+	PrintAndLogEx(WARNING, "too many sessions,  max %d", DAEMON_MAX_SESSIONS);
+	close(fd);
+}
+
+static void session_close(int i) {
+	session_t *s = &sessions[i];
+	PrintAndLogEx(INFO, "session %d closed", s->id);
+	print_stats_header();
+	print_session(s);
+	close(s->fd);
+	free(s->out);
+	s->out = NULL;
+	s->used = false;
+	if (owner != i)
+		return;
+
+	// frames still coming for its command are dropped.  A stream nobody reads is stopped
+	owner = -1;
+	if (inflight && (wait_for == CMD_LF_STREAM_END || wait_for == CMD_LF_WATCH_END)) {
+		UsbCommand stop = {wait_for == CMD_LF_STREAM_END ? CMD_LF_STREAM : CMD_LF_WATCH, {0, 0, 0}};
+		SendCommand(&stop);
+		wait_next = 0;
+	}
+}
+
+// write what the socket takes,  false if the session is gone
+static bool session_flush(session_t *s) {
+	size_t done = 0;
+	while (done < s->outlen) {
+		ssize_t n = write(s->fd, s->out + done, s->outlen - done);
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+		if (n <= 0) return false;
+		done += n;
+	}
+	memmove(s->out, s->out + done, s->outlen - done);
+	s->outlen -= done;
+	return true;
+}
+
+// queue a frame for the session,  never blocks
+static void session_send(int i, UsbCommand *c) {
+	session_t *s = &sessions[i];
+	if (s->outlen + sizeof(UsbCommand) > DAEMON_OUT_SIZE) {
+		PrintAndLogEx(WARNING, "session %d doesn't read its frames,  dropped", s->id);
+		session_close(i);
+		return;
+	}
+	memcpy(s->out + s->outlen, c, sizeof(UsbCommand));
+	s->outlen += sizeof(UsbCommand);
+	if (!session_flush(s))
+		session_close(i);
+}
+
+static void session_read(int i) {
+	session_t *s = &sessions[i];
+	ssize_t n = read(s->fd, (uint8_t *)&s->rx + s->rxlen, sizeof(UsbCommand) - s->rxlen);
+	if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+		return;
+	if (n <= 0) {
+		session_close(i);
+		return;
+	}
+	s->rxlen += n;
+	if (s->rxlen < sizeof(UsbCommand))
+		return;
+
+	memcpy(&s->queue[s->head], &s->rx, sizeof(UsbCommand));
+	s->queued_at[s->head] = usclock();
+	s->head = (s->head + 1) % DAEMON_QUEUE_SIZE;
+	s->rxlen = 0;
+	if (queue_depth(s) > s->max_depth)
+		s->max_depth = queue_depth(s);
+	stats_dirty = true;
+}
+
+static void queue_pop(session_t *s, UsbCommand *c, uint64_t now) {
+	memcpy(c, &s->queue[s->tail], sizeof(UsbCommand));
+	s->wait_us += now - s->queued_at[s->tail];
+	s->tail = (s->tail + 1) % DAEMON_QUEUE_SIZE;
+	s->sent++;
+}
+
+static void dispatch(int i) {
+	session_t *s = &sessions[i];
+	uint64_t now = usclock();
+
+	UsbCommand c;
+	queue_pop(s, &c, now);
+
+	owner = i;
+	last_served = i;
+	wait_for = terminal_frame(&c);
+	wait_next = 0;
+	streaming = false;
+	inflight = (wait_for != 0);
+	answered = false;
+	inflight_since = now;
+	last_activity = now;
+	SendCommand(&c);
+}
+
+// the owner's next command while its stream runs,  the stop usually
+static void pass_through(int i) {
+	UsbCommand c;
+	queue_pop(&sessions[i], &c, usclock());
+	uint64_t t = terminal_frame(&c);
+	if (t)
+		wait_next = t;
+	SendCommand(&c);
+}
+
+// terminal frame seen,  a command sent through meanwhile still has its reply to come
+static void command_done(void) {
+	streaming = false;
+	if (wait_next) {
+		wait_for = wait_next;
+		wait_next = 0;
+		return;
+	}
+	inflight = false;
+}
+
+static void deliver(UsbCommand *c) {
+	uint64_t now = usclock();
+	last_activity = now;
+
+	if (owner >= 0) {
+		session_t *s = &sessions[owner];
+		if (inflight && !answered) {
+			uint64_t lat = now - inflight_since;
+			s->latency_us += lat;
+			s->latency_cnt++;
+			if (lat > s->max_latency_us)
+				s->max_latency_us = lat;
+			answered = true;
+		}
+		s->frames++;
+		session_send(owner, c);
+	}
+
+	if (!inflight)
+		return;
+
+	if (is_stream_frame(c->cmd)) {
+		streaming = true;
+	} else if (is_stream_end(c->cmd)) {
+		if (wait_for == c->cmd)
+			command_done();
+		else
+			streaming = false;
+	} else if ((c->cmd == wait_for || (c->cmd == CMD_NACK && wait_for == CMD_ACK)) && !streaming) {
+		command_done();
+	}
+}
+
+static void schedule(uint32_t quiet_ms) {
+	uint64_t now = usclock();
+
+	if (holding()) {
+		if (owner >= 0 && queue_depth(&sessions[owner]))
+			pass_through(owner);
+		return;
+	}
+
+	if (inflight) {
+		session_t *s = (owner >= 0) ? &sessions[owner] : NULL;
+		// its session moved on,  or nothing came back for a while
+		if (s && queue_depth(s) && s->queued_at[s->tail] >= inflight_since)
+			inflight = false;
+		else if (now - last_activity > (uint64_t)quiet_ms * 1000)
+			inflight = false;
+		else
+			return;
+	}
+
+	for (int k = 1; k <= DAEMON_MAX_SESSIONS; k++) {
+		int i = (last_served + k + DAEMON_MAX_SESSIONS) % DAEMON_MAX_SESSIONS;
+		if (sessions[i].used && queue_depth(&sessions[i])) {
+			dispatch(i);
+			return;
+		}
+	}
+}
+
+// "tcp:[host:]port" or "unix:path"
+static int listen_on(const char *addr) {
+	int fd = -1;
+
+	if (strncmp(addr, "unix:", 5) == 0) {
+		struct sockaddr_un sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sun_family = AF_UNIX;
+		strncpy(sa.sun_path, addr + 5, sizeof(sa.sun_path) - 1);
+		unlink(sa.sun_path);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0 || bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(fd, 8) < 0) {
+			PrintAndLogEx(FAILED, "can't listen on %s: %s", addr, strerror(errno));
+			if (fd >= 0) close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	if (strncmp(addr, "tcp:", 4) == 0) {
+		char host[256] = "localhost";
+		const char *port = addr + 4;
+		const char *colon = strrchr(port, ':');
+		if (colon) {
+			snprintf(host, sizeof(host), "%.*s", (int)(colon - port), port);
+			port = colon + 1;
+		}
+
+		struct addrinfo hints, *res = NULL;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = AI_PASSIVE;
+		int err = getaddrinfo(host, port, &hints, &res);
+		if (err) {
+			PrintAndLogEx(FAILED, "can't listen on %s: %s", addr, gai_strerror(err));
+			return -1;
+		}
+		fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+		int one = 1;
+		if (fd >= 0)
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if (fd < 0 || bind(fd, res->ai_addr, res->ai_addrlen) < 0 || listen(fd, 8) < 0) {
+			PrintAndLogEx(FAILED, "can't listen on %s: %s", addr, strerror(errno));
+			if (fd >= 0) close(fd);
+			freeaddrinfo(res);
+			return -1;
+		}
+		freeaddrinfo(res);
+		return fd;
+	}
+
+	PrintAndLogEx(FAILED, "can't listen on %s,  use tcp:[host:]port or unix:path", addr);
+	return -1;
+}
+
+int RunDaemon(char *listen[], int listen_cnt, uint32_t quiet_ms, uint32_t stats_sec) {
+
+	int lfd[DAEMON_MAX_LISTEN];
+	int nl = 0;
+	for (int i = 0; i < listen_cnt && i < DAEMON_MAX_LISTEN; i++) {
+		lfd[nl] = listen_on(listen[i]);
+		if (lfd[nl] < 0) {
+			while (nl--) close(lfd[nl]);
+			return 1;
+		}
+		nl++;
+	}
+
+	if (pipe(wake_pipe) < 0) {
+		PrintAndLogEx(FAILED, "pipe: %s", strerror(errno));
+		return 1;
+	}
+	fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = daemon_stop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	daemon_running = 1;
+	memset(sessions, 0, sizeof(sessions));
+
+	pm3_device *dev = CurrentDevice();
+	dev->frame_hook = daemon_frame;
+	dev->run = 1;
+	pthread_create(&dev->reader_thread, NULL, &uart_receiver, dev);
+
+	for (int i = 0; i < listen_cnt; i++)
+		PrintAndLogEx(SUCCESS, "daemon for %s listening on %s", dev->port, listen[i]);
+
+	uint64_t last_stats = msclock();
+
+	while (daemon_running && DeviceOnline(dev)) {
+
+		struct pollfd fds[DAEMON_MAX_LISTEN + 1 + DAEMON_MAX_SESSIONS];
+		int sidx[DAEMON_MAX_SESSIONS];
+		int n = 0;
+
+		for (int i = 0; i < nl; i++) {
+			fds[n].fd = lfd[i];
+			fds[n++].events = POLLIN;
+		}
+		fds[n].fd = wake_pipe[0];
+		fds[n++].events = POLLIN;
+
+		// a full queue isn't read from,  its client then blocks on send
+		int ns = 0;
+		for (int i = 0; i < DAEMON_MAX_SESSIONS; i++) {
+			if (!sessions[i].used) continue;
+			short events = 0;
+			if (queue_depth(&sessions[i]) < DAEMON_QUEUE_SIZE - 1)
+				events |= POLLIN;
+			if (sessions[i].outlen)
+				events |= POLLOUT;
+			if (!events) continue;
+			sidx[ns++] = i;
+			fds[n].fd = sessions[i].fd;
+			fds[n++].events = events;
+		}
+
+		int res = poll(fds, n, 10);
+		if (res < 0 && errno != EINTR)
+			break;
+
+		if (res > 0) {
+			for (int i = 0; i < nl; i++) {
+				if (!(fds[i].revents & POLLIN)) continue;
+				struct sockaddr_storage peer;
+				socklen_t plen = sizeof(peer);
+				int fd = accept(lfd[i], (struct sockaddr *)&peer, &plen);
+				if (fd < 0) continue;
+
+				char name[64] = "local";
+				char host[48], port[16];
+				if (peer.ss_family != AF_UNIX &&
+					getnameinfo((struct sockaddr *)&peer, plen, host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) == 0) {
+					snprintf(name, sizeof(name), "%s:%s", host, port);
+					int one = 1;
+					setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+				}
+				session_open(fd, name);
+			}
+
+			if (fds[nl].revents & POLLIN) {
+				char b[64];
+				while (read(wake_pipe[0], b, sizeof(b)) > 0) ;
+			}
+
+			for (int k = 0; k < ns; k++) {
+				session_t *s = &sessions[sidx[k]];
+				short rev = fds[nl + 1 + k].revents;
+				if ((rev & POLLOUT) && s->used && !session_flush(s))
+					session_close(sidx[k]);
+				if ((rev & (POLLIN | POLLHUP | POLLERR)) && s->used && (fds[nl + 1 + k].events & POLLIN))
+					session_read(sidx[k]);
+			}
+		}
+
+		UsbCommand c;
+		while (device_pop(&c))
+			deliver(&c);
+
+		schedule(quiet_ms);
+
+		if (stats_sec && stats_dirty && msclock() - last_stats > stats_sec * 1000) {
+			print_stats();
+			last_stats = msclock();
+		}
+	}
+
+	if (!DeviceOnline(dev))
+		PrintAndLogEx(WARNING, "device went offline");
+
+	print_stats();
+	for (int i = 0; i < DAEMON_MAX_SESSIONS; i++) {
+		if (!sessions[i].used) continue;
+		close(sessions[i].fd);
+		free(sessions[i].out);
+	}
+	for (int i = 0; i < nl; i++) {
+		close(lfd[i]);
+		if (strncmp(listen[i], "unix:", 5) == 0)
+			unlink(listen[i] + 5);
+	}
+
+	daemon_running = 0;
+	dev->run = 0;
+	pthread_join(dev->reader_thread, NULL);
+	dev->frame_hook = NULL;
+	close(wake_pipe[0]);
+	close(wake_pipe[1]);
+	return 0;
+}
+
+#endif
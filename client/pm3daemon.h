@@ -0,0 +1,25 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Headless daemon sharing one Proxmark between several client sessions
+//-----------------------------------------------------------------------------
+
+#ifndef PM3DAEMON_H__
+#define PM3DAEMON_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define DAEMON_MAX_LISTEN		4
+#define DAEMON_MAX_SESSIONS		16
+#define DAEMON_QUEUE_SIZE		32		// commands per session waiting for the device
+#define DAEMON_OUT_FRAMES		256		// frames buffered per session for its client
+#define DAEMON_QUIET_MS			2000	// a command without ACK is considered done after this,  not streams
+#define DAEMON_STATS_SEC		10
+
+// listen: "tcp:[host:]port" or "unix:path".  Returns when interrupted.
+extern int RunDaemon(char *listen[], int listen_cnt, uint32_t quiet_ms, uint32_t stats_sec);
+
+#endif
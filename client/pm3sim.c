@@ -0,0 +1,774 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Virtual Proxmark. Answers the core device commands over TCP,  so the client
+// can be run and timed without hardware:
+//
+//   ./pm3sim -l ../traces/EM4102-1.pm3 &
+//   ./proxmark3 tcp:localhost:7901
+//
+// Supported: ping, version, device info, BigBuf / emulator memory / flash
+// downloads, trace info, profile, emulator memory get/set/clear, MIFARE Classic
+// select / rdbl / chk / fchk / nested against the card in emulator memory
+// (Crypto1 via crapto1), LF sampling, streaming and watch,  which replay the given .pm3 traces in turn,
+// and 'hf 14a sniff',  which records the card being selected SNIFF_ROUNDS times
+// (streamed like the firmware does with 'trace stream 1').
+// Anything else gets the same "unknown command" debug print as the firmware.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "usb_cmd.h"
+#include "mifare.h"
+#include "crapto1/crapto1.h"
+#include "protocols.h"
+#include "parity.h"
+#include "util_posix.h"
+#include "lfwatch.h"
+
+#define SIM_PORT			7901
+#define BIGBUF_SIZE			40000		// armsrc/BigBuf.h
+#define CARD_MEMORY_SIZE	4096
+#define FLASH_MEM_SIZE		(256*1024)	// RDV40 SPI flash
+#define MAX_TRACES			16
+#define MAX_SECTORS			40
+#define SNIFF_ROUNDS		200
+
+#ifndef MIN
+# define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+
+// firmware side state.  Emulator memory lives at the top of BigBuf,  like on the device
+static uint8_t bigbuf[BIGBUF_SIZE];
+static uint8_t *emCARD = bigbuf + BIGBUF_SIZE - CARD_MEMORY_SIZE;
+static uint8_t flashmem[FLASH_MEM_SIZE];
+static sample_config config = { 1, 8, 1, 95, 0 };
+static uint32_t card_nonce = 0x01200145;
+
+// LF traces to hand out on sampling
+static int8_t *traces[MAX_TRACES];
+static uint32_t trace_lens[MAX_TRACES];
+static int trace_count = 0;
+static int trace_next = 0;
+
+// trace of the last sniff,  at the start of BigBuf
+static uint32_t trace_len = 0;
+static bool trace_stream = false;
+
+static int client = -1;
+static bool verbose = false;
+
+// 'hw profile',  host time in the device's 3MHz ticks.  card_auth stands in for chkKey
+static prof_entry_t prof_table[PROF_ENTRIES];
+
+static uint32_t prof_ticks(void) {
+	return (uint32_t)(usclock() * PROF_TICKS_PER_MS / 1000);
+}
+
+static void prof_add(prof_entry_t *e, uint32_t start) {
+	uint32_t t = prof_ticks() - start;
+	e->calls++;
+	e->ticks += t;
+	if (t > e->max)
+		e->max = t;
+}
+
+static void Profile_reset(void) {
+	memset(prof_table, 0, sizeof(prof_table));
+	for (int i = 0; i < PROF_FUNCTIONS; i++)
+		prof_table[i].id = PROF_ID_FN + i;
+	prof_table[PROF_ENTRIES - 1].id = PROF_ID_OTHER;
+}
+
+static void Profile_command(uint16_t cmd, uint32_t start) {
+	int i;
+	for (i = PROF_FUNCTIONS; i < PROF_ENTRIES - 1; i++) {
+		if (prof_table[i].id == cmd && prof_table[i].calls)
+			break;
+		if (prof_table[i].calls == 0) {
+			prof_table[i].id = cmd;
+			break;
+		}
+	}
+	prof_add(&prof_table[i], start);
+}
+
+static void usage(void) {
+	fprintf(stdout, "Usage: pm3sim [-p <port>] [-e <dump.bin>] [-f <flash.bin>] [-l <trace.pm3>]... [-v]\n");
+	fprintf(stdout, "          Virtual Proxmark,  connect with: proxmark3 tcp:localhost:<port>\n\n");
+	fprintf(stdout, "       -p  TCP port to listen on (default %d)\n", SIM_PORT);
+	fprintf(stdout, "       -e  MIFARE Classic dump to load into emulator memory,  the modelled card\n");
+	fprintf(stdout, "       -f  flash memory image\n");
+	fprintf(stdout, "       -l  LF trace (.pm3) returned by 'lf read',  can be given several times\n");
+	fprintf(stdout, "       -v  print every command received\n\n");
+}
+
+static bool cmd_send(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, const void *data, size_t len) {
+	UsbCommand c;
+	memset(&c, 0, sizeof(c));
+	c.cmd = cmd;
+	c.arg[0] = arg0;
+	c.arg[1] = arg1;
+	c.arg[2] = arg2;
+	if (data && len)
+		memcpy(c.d.asBytes, data, MIN(len, USB_CMD_DATA_SIZE));
+
+	const uint8_t *p = (const uint8_t *)&c;
+	size_t left = sizeof(c);
+	while (left) {
+		ssize_t n = send(client, p, left, 0);
+		if (n <= 0)
+			return false;
+		p += n;
+		left -= n;
+	}
+	return true;
+}
+
+static void Dbprintf(const char *fmt, ...) {
+	char s[USB_CMD_DATA_SIZE] = {0};
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(s, sizeof(s), fmt, ap);
+	va_end(ap);
+	cmd_send(CMD_DEBUG_PRINT_STRING, strlen(s), 0, 0, s, strlen(s));
+}
+
+// same framing as the firmware: data chunks,  then an ACK
+static void download(uint64_t cmd, const uint8_t *mem, uint32_t start, uint32_t bytes, uint32_t limit, const void *ack, size_t acklen) {
+	for (uint32_t i = 0; i < bytes; i += USB_CMD_DATA_SIZE) {
+		uint32_t len = MIN(bytes - i, USB_CMD_DATA_SIZE);
+		// out of range reads return zeros instead of whatever follows in host memory
+		uint8_t chunk[USB_CMD_DATA_SIZE] = {0};
+		if (start + i < limit)
+			memcpy(chunk, mem + start + i, MIN(len, limit - start - i));
+		cmd_send(cmd, i, len, 0, chunk, len);
+	}
+	cmd_send(CMD_ACK, 1, 0, 0, ack, acklen);
+}
+
+//-----------------------------------------------------------------------------
+// MIFARE Classic card,  modelled on the emulator memory
+//-----------------------------------------------------------------------------
+static uint64_t bytes_to_num(const uint8_t *src, size_t len) {
+	uint64_t num = 0;
+	while (len--)
+		num = (num << 8) | *src++;
+	return num;
+}
+
+static uint32_t card_uid(void) {
+	return (uint32_t)bytes_to_num(emCARD, 4);
+}
+
+static uint8_t trailer_block(uint8_t block) {
+	return (block < 128) ? (block | 0x03) : (block | 0x0F);
+}
+
+static uint8_t first_block_of_sector(uint8_t sector) {
+	return (sector < 32) ? sector * 4 : 128 + (sector - 32) * 16;
+}
+
+static uint64_t card_key(uint8_t block, uint8_t keytype) {
+	return bytes_to_num(emCARD + trailer_block(block) * 16 + (keytype ? 10 : 0), 6);
+}
+
+// the card's 16 bit prng,  moved on by a random amount as if time passed between auths
+static uint32_t card_next_nonce(void) {
+	card_nonce = prng_successor(card_nonce, 1 + (rand() & 0xFFF));
+	return card_nonce;
+}
+
+// complete three pass authentication,  reader and card side each with their own Crypto1 state
+static bool card_auth(uint8_t block, uint8_t keytype, uint64_t key) {
+	uint32_t start = prof_ticks();
+	uint32_t uid = card_uid();
+	uint32_t nt = card_next_nonce();
+	uint32_t nr = rand();
+
+	struct Crypto1State *reader = crypto1_create(key);
+	crypto1_word(reader, uid ^ nt, 0);
+	uint32_t nr_enc = crypto1_word(reader, nr, 0) ^ nr;
+	uint32_t ar_enc = crypto1_word(reader, 0, 0) ^ prng_successor(nt, 64);
+	crypto1_destroy(reader);
+
+	struct Crypto1State *card = crypto1_create(card_key(block, keytype));
+	crypto1_word(card, uid ^ nt, 0);
+	crypto1_word(card, nr_enc, 1);
+	bool ok = (crypto1_word(card, 0, 0) ^ ar_enc) == prng_successor(nt, 64);
+	crypto1_destroy(card);
+	prof_add(&prof_table[PROF_FN_CHKKEY], start);
+	return ok;
+}
+
+// ISO14443a select of the card in emulator memory,  UID / ATQA / SAK from block 0
+static void ReaderIso14443a(uint64_t flags) {
+	if (!(flags & ISO14A_CONNECT))
+		return;
+
+	iso14a_card_select_t card;
+	memset(&card, 0, sizeof(card));
+	memcpy(card.uid, emCARD, 4);
+	card.uidlen = 4;
+	card.sak = emCARD[5];
+	card.atqa[0] = emCARD[6];
+	card.atqa[1] = emCARD[7];
+	cmd_send(CMD_ACK, 1, 0, 0, &card, sizeof(card));
+}
+
+static void MifareReadBlock(uint8_t block, uint8_t keytype, uint8_t *datain) {
+	uint8_t data[16] = {0};
+	bool isOK = card_auth(block, keytype, bytes_to_num(datain, 6));
+	if (isOK) {
+		memcpy(data, emCARD + block * 16, 16);
+		// key A never reads back
+		if (block == trailer_block(block))
+			memset(data, 0, 6);
+	}
+	cmd_send(CMD_ACK, isOK, 0, 0, data, sizeof(data));
+}
+
+static void MifareChkKeys(uint16_t arg0, uint32_t keycount, uint8_t *datain) {
+	uint8_t block = arg0 & 0xFF;
+	uint8_t keytype = (arg0 >> 8) & 0xFF;
+	uint8_t isOK = 0;
+	uint32_t i;
+	keycount = MIN(keycount, USB_CMD_DATA_SIZE / 6);
+	for (i = 0; i < keycount; i++) {
+		if (card_auth(block, keytype, bytes_to_num(datain + i * 6, 6))) {
+			isOK = 1;
+			break;
+		}
+	}
+	cmd_send(CMD_ACK, isOK, 0, 0, datain + MIN(i, keycount - 1) * 6, 6);
+}
+
+static void MifareChkKeys_fast(uint32_t arg0, uint32_t keycount, uint8_t *datain) {
+	uint8_t sectorcnt = MIN(arg0 & 0xFF, MAX_SECTORS);
+	bool firstchunk = (arg0 >> 8) & 0xF;
+	bool lastchunk = (arg0 >> 12) & 0xF;
+	uint8_t allkeys = sectorcnt << 1;
+
+	// keys found so far,  kept over the key chunks like on the device
+	static uint8_t k_sector[MAX_SECTORS][12];
+	static uint8_t found[80];
+	static uint8_t foundkeys = 0;
+
+	if (firstchunk) {
+		memset(k_sector, 0, sizeof(k_sector));
+		memset(found, 0, sizeof(found));
+		foundkeys = 0;
+	}
+
+	keycount = MIN(keycount, USB_CMD_DATA_SIZE / 6);
+	for (uint32_t i = 0; i < keycount && foundkeys < allkeys; i++) {
+		uint64_t key = bytes_to_num(datain + i * 6, 6);
+		for (uint8_t s = 0; s < sectorcnt; s++) {
+			for (uint8_t t = 0; t < 2; t++) {
+				if (found[s * 2 + t])
+					continue;
+				if (card_auth(first_block_of_sector(s), t, key)) {
+					memcpy(k_sector[s] + t * 6, datain + i * 6, 6);
+					found[s * 2 + t] = 1;
+					foundkeys++;
+				}
+			}
+		}
+	}
+
+	if (foundkeys == allkeys || lastchunk) {
+		uint8_t tmp[480 + 10] = {0};
+		uint64_t foo = 0;
+		uint16_t bar = 0;
+		for (uint8_t m = 0; m < 64; ++m)
+			foo |= ((uint64_t)found[m] << m);
+		for (uint8_t m = 64; m < sizeof(found); ++m)
+			bar |= (found[m] << (m - 64));
+		memcpy(tmp, k_sector, sectorcnt * 12);
+		for (int m = 0; m < 8; m++)
+			tmp[480 + m] = foo >> (56 - m * 8);
+		tmp[488] = bar & 0xFF;
+		tmp[489] = bar >> 8 & 0xFF;
+		cmd_send(CMD_ACK, foundkeys, 0, 0, tmp, sizeof(tmp));
+	} else {
+		cmd_send(CMD_ACK, foundkeys, 0, 0, 0, 0);
+	}
+}
+
+// two encrypted nonces of the target sector.  There is no timing to calibrate,  the
+// card nonces are known exactly
+static void MifareNested(uint32_t arg0, uint32_t arg1, uint8_t *datain) {
+	uint8_t block = arg0 & 0xFF;
+	uint8_t keytype = (arg0 >> 8) & 0xFF;
+	uint8_t target_block = arg1 & 0xFF;
+	uint8_t target_keytype = (arg1 >> 8) & 0xFF;
+	uint8_t buf[4 + 4 * 4] = {0};
+	int16_t isOK = 0;
+
+	uint32_t cuid = card_uid();
+	memcpy(buf, &cuid, 4);
+
+	if (!card_auth(block, keytype, bytes_to_num(datain, 6))) {
+		isOK = -4;
+	} else {
+		uint64_t key = card_key(target_block, target_keytype);
+		uint32_t nt[2];
+		for (int i = 0; i < 2; i++) {
+			do {
+				nt[i] = card_next_nonce();
+			} while (i == 1 && nt[1] == nt[0]);
+
+			struct Crypto1State *pcs = crypto1_create(key);
+			uint32_t ks = crypto1_word(pcs, cuid ^ nt[i], 0);
+			crypto1_destroy(pcs);
+
+			memcpy(buf + 4 + i * 8, &nt[i], 4);
+			memcpy(buf + 8 + i * 8, &ks, 4);
+		}
+	}
+	cmd_send(CMD_ACK, (uint16_t)isOK, 0, target_block + (target_keytype * 0x100), buf, sizeof(buf));
+}
+
+static void emlClearMem(void) {
+	const uint8_t trailer[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x07, 0x80, 0x69, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+	const uint8_t uid[]   =   {0xe6, 0x84, 0x87, 0xf3, 0x16, 0x88, 0x04, 0x00, 0x46, 0x8e, 0x45, 0x55, 0x4d, 0x70, 0x41, 0x04};
+	memset(emCARD, 0, CARD_MEMORY_SIZE);
+	for (uint16_t b = 3; b < 256; ((b < 127) ? (b += 4) : (b += 16)))
+		memcpy(emCARD + b * 16, trailer, 16);
+	memcpy(emCARD, uid, 16);
+}
+
+//-----------------------------------------------------------------------------
+// LF
+//-----------------------------------------------------------------------------
+static bool load_trace(const char *fname) {
+	if (trace_count == MAX_TRACES) {
+		fprintf(stderr, "Error. Too many traces,  max %d\n", MAX_TRACES);
+		return false;
+	}
+	FILE *f = fopen(fname, "r");
+	if (!f) {
+		fprintf(stderr, "Error. Cannot open trace file %s\n", fname);
+		return false;
+	}
+	int8_t *samples = calloc(BIGBUF_SIZE, sizeof(int8_t));
+	uint32_t n = 0;
+	int v;
+	while (n < BIGBUF_SIZE && fscanf(f, "%d", &v) == 1)
+		samples[n++] = (v < -128) ? -128 : (v > 127 ? 127 : v);
+	fclose(f);
+
+	traces[trace_count] = samples;
+	trace_lens[trace_count] = n;
+	trace_count++;
+	return true;
+}
+
+// "samples" from the next trace,  8 bit unsigned like the ADC
+static uint32_t SampleLF(uint32_t samples) {
+	memset(bigbuf, 0x80, BIGBUF_SIZE - CARD_MEMORY_SIZE);
+	if (trace_count == 0)
+		return 0;
+
+	int t = trace_next++ % trace_count;
+	uint32_t n = MIN(trace_lens[t], BIGBUF_SIZE - CARD_MEMORY_SIZE);
+	if (samples && samples < n)
+		n = samples;
+	for (uint32_t i = 0; i < n; i++)
+		bigbuf[i] = traces[t][i] + 128;
+	return n * 8;
+}
+
+// a command is waiting,  like usb_poll_validate_length()
+static bool usb_poll(void) {
+	uint8_t b;
+	return recv(client, &b, 1, MSG_PEEK | MSG_DONTWAIT) > 0;
+}
+
+// 'lf stream',  the traces in turn packed like the firmware does,  at about 125k samples/s
+static void StreamLF(uint32_t samples) {
+	lf_stream_stats_t st = {0, 0, 0, 0, 0, 0};
+	uint8_t bps = (config.bits_per_sample < 1 || config.bits_per_sample > 8) ? 8 : config.bits_per_sample;
+	uint8_t decimation = (config.decimation < 1) ? 1 : config.decimation;
+	uint8_t buf[USB_CMD_DATA_SIZE];
+	uint32_t n = 0, seq = 0, acc = 0, pos = 0, sample_sum = 0;
+	uint8_t accbits = 0, sample_counter = 0;
+	int t = 0;
+
+	if (trace_count == 0) {
+		cmd_send(CMD_ACK, 0, 0, 0, 0, 0);
+		return;
+	}
+	cmd_send(CMD_ACK, 1, 0, 0, &config, sizeof(config));
+
+	while (!usb_poll() && !(samples && st.saved >= samples)) {
+		uint8_t sample = traces[t][pos] + 128;
+		if (++pos == trace_lens[t]) {
+			pos = 0;
+			t = (t + 1) % trace_count;
+		}
+		st.seen++;
+		if (config.averaging)
+			sample_sum += sample;
+		if (decimation > 1) {
+			if (++sample_counter < decimation) continue;
+			sample_counter = 0;
+			if (config.averaging) {
+				sample = sample_sum / decimation;
+				sample_sum = 0;
+			}
+		}
+		st.saved++;
+		acc = (acc << bps) | (sample >> (8 - bps));
+		accbits += bps;
+		if (accbits >= 8) {
+			accbits -= 8;
+			buf[n++] = acc >> accbits;
+		}
+		if (n == USB_CMD_DATA_SIZE) {
+			cmd_send(CMD_LF_STREAM_DATA, n, seq++, 0, buf, n);
+			st.sent += n;
+			n = 0;
+			msleep(USB_CMD_DATA_SIZE * 8 / bps * decimation * 8 / 1000);	// 8us per ADC sample
+		}
+	}
+	if (accbits)
+		buf[n++] = acc << (8 - accbits);
+	if (n) {
+		cmd_send(CMD_LF_STREAM_DATA, n, seq++, 0, buf, n);
+		st.sent += n;
+	}
+	cmd_send(CMD_LF_STREAM_END, 0, 0, 0, &st, sizeof(st));
+}
+
+// 'lf watch',  one trace per acquisition through the same demods as the firmware
+static void LFWatch(uint8_t protocols, uint8_t flags) {
+	lf_watch_id_t ids[LF_WATCH_PROTOCOLS], last[LF_WATCH_PROTOCOLS];
+	uint32_t rounds = 0, reads = 0, sent = 0;
+	uint8_t *work = bigbuf + LF_WATCH_SAMPLES;
+	bool done = false;
+
+	memset(last, 0, sizeof(last));
+	while (!done && !usb_poll() && trace_count) {
+		uint32_t n = SampleLF(LF_WATCH_SAMPLES) >> 3;
+		rounds++;
+		msleep(LF_WATCH_SAMPLES * 8 / 1000);	// 8us per ADC sample
+
+		int found = lf_watch_decode(bigbuf, n, work, protocols, ids);
+		for (int i = 0; i < found && !done; i++) {
+			reads++;
+			if (!lf_watch_update(last, &ids[i]) && !(flags & LF_WATCH_EVERY_READ))
+				continue;
+			cmd_send(CMD_LF_WATCH_ID, rounds, 0, 0, &ids[i], sizeof(lf_watch_id_t));
+			sent++;
+			if (flags & LF_WATCH_FINDONE)
+				done = true;
+		}
+	}
+	cmd_send(CMD_LF_WATCH_END, rounds, reads, sent, 0, 0);
+}
+
+//-----------------------------------------------------------------------------
+// HF sniff
+//-----------------------------------------------------------------------------
+static void AddCrc14A(uint8_t *data, size_t len) {
+	uint16_t crc = 0x6363;
+	for (size_t i = 0; i < len; i++) {
+		uint8_t b = data[i] ^ (crc & 0xFF);
+		b ^= b << 4;
+		crc = (crc >> 8) ^ ((uint16_t)b << 8) ^ ((uint16_t)b << 3) ^ (b >> 4);
+	}
+	data[len] = crc & 0xFF;
+	data[len + 1] = crc >> 8;
+}
+
+// classic record with odd parity,  like LogTrace
+static void LogTrace(const uint8_t *data, uint16_t len, uint32_t start, uint32_t end, bool readerToTag) {
+	uint16_t plen = (len - 1) / 8 + 1;
+	if (trace_len + 8 + len + plen > BIGBUF_SIZE - CARD_MEMORY_SIZE)
+		return;
+	uint8_t *rec = bigbuf + trace_len;
+	uint16_t duration = end - start;
+	uint16_t flags = len | (readerToTag ? 0 : 0x8000);
+	memcpy(rec, &start, 4);
+	memcpy(rec + 4, &duration, 2);
+	memcpy(rec + 6, &flags, 2);
+	memcpy(rec + 8, data, len);
+	memset(rec + 8 + len, 0, plen);
+	for (uint16_t i = 0; i < len; i++)
+		rec[8 + len + i / 8] |= oddparity8(data[i]) << (7 - (i & 7));
+	trace_len += 8 + len + plen;
+}
+
+// send the trace the way the firmware streams it,  whole records per packet
+static void StreamTrace(void) {
+	trace_stream_stats_t st = {0, 0, 0, trace_len, BIGBUF_SIZE - CARD_MEMORY_SIZE};
+	uint32_t pos = 0;
+	while (pos < trace_len) {
+		uint32_t n = 0, records = 0;
+		while (pos + n < trace_len) {
+			uint16_t len = (bigbuf[pos + n + 6] | (bigbuf[pos + n + 7] << 8)) & 0x7FFF;
+			uint32_t rec = 8 + len + (len - 1) / 8 + 1;
+			if (n + rec > USB_CMD_DATA_SIZE)
+				break;
+			n += rec;
+			records++;
+		}
+		cmd_send(CMD_TRACE_STREAM_DATA, n, 0, st.packets++, bigbuf + pos, n);
+		st.records += records;
+		pos += n;
+	}
+	cmd_send(CMD_TRACE_STREAM_END, 0, 0, 0, &st, sizeof(st));
+	trace_len = 0;
+}
+
+static void SniffIso14443a(void) {
+	uint8_t uid[4], bcc = 0, buf[16];
+	memcpy(uid, emCARD, 4);
+	for (int i = 0; i < 4; i++)
+		bcc ^= uid[i];
+
+	trace_len = 0;
+	uint32_t t = 0;
+	for (int r = 0; r < SNIFF_ROUNDS; r++) {
+		t += 100000;
+		buf[0] = ISO14443A_CMD_REQA;
+		LogTrace(buf, 1, t, t + 1000, true);
+		LogTrace(emCARD + 6, 2, t + 1200, t + 2600, false);
+		t += 5000;
+		buf[0] = ISO14443A_CMD_ANTICOLL_OR_SELECT;
+		buf[1] = 0x20;
+		LogTrace(buf, 2, t, t + 2500, true);
+		memcpy(buf, uid, 4);
+		buf[4] = bcc;
+		LogTrace(buf, 5, t + 2700, t + 8700, false);
+		t += 12000;
+		buf[0] = ISO14443A_CMD_ANTICOLL_OR_SELECT;
+		buf[1] = 0x70;
+		memcpy(buf + 2, uid, 4);
+		buf[6] = bcc;
+		AddCrc14A(buf, 7);
+		LogTrace(buf, 9, t, t + 10500, true);
+		buf[0] = emCARD[5];
+		AddCrc14A(buf, 1);
+		LogTrace(buf, 3, t + 10700, t + 14300, false);
+		t += 20000;
+		buf[0] = ISO14443A_CMD_HALT;
+		buf[1] = 0x00;
+		AddCrc14A(buf, 2);
+		LogTrace(buf, 4, t, t + 4700, true);
+	}
+	if (trace_stream)
+		StreamTrace();
+}
+
+//-----------------------------------------------------------------------------
+static void UsbPacketReceived(UsbCommand *c) {
+
+	if (verbose) {
+		printf("cmd 0x%04" PRIx64 " args %" PRIx64 " %" PRIx64 " %" PRIx64 "\n", c->cmd, c->arg[0], c->arg[1], c->arg[2]);
+		fflush(stdout);
+	}
+
+	switch (c->cmd) {
+		case CMD_PING:
+			cmd_send(CMD_ACK, 0, 0, 0, 0, 0);
+			break;
+		case CMD_VERSION: {
+			const char *version = " [ ARM ]\n      os: pm3sim virtual device " __DATE__ " " __TIME__ "\n [ FPGA ]\n none";
+			// AT91SAM7S512 Rev A chip id
+			cmd_send(CMD_ACK, 0x270B0A40, 0, 0, version, strlen(version));
+			break;
+		}
+		case CMD_DEVICE_INFO:
+			cmd_send(CMD_DEVICE_INFO, DEVICE_INFO_FLAG_OSIMAGE_PRESENT | DEVICE_INFO_FLAG_CURRENT_MODE_OS | DEVICE_INFO_FLAG_TRACE_INFO, 0, 0, 0, 0);
+			break;
+		case CMD_BUFF_CLEAR:
+			memset(bigbuf, 0, BIGBUF_SIZE - CARD_MEMORY_SIZE);
+			break;
+		case CMD_TRACE_INFO: {
+			trace_header_t hdr = { TRACE_HEADER_MAGIC, TRACE_FORMAT_VERSION, 1, trace_len, 0 };
+			cmd_send(CMD_ACK, 1, 0, 0, &hdr, sizeof(hdr));
+			break;
+		}
+		case CMD_TRACE_STREAM:
+			trace_stream = c->arg[0];
+			cmd_send(CMD_ACK, 1, 0, 0, 0, 0);
+			break;
+		case CMD_SNOOP_ISO_14443a:
+			SniffIso14443a();
+			break;
+		case CMD_PROFILE:
+			if (c->arg[0] == 1) {
+				Profile_reset();
+				cmd_send(CMD_ACK, 1, 0, 0, 0, 0);
+			} else {
+				uint32_t first = c->arg[1], n = 0;
+				if (first < PROF_ENTRIES)
+					n = MIN(PROF_ENTRIES - first, USB_CMD_DATA_SIZE / sizeof(prof_entry_t));
+				cmd_send(CMD_ACK, n, first, PROF_ENTRIES, prof_table + first, n * sizeof(prof_entry_t));
+			}
+			break;
+		case CMD_DOWNLOAD_RAW_ADC_SAMPLES_125K:
+			download(CMD_DOWNLOADED_RAW_ADC_SAMPLES_125K, bigbuf, c->arg[0], c->arg[1], BIGBUF_SIZE, &config, sizeof(config));
+			break;
+		case CMD_DOWNLOAD_EML_BIGBUF:
+			download(CMD_DOWNLOADED_EML_BIGBUF, emCARD, c->arg[0], c->arg[1], CARD_MEMORY_SIZE, 0, 0);
+			break;
+		case CMD_DOWNLOAND_FLASH_MEM:
+			download(CMD_DOWNLOADED_FLASHMEM, flashmem, c->arg[0], c->arg[1], FLASH_MEM_SIZE, 0, 0);
+			break;
+		case CMD_SET_LF_SAMPLING_CONFIG:
+			memcpy(&config, c->d.asBytes, sizeof(config));
+			break;
+		case CMD_ACQUIRE_RAW_ADC_SAMPLES_125K:
+			cmd_send(CMD_ACK, SampleLF(c->arg[1]), 0, 0, 0, 0);
+			break;
+		case CMD_LF_STREAM:
+			if (c->arg[0])
+				StreamLF(c->arg[2]);
+			break;
+		case CMD_LF_WATCH:
+			if (c->arg[0])
+				LFWatch(c->arg[0], c->arg[1]);
+			break;
+		case CMD_MIFARE_EML_MEMCLR:
+			emlClearMem();
+			break;
+		case CMD_MIFARE_EML_MEMSET: {
+			uint32_t width = c->arg[2] ? c->arg[2] : 16;
+			if ((c->arg[0] + c->arg[1]) * width <= CARD_MEMORY_SIZE && c->arg[1] * width <= USB_CMD_DATA_SIZE)
+				memcpy(emCARD + c->arg[0] * width, c->d.asBytes, c->arg[1] * width);
+			break;
+		}
+		case CMD_MIFARE_EML_MEMGET: {
+			uint8_t buf[USB_CMD_DATA_SIZE] = {0};
+			if ((c->arg[0] + c->arg[1]) * 16 <= CARD_MEMORY_SIZE && c->arg[1] * 16 <= USB_CMD_DATA_SIZE)
+				memcpy(buf, emCARD + c->arg[0] * 16, c->arg[1] * 16);
+			cmd_send(CMD_ACK, c->arg[0], c->arg[1], 0, buf, sizeof(buf));
+			break;
+		}
+		case CMD_READER_ISO_14443a:
+			ReaderIso14443a(c->arg[0]);
+			break;
+		case CMD_MIFARE_READBL:
+			MifareReadBlock(c->arg[0], c->arg[1], c->d.asBytes);
+			break;
+		case CMD_MIFARE_CHKKEYS:
+			MifareChkKeys(c->arg[0], c->arg[2], c->d.asBytes);
+			break;
+		case CMD_MIFARE_CHKKEYS_FAST:
+			MifareChkKeys_fast(c->arg[0], c->arg[2], c->d.asBytes);
+			break;
+		case CMD_MIFARE_NESTED:
+			MifareNested(c->arg[0], c->arg[1], c->d.asBytes);
+			break;
+		default:
+			Dbprintf("%s: 0x%04x", "unknown command:", (uint32_t)c->cmd);
+			break;
+	}
+}
+
+static bool load_file(const char *fname, uint8_t *dest, size_t maxlen) {
+	FILE *f = fopen(fname, "rb");
+	if (!f) {
+		fprintf(stderr, "Error. Cannot open file %s\n", fname);
+		return false;
+	}
+	size_t n = fread(dest, 1, maxlen, f);
+	fclose(f);
+	printf("loaded %zu bytes from %s\n", n, fname);
+	return true;
+}
+
+int main(int argc, char **argv) {
+	int port = SIM_PORT;
+
+	emlClearMem();
+	Profile_reset();
+	memset(flashmem, 0xFF, sizeof(flashmem));
+
+	for (int i = 1; i < argc; i++) {
+		bool more = i + 1 < argc;
+		if (!strcmp(argv[i], "-p") && more) {
+			port = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-e") && more) {
+			if (!load_file(argv[++i], emCARD, CARD_MEMORY_SIZE)) return EXIT_FAILURE;
+		} else if (!strcmp(argv[i], "-f") && more) {
+			if (!load_file(argv[++i], flashmem, FLASH_MEM_SIZE)) return EXIT_FAILURE;
+		} else if (!strcmp(argv[i], "-l") && more) {
+			if (!load_trace(argv[++i])) return EXIT_FAILURE;
+		} else if (!strcmp(argv[i], "-v")) {
+			verbose = true;
+		} else {
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	srand(time(NULL));
+	// a client going away is not fatal
+	signal(SIGPIPE, SIG_IGN);
+
+	int srv = socket(AF_INET, SOCK_STREAM, 0);
+	int one = 1;
+	setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if (bind(srv, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(srv, 1) < 0) {
+		fprintf(stderr, "Error. Cannot listen on port %d\n", port);
+		return EXIT_FAILURE;
+	}
+	printf("pm3sim listening on tcp:localhost:%d\n", port);
+	fflush(stdout);
+
+	// one client at the time,  device state is kept between connections
+	while (true) {
+		client = accept(srv, NULL, NULL);
+		if (client < 0)
+			continue;
+		setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		if (verbose) {
+			printf("client connected\n");
+			fflush(stdout);
+		}
+
+		UsbCommand c;
+		size_t have = 0;
+		while (true) {
+			ssize_t n = recv(client, (uint8_t *)&c + have, sizeof(c) - have, 0);
+			if (n <= 0)
+				break;
+			have += n;
+			if (have < sizeof(c))
+				continue;
+			uint32_t start = prof_ticks();
+			UsbPacketReceived(&c);
+			Profile_command(c.cmd, start);
+			have = 0;
+		}
+
+		close(client);
+		client = -1;
+		if (verbose) printf("client disconnected\n");
+	}
+	return EXIT_SUCCESS;
+}
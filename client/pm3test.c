@@ -0,0 +1,28 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Host tests that need no device,  built and run with the client by "make",
+// or alone by "make test".  They run with the crypto tests in 'hf emv test' too.
+//
+//   ./pm3test [-v]
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "emv/test/tlv_test.h"
+#include "emv/test/trace_compact_test.h"
+
+int main(int argc, char *argv[]) {
+	bool verbose = (argc > 1 && !strcmp(argv[1], "-v"));
+	int fail = 0;
+
+	if (exec_tlv_test(verbose))
+		fail++;
+	if (exec_trace_compact_test(verbose))
+		fail++;
+
+	printf("\n%s\n", fail ? "Test(s) [ERROR]." : "Tests [OK].");
+	return fail ? 1 : 0;
+}
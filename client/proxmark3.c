@@ -25,6 +25,8 @@
 #include "cmdparser.h"
 #include "cmdhw.h"
 #include "whereami.h"
+#include "usbcapture.h"
+#include "pm3daemon.h"
 
 #if defined (_WIN32)
 #define SERIAL_PORT_H	"com3"
@@ -34,15 +36,34 @@
 #define SERIAL_PORT_H	"/dev/ttyACM0"
 #endif
 
-static serial_port sp;
-static UsbCommand txcmd;
-static char comport[255];
-byte_t rx[sizeof(UsbCommand)];
-byte_t* prx = rx;
-volatile static bool txcmd_pending = false;
-struct receiver_arg {
-	int run;
+static pm3_device devices[MAX_PM3_DEVICES] = {
+	{ .id = 0, .used = true, .cmdBufferMutex = PTHREAD_MUTEX_INITIALIZER },
 };
+static pm3_device *primary = &devices[0];
+static pthread_mutex_t devices_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// device the calling thread talks to,  NULL means device 0
+static __thread pm3_device *thread_device = NULL;
+
+pm3_device *CurrentDevice(void) {
+	return (thread_device) ? thread_device : primary;
+}
+
+void SetCurrentDevice(pm3_device *dev) {
+	thread_device = dev;
+}
+
+pm3_device *GetDevice(int id) {
+	if (id < 0 || id >= MAX_PM3_DEVICES || !devices[id].used)
+		return NULL;
+	return &devices[id];
+}
+
+bool DeviceOnline(pm3_device *dev) {
+	if (dev == primary)
+		return !offline;
+	return !dev->offline;
+}
 
 void SendCommand(UsbCommand *c) {
 	#if 0
@@ -51,7 +72,15 @@ void SendCommand(UsbCommand *c) {
 	//pthread_mutex_unlock(&print_lock);
 	#endif
 
-	if (offline) {
+	pm3_device *dev = CurrentDevice();
+
+	// a replayed capture stands in for the device
+	if (dev == primary && replay_active()) {
+		replay_send(c);
+		return;
+	}
+
+	if (!DeviceOnline(dev)) {
 		PrintAndLogEx(NORMAL, "Sending bytes to proxmark failed - offline");
 		return;
 	}
@@ -60,10 +89,10 @@ void SendCommand(UsbCommand *c) {
 	or disconnected. The main console thread is alive, but comm thread just spins here.
 	Not good.../holiman
 	**/
-	while (txcmd_pending);
+	while (dev->txcmd_pending);
 
-	txcmd = *c;
-	 __atomic_test_and_set(&txcmd_pending, __ATOMIC_SEQ_CST);
+	dev->txcmd = *c;
+	 __atomic_test_and_set(&dev->txcmd_pending, __ATOMIC_SEQ_CST);
 }
 
 
@@ -85,18 +114,19 @@ static void showBanner(void){
 
 bool hookUpPM3() {	
 	bool ret = false;
-	sp = uart_open( comport );
+	serial_port sp = uart_open( primary->port );
+	primary->sp = sp;
 	
 	//pthread_mutex_lock(&print_lock);
 
 	if (sp == INVALID_SERIAL_PORT) {
 		PrintAndLogEx(WARNING, "Reconnect failed, retrying...  (reason: invalid serial port)\n");
-		sp = NULL;
+		primary->sp = NULL;
 		ret = false;
 		offline = 1;
 	} else if (sp == CLAIMED_SERIAL_PORT) {
 		PrintAndLogEx(WARNING, "Reconnect failed, retrying... (reason: serial port is claimed by another process)\n");
-		sp = NULL;
+		primary->sp = NULL;
 		ret = false;
 		offline = 1;
 	} else {	
@@ -116,51 +146,122 @@ __attribute__((force_align_arg_pointer))
 #endif
 #endif
 *uart_receiver(void *targ) {
-	struct receiver_arg *arg = (struct receiver_arg*)targ;
+	pm3_device *dev = (pm3_device*)targ;
 	size_t rxlen;
 	bool tmpsignal;
 	int counter_to_offline = 0;
 	
-	while (arg->run) {
+	// responses land in this device's buffer
+	SetCurrentDevice(dev);
+	dev->prx = dev->rx;
+
+	while (dev->run) {
 		rxlen = 0;
 		
-		if (uart_receive(sp, prx, sizeof(UsbCommand) - (prx-rx), &rxlen)) {
+		if (uart_receive(dev->sp, dev->prx, sizeof(UsbCommand) - (dev->prx - dev->rx), &rxlen)) {
 			
 			if ( rxlen == 0 ) continue;
 			
-			prx += rxlen;
-			if ( (prx-rx) < sizeof(UsbCommand)) {
+			dev->prx += rxlen;
+			if ( (dev->prx - dev->rx) < sizeof(UsbCommand)) {
 				continue;
 			}
 			
-			UsbCommandReceived((UsbCommand*)rx);
+			if (dev == primary)
+				capture_frame(CAPTURE_FROM_DEVICE, (UsbCommand*)dev->rx);
+			if (dev->frame_hook)
+				dev->frame_hook((UsbCommand*)dev->rx);
+			else
+				UsbCommandReceived((UsbCommand*)dev->rx);
 		}
-		prx = rx;
+		dev->prx = dev->rx;
 
-		__atomic_load(&txcmd_pending, &tmpsignal, __ATOMIC_SEQ_CST);
+		__atomic_load(&dev->txcmd_pending, &tmpsignal, __ATOMIC_SEQ_CST);
 		if ( tmpsignal ) {
-			bool res = uart_send(sp, (byte_t*) &txcmd, sizeof(UsbCommand));
+			bool res = uart_send(dev->sp, (byte_t*) &dev->txcmd, sizeof(UsbCommand));
 			if (!res) {
 				counter_to_offline++;
 				PrintAndLogEx(NORMAL, "sending bytes to proxmark failed");
+			} else if (dev == primary) {
+				capture_frame(CAPTURE_TO_DEVICE, &dev->txcmd);
 			}
-			 __atomic_clear(&txcmd_pending, __ATOMIC_SEQ_CST);
+			 __atomic_clear(&dev->txcmd_pending, __ATOMIC_SEQ_CST);
 			
 			// set offline flag
 			if ( counter_to_offline == 3 ) {
-				__atomic_test_and_set(&offline, __ATOMIC_SEQ_CST);
+				if (dev == primary)
+					__atomic_test_and_set(&offline, __ATOMIC_SEQ_CST);
+				else
+					__atomic_test_and_set(&dev->offline, __ATOMIC_SEQ_CST);
 				break;
 			}			
 		}
 	}
 
 	// when this reader thread dies, we close the serial port.
-	uart_close(sp);
+	uart_close(dev->sp);
 	
 	pthread_exit(NULL);
 	return NULL;
 }
 
+// connects an additional device and starts its receiver thread
+pm3_device *OpenDevice(const char *port) {
+
+	pthread_mutex_lock(&devices_lock);
+	pm3_device *dev = NULL;
+	for (int i = 1; i < MAX_PM3_DEVICES; i++) {
+		if (devices[i].used) {
+			if (strcmp(devices[i].port, port) == 0) {
+				pthread_mutex_unlock(&devices_lock);
+				PrintAndLogEx(WARNING, "%s is already connected as device %d", port, i);
+				return NULL;
+			}
+			continue;
+		}
+		if (!dev) dev = &devices[i];
+	}
+	if (!dev) {
+		pthread_mutex_unlock(&devices_lock);
+		PrintAndLogEx(WARNING, "too many devices,  max %d", MAX_PM3_DEVICES);
+		return NULL;
+	}
+
+	serial_port sp = uart_open(port);
+	if (sp == INVALID_SERIAL_PORT || sp == CLAIMED_SERIAL_PORT) {
+		pthread_mutex_unlock(&devices_lock);
+		PrintAndLogEx(WARNING, "ERROR: %s", (sp == INVALID_SERIAL_PORT) ? "invalid serial port" : "serial port is claimed by another process");
+		return NULL;
+	}
+
+	int id = dev - devices;
+	memset(dev, 0, sizeof(pm3_device));
+	dev->id = id;
+	dev->used = true;
+	dev->sp = sp;
+	strncpy(dev->port, port, sizeof(dev->port) - 1);
+	pthread_mutex_init(&dev->cmdBufferMutex, NULL);
+	dev->run = 1;
+	pthread_create(&dev->reader_thread, NULL, &uart_receiver, dev);
+	pthread_mutex_unlock(&devices_lock);
+	return dev;
+}
+
+void CloseDevice(pm3_device *dev) {
+	if (!dev || dev == primary || !dev->used)
+		return;
+
+	pthread_mutex_lock(&devices_lock);
+	dev->run = 0;
+	pthread_join(dev->reader_thread, NULL);
+	pthread_mutex_destroy(&dev->cmdBufferMutex);
+	dev->used = false;
+	pthread_mutex_unlock(&devices_lock);
+
+	if (thread_device == dev)
+		thread_device = NULL;
+}
+
 void
 #ifdef __has_attribute
 #if __has_attribute(force_align_arg_pointer)
@@ -169,19 +270,23 @@ __attribute__((force_align_arg_pointer))
 #endif
 main_loop(char *script_cmds_file, char *script_cmd, bool usb_present, bool stayInCommandLoop) {
 
-	struct receiver_arg rarg;
 	char *cmd = NULL;
-	pthread_t reader_thread;
 	bool execCommand = (script_cmd != NULL);
 	bool stdinOnPipe = !isatty(STDIN_FILENO);
+	bool reader_running = false;
 	FILE *sf = NULL;
 	char script_cmd_buf[256] = {0x00};  // iceman, needs lua script the same file_path_buffer as the rest
 	
+	PrintAndLogSetConsoleThread();
 	PrintAndLogEx(DEBUG, "ISATTY/STDIN_FILENO == %s\n", (stdinOnPipe) ? "true" : "false");
 	
 	if (usb_present) {
-		rarg.run = 1;
-		pthread_create(&reader_thread, NULL, &uart_receiver, &rarg);
+		// no serial port to read when replaying a capture
+		if (!replay_active()) {
+			primary->run = 1;
+			pthread_create(&primary->reader_thread, NULL, &uart_receiver, primary);
+			reader_running = true;
+		}
 		// cache Version information now:
 		if ( execCommand || script_cmds_file || stdinOnPipe)
 			CmdVersion("s");
@@ -213,8 +318,9 @@ main_loop(char *script_cmds_file, char *script_cmd, bool usb_present, bool stayI
 		
 			// usb and the reader_thread is NULL,  create a new reader thread.
 			if (usb_present && !offline) {
-				rarg.run = 1;
-				pthread_create(&reader_thread, NULL, &uart_receiver, &rarg);
+				primary->run = 1;
+				pthread_create(&primary->reader_thread, NULL, &uart_receiver, primary);
+				reader_running = true;
 				// cache Version information now:
 				if ( execCommand || script_cmds_file || stdinOnPipe)
 					CmdVersion("s");
@@ -288,6 +394,9 @@ main_loop(char *script_cmds_file, char *script_cmd, bool usb_present, bool stayI
 			if (cmd[0] != 0x00) {
 				int ret = CommandReceived(cmd);
 				add_history(cmd);
+
+				// output of the command is written before the next prompt
+				PrintAndLogFlush();
 				
 				// exit or quit
 				if (ret == 99) 
@@ -310,9 +419,12 @@ main_loop(char *script_cmds_file, char *script_cmd, bool usb_present, bool stayI
 	free(cmd);
 	cmd = NULL;
 			
-	if (usb_present) {
-		rarg.run = 0;
-		pthread_join(reader_thread, NULL);
+	for (int i = 1; i < MAX_PM3_DEVICES; i++)
+		CloseDevice(GetDevice(i));
+
+	if (reader_running) {
+		primary->run = 0;
+		pthread_join(primary->reader_thread, NULL);
 	}
 }
 
@@ -351,7 +463,7 @@ static void set_my_executable_path(void) {
 }
 
 static void show_help(bool showFullHelp, char *command_line){
-	PrintAndLogEx(NORMAL, "syntax: %s <port> [-h|-help|-m|-f|-flush|-w|-wait|-c|-command|-l|-lua|-k] [cmd_script_file_name] [command][lua_script_name]\n", command_line);
+	PrintAndLogEx(NORMAL, "syntax: %s <port> [-h|-help|-m|-f|-flush|-w|-wait|-c|-command|-l|-lua|-k|-capture file|-daemon addr] [cmd_script_file_name] [command][lua_script_name]\n", command_line);
 	PrintAndLogEx(NORMAL, "\texample:'%s "SERIAL_PORT_H"'\n\n", command_line);
 	
 	if (showFullHelp){
@@ -371,6 +483,14 @@ static void show_help(bool showFullHelp, char *command_line){
 		PrintAndLogEx(NORMAL, "\t%s "SERIAL_PORT_H" -l hf_read\n\n", command_line);
 		PrintAndLogEx(NORMAL, "stay: <-k> Stay in the command loop after script/command/lua execution.\n");
 		PrintAndLogEx(NORMAL, "\t%s "SERIAL_PORT_H" -k scriptfile\n\n", command_line);
+		PrintAndLogEx(NORMAL, "capture: <-capture> Record all communication with the device to a file.\n");
+		PrintAndLogEx(NORMAL, "\t%s "SERIAL_PORT_H" -capture chk.cap -c \"hf mf chk *1 ? d\"\n\n", command_line);
+		PrintAndLogEx(NORMAL, "daemon: <-daemon> Share the device with clients connecting to unix:path or tcp:[host:]port.\n");
+		PrintAndLogEx(NORMAL, "\t%s "SERIAL_PORT_H" -daemon unix:/tmp/pm3.sock -daemon tcp:7902\n", command_line);
+		PrintAndLogEx(NORMAL, "\t%s unix:/tmp/pm3.sock\n\n", command_line);
+		PrintAndLogEx(NORMAL, "replay: Use a capture instead of a device,  with its original timing or as fast as possible.\n");
+		PrintAndLogEx(NORMAL, "\t%s replay:chk.cap -c \"hf mf chk *1 ? d\"\n", command_line);
+		PrintAndLogEx(NORMAL, "\t%s replayfast:chk.cap -c \"hf mf chk *1 ? d\"\n\n", command_line);
 	}
 }
 
@@ -384,6 +504,10 @@ int main(int argc, char* argv[]) {
 	bool stayInCommandLoop = false;
 	char *script_cmds_file = NULL;
 	char *script_cmd = NULL;
+	char *capture_fname = NULL;
+	char *daemon_listen[DAEMON_MAX_LISTEN];
+	int daemon_listen_cnt = 0;
+	int last_value_arg = 0;
 
 	 /* initialize history */
 	using_history();
@@ -394,8 +518,7 @@ int main(int argc, char* argv[]) {
 	}
 	
 	// lets copy the comport string.
-	memset(comport, 0, sizeof(comport));
-	memcpy(comport, argv[1], strlen(argv[1]));
+	strncpy(primary->port, argv[1], sizeof(primary->port) - 1);
 
 	for (int i = 1; i < argc; i++) {
 	
@@ -438,10 +561,22 @@ int main(int argc, char* argv[]) {
 		if(strcmp(argv[i], "-k") == 0){
 			stayInCommandLoop = true;
 		}
+
+		// record device communication
+		if(strcmp(argv[i], "-capture") == 0 && i + 1 < argc){
+			capture_fname = argv[++i];
+			last_value_arg = i;
+		}
+
+		// share the device
+		if(strcmp(argv[i], "-daemon") == 0 && i + 1 < argc && daemon_listen_cnt < DAEMON_MAX_LISTEN){
+			daemon_listen[daemon_listen_cnt++] = argv[++i];
+			last_value_arg = i;
+		}
 	}
 
 	// If the user passed the filename of the 'script' to execute, get it from last parameter
-	if (argc > 2 && argv[argc - 1] && argv[argc - 1][0] != '-') {
+	if (argc > 2 && argv[argc - 1] && argv[argc - 1][0] != '-' && last_value_arg != argc - 1) {
 		if (executeCommand){
 			script_cmd = argv[argc - 1];
 			
@@ -489,8 +624,18 @@ int main(int argc, char* argv[]) {
 	// set global variables
 	set_my_executable_path();
 	
+	// replay a capture instead of talking to a device
+	serial_port sp = NULL;
+	bool replaying = false;
+	if (strncmp(argv[1], "replay:", 7) == 0)
+		replaying = replay_start(argv[1] + 7, false);
+	else if (strncmp(argv[1], "replayfast:", 11) == 0)
+		replaying = replay_start(argv[1] + 11, true);
+
 	// open uart
-	if (!waitCOMPort) {
+	if (replaying) {
+		sp = NULL;
+	} else if (!waitCOMPort) {
 		sp = uart_open(argv[1]);
 	} else {
 		PrintAndLogEx(SUCCESS, "waiting for Proxmark to appear on %s ", argv[1]);
@@ -514,13 +659,30 @@ int main(int argc, char* argv[]) {
 		usb_present = false;
 		offline = 1;
 	} else {
+		primary->sp = sp;
 		usb_present = true;
 		offline = 0;
 	}
 
+	if (capture_fname && usb_present && !replaying)
+		capture_start(capture_fname);
+
+	// headless,  no console
+	if (daemon_listen_cnt) {
+		if (!usb_present || replaying) {
+			PrintAndLogEx(WARNING, "ERROR: the daemon needs a device");
+			return 1;
+		}
+		// usually logging to a file or journal
+		g_flushAfterWrite = 1;
+		int ret = RunDaemon(daemon_listen, daemon_listen_cnt, DAEMON_QUIET_MS, DAEMON_STATS_SEC);
+		capture_stop();
+		return ret;
+	}
+
 	fflush(NULL);
-	// create a mutex to avoid interlacing print commands from our different threads
-	pthread_mutex_init(&print_lock, NULL);
+	// print_lock is statically initialised (ui.c) and shared with the log writer thread,
+	// so it is neither re-initialised nor destroyed here.
 
 #ifdef HAVE_GUI
 
@@ -542,8 +704,8 @@ int main(int argc, char* argv[]) {
 	main_loop(script_cmds_file, script_cmd, usb_present, stayInCommandLoop);
 #endif	
  
-	// clean up mutex
-	pthread_mutex_destroy(&print_lock);
-	
+	replay_stop();
+	capture_stop();
+
 	exit(0);
 }
\ No newline at end of file
@@ -12,11 +12,41 @@
 #ifndef PROXMARK3_H__
 #define PROXMARK3_H__
 
+#include <pthread.h>
 #include "usb_cmd.h"
+#include "uart.h"
 #include "cmdscript.h"  // CmdScriptRun  
 
 #define PROXPROMPT "pm3 --> "
 
+//For storing command that are received from the device
+#define CMD_BUFFER_SIZE 100
+
+// device 0 is the one given on the command line,  more can be added with "multi connect"
+#define MAX_PM3_DEVICES 8
+
+typedef struct {
+	int id;
+	bool used;
+	char port[255];
+	serial_port sp;
+	volatile bool offline;		// device 0 uses the global offline flag
+	int run;					// receiver thread keeps going while set
+	pthread_t reader_thread;
+	UsbCommand txcmd;
+	volatile bool txcmd_pending;
+	byte_t rx[sizeof(UsbCommand)];
+	byte_t *prx;
+	// responses received from this device
+	UsbCommand cmdBuffer[CMD_BUFFER_SIZE];
+	int cmd_head;				// next empty position to write to
+	int cmd_tail;				// position of the last unread command
+	pthread_mutex_t cmdBufferMutex;
+	// when set,  received frames go here instead of UsbCommandReceived
+	void (*frame_hook)(UsbCommand *c);
+	uint32_t dev_info;			// CMD_DEVICE_INFO flags,  0 until asked for
+} pm3_device;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -29,6 +59,14 @@ void main_loop(char *script_cmds_file, char *script_cmd, bool usb_present, bool
 bool hookUpPM3(void);
 void *uart_receiver(void *targ);
 
+// SendCommand and the response buffer use the device bound to the calling thread,  device 0 if none.
+pm3_device *CurrentDevice(void);
+void SetCurrentDevice(pm3_device *dev);
+pm3_device *GetDevice(int id);
+bool DeviceOnline(pm3_device *dev);
+pm3_device *OpenDevice(const char *port);
+void CloseDevice(pm3_device *dev);
+
 #ifdef __cplusplus
 }
 #endif